@@ -2,12 +2,14 @@
 #include <QMediaDevices>
 #include <QTimer>
 #include <QBuffer>
+#include <algorithm>
 
 /// Custom QIODevice that writes incoming PCM16 samples into a vector
 class CaptureDevice : public QIODevice {
 public:
-    explicit CaptureDevice(std::vector<int16_t>& out)
-        : QIODevice(), m_out(out) {
+    /// @param maxSamples If non-zero, keep only the newest maxSamples
+    CaptureDevice(std::vector<int16_t>& out, size_t maxSamples = 0)
+        : QIODevice(), m_out(out), m_max(maxSamples) {
         open(QIODevice::WriteOnly);
     }
 
@@ -17,6 +19,13 @@ public:
         auto n = len / 2;
         const int16_t* p = reinterpret_cast<const int16_t*>(data);
         m_out.insert(m_out.end(), p, p + n);
+
+        // Consumer fell behind: drop the oldest audio rather than grow
+        if (m_max && m_out.size() > m_max) {
+            m_out.erase(m_out.begin(), m_out.end() - std::ptrdiff_t(m_max));
+        }
+
+        emit bytesWritten(len);
         return len;
     }
 
@@ -25,6 +34,7 @@ public:
 
 private:
     std::vector<int16_t>& m_out; ///< Reference to external buffer
+    size_t m_max;                ///< Sample cap (0 = unbounded)
 };
 
 AudioCapture::AudioCapture(QObject* parent) : QObject(parent) {}
@@ -56,6 +66,34 @@ void AudioCapture::start(int seconds) {
     });
 }
 
+/// Begin recording until stop(); samples are collected with takeSamples()
+void AudioCapture::startContinuous(int maxBufferedSeconds) {
+    stop();
+    m_samples.clear();
+    m_maxSamples = size_t(std::max(1, maxBufferedSeconds)) * size_t(m_sampleRate);
+
+    // Configure mono 16-bit PCM format
+    QAudioFormat fmt;
+    fmt.setSampleRate(m_sampleRate);
+    fmt.setChannelCount(1);
+    fmt.setSampleFormat(QAudioFormat::Int16);
+
+    m_source.reset(new QAudioSource(QMediaDevices::defaultAudioInput(), fmt));
+    m_dev.reset(new CaptureDevice(m_samples, m_maxSamples));
+
+    // Each write from the audio backend becomes a samplesAvailable()
+    connect(m_dev.data(), &QIODevice::bytesWritten, this, &AudioCapture::samplesAvailable);
+
+    m_source->start(m_dev.data());
+}
+
+/// Hand over everything captured since the previous call
+void AudioCapture::takeSamples(std::vector<int16_t>& out) {
+    // Swap rather than copy; the buffers ping-pong between caller and device
+    out.clear();
+    out.swap(m_samples);
+}
+
 /// Stop recording (if active)
 void AudioCapture::stop() {
     if (m_source) { m_source->stop(); m_source.reset(); }
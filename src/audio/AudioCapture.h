@@ -4,6 +4,7 @@
 #include <QIODevice>
 #include <vector>
 #include <cstdint>
+#include <memory>
 
 /**
  * @class AudioCapture
@@ -16,6 +17,11 @@
  *   AudioCapture cap;
  *   connect(&cap, &AudioCapture::finished, ...);
  *   cap.start(10);  // record for 10 seconds
+ *
+ * Continuous mode (live monitoring) records until stop(). Samples are
+ * handed out incrementally through takeSamples() after each
+ * samplesAvailable() signal; at most `maxBufferedSeconds` are held if the
+ * consumer falls behind (oldest audio is dropped), so memory stays flat.
  */
 class AudioCapture : public QObject {
     Q_OBJECT
@@ -25,9 +31,18 @@ public:
     /// Start capturing audio for a fixed duration (seconds)
     void start(int seconds=10);
 
+    /// Capture until stop(), delivering audio via samplesAvailable()/takeSamples()
+    void startContinuous(int maxBufferedSeconds=10);
+
     /// Stop capturing immediately
     void stop();
 
+    /// Continuous mode: move samples captured since the last call into `out`
+    void takeSamples(std::vector<int16_t>& out);
+
+    /// True while capturing (either mode)
+    bool isActive() const { return m_source != nullptr; }
+
     /// Access recorded samples (PCM16, mono)
     const std::vector<int16_t>& samples() const { return m_samples; }
 
@@ -38,10 +53,14 @@ public:
         /// Emitted after recording stops (either by timeout or manual stop)
         void finished();
 
+        /// Continuous mode: new samples can be collected with takeSamples()
+        void samplesAvailable();
+
 private:
     int m_sampleRate = 44100; ///< Fixed sample rate (Hz)
 
     std::unique_ptr<QAudioSource> m_source; ///< Audio input source
     QScopedPointer<QIODevice> m_dev;        ///< Custom device for buffering samples
     std::vector<int16_t> m_samples;         ///< Recorded PCM buffer
+    size_t m_maxSamples = 0;                ///< Continuous-mode cap on m_samples (0 = none)
 };
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include "AudioPlayer.h"
+#include "WavStreamDevice.h"
+#include <QFileInfo>
 #include <QMediaDevices>
-#include <QBuffer>
 
 AudioPlayer::AudioPlayer(QObject* parent) : QObject(parent) {
     // Default to 44.1 kHz, mono, 16-bit PCM
@@ -9,25 +10,43 @@ AudioPlayer::AudioPlayer(QObject* parent) : QObject(parent) {
     m_format.setSampleFormat(QAudioFormat::Int16);
 }
 
-/// Store audio samples in an internal QByteArray for playback
-void AudioPlayer::setBuffer(const std::vector<int16_t>& samples, int sr) {
-    m_format.setSampleRate(sr);
-    m_pcm = QByteArray(reinterpret_cast<const char*>(samples.data()),
-                       int(samples.size() * sizeof(int16_t)));
+/// Remember the file and take the sample rate from its header
+bool AudioPlayer::setFile(const QString& wavPath, QString* err) {
+    WavInfo info;
+    if (!WavFile::readInfo(wavPath, info, err)) return false;
+
+    m_format.setSampleRate(info.sampleRate);
+    m_path = wavPath;
+    return true;
+}
+
+void AudioPlayer::clear() {
+    stop();
+    m_path.clear();
 }
 
-/// Play the loaded buffer using system's default audio output
+bool AudioPlayer::canPlay(const QString& path) {
+    return QFileInfo(path).suffix().compare("wav", Qt::CaseInsensitive) == 0;
+}
+
+/// Stream the selected file using system's default audio output
 void AudioPlayer::play() {
+    if (m_path.isEmpty()) return;
+    stop();
+
     auto devInfo = QMediaDevices::defaultAudioOutput();
 
     // Create audio sink with chosen format
     m_sink.reset(new QAudioSink(devInfo, m_format));
 
-    // Wrap QByteArray in a QBuffer so QAudioSink can read it
-    auto* buf = new QBuffer(&m_pcm);
-    buf->open(QIODevice::ReadOnly);
-
-    m_dev.reset(buf);
+    // Mono PCM16 read straight from the mapped file as the sink pulls it
+    auto* stream = new WavStreamDevice(m_path);
+    m_dev.reset(stream);
+    if (!stream->open(QIODevice::ReadOnly)) {
+        m_dev.reset();
+        m_sink.reset();
+        return;
+    }
 
     // Start playback
     m_sink->start(m_dev.data());
@@ -3,19 +3,20 @@
 #include <QAudioFormat>
 #include <QAudioSink>
 #include <QIODevice>
-#include <vector>
-#include <cstdint>
+#include <QString>
+#include <memory>
 
 /**
  * @class AudioPlayer
  * @brief Simple wrapper around QAudioSink for PCM playback.
  *
- * Accepts raw PCM16 mono audio data via setBuffer() and plays it
- * through the system's default audio output device.
+ * Plays a PCM16 WAV file through the system's default audio output
+ * device. The file is streamed from a memory mapping (WavStreamDevice),
+ * so no copy of the samples is kept in memory, however long the file.
  *
  * Typical usage:
  *   AudioPlayer player;
- *   player.setBuffer(samples, 44100);
+ *   player.setFile("song.wav");
  *   player.play();
  */
 class AudioPlayer : public QObject {
@@ -23,8 +24,18 @@ class AudioPlayer : public QObject {
 public:
     explicit AudioPlayer(QObject* parent=nullptr);
 
-    /// Load PCM buffer into player (16-bit mono, with given sample rate)
-    void setBuffer(const std::vector<int16_t>& samples, int sampleRate);
+    /// Select the WAV file to play (PCM16, any channel count).
+    /// Only the header is read here; samples are streamed during play().
+    bool setFile(const QString& wavPath, QString* err=nullptr);
+
+    /// Forget the selected file (after stopping playback)
+    void clear();
+
+    /// True once a playable file has been selected
+    bool hasSource() const { return !m_path.isEmpty(); }
+
+    /// True if `path` is a kind of file setFile() takes (WAV, by extension)
+    static bool canPlay(const QString& path);
 
 public slots:
     void play(); ///< Start playback
@@ -33,6 +44,6 @@ public slots:
 private:
     QAudioFormat m_format;                   ///< Current audio format
     std::unique_ptr<QAudioSink> m_sink;      ///< Audio output backend
-    QByteArray m_pcm;                        ///< Raw PCM data
-    QScopedPointer<QIODevice> m_dev;         ///< Buffer device feeding QAudioSink
+    QString m_path;                          ///< WAV file being previewed
+    QScopedPointer<QIODevice> m_dev;         ///< Streaming device feeding QAudioSink
 };
\ No newline at end of file
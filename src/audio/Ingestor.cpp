@@ -0,0 +1,194 @@
+#include "Ingestor.h"
+#include "fingerprint/StreamingFingerprinter.h"
+#include "server/BoundedQueue.h"
+#include "perf/Perf.h"
+#include "util/TaskPool.h"
+#include <QAudioBuffer>
+#include <QAudioDecoder>
+#include <QAudioFormat>
+#include <QDirIterator>
+#include <QEventLoop>
+#include <QFileInfo>
+#include <QUrl>
+#include <algorithm>
+#include <memory>
+
+Ingestor::Ingestor(Database& db) : m_db(db) {}
+
+QStringList Ingestor::nameFilters() {
+    return {"*.wav", "*.flac", "*.mp3", "*.ogg", "*.opus", "*.m4a", "*.aac", "*.wma"};
+}
+
+QStringList Ingestor::audioFiles(const QString& dir) {
+    QStringList files;
+    QDirIterator it(dir, nameFilters(), QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) files << it.next();
+    files.sort();
+    return files;
+}
+
+/// Feed decoder buffers to a StreamingFingerprinter as they arrive
+bool Ingestor::fingerprintFile(const QString& path, DecodedTrack& out, QString* err,
+                               const FingerprintProfile& profile, bool keepPeaks) {
+    PERF_SCOPE("ingest.file");
+
+    out = DecodedTrack();
+    out.path = path;
+
+    // Let the decoder downmix and convert; the sample rate stays native
+    QAudioFormat format;
+    format.setChannelCount(1);
+    format.setSampleFormat(QAudioFormat::Int16);
+
+    QAudioDecoder decoder;
+    decoder.setAudioFormat(format);
+    decoder.setSource(QUrl::fromLocalFile(path));
+
+    std::unique_ptr<StreamingFingerprinter> fp;
+    std::vector<StreamHash> hashes;
+    QString error;
+    bool done = false;
+    QEventLoop loop;
+
+    auto stop = [&](const QString& why) {
+        if (error.isEmpty()) error = why;
+        done = true;
+        decoder.stop();
+        loop.quit();
+    };
+
+    QObject::connect(&decoder, &QAudioDecoder::bufferReady, [&] {
+        const QAudioBuffer buffer = decoder.read();
+        if (!buffer.isValid() || done) return;
+
+        const QAudioFormat f = buffer.format();
+        if (f.sampleFormat() != QAudioFormat::Int16 || f.channelCount() != 1) {
+            stop("Decoder cannot convert to mono PCM16");
+            return;
+        }
+        if (!fp) {
+            out.sampleRate = f.sampleRate();
+            fp = std::make_unique<StreamingFingerprinter>(out.sampleRate, profile);
+            if (keepPeaks) fp->recordPeaks(&out.peaks);
+        } else if (f.sampleRate() != out.sampleRate) {
+            stop("Sample rate changed mid-stream");
+            return;
+        }
+
+        PERF_SCOPE("ingest.fingerprint");
+        const size_t n = size_t(buffer.frameCount());
+        fp->push(buffer.constData<int16_t>(), n, hashes);
+        out.samples += qint64(n);
+    });
+    QObject::connect(&decoder, &QAudioDecoder::finished, [&] {
+        done = true;
+        loop.quit();
+    });
+    QObject::connect(&decoder, qOverload<QAudioDecoder::Error>(&QAudioDecoder::error),
+                     [&](QAudioDecoder::Error) { stop(decoder.errorString()); });
+
+    decoder.start();
+    if (!done) loop.exec(); // errors may be reported from start() already
+
+    if (error.isEmpty() && !fp) error = "No audio decoded";
+    if (!error.isEmpty()) {
+        if (err) *err = error;
+        return false;
+    }
+
+    fp->finish(hashes);
+    out.hashes.reserve(hashes.size());
+    for (const StreamHash& h : hashes) out.hashes.emplace_back(h.hash, int(h.timeMs));
+    return true;
+}
+
+/// "Artist - Title" file names fill both fields; anything else is a title
+bool Ingestor::store(const DecodedTrack& track, QString* err) {
+    PERF_SCOPE("ingest.store");
+
+    DuplicateMatch dup;
+    if (m_duplicatePolicy != DuplicatePolicy::Allow &&
+        !m_db.findDuplicate(track.hashes, dup, -1, err)) {
+        return false;
+    }
+    if (dup.found) {
+        if (m_duplicate) m_duplicate(track.path, dup);
+        if (m_duplicatePolicy == DuplicatePolicy::Skip) return true;
+    }
+
+    SongRow s;
+    s.artist = ""; // NOT NULL column; a null QString would bind as NULL
+    const QString name = QFileInfo(track.path).completeBaseName();
+    const int dash = name.indexOf(" - ");
+    if (dash > 0) {
+        s.artist = name.left(dash).trimmed();
+        s.title = name.mid(dash + 3).trimmed();
+    } else {
+        s.title = name;
+    }
+
+    int songId = -1;
+    if (!m_db.insertSong(s, songId, err)) return false;
+    if (dup.found) {
+        if (!m_db.setDuplicateOf(songId, dup.song.id, err)) return false;
+        if (m_duplicatePolicy == DuplicatePolicy::Link) return true; // postings stay shared
+    }
+    if (!m_db.insertFingerprints(songId, track.hashes, err)) return false;
+
+    std::vector<uint8_t> blob = track.peaks.encode();
+    return m_db.insertConstellation(songId, QByteArray(reinterpret_cast<const char*>(blob.data()),
+                                                       int(blob.size())), err);
+}
+
+/// Pool tasks decode while the calling thread stores finished tracks
+bool Ingestor::run(const QStringList& paths, QString* err) {
+    PERF_SCOPE("ingest.run");
+
+    // Files are fingerprinted (and duplicates checked) with the default scheme
+    if (!m_db.checkScheme(Fingerprint::SCHEME, err)) return false;
+
+    const qint64 total = paths.size();
+    if (total == 0) return true;
+
+    int threads = m_threads > 0 ? m_threads : TaskPool::instance().backgroundLimit();
+    threads = int(std::max<qint64>(1, std::min<qint64>(threads, total)));
+
+    // Files in flight (decoding, or decoded and not stored yet) are capped:
+    // a slow database throttles decoding instead of piling up finished
+    // tracks in memory. The queue holds them all, so a task never blocks
+    // a pool worker on a full queue.
+    const qint64 window = qint64(threads) * 2;
+    BoundedQueue<DecodedTrack> decoded(static_cast<size_t>(window));
+    TaskGroup decoding;
+    qint64 next = 0;
+
+    auto decodeNext = [&] {
+        const QString path = paths[int(next++)];
+        decoding.submit(TaskLane::Background, [this, &decoded, path] {
+            DecodedTrack track;
+            fingerprintFile(path, track, &track.error, m_profile);
+            decoded.push(std::move(track)); // refused once closed: the run stopped early
+        });
+    };
+    while (next < std::min(window, total)) decodeNext();
+
+    bool ok = true;
+    DecodedTrack track;
+    for (qint64 done = 0; done < total && decoded.pop(track); ) {
+        if (next < total) decodeNext();
+
+        if (!track.error.isEmpty()) {
+            if (m_failure) m_failure(track.path, track.error);
+        } else if (!store(track, err)) {
+            ok = false;
+            break;
+        }
+
+        ++done;
+        if (m_progress) m_progress(done, total);
+    }
+
+    decoded.close();
+    decoding.wait();
+    return ok;
+}
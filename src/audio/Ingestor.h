@@ -0,0 +1,99 @@
+#pragma once
+#include <QString>
+#include <QStringList>
+#include <functional>
+#include "db/Database.h"
+#include "fingerprint/Constellation.h"
+#include "fingerprint/Fingerprint.h"
+
+/**
+ * @struct DecodedTrack
+ * @brief Fingerprints of one audio file, as produced by Ingestor.
+ */
+struct DecodedTrack {
+    QString path;
+    int sampleRate = 0;
+    qint64 samples = 0;   ///< Mono samples decoded
+    HashList hashes;      ///< (hash, offset_ms), as Fingerprint::compute
+    Constellation peaks;  ///< Stored for re-indexing
+    QString error;        ///< Why decoding failed (empty on success)
+};
+
+/**
+ * @class Ingestor
+ * @brief Adds audio files of any format Qt Multimedia can decode
+ *        (FLAC, MP3, Ogg, AAC, WAV, ...) to the catalog.
+ *
+ * Files are never materialized as PCM: QAudioDecoder hands over decoded
+ * buffers (converted to mono PCM16) which go straight into a
+ * StreamingFingerprinter, so memory per file is one decoder buffer plus
+ * the song's peaks and hashes.
+ *
+ * Pipeline:
+ *   - each file is decoded + fingerprinted by one TaskPool task on the
+ *     Background lane (running its own event loop for its QAudioDecoder),
+ *     so an import leaves a worker free for interactive recognition,
+ *   - the calling thread, which owns the Database connection, stores
+ *     finished tracks while the pool decodes the next ones.
+ *
+ * A file that cannot be decoded is reported and skipped; only a database
+ * error stops the run. Before a track is stored it is checked against the
+ * catalog (Database::findDuplicate) and handled per DuplicatePolicy.
+ */
+class Ingestor {
+public:
+    /// Progress callback: (files done, files total), on the calling thread
+    using Progress = std::function<void(qint64, qint64)>;
+
+    /// Skipped file callback: (path, error), on the calling thread
+    using Failure = std::function<void(const QString&, const QString&)>;
+
+    /// Duplicate callback: (path, existing song), on the calling thread
+    using Duplicate = std::function<void(const QString&, const DuplicateMatch&)>;
+
+    explicit Ingestor(Database& db);
+
+    /// Decoding parallelism: at most 2n files are in flight (decoding or
+    /// waiting to be stored); default n: the TaskPool's Background limit
+    void setThreads(int n) { m_threads = n; }
+
+    void setProgress(Progress cb) { m_progress = std::move(cb); }
+    void setFailure(Failure cb) { m_failure = std::move(cb); }
+    void setDuplicate(Duplicate cb) { m_duplicate = std::move(cb); }
+
+    /// What to do with tracks already in the catalog (default: Skip)
+    void setDuplicatePolicy(DuplicatePolicy p) { m_duplicatePolicy = p; }
+
+    /// Density songs are stored with (default: Fingerprint::indexProfile)
+    void setProfile(const FingerprintProfile& p) { m_profile = p; }
+
+    /// Decode, fingerprint and store every file; songs are titled from
+    /// the file name ("Artist - Title.ext" or "Title.ext")
+    bool run(const QStringList& paths, QString* err=nullptr);
+
+    /// Decode + fingerprint one file on the calling thread (runs a local
+    /// event loop until the decoder is done). Without `keepPeaks`,
+    /// `out.peaks` stays empty (for recordings that are only matched).
+    static bool fingerprintFile(const QString& path, DecodedTrack& out, QString* err=nullptr,
+                                const FingerprintProfile& profile = Fingerprint::indexProfile(),
+                                bool keepPeaks = true);
+
+    /// Audio files below `dir` (recursive, sorted)
+    static QStringList audioFiles(const QString& dir);
+
+    /// Name filters of the formats tried by audioFiles
+    static QStringList nameFilters();
+
+private:
+    /// Insert song row, fingerprints and constellation of a decoded track
+    /// (or less, per the duplicate policy)
+    bool store(const DecodedTrack& track, QString* err);
+
+    Database& m_db;
+    int m_threads = 0;
+    Progress m_progress;
+    Failure m_failure;
+    Duplicate m_duplicate;
+    DuplicatePolicy m_duplicatePolicy = DuplicatePolicy::Skip;
+    FingerprintProfile m_profile = Fingerprint::indexProfile();
+};
@@ -1,6 +1,8 @@
 #include "WavFile.h"
+#include "perf/Perf.h"
 #include <QFile>
 #include <QtEndian>
+#include <algorithm>
 #include <iostream>
 
 // Helper to read a WAV chunk header (id + size)
@@ -11,17 +13,8 @@ static bool readChunkHeader(QFile& f, QByteArray& id, quint32& size) {
     return true;
 }
 
-/// Load PCM16 WAV file into memory
-bool WavFile::loadPcm16(const QString& path,
-                        std::vector<int16_t>& out,
-                        WavInfo& info,
-                        QString* err) {
-    QFile f(path);
-    if (!f.open(QIODevice::ReadOnly)) {
-        if (err) *err = "Cannot open file";
-        return false;
-    }
-
+/// Walk the RIFF chunks and locate the fmt/data chunks
+bool WavFile::parseHeader(QFile& f, WavInfo& info, QString* err) {
     // --- RIFF/WAVE header ---
     char riff[4]; quint32 riffSize; char wave[4];
     if (f.read(riff, 4) != 4 ||
@@ -90,18 +83,56 @@ bool WavFile::loadPcm16(const QString& path,
     }
 
     // Only PCM16 is supported
-    if (audioFormat != 1 || bitsPerSample != 16) {
+    if (audioFormat != 1 || bitsPerSample != 16 || numChannels == 0) {
         if (err) *err = QString("Unsupported format: code=%1, bits=%2")
                             .arg(audioFormat).arg(bitsPerSample);
         return false;
     }
 
+    // Fill WavInfo struct (a truncated file holds less than the chunk claims)
+    info.sampleRate = sampleRate;
+    info.channels = numChannels;
+    info.bitsPerSample = 16;
+    info.dataOffset = dataPos;
+    info.dataBytes = std::min<qint64>(dataSize, std::max<qint64>(0, f.size() - dataPos));
+    info.totalFrames = info.dataBytes / (numChannels * 2);
+
+    return true;
+}
+
+/// Read only the header of a PCM16 WAV file
+bool WavFile::readInfo(const QString& path, WavInfo& info, QString* err) {
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly)) {
+        if (err) *err = "Cannot open file";
+        return false;
+    }
+    return parseHeader(f, info, err);
+}
+
+/// Load PCM16 WAV file into memory
+bool WavFile::loadPcm16(const QString& path,
+                        std::vector<int16_t>& out,
+                        WavInfo& info,
+                        QString* err) {
+    PERF_SCOPE("wav.loadPcm16");
+
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly)) {
+        if (err) *err = "Cannot open file";
+        return false;
+    }
+
+    if (!parseHeader(f, info, err)) return false;
+
     // --- Read sample data ---
-    f.seek(dataPos);
-    QByteArray raw = f.read(dataSize);
+    f.seek(info.dataOffset);
+    QByteArray raw = f.read(info.dataBytes);
+    PERF_COUNT("wav.bytesRead", raw.size());
 
     const int16_t* p = reinterpret_cast<const int16_t*>(raw.constData());
-    int frames = dataSize / (numChannels * 2);
+    const int numChannels = info.channels;
+    int frames = int(raw.size() / (numChannels * 2));
 
     out.clear();
     out.reserve(frames);
@@ -112,18 +143,13 @@ bool WavFile::loadPcm16(const QString& path,
     } else {
         // Stereo: downmix to mono (average L & R)
         for (int i = 0; i < frames; i++) {
-            int32_t L = p[2 * i];
-            int32_t R = p[2 * i + 1];
+            int32_t L = p[numChannels * i];
+            int32_t R = p[numChannels * i + 1];
             out.push_back(static_cast<int16_t>((L + R) / 2));
         }
     }
 
-    // Fill WavInfo struct
-    info.sampleRate = sampleRate;
-    info.channels = numChannels;
-    info.bitsPerSample = 16;
     info.totalFrames = frames;
-
     return true;
 }
 
@@ -1,6 +1,7 @@
 #pragma once
 #include <QByteArray>
 #include <QString>
+#include <QFile>
 #include <vector>
 #include <cstdint>
 
@@ -8,13 +9,16 @@
  * @struct WavInfo
  * @brief Metadata extracted from a WAV file.
  *
- * Includes sample rate, number of channels, bit depth, and total frame count.
+ * Includes sample rate, number of channels, bit depth, and total frame count,
+ * plus where the sample data lives inside the file.
  */
 struct WavInfo {
     int sampleRate = 44100;
     int channels = 1;
     int bitsPerSample = 16;
     int64_t totalFrames = 0;
+    int64_t dataOffset = 0;  ///< Byte offset of the `data` chunk payload
+    int64_t dataBytes = 0;   ///< Payload size (clamped to what the file holds)
 };
 
 /**
@@ -24,9 +28,14 @@ struct WavInfo {
  * Supports:
  *   - Loading uncompressed PCM16 WAV files (mono/stereo).
  *   - Saving mono PCM16 audio (used for captured microphone data).
+ *   - Reading only the header, for streaming access (WavStreamDevice).
  */
 class WavFile {
 public:
+    /// Parse the header of an uncompressed PCM16 WAV without reading samples.
+    /// Returns false on error (err set if provided).
+    static bool readInfo(const QString& path, WavInfo& info, QString* err=nullptr);
+
     /// Load uncompressed PCM16 WAV into samples + metadata.
     /// Returns false on error (err set if provided).
     static bool loadPcm16(const QString& path,
@@ -39,4 +48,8 @@ public:
                               const std::vector<int16_t>& samples,
                               int sampleRate,
                               QString* err=nullptr);
+
+private:
+    /// Walk the RIFF chunks of an open file and fill `info`
+    static bool parseHeader(QFile& f, WavInfo& info, QString* err);
 };
\ No newline at end of file
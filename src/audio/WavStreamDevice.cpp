@@ -0,0 +1,89 @@
+#include "WavStreamDevice.h"
+#include "perf/Perf.h"
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+
+WavStreamDevice::WavStreamDevice(const QString& path, QObject* parent)
+    : QIODevice(parent), m_file(path) {}
+
+WavStreamDevice::~WavStreamDevice() {
+    close();
+}
+
+/// Map the data chunk; nothing is read until readData()
+bool WavStreamDevice::open(OpenMode mode) {
+    if ((mode & WriteOnly) != 0) {
+        setErrorString("WavStreamDevice is read-only");
+        return false;
+    }
+
+    QString err;
+    if (!WavFile::readInfo(m_file.fileName(), m_info, &err)) {
+        setErrorString(err);
+        return false;
+    }
+
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        setErrorString(m_file.errorString());
+        return false;
+    }
+
+    if (m_info.dataBytes > 0) {
+        m_samples = m_file.map(m_info.dataOffset, m_info.dataBytes);
+        if (!m_samples) {
+            setErrorString("Cannot map WAV data: " + m_file.errorString());
+            m_file.close();
+            return false;
+        }
+    }
+
+    // Like QBuffer: the position is ours, no QIODevice read-ahead copy
+    return QIODevice::open(mode | Unbuffered);
+}
+
+void WavStreamDevice::close() {
+    if (m_samples) {
+        m_file.unmap(const_cast<uchar*>(m_samples));
+        m_samples = nullptr;
+    }
+    m_file.close();
+    QIODevice::close();
+}
+
+qint64 WavStreamDevice::size() const {
+    return m_info.totalFrames * qint64(sizeof(int16_t));
+}
+
+/// Produce mono PCM16 bytes [pos, pos + maxSize) from the mapping
+qint64 WavStreamDevice::readData(char* data, qint64 maxSize) {
+    PERF_SCOPE("wav.stream.read");
+
+    qint64 pos = this->pos();
+    const qint64 n = std::min(maxSize, size() - pos);
+    if (n <= 0) return 0;
+
+    const int channels = m_info.channels;
+    if (channels == 1) {
+        std::memcpy(data, m_samples + pos, size_t(n));
+        return n;
+    }
+
+    // Downmix one frame at a time; a read may start or end mid-sample
+    qint64 done = 0;
+    while (done < n) {
+        const uchar* frame = m_samples + (pos / 2) * channels * 2;
+        int32_t sum = 0;
+        for (int ch = 0; ch < channels; ++ch) {
+            sum += qFromLittleEndian<qint16>(frame + 2 * ch);
+        }
+        const qint16 mono = qint16(sum / channels);
+
+        const int skip = int(pos % 2);
+        const qint64 take = std::min<qint64>(2 - skip, n - done);
+        std::memcpy(data + done, reinterpret_cast<const char*>(&mono) + skip, size_t(take));
+        done += take;
+        pos += take;
+    }
+    return n;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <QIODevice>
+#include <QFile>
+#include <QString>
+#include "WavFile.h"
+
+/**
+ * @class WavStreamDevice
+ * @brief Read-only QIODevice serving a PCM16 WAV file as mono PCM16.
+ *
+ * The `data` chunk is memory-mapped and converted on demand in readData(),
+ * so playing a file costs no heap beyond the mapping itself, whatever its
+ * length. Multi-channel files are downmixed (channel average) while
+ * reading; mono files are copied straight out of the mapping.
+ *
+ * Typical usage:
+ *   auto* dev = new WavStreamDevice(path);
+ *   if (dev->open(QIODevice::ReadOnly)) sink->start(dev);
+ */
+class WavStreamDevice : public QIODevice {
+    Q_OBJECT
+public:
+    explicit WavStreamDevice(const QString& path, QObject* parent=nullptr);
+    ~WavStreamDevice() override;
+
+    /// Parse the header and map the sample data (ReadOnly only)
+    bool open(OpenMode mode) override;
+    void close() override;
+
+    bool isSequential() const override { return false; }
+
+    /// Size of the mono PCM16 stream in bytes
+    qint64 size() const override;
+
+    /// Header of the underlying file (valid once open)
+    const WavInfo& info() const { return m_info; }
+
+protected:
+    qint64 readData(char* data, qint64 maxSize) override;
+    qint64 writeData(const char*, qint64) override { return -1; }
+
+private:
+    QFile m_file;
+    WavInfo m_info;
+    const uchar* m_samples = nullptr; ///< Mapped `data` chunk payload
+};
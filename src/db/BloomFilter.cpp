@@ -0,0 +1,92 @@
+#include "BloomFilter.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static const uint8_t MAGIC[4] = {'B','L','M','1'};
+static constexpr size_t HEADER_BYTES = 4 + 4 + 8 + 8 + 8;
+
+// ---- Little-endian helpers ----
+
+static void putU32(std::vector<uint8_t>& out, uint32_t v) {
+    for (int i = 0; i < 4; ++i) out.push_back(uint8_t(v >> (8 * i)));
+}
+
+static void putU64(std::vector<uint8_t>& out, uint64_t v) {
+    for (int i = 0; i < 8; ++i) out.push_back(uint8_t(v >> (8 * i)));
+}
+
+static uint64_t getLE(const uint8_t* p, int bytes) {
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; ++i) v |= uint64_t(p[i]) << (8 * i);
+    return v;
+}
+
+/// Allocate ceil(expectedKeys * bitsPerKey / 512) blocks, all clear
+void BloomFilter::reset(size_t expectedKeys, double bitsPerKey) {
+    const double bitsWanted = double(std::max<size_t>(expectedKeys, 1)) * std::max(bitsPerKey, 1.0);
+    const size_t blocks = size_t(std::ceil(bitsWanted / (WORDS_PER_BLOCK * 64)));
+
+    m_blocks.assign(std::max<size_t>(blocks, 1), Block{});
+    m_keys = 0;
+}
+
+void BloomFilter::clear() {
+    std::vector<Block>().swap(m_blocks);
+    m_keys = 0;
+}
+
+/// Set one bit per word of the key's block
+void BloomFilter::add(uint32_t key) {
+    if (m_blocks.empty()) return;
+
+    const uint64_t h = mix(key);
+    Block& b = m_blocks[blockIndex(h)];
+    const uint32_t lo = uint32_t(h);
+
+    bool fresh = false;
+    for (int i = 0; i < WORDS_PER_BLOCK; ++i) {
+        const uint64_t m = bitMask(lo, i);
+        fresh |= !(b.words[i] & m);
+        b.words[i] |= m;
+    }
+    if (fresh) ++m_keys;
+}
+
+std::vector<uint8_t> BloomFilter::encode(uint64_t stampA, uint64_t stampB) const {
+    std::vector<uint8_t> out;
+    out.reserve(HEADER_BYTES + bytes());
+
+    for (uint8_t c : MAGIC) out.push_back(c);
+    putU32(out, uint32_t(m_blocks.size()));
+    putU64(out, m_keys);
+    putU64(out, stampA);
+    putU64(out, stampB);
+
+    for (const Block& b : m_blocks) {
+        for (uint64_t w : b.words) putU64(out, w);
+    }
+    return out;
+}
+
+bool BloomFilter::decode(const uint8_t* data, size_t size, BloomFilter& out,
+                         uint64_t& stampA, uint64_t& stampB) {
+    if (size < HEADER_BYTES || std::memcmp(data, MAGIC, 4) != 0) return false;
+
+    const size_t blocks = size_t(getLE(data + 4, 4));
+    if (blocks == 0 || size != HEADER_BYTES + blocks * sizeof(Block)) return false;
+
+    out.m_blocks.assign(blocks, Block{});
+    out.m_keys = size_t(getLE(data + 8, 8));
+    stampA = getLE(data + 16, 8);
+    stampB = getLE(data + 24, 8);
+
+    const uint8_t* p = data + HEADER_BYTES;
+    for (Block& b : out.m_blocks) {
+        for (uint64_t& w : b.words) {
+            w = getLE(p, 8);
+            p += 8;
+        }
+    }
+    return true;
+}
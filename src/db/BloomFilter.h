@@ -0,0 +1,98 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @class BloomFilter
+ * @brief Blocked (cache-line) Bloom filter over 32-bit fingerprint hashes.
+ *
+ * The bit array is split into 512-bit blocks, one 64-byte cache line each.
+ * A key selects a single block and sets one bit in each of its eight
+ * 64-bit words, so add() and mayContain() touch exactly one cache line.
+ * At 12 bits per key the false-positive rate is under 0.5%; there are no
+ * false negatives.
+ *
+ * An empty (never sized) filter answers "maybe" to everything, so a
+ * Database without one behaves as before.
+ *
+ * Binary format (little-endian), see encode/decode:
+ *   "BLM1" | u32 blocks | u64 keys | u64 stampA | u64 stampB | u64 words[blocks*8]
+ * The two stamps are opaque to the filter; Database stores the catalog
+ * size there to detect a file that no longer matches the index.
+ *
+ * Not synchronized: Database guards it with its state lock.
+ */
+class BloomFilter {
+public:
+    static constexpr int WORDS_PER_BLOCK = 8; ///< 8 x 64 bits = one 64-byte cache line
+
+    /// Size for `expectedKeys` at `bitsPerKey` and clear all bits
+    void reset(size_t expectedKeys, double bitsPerKey = 12.0);
+
+    /// Drop all bits and the storage (back to "maybe" for every key)
+    void clear();
+
+    /// Insert one key (no-op on an empty filter)
+    void add(uint32_t key);
+
+    /// False only if `key` was definitely never added
+    bool mayContain(uint32_t key) const {
+        if (m_blocks.empty()) return true;
+        const uint64_t h = mix(key);
+        const Block& b = m_blocks[blockIndex(h)];
+        const uint32_t lo = uint32_t(h);
+        for (int i = 0; i < WORDS_PER_BLOCK; ++i) {
+            if (!(b.words[i] & bitMask(lo, i))) return false;
+        }
+        return true;
+    }
+
+    bool empty() const { return m_blocks.empty(); }
+
+    /// Keys added so far (new keys only; repeats are not counted)
+    size_t keyCount() const { return m_keys; }
+
+    /// Size of the bit array
+    size_t bits() const { return m_blocks.size() * WORDS_PER_BLOCK * 64; }
+
+    /// Memory held by the bit array
+    size_t bytes() const { return m_blocks.size() * sizeof(Block); }
+
+    /// Serialize with two caller-defined stamps
+    std::vector<uint8_t> encode(uint64_t stampA, uint64_t stampB) const;
+
+    /// Parse encode() output; false on malformed input
+    static bool decode(const uint8_t* data, size_t size, BloomFilter& out,
+                       uint64_t& stampA, uint64_t& stampB);
+
+private:
+    struct alignas(64) Block {
+        uint64_t words[WORDS_PER_BLOCK];
+    };
+
+    /// 32 -> 64 bit mixer (splitmix64 finalizer): high half picks the
+    /// block, low half the bits
+    static uint64_t mix(uint32_t key) {
+        uint64_t z = uint64_t(key) + 0x9E3779B97F4A7C15ull;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    /// Range reduction without a division
+    size_t blockIndex(uint64_t h) const {
+        return size_t((uint64_t(uint32_t(h >> 32)) * m_blocks.size()) >> 32);
+    }
+
+    /// Bit of word i: top 6 bits of an odd-multiplier rehash
+    static uint64_t bitMask(uint32_t lo, int i) {
+        static constexpr uint32_t SALT[WORDS_PER_BLOCK] = {
+            0x47b6137bu, 0x44974d91u, 0x8824ad5bu, 0xa2b7289du,
+            0x705495c7u, 0x2df1424bu, 0x9efc4947u, 0x5c6bfb31u};
+        return uint64_t(1) << ((lo * SALT[i]) >> 26);
+    }
+
+    std::vector<Block> m_blocks;
+    size_t m_keys = 0;
+};
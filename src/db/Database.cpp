@@ -1,13 +1,88 @@
 #include "Database.h"
+#include "perf/Perf.h"
+#include "util/TaskPool.h"
 #include <QSqlQuery>
 #include <QSqlError>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
 #include <QVariant>
+#include <QStringList>
+#include <QThread>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
 
-Database::Database(const QString& filePath) {
-    m_db = QSqlDatabase::addDatabase("QSQLITE");
+// Fingerprint indexes, shared by migrate() and the bulk re-index path.
+// idx_fp_hash covers (hash, song_id, offset_ms) so posting lookups never
+// touch the table.
+static const char* SQL_IDX_FP_HASH =
+    "CREATE INDEX IF NOT EXISTS idx_fp_hash ON fingerprints(hash, song_id, offset_ms)";
+static const char* SQL_IDX_FP_SONG =
+    "CREATE INDEX IF NOT EXISTS idx_fp_song ON fingerprints(song_id)";
+
+// selectivityOrder() reads the posting counts of uncached hashes from
+// hash_stats this many at a time
+static constexpr size_t SELECTIVITY_BATCH = 1000;
+
+// syncCatalog() applies at most this many change-log entries one by one;
+// after more writes than that, reloading the state is about as cheap
+static constexpr int SYNC_MAX_CHANGES = 512;
+
+// Bloom filter sizing: built for BLOOM_HEADROOM x the current distinct
+// hashes at BLOOM_BITS_PER_KEY, rebuilt once inserts push it below
+// BLOOM_MIN_BITS_PER_KEY (false positives ~0.4% -> ~1.5%)
+static constexpr double BLOOM_BITS_PER_KEY = 12.0;
+static constexpr double BLOOM_HEADROOM = 2.0;
+static constexpr double BLOOM_MIN_BITS_PER_KEY = 9.0;
+
+// warmIndex() walks idx_fp_hash in this many hash ranges (progress steps)
+static constexpr int WARM_SLICES = 64;
+
+// Duplicate detection: a DUPLICATE_PROBE_MS excerpt from the middle of the
+// recording is matched; the winner is a copy if it aligns with at least
+// DUPLICATE_MIN_COVERAGE of the excerpt (and DUPLICATE_MIN_VOTES hashes)
+// and the lengths differ by at most DUPLICATE_LENGTH_TOLERANCE (or
+// DUPLICATE_LENGTH_SLACK_MS for short songs)
+static constexpr int DUPLICATE_PROBE_MS = 30000;
+static constexpr double DUPLICATE_MIN_COVERAGE = 0.25;
+static constexpr int DUPLICATE_MIN_VOTES = 20;
+static constexpr double DUPLICATE_LENGTH_TOLERANCE = 0.05;
+static constexpr int DUPLICATE_LENGTH_SLACK_MS = 3000;
+
+// bestMatchBatch() in read-pool mode hands each pool task at least this
+// many distinct hashes; smaller batches are looked up by the caller alone
+static constexpr size_t BATCH_TASK_HASHES = 512;
+
+Database::Database(const QString& filePath, const QString& connectionName)
+    : m_path(filePath), m_connName(connectionName) {
+    // Every instance gets its own connection name so that several
+    // Database objects (or threads) never share a QSqlDatabase
+    static std::atomic<int> s_instances{0};
+    if (m_connName.isEmpty()) m_connName = QString("mra_db_%1").arg(s_instances++);
+
+    m_db = QSqlDatabase::addDatabase("QSQLITE", m_connName);
     m_db.setDatabaseName(filePath);
 }
 
+/// Close and unregister the writer and every pooled reader connection
+Database::~Database() {
+    if (m_bloomDirty && m_db.isOpen()) saveBloomFilter();
+
+    m_reindexInsert = QSqlQuery();
+    m_db.close();
+    m_db = QSqlDatabase();
+    QSqlDatabase::removeDatabase(m_connName);
+
+    std::lock_guard<std::mutex> lock(m_readersMutex);
+    for (const QString& name : m_readerNames) QSqlDatabase::removeDatabase(name);
+}
+
 /// Open database connection
 bool Database::open(QString* err) {
     if (!m_db.open()) {
@@ -43,23 +118,103 @@ bool Database::migrate(QString* err) {
         return false;
     }
 
-    // Indexes for faster lookup
-    if (!q.exec("CREATE INDEX IF NOT EXISTS idx_fp_hash ON fingerprints(hash)")) {
+    // Indexes for faster lookup; databases with the older hash-only
+    // idx_fp_hash are upgraded once to the covering version.
+    if (q.exec("SELECT COUNT(*) FROM pragma_index_info('idx_fp_hash')") &&
+        q.next() && q.value(0).toInt() == 1) {
+        q.finish();
+        if (!q.exec("DROP INDEX idx_fp_hash")) {
+            if (err) *err = q.lastError().text();
+            return false;
+        }
+    }
+    q.finish();
+    if (!q.exec(SQL_IDX_FP_HASH)) {
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+    if (!q.exec(SQL_IDX_FP_SONG)) {
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+
+    // Per-hash posting statistics (maintained by insertFingerprints)
+    if (!q.exec("CREATE TABLE IF NOT EXISTS hash_stats("
+                "hash INTEGER PRIMARY KEY,"
+                "postings INTEGER NOT NULL,"
+                "songs INTEGER NOT NULL)")) {
         if (err) *err = q.lastError().text();
         return false;
     }
-    if (!q.exec("CREATE INDEX IF NOT EXISTS idx_fp_song ON fingerprints(song_id)")) {
+
+    // Per-song peak constellations (Constellation::encode), for re-indexing
+    if (!q.exec("CREATE TABLE IF NOT EXISTS constellations("
+                "song_id INTEGER PRIMARY KEY,"
+                "data BLOB NOT NULL)")) {
         if (err) *err = q.lastError().text();
         return false;
     }
 
-    return true;
+    // Columns added after the first release
+    if (!addColumnIfMissing("songs", "sketch", "BLOB", err) ||
+        !addColumnIfMissing("songs", "duplicate_of", "INTEGER", err)) {
+        return false;
+    }
+
+    // Append-only log of committed writes, replayed by replicas.
+    // AUTOINCREMENT: a seq is never reused, even after pruning.
+    if (!q.exec("CREATE TABLE IF NOT EXISTS change_log("
+                "seq INTEGER PRIMARY KEY AUTOINCREMENT,"
+                "op INTEGER NOT NULL,"
+                "song_id INTEGER NOT NULL,"
+                "payload BLOB)")) {
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+
+    // Catalog settings (hash_scheme)
+    if (!q.exec("CREATE TABLE IF NOT EXISTS meta("
+                "key TEXT PRIMARY KEY,"
+                "value TEXT NOT NULL)")) {
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+    // State loaded from here on reflects at least this write counter;
+    // later writes through other connections are caught by syncCatalog()
+    qint64 token = 0;
+    if (!writeToken(m_db, token, err) || !loadScheme(err)) return false;
+
+    // Per-song MinHash sketches: lookup table for songs.sketch
+    if (!q.exec("CREATE TABLE IF NOT EXISTS sketch_keys("
+                "key INTEGER NOT NULL,"
+                "song_id INTEGER NOT NULL,"
+                "PRIMARY KEY(key, song_id)) WITHOUT ROWID") ||
+        !q.exec("CREATE INDEX IF NOT EXISTS idx_sketch_song ON sketch_keys(song_id)")) {
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+
+    // Databases created before hash_stats existed: backfill once
+    if (q.exec("SELECT EXISTS(SELECT 1 FROM fingerprints), EXISTS(SELECT 1 FROM hash_stats)") &&
+        q.next() && q.value(0).toInt() && !q.value(1).toInt()) {
+        q.finish();
+        if (!rebuildHashStats(err)) return false;
+    }
+    q.finish();
+
+    if (!backfillSketches(err)) return false;
+
+    m_syncedToken = token;
+    return reloadStopList(m_db, err) && loadBloomFilter(err);
 }
 
 /// Insert song metadata and return auto-generated ID
 bool Database::insertSong(const SongRow& s, int& outId, QString* err) {
+    if (!beginWrite(err)) return false;
+
     QSqlQuery q(m_db);
-    q.prepare("INSERT INTO songs(title,artist,album,year,genre) VALUES(?,?,?,?,?)");
+    q.prepare("INSERT INTO songs(id,title,artist,album,year,genre) VALUES(?,?,?,?,?,?)");
+    q.addBindValue(s.id > 0 ? QVariant(s.id) : QVariant()); // NULL: next id
     q.addBindValue(s.title);
     q.addBindValue(s.artist);
     q.addBindValue(s.album);
@@ -67,11 +222,22 @@ bool Database::insertSong(const SongRow& s, int& outId, QString* err) {
     q.addBindValue(s.genre);
 
     if (!q.exec()) {
+        m_db.rollback();
         if (err) *err = q.lastError().text();
         return false;
     }
-
     outId = q.lastInsertId().toInt();
+
+    SongRow logged = s;
+    logged.id = outId;
+    if (!logChange(Change::SongInsert, outId, Change::encodeSong(logged), err)) {
+        m_db.rollback();
+        return false;
+    }
+    if (!commitWrite(err)) return false;
+
+    std::unique_lock<std::shared_mutex> state(m_stateLock);
+    ++m_songCount;
     return true;
 }
 
@@ -79,12 +245,52 @@ bool Database::insertSong(const SongRow& s, int& outId, QString* err) {
 bool Database::insertFingerprints(int songId,
                                   const std::vector<std::pair<uint32_t,int>>& hashes,
                                   QString* err) {
-    m_db.transaction();
+    PERF_SCOPE("db.insertFingerprints");
+
+    // What is stored is also what the sketch, the change log and the
+    // counters see
+    HashList kept;
+    const HashList& stored = insertable(hashes, kept);
+    PERF_COUNT("db.postingsInserted", stored.size());
+
+    if (!beginWrite(err)) return false;
 
+    // Postings added per distinct hash, folded into hash_stats below, and
+    // whether the song is new to the hash (counted once in hash_stats.songs)
+    struct Added { qint64 postings = 0; int newSong = 1; };
+    std::unordered_map<uint32_t, Added> added;
+    added.reserve(stored.size());
+    for (auto& h : stored) ++added[h.first].postings;
+
+    // A song's fingerprints may arrive in several calls: only then can it
+    // already hold some of these hashes
     QSqlQuery q(m_db);
-    q.prepare("INSERT INTO fingerprints(song_id,hash,offset_ms) VALUES(?,?,?)");
+    q.prepare("SELECT EXISTS(SELECT 1 FROM fingerprints WHERE song_id=?)");
+    q.addBindValue(songId);
+    if (!q.exec() || !q.next()) {
+        m_db.rollback();
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+    const bool indexed = q.value(0).toInt() != 0;
+    q.finish();
+    if (indexed) {
+        q.prepare("SELECT EXISTS(SELECT 1 FROM fingerprints WHERE hash=? AND song_id=?)");
+        for (auto& a : added) {
+            q.bindValue(0, (qulonglong)a.first);
+            q.bindValue(1, songId);
+            if (!q.exec() || !q.next()) {
+                m_db.rollback();
+                if (err) *err = q.lastError().text();
+                return false;
+            }
+            a.second.newSong = q.value(0).toInt() ? 0 : 1;
+            q.finish();
+        }
+    }
 
-    for (auto& h : hashes) {
+    q.prepare("INSERT INTO fingerprints(song_id,hash,offset_ms) VALUES(?,?,?)");
+    for (auto& h : stored) {
         q.addBindValue(songId);
         q.addBindValue((qulonglong)h.first);
         q.addBindValue(h.second);
@@ -100,70 +306,1958 @@ bool Database::insertFingerprints(int songId,
         q.prepare("INSERT INTO fingerprints(song_id,hash,offset_ms) VALUES(?,?,?)");
     }
 
+    // Update posting statistics (one upsert per distinct hash)
+    QSqlQuery qs(m_db);
+    qs.prepare("INSERT INTO hash_stats(hash,postings,songs) VALUES(?,?,?) "
+               "ON CONFLICT(hash) DO UPDATE SET "
+               "postings=postings+excluded.postings, songs=songs+excluded.songs");
+
+    for (auto& a : added) {
+        qs.addBindValue((qulonglong)a.first);
+        qs.addBindValue(a.second.postings);
+        qs.addBindValue(a.second.newSong);
+
+        if (!qs.exec()) {
+            m_db.rollback();
+            if (err) *err = qs.lastError().text();
+            return false;
+        }
+    }
+
+    if (!storeSketch(songId, stored, err) ||
+        !logChange(Change::Fingerprints, songId, Change::encodeHashes(stored), err)) {
+        m_db.rollback();
+        return false;
+    }
+
+    if (!commitWrite(err)) return false;
+
+    // Posting lists of the touched hashes are now stale in the cache
+    for (auto& a : added) m_cache.invalidate(a.first);
+
+    bool saturated = false;
+    {
+        std::unique_lock<std::shared_mutex> state(m_stateLock);
+        for (auto& a : added) m_bloom.add(a.first);
+        m_bloomDirty = true;
+        saturated = !m_bloom.empty() &&
+                    double(m_bloom.keyCount()) * BLOOM_MIN_BITS_PER_KEY > double(m_bloom.bits());
+    }
+
+    // The catalog outgrew the filter: resize before false positives pile up
+    return !saturated || rebuildBloomFilter(err);
+}
+
+/// Optionally keep stop-listed hashes out of the index entirely
+const HashList& Database::insertable(const HashList& hashes, HashList& kept) const {
+    std::shared_lock<std::shared_mutex> state(m_stateLock);
+    if (!m_hotPolicy.applyOnInsert || m_stopList.empty()) return hashes;
+
+    kept.clear();
+    kept.reserve(hashes.size());
+    for (auto& h : hashes) {
+        if (!isStopListed(h.first)) kept.push_back(h);
+    }
+    return kept;
+}
+
+/// Merge into the stored sketch (fingerprints may arrive in several calls)
+bool Database::storeSketch(int songId, const HashList& hashes, QString* err) {
+    MinHashSketch sketch = MinHashSketch::build(hashes);
+
+    QSqlQuery q(m_db);
+    q.prepare("SELECT sketch FROM songs WHERE id=?");
+    q.addBindValue(songId);
+    if (!q.exec()) {
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+    if (q.next() && !q.value(0).isNull()) {
+        const QByteArray stored = q.value(0).toByteArray();
+        MinHashSketch previous;
+        if (MinHashSketch::decode(reinterpret_cast<const uint8_t*>(stored.constData()),
+                                  size_t(stored.size()), previous)) {
+            sketch.merge(previous);
+        }
+    }
+    q.finish();
+
+    const std::vector<uint8_t> blob = sketch.encode();
+    q.prepare("UPDATE songs SET sketch=? WHERE id=?");
+    q.addBindValue(QByteArray(reinterpret_cast<const char*>(blob.data()), int(blob.size())));
+    q.addBindValue(songId);
+    if (!q.exec()) {
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+
+    q.prepare("DELETE FROM sketch_keys WHERE song_id=?");
+    q.addBindValue(songId);
+    if (!q.exec()) {
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+
+    q.prepare("INSERT OR IGNORE INTO sketch_keys(key,song_id) VALUES(?,?)");
+    for (int64_t key : sketch.keys()) {
+        q.bindValue(0, qint64(key));
+        q.bindValue(1, songId);
+        if (!q.exec()) {
+            if (err) *err = q.lastError().text();
+            return false;
+        }
+    }
+    return true;
+}
+
+/// Compute sketches of fingerprinted songs that have none
+bool Database::backfillSketches(QString* err) {
+    QSqlQuery q(m_db);
+    q.setForwardOnly(true);
+    if (!q.exec("SELECT id FROM songs WHERE sketch IS NULL "
+                "AND EXISTS(SELECT 1 FROM fingerprints WHERE song_id=songs.id)")) {
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+    std::vector<int> songIds;
+    while (q.next()) songIds.push_back(q.value(0).toInt());
+    q.finish();
+    if (songIds.empty()) return true;
+
+    PERF_SCOPE("db.sketch.backfill");
+    m_db.transaction();
+
+    QSqlQuery qf(m_db);
+    qf.setForwardOnly(true);
+    qf.prepare("SELECT hash, offset_ms FROM fingerprints WHERE song_id=?");
+
+    HashList hashes;
+    for (int songId : songIds) {
+        qf.bindValue(0, songId);
+        if (!qf.exec()) {
+            m_db.rollback();
+            if (err) *err = qf.lastError().text();
+            return false;
+        }
+        hashes.clear();
+        while (qf.next()) {
+            hashes.emplace_back((uint32_t)qf.value(0).toULongLong(), qf.value(1).toInt());
+        }
+        qf.finish();
+
+        if (!storeSketch(songId, hashes, err)) {
+            m_db.rollback();
+            return false;
+        }
+    }
+
     m_db.commit();
     return true;
 }
 
-/// Match fingerprints by voting mechanism
-bool Database::bestMatch(const std::vector<std::pair<uint32_t,int>>& hashes,
-                         SongRow& outSong,
-                         int& voteCount,
-                         QString* err) {
-    // Votes keyed by (song_id, time delta)
-    QHash<QPair<int,int>, int> votes;
+bool Database::addColumnIfMissing(const QString& table, const QString& column,
+                                  const QString& type, QString* err) {
+    QSqlQuery q(m_db);
+    q.prepare(QString("SELECT COUNT(*) FROM pragma_table_info('%1') WHERE name=?").arg(table));
+    q.addBindValue(column);
+    if (!q.exec() || !q.next()) {
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+    const bool present = q.value(0).toInt() > 0;
+    q.finish();
+
+    if (!present && !q.exec(QString("ALTER TABLE %1 ADD COLUMN %2 %3").arg(table, column, type))) {
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+/// Catalogs from before meta existed were all hashed with scheme 1: V1
+/// hashes bit for bit as fingerprinting did before schemes were recorded,
+/// so they are stamped V1 and keep working. (Their peaks come from the
+/// older picker; re-ingesting the songs improves accuracy.)
+bool Database::loadScheme(QString* err) {
+    int stored = 0;
+    if (!storedScheme(m_db, stored, err)) return false;
 
     QSqlQuery q(m_db);
-    q.prepare("SELECT song_id, offset_ms FROM fingerprints WHERE hash=?");
+    const bool record = stored == 0;
+    if (record) {
+        if (!q.exec("SELECT EXISTS(SELECT 1 FROM fingerprints)") || !q.next()) {
+            if (err) *err = q.lastError().text();
+            return false;
+        }
+        stored = q.value(0).toInt() ? FingerprintSchemeV1::ID : m_scheme;
+        q.finish();
+    }
 
-    // For each hash, look up candidates and vote
-    for (auto& h : hashes) {
-        q.addBindValue((qulonglong)h.first);
+    if (!FingerprintKernels::find(stored)) {
+        if (err) *err = QString("Catalog uses fingerprint scheme %1, which this build does not have")
+                            .arg(stored);
+        return false;
+    }
 
+    if (record) {
+        q.prepare("INSERT INTO meta(key,value) VALUES('hash_scheme',?)");
+        q.addBindValue(QString::number(stored));
         if (!q.exec()) {
             if (err) *err = q.lastError().text();
             return false;
         }
+    }
+
+    std::unique_lock<std::shared_mutex> state(m_stateLock);
+    m_scheme = stored;
+    return true;
+}
+
+bool Database::storedScheme(int& out, QString* err) {
+    return storedScheme(m_db, out, err);
+}
+
+bool Database::storedScheme(const QSqlDatabase& db, int& out, QString* err) const {
+    out = 0;
+    QSqlQuery q(db);
+    if (!q.exec("SELECT COUNT(*) FROM sqlite_master WHERE type='table' AND name='meta'") || !q.next()) {
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+    if (q.value(0).toInt() == 0) return true;
+    q.finish();
+
+    if (!q.exec("SELECT value FROM meta WHERE key='hash_scheme'")) {
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+    if (q.next()) out = q.value(0).toInt();
+    return true;
+}
+
+bool Database::checkScheme(int scheme, QString* err) const {
+    std::shared_lock<std::shared_mutex> state(m_stateLock);
+    const QString e = schemeError(scheme);
+    if (e.isEmpty()) return true;
+    if (err) *err = e;
+    return false;
+}
+
+QString Database::schemeError(int scheme) const {
+    if (scheme != m_scheme) {
+        return QString("Hashes of fingerprint scheme %1 do not match the catalog's scheme %2")
+            .arg(scheme).arg(m_scheme);
+    }
+    return QString();
+}
+
+bool Database::songLengthMs(int songId, int& out, QString* err) {
+    QSqlQuery q(readDb());
+    q.prepare("SELECT COALESCE(MAX(offset_ms),0) FROM fingerprints WHERE song_id=?");
+    q.addBindValue(songId);
+    if (!q.exec() || !q.next()) {
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+    out = q.value(0).toInt();
+    return true;
+}
+
+/// Self-match an excerpt, then check alignment share and length
+bool Database::findDuplicate(const HashList& hashes, DuplicateMatch& out,
+                             int excludeSongId, QString* err) {
+    PERF_SCOPE("db.findDuplicate");
+    out = DuplicateMatch();
+    if (hashes.empty()) return true;
+
+    int lengthMs = 0;
+    for (auto& h : hashes) lengthMs = std::max(lengthMs, h.second);
+
+    // Excerpt from the middle: intros and fade-outs are the parts most
+    // often shared with other songs (or trimmed differently)
+    const int from = std::max(0, lengthMs / 2 - DUPLICATE_PROBE_MS / 2);
+    const int to = from + DUPLICATE_PROBE_MS;
+    HashList excerpt;
+    for (auto& h : hashes) {
+        if (h.second >= from && h.second < to) excerpt.push_back(h);
+    }
+    if (excerpt.empty()) return true;
+
+    VoteBin best;
+    {
+        if (!openReader(err) || !syncCatalog(err)) return false;
+        std::shared_lock<std::shared_mutex> state(m_stateLock);
+
+        VoteTable votes;
+        MatchResult probe;
+        if (!voteAll(excerpt, MatchOptions(), votes, probe, err)) return false;
+        best = votes.best().songId == excludeSongId ? votes.runnerUp() : votes.best();
+    }
+    if (best.songId < 0) return true;
+
+    out.coverage = double(best.count) / double(excerpt.size());
+    out.deltaMs = best.deltaMs;
+    PERF_VALUE("db.duplicateCoverage", out.coverage);
+    if (best.count < DUPLICATE_MIN_VOTES || out.coverage < DUPLICATE_MIN_COVERAGE) return true;
+
+    // A clip or an edit of a longer song aligns just as well: compare lengths
+    int storedMs = 0;
+    if (!songLengthMs(best.songId, storedMs, err)) return false;
+    const int slack = std::max(DUPLICATE_LENGTH_SLACK_MS,
+                               int(DUPLICATE_LENGTH_TOLERANCE * std::max(storedMs, lengthMs)));
+    if (std::abs(storedMs - lengthMs) > slack) return true;
+
+    if (!loadSong(best.songId, out.song, err)) return false;
+    out.found = true;
+    return true;
+}
+
+bool Database::setDuplicateOf(int songId, int originalId, QString* err) {
+    if (!beginWrite(err)) return false;
+
+    QSqlQuery q(m_db);
+    q.prepare("UPDATE songs SET duplicate_of=? WHERE id=?");
+    q.addBindValue(originalId);
+    q.addBindValue(songId);
+    if (!q.exec()) {
+        m_db.rollback();
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+    if (!logChange(Change::DuplicateOf, songId, QByteArray::number(originalId), err)) {
+        m_db.rollback();
+        return false;
+    }
+    return commitWrite(err);
+}
 
-        while (q.next()) {
-            int song = q.value(0).toInt();
-            int delta = q.value(1).toInt() - h.second;
-            auto key = qMakePair(song, delta);
-            votes[key] += 1;
+/// Undo everything insertSong/insertFingerprints/insertConstellation stored
+bool Database::deleteSong(int songId, QString* err) {
+    PERF_SCOPE("db.deleteSong");
+    if (!beginWrite(err)) return false;
+
+    // Postings removed per hash, for hash_stats and the cache
+    std::vector<std::pair<uint32_t,qint64>> removed;
+    QSqlQuery q(m_db);
+    q.setForwardOnly(true);
+    q.prepare("SELECT hash, COUNT(*) FROM fingerprints WHERE song_id=? GROUP BY hash");
+    q.addBindValue(songId);
+    if (!q.exec()) {
+        m_db.rollback();
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+    while (q.next()) {
+        removed.emplace_back((uint32_t)q.value(0).toULongLong(), q.value(1).toLongLong());
+    }
+    q.finish();
+
+    QSqlQuery qs(m_db);
+    qs.prepare("UPDATE hash_stats SET postings=postings-?, songs=songs-1 WHERE hash=?");
+    for (auto& r : removed) {
+        qs.addBindValue(r.second);
+        qs.addBindValue((qulonglong)r.first);
+        if (!qs.exec()) {
+            m_db.rollback();
+            if (err) *err = qs.lastError().text();
+            return false;
         }
+    }
 
-        q.finish();
-        q.bindValue(0, QVariant()); // reset binding
+    if (!q.exec("DELETE FROM hash_stats WHERE postings <= 0")) {
+        m_db.rollback();
+        if (err) *err = q.lastError().text();
+        return false;
     }
 
-    // Pick song with highest vote count
-    int bestSong = -1;
-    int bestCount = 0;
-    for (auto it = votes.constBegin(); it != votes.constEnd(); ++it) {
-        if (it.value() > bestCount) {
-            bestCount = it.value();
-            bestSong = it.key().first;
+    const char* statements[] = {
+        "DELETE FROM fingerprints WHERE song_id=?",
+        "DELETE FROM constellations WHERE song_id=?",
+        "DELETE FROM sketch_keys WHERE song_id=?",
+        "UPDATE songs SET duplicate_of=NULL WHERE duplicate_of=?",
+        "DELETE FROM songs WHERE id=?",
+    };
+    for (const char* sql : statements) {
+        q.prepare(sql);
+        q.addBindValue(songId);
+        if (!q.exec()) {
+            m_db.rollback();
+            if (err) *err = q.lastError().text();
+            return false;
         }
     }
 
-    voteCount = bestCount;
-    if (bestSong < 0) return false;
+    if (!logChange(Change::SongDelete, songId, QByteArray(), err)) {
+        m_db.rollback();
+        return false;
+    }
+    if (!commitWrite(err)) return false;
+
+    // The Bloom filter cannot forget keys; stale ones only cost a lookup
+    for (auto& r : removed) m_cache.invalidate(r.first);
+    std::unique_lock<std::shared_mutex> state(m_stateLock);
+    m_songCount = std::max<qint64>(0, m_songCount - 1);
+    return true;
+}
+
+bool Database::logChange(int op, int songId, const QByteArray& payload, QString* err) {
+    QSqlQuery q(m_db);
+    q.prepare("INSERT INTO change_log(seq,op,song_id,payload) VALUES(?,?,?,?)");
+    q.addBindValue(m_replaySeq > 0 ? QVariant(m_replaySeq) : QVariant()); // NULL: next seq
+    q.addBindValue(op);
+    q.addBindValue(songId);
+    q.addBindValue(payload);
+    if (!q.exec()) {
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+    if (m_replaySeq > 0) m_replayLogged = true;
+    return true;
+}
 
-    // Fetch song metadata
-    QSqlQuery q2(m_db);
-    q2.prepare("SELECT id,title,artist,album,year,genre FROM songs WHERE id=?");
-    q2.addBindValue(bestSong);
+bool Database::replay(qint64 seq, const std::function<bool(QString*)>& apply, QString* err) {
+    m_replaySeq = seq;
+    m_replayLogged = false;
+    const bool ok = apply(err);
+    const bool logged = m_replayLogged;
+    m_replaySeq = 0;
+    m_replayLogged = false;
 
-    if (!q2.exec() || !q2.next()) {
-        if (err) *err = q2.lastError().text();
+    if (ok && !logged) {
+        if (err) *err = QString("Change %1 was applied but not logged").arg(seq);
         return false;
     }
+    return ok;
+}
+
+bool Database::readChanges(qint64 afterSeq, int limit, std::vector<Change>& out, QString* err) {
+    out.clear();
 
-    outSong.id     = q2.value(0).toInt();
-    outSong.title  = q2.value(1).toString();
-    outSong.artist = q2.value(2).toString();
-    outSong.album  = q2.value(3).toString();
-    outSong.year   = q2.value(4).toInt();
-    outSong.genre  = q2.value(5).toString();
+    QSqlQuery q(readDb());
+    q.setForwardOnly(true);
+    q.prepare("SELECT seq, op, song_id, payload FROM change_log WHERE seq > ? ORDER BY seq LIMIT ?");
+    q.addBindValue(afterSeq);
+    q.addBindValue(std::max(limit, 1));
+    if (!q.exec()) {
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+    while (q.next()) {
+        Change c;
+        c.seq = q.value(0).toLongLong();
+        c.op = q.value(1).toInt();
+        c.songId = q.value(2).toInt();
+        c.payload = q.value(3).toByteArray();
+        out.push_back(std::move(c));
+    }
+    return true;
+}
 
+bool Database::lastChangeSeq(qint64& out, QString* err) {
+    QSqlQuery q(readDb());
+    if (!q.exec("SELECT COALESCE(MAX(seq),0) FROM change_log") || !q.next()) {
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+    out = q.value(0).toLongLong();
     return true;
-}
\ No newline at end of file
+}
+
+bool Database::pruneChanges(qint64 upToSeq, QString* err) {
+    QSqlQuery q(m_db);
+    q.prepare("DELETE FROM change_log WHERE seq <= ?");
+    q.addBindValue(upToSeq);
+    if (!q.exec()) {
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+/// Re-run findDuplicate for every stored song against all the others
+bool Database::duplicateReport(std::vector<std::pair<int,DuplicateMatch>>& out,
+                               const std::function<bool(int)>& progress,
+                               QString* err) {
+    PERF_SCOPE("db.duplicateReport");
+    out.clear();
+
+    QSqlQuery q(m_db);
+    q.setForwardOnly(true);
+    if (!q.exec("SELECT id FROM songs WHERE EXISTS"
+                "(SELECT 1 FROM fingerprints WHERE song_id=songs.id) ORDER BY id")) {
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+    std::vector<int> songIds;
+    while (q.next()) songIds.push_back(q.value(0).toInt());
+    q.finish();
+
+    QSqlQuery qf(m_db);
+    qf.setForwardOnly(true);
+    qf.prepare("SELECT hash, offset_ms FROM fingerprints WHERE song_id=?");
+
+    HashList hashes;
+    for (size_t i = 0; i < songIds.size(); ++i) {
+        const int songId = songIds[i];
+        qf.bindValue(0, songId);
+        if (!qf.exec()) {
+            if (err) *err = qf.lastError().text();
+            return false;
+        }
+        hashes.clear();
+        while (qf.next()) {
+            hashes.emplace_back((uint32_t)qf.value(0).toULongLong(), qf.value(1).toInt());
+        }
+        qf.finish();
+
+        DuplicateMatch dup;
+        if (!findDuplicate(hashes, dup, songId, err)) return false;
+        // Both songs of a pair find each other: report it from the later one
+        if (dup.found && dup.song.id < songId) out.emplace_back(songId, dup);
+
+        if (progress && !progress(int(100 * (i + 1) / songIds.size()))) return true;
+    }
+    return true;
+}
+
+/// Store a song's encoded constellation (replaces any previous one)
+bool Database::insertConstellation(int songId, const QByteArray& blob, QString* err) {
+    if (!beginWrite(err)) return false;
+
+    QSqlQuery q(m_db);
+    q.prepare("INSERT OR REPLACE INTO constellations(song_id,data) VALUES(?,?)");
+    q.addBindValue(songId);
+    q.addBindValue(blob);
+
+    if (!q.exec()) {
+        m_db.rollback();
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+    if (!logChange(Change::Constellation, songId, blob, err)) {
+        m_db.rollback();
+        return false;
+    }
+    return commitWrite(err);
+}
+
+/// Keyset-paginated read of stored constellations
+bool Database::loadConstellations(int afterSongId, int limit,
+                                  std::vector<std::pair<int,QByteArray>>& out,
+                                  QString* err) {
+    out.clear();
+
+    QSqlQuery q(m_db);
+    q.setForwardOnly(true);
+    q.prepare("SELECT song_id, data FROM constellations "
+              "WHERE song_id > ? ORDER BY song_id LIMIT ?");
+    q.addBindValue(afterSongId);
+    q.addBindValue(limit);
+
+    if (!q.exec()) {
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+    while (q.next()) {
+        out.emplace_back(q.value(0).toInt(), q.value(1).toByteArray());
+    }
+    return true;
+}
+
+/// Number of songs that can be re-indexed
+bool Database::countConstellations(qint64& out, QString* err) {
+    QSqlQuery q(m_db);
+    if (!q.exec("SELECT COUNT(*) FROM constellations") || !q.next()) {
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+    out = q.value(0).toLongLong();
+    return true;
+}
+
+/// Start regenerating fingerprints of every song that has a constellation.
+/// Runs as one transaction: indexes are dropped for fast appends and
+/// rebuilt in finishReindex(); abortReindex() restores the old table.
+bool Database::beginReindex(int scheme, const FingerprintProfile& profile, QString* err) {
+    if (!FingerprintKernels::find(scheme)) {
+        if (err) *err = QString("Unknown fingerprint scheme %1").arg(scheme);
+        return false;
+    }
+    if (!beginWrite(err)) return false;
+
+    QSqlQuery q(m_db);
+
+    // Songs without a constellation keep their hashes, which must then
+    // already be of the target scheme
+    if (scheme != m_scheme) {
+        if (!q.exec("SELECT COUNT(DISTINCT song_id) FROM fingerprints "
+                    "WHERE song_id NOT IN (SELECT song_id FROM constellations)") || !q.next()) {
+            if (err) *err = q.lastError().text();
+            m_db.rollback();
+            return false;
+        }
+        const qint64 stranded = q.value(0).toLongLong();
+        q.finish();
+        if (stranded > 0) {
+            if (err) {
+                *err = QString("%1 song(s) have no stored constellation and cannot be "
+                               "re-hashed into scheme %2; re-ingest them first")
+                           .arg(stranded).arg(scheme);
+            }
+            m_db.rollback();
+            return false;
+        }
+    }
+
+    if (!q.exec("DROP INDEX IF EXISTS idx_fp_hash") ||
+        !q.exec("DROP INDEX IF EXISTS idx_fp_song") ||
+        !q.exec("DELETE FROM fingerprints WHERE song_id IN (SELECT song_id FROM constellations)") ||
+        !q.exec("DELETE FROM sketch_keys WHERE song_id IN (SELECT song_id FROM constellations)") ||
+        !q.exec("UPDATE songs SET sketch=NULL WHERE id IN (SELECT song_id FROM constellations)")) {
+        if (err) *err = q.lastError().text();
+        m_db.rollback();
+        return false;
+    }
+
+    m_reindexInsert = QSqlQuery(m_db);
+    m_reindexInsert.prepare("INSERT INTO fingerprints(song_id,hash,offset_ms) VALUES(?,?,?)");
+    m_reindexScheme = scheme;
+    m_reindexProfile = profile;
+    return true;
+}
+
+/// Append one song's regenerated fingerprints (between begin/finishReindex)
+bool Database::appendFingerprints(int songId, const HashList& hashes, QString* err) {
+    HashList kept;
+    const HashList& stored = insertable(hashes, kept);
+
+    for (auto& h : stored) {
+        m_reindexInsert.bindValue(0, songId);
+        m_reindexInsert.bindValue(1, (qulonglong)h.first);
+        m_reindexInsert.bindValue(2, h.second);
+
+        if (!m_reindexInsert.exec()) {
+            if (err) *err = m_reindexInsert.lastError().text();
+            return false;
+        }
+    }
+    return storeSketch(songId, stored, err);
+}
+
+/// Rebuild indexes and hash_stats, then commit the re-index
+bool Database::finishReindex(QString* err) {
+    m_reindexInsert = QSqlQuery();
+
+    QSqlQuery q(m_db);
+    if (!q.exec(SQL_IDX_FP_HASH) ||
+        !q.exec(SQL_IDX_FP_SONG) ||
+        !q.exec("DELETE FROM hash_stats") ||
+        !q.exec("INSERT INTO hash_stats(hash,postings,songs) "
+                "SELECT hash, COUNT(*), COUNT(DISTINCT song_id) "
+                "FROM fingerprints GROUP BY hash")) {
+        if (err) *err = q.lastError().text();
+        m_db.rollback();
+        return false;
+    }
+
+    q.prepare("UPDATE meta SET value=? WHERE key='hash_scheme'");
+    q.addBindValue(QString::number(m_reindexScheme));
+    if (!q.exec()) {
+        if (err) *err = q.lastError().text();
+        m_db.rollback();
+        return false;
+    }
+
+    // Replicas re-run the (deterministic) re-index from their constellations
+    if (!logChange(Change::Reindex, 0, Change::encodeReindex(m_reindexScheme, m_reindexProfile), err)) {
+        m_db.rollback();
+        return false;
+    }
+
+    if (!commitWrite(err)) return false;
+
+    {
+        std::unique_lock<std::shared_mutex> state(m_stateLock);
+        m_scheme = m_reindexScheme;
+    }
+
+    // Every posting list may have changed
+    m_cache.clear();
+    return reloadStopList(m_db, err) && rebuildBloomFilter(err);
+}
+
+/// Roll back an unfinished re-index
+void Database::abortReindex() {
+    m_reindexInsert = QSqlQuery();
+    m_db.rollback();
+}
+
+/// Rebuild hash_stats from the fingerprints table
+bool Database::rebuildHashStats(QString* err) {
+    m_db.transaction();
+
+    QSqlQuery q(m_db);
+    if (!q.exec("DELETE FROM hash_stats") ||
+        !q.exec("INSERT INTO hash_stats(hash,postings,songs) "
+                "SELECT hash, COUNT(*), COUNT(DISTINCT song_id) "
+                "FROM fingerprints GROUP BY hash")) {
+        m_db.rollback();
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+
+    m_db.commit();
+    return true;
+}
+
+/// Collect index statistics from hash_stats and SQLite pragmas
+bool Database::indexStats(IndexStats& out, int topN, QString* err) {
+    out = IndexStats();
+    QSqlQuery q(m_db);
+
+    if (!q.exec("SELECT COUNT(*) FROM songs") || !q.next()) {
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+    out.songs = q.value(0).toLongLong();
+
+    if (!q.exec("SELECT COUNT(*), COALESCE(SUM(postings),0) FROM hash_stats") || !q.next()) {
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+    out.distinctHashes = q.value(0).toLongLong();
+    out.postings = q.value(1).toLongLong();
+
+    // Posting-length histogram, log2 buckets
+    if (!q.exec("SELECT postings FROM hash_stats")) {
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+    while (q.next()) {
+        qint64 n = q.value(0).toLongLong();
+        size_t bucket = 0;
+        while (n > 1) { n >>= 1; ++bucket; }
+        if (out.postingHistogram.size() <= bucket) out.postingHistogram.resize(bucket + 1, 0);
+        ++out.postingHistogram[bucket];
+    }
+
+    // Heaviest hashes
+    q.prepare("SELECT hash, postings FROM hash_stats ORDER BY postings DESC LIMIT ?");
+    q.addBindValue(topN);
+    if (!q.exec()) {
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+    while (q.next()) {
+        out.heaviest.emplace_back((uint32_t)q.value(0).toULongLong(), q.value(1).toLongLong());
+    }
+
+    // On-disk size
+    qint64 pageCount = 0, pageSize = 0;
+    if (q.exec("PRAGMA page_count") && q.next()) pageCount = q.value(0).toLongLong();
+    if (q.exec("PRAGMA page_size") && q.next()) pageSize = q.value(0).toLongLong();
+    out.fileBytes = pageCount * pageSize;
+
+    if (out.songs > 0) {
+        out.postingsPerSong = double(out.postings) / out.songs;
+        out.bytesPerSong = double(out.fileBytes) / out.songs;
+    }
+
+    return true;
+}
+
+/// Range-scan the covering index slice by slice, then the small tables
+bool Database::warmIndex(const std::function<bool(int)>& progress, QString* err) {
+    PERF_SCOPE("db.warmIndex");
+
+    QSqlQuery q(m_db);
+    q.setForwardOnly(true);
+    q.prepare("SELECT COUNT(*) FROM fingerprints INDEXED BY idx_fp_hash "
+              "WHERE hash >= ? AND hash < ?");
+
+    const qint64 span = (qint64(1) << 32) / WARM_SLICES;
+    for (int i = 0; i < WARM_SLICES; ++i) {
+        q.bindValue(0, qint64(i) * span);
+        q.bindValue(1, qint64(i + 1) * span);
+        if (!q.exec()) {
+            if (err) *err = q.lastError().text();
+            return false;
+        }
+        q.finish();
+
+        if (progress && !progress(90 * (i + 1) / WARM_SLICES)) return true;
+    }
+
+    // Selectivity lookups and song metadata
+    if (!q.exec("SELECT COUNT(*), COALESCE(SUM(postings),0) FROM hash_stats")) {
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+    q.finish();
+    if (progress && !progress(95)) return true;
+
+    if (!q.exec("SELECT COUNT(*), COALESCE(SUM(LENGTH(title) + LENGTH(artist)),0) FROM songs")) {
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+    q.finish();
+    if (progress) progress(100);
+    return true;
+}
+
+// ---- Change log payloads ----
+
+QByteArray Change::encodeSong(const SongRow& s) {
+    QJsonObject o;
+    o["title"] = s.title;
+    o["artist"] = s.artist;
+    o["album"] = s.album;
+    o["year"] = s.year;
+    o["genre"] = s.genre;
+    return QJsonDocument(o).toJson(QJsonDocument::Compact);
+}
+
+bool Change::decodeSong(const QByteArray& payload, SongRow& out) {
+    const QJsonDocument doc = QJsonDocument::fromJson(payload);
+    if (!doc.isObject()) return false;
+    const QJsonObject o = doc.object();
+    out.title = o["title"].toString("");
+    out.artist = o["artist"].toString("");
+    out.album = o["album"].toString();
+    out.year = o["year"].toInt();
+    out.genre = o["genre"].toString();
+    return true;
+}
+
+QByteArray Change::encodeReindex(int scheme, const FingerprintProfile& profile) {
+    QJsonObject o;
+    o["scheme"] = scheme;
+    o["hashesPerSec"] = profile.hashesPerSec;
+    o["fanout"] = profile.fanout;
+    o["phases"] = profile.phases;
+    return QJsonDocument(o).toJson(QJsonDocument::Compact);
+}
+
+bool Change::decodeReindex(const QByteArray& payload, int& scheme, FingerprintProfile& profile) {
+    // Entries written before profiles were recorded carry no payload
+    if (payload.isEmpty()) return true;
+
+    const QJsonDocument doc = QJsonDocument::fromJson(payload);
+    if (!doc.isObject()) return false;
+    const QJsonObject o = doc.object();
+    scheme = o["scheme"].toInt(scheme);
+    profile.hashesPerSec = o["hashesPerSec"].toDouble(profile.hashesPerSec);
+    profile.fanout = o["fanout"].toInt(profile.fanout);
+    profile.phases = o["phases"].toInt(profile.phases);
+    return true;
+}
+
+QByteArray Change::encodeHashes(const HashList& hashes) {
+    QByteArray out(qsizetype(hashes.size() * 8), '\0');
+    uint8_t* p = reinterpret_cast<uint8_t*>(out.data());
+    for (auto& h : hashes) {
+        const uint32_t offset = uint32_t(h.second);
+        for (int i = 0; i < 4; ++i) *p++ = uint8_t(h.first >> (8 * i));
+        for (int i = 0; i < 4; ++i) *p++ = uint8_t(offset >> (8 * i));
+    }
+    return out;
+}
+
+bool Change::decodeHashes(const QByteArray& payload, HashList& out) {
+    out.clear();
+    if (payload.size() % 8 != 0) return false;
+
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(payload.constData());
+    out.reserve(size_t(payload.size() / 8));
+    for (qsizetype i = 0; i < payload.size(); i += 8, p += 8) {
+        uint32_t hash = 0, offset = 0;
+        for (int b = 0; b < 4; ++b) hash |= uint32_t(p[b]) << (8 * b);
+        for (int b = 0; b < 4; ++b) offset |= uint32_t(p[4 + b]) << (8 * b);
+        out.emplace_back(hash, int(offset));
+    }
+    return true;
+}
+
+/// Format statistics as a plain-text report
+QString IndexStats::summary() const {
+    QStringList lines;
+    lines << QString("Songs: %1, postings: %2, distinct hashes: %3")
+                 .arg(songs).arg(postings).arg(distinctHashes);
+    lines << QString("File size: %1 bytes (%2 bytes/song, %3 postings/song)")
+                 .arg(fileBytes).arg(bytesPerSong, 0, 'f', 0).arg(postingsPerSong, 0, 'f', 1);
+
+    lines << "Posting length histogram:";
+    for (size_t i = 0; i < postingHistogram.size(); ++i) {
+        lines << QString("  [%1, %2): %3")
+                     .arg(qint64(1) << i).arg(qint64(1) << (i + 1)).arg(postingHistogram[i]);
+    }
+
+    lines << "Heaviest hashes:";
+    for (auto& h : heaviest) {
+        lines << QString("  0x%1: %2 postings")
+                     .arg(h.first, 8, 16, QChar('0')).arg(h.second);
+    }
+
+    return lines.join("\n");
+}
+
+/// Install a new hot-hash policy
+bool Database::setHotHashPolicy(const HotHashPolicy& policy, QString* err) {
+    // Not while syncCatalog reloads the stop-list under the old policy
+    std::lock_guard<std::mutex> sync(m_syncMutex);
+    {
+        std::unique_lock<std::shared_mutex> state(m_stateLock);
+        m_hotPolicy = policy;
+    }
+    return reloadStopList(m_db, err);
+}
+
+/// Rebuild the in-memory stop-list from hash_stats
+bool Database::reloadStopList(const QSqlDatabase& db, QString* err) {
+    HotHashPolicy policy;
+    {
+        std::shared_lock<std::shared_mutex> state(m_stateLock);
+        policy = m_hotPolicy;
+    }
+
+    QSqlQuery q(db);
+    if (!q.exec("SELECT COUNT(*) FROM songs") || !q.next()) {
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+    const qint64 songCount = q.value(0).toLongLong();
+
+    // Built aside and swapped in, so concurrent matches never see it half-filled
+    std::unordered_set<uint32_t> stopList;
+    if (policy.maxPostings <= 0 && policy.maxSongFraction <= 0) {
+        std::unique_lock<std::shared_mutex> state(m_stateLock);
+        m_songCount = songCount;
+        m_stopList.swap(stopList);
+        return true;
+    }
+
+    // Thresholds of 0 are disabled; use values no row can exceed
+    qint64 maxPostings = policy.maxPostings > 0 ? policy.maxPostings
+                                                : std::numeric_limits<qint64>::max();
+    qint64 maxSongs = policy.maxSongFraction > 0
+                          ? qint64(std::ceil(policy.maxSongFraction * songCount))
+                          : std::numeric_limits<qint64>::max();
+
+    q.prepare("SELECT hash FROM hash_stats WHERE postings > ? OR songs > ?");
+    q.addBindValue(maxPostings);
+    q.addBindValue(maxSongs);
+    if (!q.exec()) {
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+    while (q.next()) {
+        stopList.insert((uint32_t)q.value(0).toULongLong());
+    }
+
+    std::unique_lock<std::shared_mutex> state(m_stateLock);
+    m_songCount = songCount;
+    m_stopList.swap(stopList);
+    return true;
+}
+
+/// Build a fresh filter, swap it in and save it
+bool Database::rebuildBloomFilter(QString* err) {
+    BloomFilter bloom;
+    if (!buildBloomFilter(m_db, bloom, err)) return false;
+
+    {
+        std::unique_lock<std::shared_mutex> state(m_stateLock);
+        m_bloom = std::move(bloom);
+        m_bloomDirty = true;
+    }
+    return saveBloomFilter(err);
+}
+
+/// Fill a filter from hash_stats (one row per stored hash)
+bool Database::buildBloomFilter(const QSqlDatabase& db, BloomFilter& out, QString* err) const {
+    PERF_SCOPE("db.bloom.rebuild");
+
+    QSqlQuery q(db);
+    q.setForwardOnly(true);
+    if (!q.exec("SELECT COUNT(*) FROM hash_stats") || !q.next()) {
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+    const qint64 distinct = q.value(0).toLongLong();
+    q.finish();
+
+    out.reset(size_t(double(distinct) * BLOOM_HEADROOM), BLOOM_BITS_PER_KEY);
+
+    if (!q.exec("SELECT hash FROM hash_stats")) {
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+    while (q.next()) {
+        out.add((uint32_t)q.value(0).toULongLong());
+    }
+    return true;
+}
+
+/// Persist the filter together with the index state it describes
+bool Database::saveBloomFilter(QString* err) {
+    const QString path = bloomPath();
+    if (path.isEmpty()) return true;
+
+    // A filter that has not caught up with other writers lacks their
+    // hashes: it must not be stamped with their index state. The counter
+    // is read on both sides of the stamp so that no write slips between.
+    qint64 before = 0, after = 0, distinct = 0, postings = 0;
+    if (!writeToken(m_db, before, err) ||
+        !catalogStamp(m_db, distinct, postings, err) ||
+        !writeToken(m_db, after, err)) {
+        return false;
+    }
+    if (before != after || after > m_syncedToken) return true;
+
+    std::vector<uint8_t> data;
+    {
+        std::shared_lock<std::shared_mutex> state(m_stateLock);
+        if (m_bloom.empty()) return true;
+        data = m_bloom.encode(uint64_t(distinct), uint64_t(postings));
+    }
+
+    // Written aside and renamed, so a crash never leaves a torn file
+    QSaveFile f(path);
+    if (!f.open(QIODevice::WriteOnly) ||
+        f.write(reinterpret_cast<const char*>(data.data()), qint64(data.size())) != qint64(data.size()) ||
+        !f.commit()) {
+        if (err) *err = "Bloom filter: " + f.errorString();
+        return false;
+    }
+
+    std::unique_lock<std::shared_mutex> state(m_stateLock);
+    m_bloomDirty = false;
+    return true;
+}
+
+/// Reuse the saved filter unless the index changed since it was written
+bool Database::loadBloomFilter(QString* err) {
+    BloomFilter bloom;
+    bool built = false;
+    if (!readBloomFilter(m_db, bloom, built, err)) return false;
+
+    {
+        std::unique_lock<std::shared_mutex> state(m_stateLock);
+        m_bloom = std::move(bloom);
+        m_bloomDirty = built;
+    }
+    return !built || saveBloomFilter(err);
+}
+
+bool Database::readBloomFilter(const QSqlDatabase& db, BloomFilter& out, bool& built,
+                               QString* err) const {
+    built = false;
+    qint64 distinct = 0, postings = 0;
+    if (!catalogStamp(db, distinct, postings, err)) return false;
+
+    QFile f(bloomPath());
+    if (!bloomPath().isEmpty() && f.open(QIODevice::ReadOnly)) {
+        const QByteArray data = f.readAll();
+
+        uint64_t savedDistinct = 0, savedPostings = 0;
+        if (BloomFilter::decode(reinterpret_cast<const uint8_t*>(data.constData()),
+                                size_t(data.size()), out, savedDistinct, savedPostings) &&
+            savedDistinct == uint64_t(distinct) && savedPostings == uint64_t(postings)) {
+            return true;
+        }
+    }
+
+    // Missing, damaged or stale (written by another process, crash, ...)
+    built = true;
+    return buildBloomFilter(db, out, err);
+}
+
+bool Database::catalogStamp(const QSqlDatabase& db, qint64& distinct, qint64& postings,
+                            QString* err) const {
+    QSqlQuery q(db);
+    if (!q.exec("SELECT COUNT(*), COALESCE(SUM(postings),0) FROM hash_stats") || !q.next()) {
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+    distinct = q.value(0).toLongLong();
+    postings = q.value(1).toLongLong();
+    return true;
+}
+
+QString Database::bloomPath() const {
+    if (m_path.isEmpty() || m_path == ":memory:") return QString();
+    return m_path + ".bloom";
+}
+
+size_t Database::bloomFilterBytes() const {
+    std::shared_lock<std::shared_mutex> state(m_stateLock);
+    return m_bloom.bytes();
+}
+
+/// Owner connection, or the calling thread's pooled reader
+QSqlDatabase Database::readDb() const {
+    if (!m_readPool) return m_db;
+    return QSqlDatabase::database(readerName(), false);
+}
+
+QString Database::readerName() const {
+    return QString("%1_ro_%2").arg(m_connName).arg(quintptr(QThread::currentThreadId()));
+}
+
+/// Open this thread's read-only connection on first use
+bool Database::openReader(QString* err) {
+    if (!m_readPool) return true;
+
+    const QString name = readerName();
+    if (QSqlDatabase::contains(name)) {
+        if (QSqlDatabase::database(name, false).isOpen()) return true;
+
+        // Left behind by an earlier thread that got the same id
+        QSqlDatabase::removeDatabase(name);
+    }
+
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", name);
+    db.setDatabaseName(m_path);
+    db.setConnectOptions("QSQLITE_OPEN_READONLY;QSQLITE_BUSY_TIMEOUT=5000");
+    if (!db.open()) {
+        if (err) *err = db.lastError().text();
+        db = QSqlDatabase();
+        QSqlDatabase::removeDatabase(name);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_readersMutex);
+    if (std::find(m_readerNames.begin(), m_readerNames.end(), name) == m_readerNames.end()) {
+        m_readerNames.push_back(name);
+    }
+    return true;
+}
+
+/// Drop the calling thread's pooled reader
+void Database::releaseThreadConnection() {
+    const QString name = readerName();
+    if (!QSqlDatabase::contains(name)) return;
+
+    QSqlDatabase::database(name, false).close();
+    QSqlDatabase::removeDatabase(name);
+
+    std::lock_guard<std::mutex> lock(m_readersMutex);
+    m_readerNames.erase(std::remove(m_readerNames.begin(), m_readerNames.end(), name),
+                        m_readerNames.end());
+}
+
+/// Resolve a hash to its postings, consulting the LRU cache first
+bool Database::fetchPostings(QSqlQuery& q, uint32_t hash, PostingList& out, QString* err) {
+    // Not in the catalog: one cache line instead of a cache or SQLite probe
+    if (!m_bloom.mayContain(hash)) {
+        static const PostingList s_none = std::make_shared<const std::vector<Posting>>();
+        PERF_COUNT("db.bloom.negative", 1);
+        out = s_none;
+        return true;
+    }
+
+    out = m_cache.lookup(hash);
+    if (out) {
+        PERF_COUNT("db.postingCache.hit", 1);
+        return true;
+    }
+    PERF_COUNT("db.postingCache.miss", 1);
+    return readPostings(q, hash, out, err);
+}
+
+/// Cache miss: read the list from SQLite and cache it
+bool Database::readPostings(QSqlQuery& q, uint32_t hash, PostingList& out, QString* err) {
+    PERF_SCOPE("db.lookup.sqlite");
+
+    // Taken before reading, so a concurrent insertFingerprints can't leave
+    // this (possibly older) list in the cache after invalidating it
+    const uint64_t generation = m_cache.generation();
+
+    q.addBindValue((qulonglong)hash);
+
+    if (!q.exec()) {
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+
+    auto postings = std::make_shared<std::vector<Posting>>();
+    while (q.next()) {
+        postings->push_back(Posting{q.value(0).toInt(), q.value(1).toInt()});
+    }
+
+    q.finish();
+    q.bindValue(0, QVariant()); // reset binding
+
+    out = postings;
+    m_cache.insert(hash, out, generation);
+    return true;
+}
+
+/// Hot-hash filter + vote weight for a posting list of length n.
+/// Returns false if the list must be skipped under the current policy.
+/// Long lists are rejected even if the stop-list has not been reloaded
+/// since they grew. The song-fraction rule is left to the stop-list: it
+/// counts songs (hash_stats.songs), and one song may hold a hash many
+/// times, so a posting count says nothing about it.
+bool Database::postingWeight(qint64 n, double& weight) const {
+    if (n <= 0) return false;
+    if (m_hotPolicy.maxPostings > 0 && n > m_hotPolicy.maxPostings) return false;
+
+    // IDF-style weight: rare hashes count more than common ones
+    weight = m_hotPolicy.idfWeighting
+                 ? std::log(1.0 + double(std::max<qint64>(m_songCount, 1)) / n)
+                 : 1.0;
+    return true;
+}
+
+/// Load one song's metadata by ID
+bool Database::loadSong(int songId, SongRow& out, QString* err) {
+    QSqlQuery q(readDb());
+    q.prepare("SELECT id,title,artist,album,year,genre FROM songs WHERE id=?");
+    q.addBindValue(songId);
+
+    if (!q.exec() || !q.next()) {
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+
+    out.id     = q.value(0).toInt();
+    out.title  = q.value(1).toString();
+    out.artist = q.value(2).toString();
+    out.album  = q.value(3).toString();
+    out.year   = q.value(4).toInt();
+    out.genre  = q.value(5).toString();
+
+    return true;
+}
+
+/// Match fingerprints by voting mechanism
+bool Database::bestMatch(const std::vector<std::pair<uint32_t,int>>& hashes,
+                         SongRow& outSong,
+                         int& voteCount,
+                         QString* err) {
+    MatchResult r;
+    if (!match(hashes, MatchOptions(), r, err)) return false;
+
+    voteCount = r.votes;
+    if (!r.found) return false;
+
+    outSong = r.song;
+    return true;
+}
+
+/// Match one query with explicit options
+bool Database::match(const HashList& hashes,
+                     const MatchOptions& opts,
+                     MatchResult& out,
+                     QString* err) {
+    PERF_SCOPE("db.bestMatch");
+
+    out = MatchResult();
+    if (!openReader(err) || !syncCatalog(err)) return false;
+    std::shared_lock<std::shared_mutex> state(m_stateLock);
+
+    const QString schemeErr = schemeError(opts.scheme);
+    if (!schemeErr.isEmpty()) {
+        if (err) *err = schemeErr;
+        return false;
+    }
+
+    // Votes keyed by (song_id, time delta)
+    VoteTable votes;
+    bool ok = true;
+    if (opts.sketchPrefilter) {
+        ok = voteSketch(hashes, opts, votes, out, err);
+    } else if (opts.twoStage) {
+        ok = voteTwoStage(hashes, opts, votes, out, err);
+    } else if (opts.earlyTermination) {
+        std::vector<SelectiveHash> order;
+        ok = selectivityOrder(hashes, opts.deadline, order, out.incomplete, err);
+        out.hashesTotal = int(order.size());
+        if (ok) ok = voteOrdered(order, opts, votes, out, err);
+    } else {
+        ok = voteAll(hashes, opts, votes, out, err);
+    }
+    if (!ok) return false;
+    PERF_VALUE("db.hashesProbed", out.hashesProbed);
+    if (out.incomplete) PERF_COUNT("db.deadlineCut", 1);
+
+    // Song with highest (weighted) score
+    const VoteBin& best = votes.best();
+    out.votes = best.count;
+    out.score = best.score;
+    out.deltaMs = best.deltaMs;
+    if (best.songId < 0) return true;
+
+    if (!loadSong(best.songId, out.song, err)) return false;
+    out.found = true;
+
+    if (opts.topK <= 0) return true;
+    for (const VoteBin& bin : votes.top(opts.topK)) {
+        MatchCandidate c{SongRow(), bin.count, bin.score, bin.deltaMs};
+        if (bin.songId == best.songId) {
+            c.song = out.song;
+        } else if (!loadSong(bin.songId, c.song, err)) {
+            return false;
+        }
+        out.candidates.push_back(c);
+    }
+    return true;
+}
+
+/// Full vote: every posting of every query hash
+bool Database::voteAll(const HashList& hashes, const MatchOptions& opts,
+                       VoteTable& votes, MatchResult& out, QString* err) {
+    QSqlQuery q(readDb());
+    q.prepare("SELECT song_id, offset_ms FROM fingerprints WHERE hash=?");
+
+    PERF_PHASE(tLookup, "db.bestMatch.lookup");
+    PERF_PHASE(tVote, "db.bestMatch.vote");
+
+    // For each hash, look up candidates (cache first) and vote
+    out.hashesTotal = int(hashes.size());
+    for (auto& h : hashes) {
+        if (opts.deadline.expired()) {
+            out.incomplete = true;
+            break;
+        }
+        ++out.hashesProbed;
+        if (isStopListed(h.first)) continue;
+
+        PostingList postings;
+        PERF_PHASE_START(tLookup);
+        bool ok = fetchPostings(q, h.first, postings, err);
+        PERF_PHASE_STOP(tLookup);
+        if (!ok) return false;
+
+        double w = 1.0;
+        if (!postingWeight(qint64(postings->size()), w)) continue;
+
+        PERF_PHASE_START(tVote);
+        votes.vote(*postings, h.second, w);
+        PERF_PHASE_STOP(tVote);
+        PERF_COUNT("db.postingsVoted", postings->size());
+    }
+
+    return true;
+}
+
+/// Distinct query hashes present in the catalog, rarest first. Stop-listed
+/// and absent hashes are dropped here without ever fetching their postings.
+bool Database::selectivityOrder(const HashList& hashes,
+                                const Deadline& deadline,
+                                std::vector<SelectiveHash>& order,
+                                bool& incomplete,
+                                QString* err) {
+    PERF_SCOPE("db.selectivity");
+
+    // Group query offsets by hash (a hash may occur at several offsets)
+    std::unordered_map<uint32_t, size_t> index;
+    index.reserve(hashes.size());
+    order.clear();
+    for (auto& h : hashes) {
+        if (isStopListed(h.first) || !m_bloom.mayContain(h.first)) continue;
+        auto it = index.find(h.first);
+        if (it == index.end()) {
+            it = index.emplace(h.first, order.size()).first;
+            order.push_back(SelectiveHash{h.first, 0, {}, nullptr});
+        }
+        order[it->second].offsets.push_back(h.second);
+    }
+
+    // A cached list knows its length, and is kept for the vote
+    std::vector<size_t> uncached;
+    for (size_t i = 0; i < order.size(); ++i) {
+        SelectiveHash& sh = order[i];
+        sh.list = m_cache.lookup(sh.hash);
+        if (sh.list) {
+            PERF_COUNT("db.postingCache.hit", 1);
+            sh.postings = qint64(sh.list->size());
+        } else {
+            PERF_COUNT("db.postingCache.miss", 1);
+            uncached.push_back(i);
+        }
+    }
+
+    // The others' counts come from hash_stats, many hashes per statement
+    QSqlQuery qs(readDb());
+    qs.setForwardOnly(true);
+    for (size_t from = 0; from < uncached.size(); from += SELECTIVITY_BATCH) {
+        // Unranked hashes cannot be probed rarest-first: leave them out
+        if (deadline.expired()) {
+            incomplete = true;
+            break;
+        }
+
+        const size_t to = std::min(uncached.size(), from + SELECTIVITY_BATCH);
+        QStringList list;
+        for (size_t k = from; k < to; ++k) list << QString::number(order[uncached[k]].hash);
+        if (!qs.exec(QString("SELECT hash, postings FROM hash_stats WHERE hash IN (%1)")
+                         .arg(list.join(",")))) {
+            if (err) *err = qs.lastError().text();
+            return false;
+        }
+        while (qs.next()) {
+            order[index[(uint32_t)qs.value(0).toULongLong()]].postings = qs.value(1).toLongLong();
+        }
+        qs.finish();
+    }
+
+    order.erase(std::remove_if(order.begin(), order.end(),
+                               [](const SelectiveHash& sh) { return sh.postings <= 0; }),
+                order.end());
+    std::sort(order.begin(), order.end(), [](const SelectiveHash& a, const SelectiveHash& b) {
+        return a.postings != b.postings ? a.postings < b.postings : a.hash < b.hash;
+    });
+    return true;
+}
+
+/// Remaining-vote bookkeeping for statistical early termination. A hash
+/// the policy skips adds nothing; any other adds its vote weight once per
+/// query occurrence.
+Database::EarlyStop::EarlyStop(const std::vector<SelectiveHash>& order, const MatchOptions& opts,
+                               const Database& db)
+    : m_opts(opts) {
+    m_weights.reserve(order.size());
+    for (auto& sh : order) {
+        double w = 1.0;
+        if (!db.postingWeight(sh.postings, w)) w = 0.0;
+        m_weights.push_back(w * double(sh.offsets.size()));
+        m_remaining += m_weights.back();
+    }
+}
+
+void Database::EarlyStop::consume(size_t i) {
+    m_probed += m_weights[i];
+    m_remaining -= m_weights[i];
+}
+
+/// True once the leading bin cannot plausibly be overtaken.
+///
+/// Each remaining query hash occurrence adds at most its hash's weight to
+/// any bin; `remaining` is the sum of those.
+///  - Certain:  leader > runnerUp + remaining.
+///  - Likely:   the runner-up keeps gaining at its observed rate; model its
+///              further gain as Poisson(lambda) and require the leader to
+///              exceed runnerUp + lambda + z * sqrt(lambda).
+bool Database::EarlyStop::reached(const VoteTable& votes) const {
+    if (!m_opts.earlyTermination) return false;
+
+    const VoteBin& lead = votes.best();
+    if (lead.songId < 0 || lead.count < m_opts.minLeaderVotes) return false;
+    if (m_remaining <= 0) return false;
+
+    const double runner = votes.runnerUp().score;
+    if (lead.score > runner + m_remaining) return true;
+
+    const double lambda = (runner + 1.0) / std::max(m_probed, 1.0) * m_remaining;
+    return lead.score > runner + lambda + m_opts.confidenceZ * std::sqrt(lambda);
+}
+
+/// Full vote in selectivity order, stopping early when the winner is clear
+bool Database::voteOrdered(const std::vector<SelectiveHash>& order,
+                           const MatchOptions& opts,
+                           VoteTable& votes,
+                           MatchResult& out,
+                           QString* err) {
+    QSqlQuery q(readDb());
+    q.prepare("SELECT song_id, offset_ms FROM fingerprints WHERE hash=?");
+
+    EarlyStop stop(order, opts, *this);
+
+    for (size_t i = 0; i < order.size(); ++i) {
+        if (stop.reached(votes)) break;
+        if (opts.deadline.expired()) {
+            out.incomplete = true;
+            break;
+        }
+
+        out.hashesProbed = int(i + 1);
+        stop.consume(i);
+
+        PostingList postings = order[i].list;
+        if (!postings && !readPostings(q, order[i].hash, postings, err)) return false;
+
+        double w = 1.0;
+        if (!postingWeight(qint64(postings->size()), w)) continue;
+
+        for (int off : order[i].offsets) votes.vote(*postings, off, w);
+        PERF_COUNT("db.postingsVoted", postings->size());
+    }
+
+    return true;
+}
+
+/// Coarse-to-fine vote.
+///  Stage 1: probe only the most selective query hashes (shortest posting
+///           lists per hash_stats) and shortlist the best-aligned songs.
+///  Stage 2: full (song_id, delta) vote over all query hashes, fetching
+///           only postings that belong to shortlisted songs.
+bool Database::voteTwoStage(const HashList& hashes,
+                            const MatchOptions& opts,
+                            VoteTable& votes,
+                            MatchResult& out,
+                            QString* err) {
+    std::vector<SelectiveHash> order;
+    if (!selectivityOrder(hashes, opts.deadline, order, out.incomplete, err)) return false;
+    out.hashesTotal = int(order.size());
+
+    // Few enough hashes: the coarse pass would be the whole query anyway
+    const size_t probe = size_t(std::max(opts.probeHashes, 1));
+    if (order.size() <= probe) return voteOrdered(order, opts, votes, out, err);
+
+    // ---- Stage 1: selective hashes only ----
+    QSqlQuery q(readDb());
+    q.prepare("SELECT song_id, offset_ms FROM fingerprints WHERE hash=?");
+
+    VoteTable coarse;
+    std::vector<PostingList> probed(probe);
+    {
+        PERF_SCOPE("db.twoStage.coarse");
+        for (size_t i = 0; i < probe; ++i) {
+            // Out of time before the fine pass: the coarse leader is the answer
+            if (opts.deadline.expired()) {
+                out.hashesProbed = int(i);
+                out.incomplete = true;
+                votes = std::move(coarse);
+                return true;
+            }
+            probed[i] = order[i].list;
+            if (!probed[i] && !readPostings(q, order[i].hash, probed[i], err)) return false;
+
+            double w = 1.0;
+            if (!postingWeight(qint64(probed[i]->size()), w)) continue;
+            for (int off : order[i].offsets) coarse.vote(*probed[i], off, w);
+            PERF_COUNT("db.postingsVoted", probed[i]->size());
+        }
+    }
+
+    std::vector<VoteBin> shortlist = coarse.top(std::max(opts.maxCandidates, 1));
+    if (shortlist.empty()) return true;
+
+    std::vector<int> candidates;
+    for (auto& c : shortlist) candidates.push_back(c.songId);
+
+    // ---- Stage 2: full alignment vote restricted to candidates ----
+    PERF_SCOPE("db.twoStage.fine");
+    return voteCandidates(order, candidates, probed, opts, votes, out, err);
+}
+
+/// Full alignment vote over the candidate songs only
+bool Database::voteCandidates(const std::vector<SelectiveHash>& order,
+                              const std::vector<int>& candidateIds,
+                              const std::vector<PostingList>& known,
+                              const MatchOptions& opts,
+                              VoteTable& votes,
+                              MatchResult& out,
+                              QString* err) {
+    std::unordered_set<int> candidates(candidateIds.begin(), candidateIds.end());
+    QStringList ids;
+    for (int id : candidateIds) ids << QString::number(id);
+
+    // Covering idx_fp_hash turns this into one index seek per (hash, song)
+    QSqlQuery qr(readDb());
+    qr.prepare(QString("SELECT song_id, offset_ms FROM fingerprints "
+                       "WHERE hash=? AND song_id IN (%1)").arg(ids.join(",")));
+
+    EarlyStop stop(order, opts, *this);
+
+    std::vector<Posting> restricted;
+    for (size_t i = 0; i < order.size(); ++i) {
+        if (stop.reached(votes)) break;
+        if (opts.deadline.expired()) {
+            out.incomplete = true;
+            break;
+        }
+
+        const uint32_t hash = order[i].hash;
+        out.hashesProbed = int(i + 1);
+        stop.consume(i);
+
+        double w = 1.0;
+        if (!postingWeight(order[i].postings, w)) continue;
+
+        // Reuse known or cached full lists; otherwise fetch the subset
+        PostingList full = i < known.size() ? known[i] : order[i].list;
+        restricted.clear();
+        if (full) {
+            for (const Posting& p : *full) {
+                if (candidates.count(p.songId)) restricted.push_back(p);
+            }
+        } else {
+            qr.addBindValue((qulonglong)hash);
+            if (!qr.exec()) {
+                if (err) *err = qr.lastError().text();
+                return false;
+            }
+            while (qr.next()) {
+                restricted.push_back(Posting{qr.value(0).toInt(), qr.value(1).toInt()});
+            }
+            qr.finish();
+            qr.bindValue(0, QVariant()); // reset binding
+        }
+
+        for (int off : order[i].offsets) votes.vote(restricted, off, w);
+        PERF_COUNT("db.postingsVoted", restricted.size());
+    }
+
+    return true;
+}
+
+/// Shortlist by sketch keys, then vote over the shortlist only
+bool Database::voteSketch(const HashList& hashes,
+                          const MatchOptions& opts,
+                          VoteTable& votes,
+                          MatchResult& out,
+                          QString* err) {
+    std::vector<int> candidates;
+    if (!sketchCandidates(hashes, opts.sketchCandidates, candidates, err)) return false;
+
+    std::vector<SelectiveHash> order;
+    if (!selectivityOrder(hashes, opts.deadline, order, out.incomplete, err)) return false;
+    out.hashesTotal = int(order.size());
+    if (candidates.empty()) return true;
+
+    PERF_SCOPE("db.sketch.vote");
+    return voteCandidates(order, candidates, {}, opts, votes, out, err);
+}
+
+/// Rank songs by sketch keys shared with the query
+bool Database::sketchCandidates(const HashList& hashes, int limit,
+                                std::vector<int>& out, QString* err) {
+    PERF_SCOPE("db.sketch.candidates");
+    out.clear();
+
+    const std::vector<int64_t> keys = MinHashSketch::build(hashes).keys();
+    if (keys.empty()) return true;
+
+    QStringList list;
+    for (int64_t key : keys) list << QString::number(key);
+
+    QSqlQuery q(readDb());
+    q.setForwardOnly(true);
+    q.prepare(QString("SELECT song_id, COUNT(*) AS hits FROM sketch_keys WHERE key IN (%1) "
+                      "GROUP BY song_id ORDER BY hits DESC, song_id LIMIT ?").arg(list.join(",")));
+    q.addBindValue(std::max(limit, 1));
+    if (!q.exec()) {
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+    while (q.next()) out.push_back(q.value(0).toInt());
+
+    PERF_VALUE("db.sketch.shortlist", out.size());
+    return true;
+}
+
+/// Match several queries while fetching each distinct hash only once
+bool Database::bestMatchBatch(const std::vector<HashList>& queries,
+                              std::vector<MatchResult>& results,
+                              QString* err,
+                              int scheme,
+                              const Deadline& deadline,
+                              int topK) {
+    PERF_SCOPE("db.bestMatchBatch");
+
+    results.assign(queries.size(), MatchResult());
+    if (!openReader(err) || !syncCatalog(err)) return false;
+    std::shared_lock<std::shared_mutex> state(m_stateLock);
+
+    const QString schemeErr = schemeError(scheme);
+    if (!schemeErr.isEmpty()) {
+        if (err) *err = schemeErr;
+        return false;
+    }
+
+    // Union of all (hash, query, offset) occurrences, sorted by hash so that
+    // each posting list is fetched once and SQLite walks idx_fp_hash in order
+    struct Occurrence { uint32_t hash; uint32_t query; int offsetMs; };
+    std::vector<Occurrence> occ;
+    size_t total = 0;
+    for (auto& qh : queries) total += qh.size();
+    occ.reserve(total);
+
+    // Per query: distinct non-stop-listed hashes are its total; those the
+    // Bloom filter rules out are answered, so probed, right away
+    std::vector<uint32_t> distinctHashes;
+    for (size_t qi = 0; qi < queries.size(); ++qi) {
+        distinctHashes.clear();
+        for (auto& h : queries[qi]) {
+            if (isStopListed(h.first)) continue;
+            distinctHashes.push_back(h.first);
+            if (!m_bloom.mayContain(h.first)) continue;
+            occ.push_back(Occurrence{h.first, uint32_t(qi), h.second});
+        }
+        std::sort(distinctHashes.begin(), distinctHashes.end());
+        distinctHashes.erase(std::unique(distinctHashes.begin(), distinctHashes.end()),
+                             distinctHashes.end());
+
+        MatchResult& r = results[qi];
+        r.hashesTotal = int(distinctHashes.size());
+        for (uint32_t hash : distinctHashes) {
+            if (!m_bloom.mayContain(hash)) ++r.hashesProbed;
+        }
+    }
+    std::sort(occ.begin(), occ.end(), [](const Occurrence& a, const Occurrence& b) {
+        return a.hash != b.hash ? a.hash < b.hash : a.query < b.query;
+    });
+
+    // Distinct hash d occurs at occ[starts[d]] ... occ[starts[d + 1] - 1]
+    std::vector<size_t> starts;
+    for (size_t i = 0; i < occ.size(); ++i) {
+        if (i == 0 || occ[i].hash != occ[i - 1].hash) starts.push_back(i);
+    }
+    const size_t distinct = starts.size();
+    starts.push_back(occ.size());
+
+    // With pooled readers, ranges of distinct hashes are looked up by pool
+    // tasks on the caller's lane, each on its thread's reader and voting
+    // into its own tables; otherwise the connection belongs to this thread
+    // and one range covers everything
+    TaskPool& pool = TaskPool::instance();
+    size_t ranges = 1;
+    if (m_readPool) ranges = std::min(size_t(pool.threads()) + 1, distinct / BATCH_TASK_HASHES);
+    ranges = std::max<size_t>(1, ranges);
+
+    std::vector<std::vector<VoteTable>> partial(ranges);
+    std::vector<size_t> cutAt(ranges);    // first occurrence a range did not vote
+    std::vector<QString> errors(ranges);
+
+    auto lookupRange = [&](size_t r) {
+        std::vector<VoteTable>& votes = partial[r];
+        votes.resize(queries.size());
+        const size_t from = starts[distinct * r / ranges];
+        const size_t to = starts[distinct * (r + 1) / ranges];
+        cutAt[r] = to;
+
+        QString& e = errors[r];
+        if (!openReader(&e)) {
+            if (e.isEmpty()) e = "Cannot open reader";
+            return;
+        }
+        QSqlQuery q(readDb());
+        q.prepare("SELECT song_id, offset_ms FROM fingerprints WHERE hash=?");
+
+        PERF_PHASE(tLookup, "db.bestMatchBatch.lookup");
+        PERF_PHASE(tVote, "db.bestMatchBatch.vote");
+
+        // One lookup per distinct hash, postings distributed to every query using it
+        for (size_t i = from; i < to; ) {
+            // Out of time: queries with occurrences left get their leader so far
+            if (deadline.expired()) {
+                cutAt[r] = i;
+                break;
+            }
+
+            size_t j = i;
+            while (j < to && occ[j].hash == occ[i].hash) ++j;
+
+            PostingList postings;
+            PERF_PHASE_START(tLookup);
+            bool ok = fetchPostings(q, occ[i].hash, postings, &e);
+            PERF_PHASE_STOP(tLookup);
+            if (!ok) {
+                if (e.isEmpty()) e = "Posting lookup failed";
+                return;
+            }
+            PERF_COUNT("db.batch.distinctHashes", 1);
+
+            double w = 1.0;
+            if (postingWeight(qint64(postings->size()), w)) {
+                PERF_PHASE_START(tVote);
+                for (size_t k = i; k < j; ++k) {
+                    votes[occ[k].query].vote(*postings, occ[k].offsetMs, w);
+                }
+                PERF_PHASE_STOP(tVote);
+            }
+
+            i = j;
+        }
+    };
+    pool.parallelFor(TaskPool::currentLane(), ranges, lookupRange);
+    PERF_VALUE("db.batch.lookupTasks", ranges);
+
+    // Occurrences are sorted by (hash, query), so each (hash, query) pair
+    // starts a run; a run before the cut was probed, one after it was not
+    bool cut = false;
+    for (size_t r = 0; r < ranges; ++r) {
+        if (!errors[r].isEmpty()) {
+            if (err) *err = errors[r];
+            return false;
+        }
+        const size_t from = starts[distinct * r / ranges];
+        const size_t to = starts[distinct * (r + 1) / ranges];
+        for (size_t k = from; k < cutAt[r]; ++k) {
+            if (k == from || occ[k].hash != occ[k - 1].hash || occ[k].query != occ[k - 1].query) {
+                ++results[occ[k].query].hashesProbed;
+            }
+        }
+        for (size_t k = cutAt[r]; k < to; ++k) results[occ[k].query].incomplete = true;
+        cut = cut || cutAt[r] < to;
+    }
+    if (cut) PERF_COUNT("db.deadlineCut", 1);
+
+    // Per-query merge of the ranges' tables, queries spread over the pool
+    std::vector<VoteTable>& votes = partial[0];
+    if (ranges > 1) {
+        PERF_SCOPE("db.bestMatchBatch.merge");
+        pool.parallelFor(TaskPool::currentLane(), queries.size(), [&](size_t qi) {
+            for (size_t r = 1; r < ranges; ++r) votes[qi].merge(partial[r][qi]);
+        });
+    }
+
+    // Resolve winners (and candidates); several queries often hit the same song
+    std::unordered_map<int, SongRow> songs;
+    auto song = [&](int songId, const SongRow*& row) {
+        auto it = songs.find(songId);
+        if (it == songs.end()) {
+            SongRow loaded;
+            if (!loadSong(songId, loaded, err)) return false;
+            it = songs.emplace(songId, loaded).first;
+        }
+        row = &it->second;
+        return true;
+    };
+
+    for (size_t qi = 0; qi < queries.size(); ++qi) {
+        const VoteBin& best = votes[qi].best();
+        MatchResult& r = results[qi];
+        r.votes = best.count;
+        r.score = best.score;
+        r.deltaMs = best.deltaMs;
+        if (best.songId < 0) continue;
+
+        const SongRow* row = nullptr;
+        if (!song(best.songId, row)) return false;
+        r.song = *row;
+        r.found = true;
+
+        if (topK <= 0) continue;
+        for (const VoteBin& bin : votes[qi].top(topK)) {
+            if (!song(bin.songId, row)) return false;
+            r.candidates.push_back(MatchCandidate{*row, bin.count, bin.score, bin.deltaMs});
+        }
+    }
+
+    return true;
+}
+
+bool Database::writeToken(const QSqlDatabase& db, qint64& out, QString* err) const {
+    // sqlite_sequence keeps the highest seq ever handed out, even once
+    // the log has been pruned
+    QSqlQuery q(db);
+    if (!q.exec("SELECT COALESCE(MAX(seq),0) FROM sqlite_sequence WHERE name='change_log'") ||
+        !q.next()) {
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+    out = q.value(0).toLongLong();
+    return true;
+}
+
+/// Catch up with other writers: replay their change-log entries into the
+/// cache, Bloom filter and stop-list, or reload all three (and the scheme)
+bool Database::syncCatalog(QString* err) {
+    const QSqlDatabase db = readDb();
+    qint64 token = 0;
+    if (!writeToken(db, token, err)) return false;
+    if (token <= m_syncedToken) return true;
+
+    // One thread refreshes; the others wait and then find nothing left to do
+    std::lock_guard<std::mutex> lock(m_syncMutex);
+    const qint64 synced = m_syncedToken;
+    if (!writeToken(db, token, err)) return false;
+    if (token <= synced) return true;
+    PERF_SCOPE("db.catalogSync");
+
+    // Entry by entry only if the log holds all of them, they are few, and
+    // none rewrote the whole index
+    std::vector<Change> changes;
+    if (!readChanges(synced, SYNC_MAX_CHANGES + 1, changes, err)) return false;
+    bool reload = changes.empty() || changes.size() > size_t(SYNC_MAX_CHANGES) ||
+                  changes.front().seq != synced + 1;
+    std::vector<uint32_t> added;
+    bool deleted = false;
+    for (size_t i = 0; i < changes.size() && !reload; ++i) {
+        const Change& c = changes[i];
+        HashList hashes;
+        if (i > 0 && c.seq != changes[i - 1].seq + 1) {
+            reload = true;
+        } else if (c.op == Change::Reindex) {
+            reload = true;
+        } else if (c.op == Change::SongDelete) {
+            deleted = true;
+        } else if (c.op == Change::Fingerprints) {
+            if (!Change::decodeHashes(c.payload, hashes)) reload = true;
+            for (auto& h : hashes) added.push_back(h.first);
+        }
+    }
+
+    if (!reload) {
+        // A deleted song's hashes are not logged: every cached list may be stale
+        if (deleted) {
+            m_cache.clear();
+        } else {
+            for (uint32_t hash : added) m_cache.invalidate(hash);
+        }
+
+        std::unique_lock<std::shared_mutex> state(m_stateLock);
+        for (uint32_t hash : added) m_bloom.add(hash);
+        m_bloomDirty = m_bloomDirty || !added.empty();
+        reload = !m_bloom.empty() &&
+                 double(m_bloom.keyCount()) * BLOOM_MIN_BITS_PER_KEY > double(m_bloom.bits());
+        token = std::max(token, changes.back().seq);
+    }
+
+    if (reload) {
+        PERF_COUNT("db.catalogReload", 1);
+        BloomFilter bloom;
+        bool built = false;
+        int scheme = 0;
+        if (!readBloomFilter(db, bloom, built, err) || !storedScheme(db, scheme, err)) return false;
+
+        m_cache.clear();
+        std::unique_lock<std::shared_mutex> state(m_stateLock);
+        m_bloom = std::move(bloom);
+        m_bloomDirty = m_bloomDirty || built;
+        if (scheme > 0) m_scheme = scheme;
+    }
+
+    if (!reloadStopList(db, err)) return false;
+    m_syncedToken = token;
+    return true;
+}
+
+/// BEGIN IMMEDIATE takes the write lock up front: no other writer can
+/// commit between the counter read here and the one in commitWrite()
+bool Database::beginWrite(QString* err) {
+    QSqlQuery q(m_db);
+    if (!q.exec("BEGIN IMMEDIATE")) {
+        if (err) *err = q.lastError().text();
+        return false;
+    }
+    if (!writeToken(m_db, m_writeBase, err)) {
+        m_db.rollback();
+        return false;
+    }
+    return true;
+}
+
+bool Database::commitWrite(QString* err) {
+    qint64 top = 0;
+    if (!writeToken(m_db, top, err)) {
+        m_db.rollback();
+        return false;
+    }
+    if (!m_db.commit()) {
+        if (err) *err = m_db.lastError().text();
+        m_db.rollback();
+        return false;
+    }
+
+    // Only this write lies between base and top. If the state was current
+    // before it, the caller's own updates keep it current; otherwise the
+    // next syncCatalog replays this write along with the others.
+    qint64 expected = m_writeBase;
+    m_syncedToken.compare_exchange_strong(expected, top);
+    return true;
+}
@@ -1,8 +1,20 @@
 #pragma once
 #include <QString>
 #include <QSqlDatabase>
+#include <QSqlQuery>
 #include <vector>
+#include <atomic>
 #include <cstdint>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_set>
+#include "BloomFilter.h"
+#include "MinHashSketch.h"
+#include "PostingCache.h"
+#include "VoteTable.h"
+#include "fingerprint/Fingerprint.h"
+#include "util/Deadline.h"
 
 /**
  * @struct SongRow
@@ -14,33 +26,261 @@ struct SongRow {
     int year = 0;
 };
 
+/// Query fingerprints: (hash, offset_ms), as produced by Fingerprint::compute
+using HashList = std::vector<std::pair<uint32_t,int>>;
+
+/**
+ * @struct MatchCandidate
+ * @brief One song of a ranked answer (MatchResult::candidates).
+ */
+struct MatchCandidate {
+    SongRow song;
+    int votes = 0;       ///< Raw votes in the song's best (song_id, delta) bin
+    double score = 0.0;  ///< Weighted score of that bin
+    int deltaMs = 0;     ///< Its alignment
+};
+
+/**
+ * @struct MatchResult
+ * @brief Outcome of matching one query.
+ */
+struct MatchResult {
+    SongRow song;        ///< Winning song (valid if found)
+    int votes = 0;       ///< Raw votes in the winning (song_id, delta) bin
+    double score = 0.0;  ///< Weighted score of that bin (== votes unless IDF weighting)
+    int deltaMs = 0;     ///< Winning alignment: song offset minus query offset
+    bool found = false;  ///< False if no hash matched anything
+    int hashesProbed = 0; ///< Query hashes whose postings were actually examined
+    int hashesTotal = 0;  ///< Query hashes that could have been examined
+    bool incomplete = false; ///< The deadline expired first: best candidate so far
+    std::vector<MatchCandidate> candidates; ///< Best songs, best first (with a topK)
+};
+
+/**
+ * @struct Change
+ * @brief One entry of the change log (`change_log` table).
+ *
+ * Every catalog write appends one entry in the same transaction, so the
+ * log is exactly the sequence of committed changes. Replicas replay it in
+ * `seq` order (see Replica). Payloads:
+ *   - SongInsert:    songs row as compact JSON (encodeSong)
+ *   - Fingerprints:  (u32 hash, i32 offset_ms) pairs, little-endian (encodeHashes)
+ *   - Constellation: the Constellation::encode blob
+ *   - DuplicateOf:   original song id, decimal
+ *   - Reindex:       scheme and index profile of the new hashes as compact
+ *                    JSON (encodeReindex); older entries lack the scheme,
+ *                    or hold nothing
+ *   - SongDelete:    empty
+ */
+struct Change {
+    enum Op {
+        SongInsert = 1,
+        Fingerprints = 2,
+        Constellation = 3,
+        DuplicateOf = 4,
+        SongDelete = 5,
+        Reindex = 6   ///< Fingerprints regenerated from constellations
+    };
+
+    qint64 seq = 0;
+    int op = 0;
+    int songId = 0;
+    QByteArray payload;
+
+    static QByteArray encodeSong(const SongRow& s);
+    static bool decodeSong(const QByteArray& payload, SongRow& out);
+    static QByteArray encodeHashes(const HashList& hashes);
+    static bool decodeHashes(const QByteArray& payload, HashList& out);
+    static QByteArray encodeReindex(int scheme, const FingerprintProfile& profile);
+    /// Fields an older payload lacks keep the values passed in
+    static bool decodeReindex(const QByteArray& payload, int& scheme, FingerprintProfile& profile);
+};
+
+/**
+ * @struct DuplicateMatch
+ * @brief An existing song that a recording duplicates (Database::findDuplicate).
+ */
+struct DuplicateMatch {
+    bool found = false;
+    SongRow song;          ///< The song already in the catalog
+    double coverage = 0.0; ///< Share of the probed hashes aligned with it (0-1)
+    int deltaMs = 0;       ///< Alignment, as MatchResult::deltaMs
+};
+
+/// What ingest does with a recording that is already in the catalog
+enum class DuplicatePolicy {
+    Allow,  ///< No check: store it like any other song
+    Skip,   ///< Store nothing
+    Link,   ///< Store the song row only, duplicate_of set, no postings
+    Flag    ///< Store it fully with duplicate_of set, for a later cleanup
+};
+
+/**
+ * @struct MatchOptions
+ * @brief Tuning knobs for Database::match.
+ *
+ * Defaults reproduce the plain full vote used by bestMatch().
+ */
+struct MatchOptions {
+    /// Coarse-to-fine matching: shortlist songs from the most selective
+    /// hashes, then run the full alignment vote on the shortlist only
+    bool twoStage = false;
+    int probeHashes = 48;    ///< Stage 1: rarest distinct hashes probed
+    int maxCandidates = 16;  ///< Stage 1: songs kept for stage 2
+
+    /// Probe hashes rarest-first and stop once the leading (song_id, delta)
+    /// bin is statistically unbeatable given the hashes left to probe
+    bool earlyTermination = false;
+    double confidenceZ = 3.0;   ///< Safety margin, in Poisson standard deviations
+    int minLeaderVotes = 8;     ///< Never stop before the leader has this many votes
+
+    /// Sketch prefilter for very large catalogs: shortlist the songs whose
+    /// MinHash sketch shares the most keys with the query's, then run the
+    /// alignment vote on the shortlist only. Takes precedence over twoStage.
+    bool sketchPrefilter = false;
+    int sketchCandidates = 300; ///< Songs kept by the sketch prefilter
+
+    /// Fingerprint scheme the query was hashed with; a query of another
+    /// scheme than the catalog's is rejected
+    int scheme = Fingerprint::SCHEME;
+
+    /// Stop looking up and voting hashes once this expires; the result is
+    /// then the leader so far, flagged MatchResult::incomplete. Combine with
+    /// earlyTermination to probe the most selective hashes first.
+    Deadline deadline;
+
+    /// Also rank this many best songs into MatchResult::candidates (0 = none)
+    int topK = 0;
+};
+
+/**
+ * @struct IndexStats
+ * @brief Shape of the fingerprint index, produced by Database::indexStats().
+ *
+ * Posting lengths are bucketed by powers of two: bucket i counts hashes
+ * whose posting list holds [2^i, 2^(i+1)) entries.
+ */
+struct IndexStats {
+    qint64 songs = 0;            ///< Rows in `songs`
+    qint64 postings = 0;         ///< Rows in `fingerprints`
+    qint64 distinctHashes = 0;   ///< Distinct hash values
+    qint64 fileBytes = 0;        ///< SQLite file size (page_count * page_size)
+    double postingsPerSong = 0;  ///< Average fingerprints per song
+    double bytesPerSong = 0;     ///< Average file bytes per song
+    std::vector<qint64> postingHistogram;                 ///< log2 buckets
+    std::vector<std::pair<uint32_t,qint64>> heaviest;     ///< Top-N (hash, postings)
+
+    /// Human-readable multi-line report
+    QString summary() const;
+};
+
+/**
+ * @struct HotHashPolicy
+ * @brief How very common ("hot") hashes are treated.
+ *
+ * Hot hashes appear in a large fraction of songs; their posting lists
+ * dominate bestMatch cost while carrying almost no discriminative signal.
+ * Limits of 0 disable the corresponding rule.
+ */
+struct HotHashPolicy {
+    qint64 maxPostings = 0;       ///< Stop-list hashes with more postings than this
+    double maxSongFraction = 0.0; ///< Stop-list hashes present in more than this fraction of songs
+    bool idfWeighting = false;    ///< Weight votes by log(1 + songs / postings) instead of 1
+    bool applyOnInsert = false;   ///< Also drop stop-listed hashes in insertFingerprints
+};
+
 /**
  * @class Database
  * @brief SQLite wrapper for storing songs and fingerprints.
  *
  * Schema:
- *   - songs(id, title, artist, album, year, genre)
+ *   - songs(id, title, artist, album, year, genre, sketch, duplicate_of)
  *   - fingerprints(id, song_id, hash, offset_ms)
+ *   - hash_stats(hash, postings, songs)   -- per-hash posting statistics
+ *   - constellations(song_id, data)       -- encoded peaks, for re-indexing
+ *   - sketch_keys(key, song_id)           -- MinHash keys of songs.sketch, for lookup
+ *   - change_log(seq, op, song_id, payload) -- every committed write, for replicas
+ *   - meta(key, value)                    -- catalog settings: hash_scheme
+ *   - <file>.bloom                        -- Bloom filter of stored hashes (sidecar)
  *
  * Features:
  *   - Migration (auto-create schema + indexes if missing)
+ *   - Recorded fingerprint scheme: queries hashed with another scheme are
+ *     rejected, a re-index can convert the catalog to a new one
  *   - Insert new songs with metadata
  *   - Insert fingerprint hashes (transaction for efficiency)
- *   - Find best match by hash voting (song_id + time delta)
+ *   - Find best match by hash voting (song_id + time delta),
+ *     optionally coarse-to-fine over a shortlist of candidate songs
+ *   - Blocked Bloom filter of stored hashes: query hashes absent from
+ *     the catalog are dropped without any cache or SQLite lookup
+ *   - Per-song MinHash sketches as an optional candidate prefilter
+ *   - Duplicate detection (self-match of a new recording) and a
+ *     catalog-wide duplicate report
+ *   - Append-only change log of song/fingerprint writes and deletes,
+ *     replayed by read replicas (Replica)
+ *   - LRU cache of decoded posting lists in front of `fingerprints`
+ *   - Index statistics and a hot-hash stop-list / IDF weighting
+ *   - Optional read pool: concurrent matching from several threads
+ *   - Deadline-bounded matching: best candidate so far, flagged incomplete
+ *
+ * Threading: by default the object belongs to the thread that opened it.
+ * With setReadPool(true), match/bestMatch/bestMatchBatch may be called
+ * from any number of threads at once; each thread lazily opens its own
+ * named read-only SQLite connection (WAL lets readers run alongside the
+ * writer). All writes, migrations and policy changes still go through
+ * the owner's connection and must come from the owning thread. In that
+ * mode a large bestMatchBatch also spreads its lookups over TaskPool
+ * workers, whose readers stay open until the Database is destroyed.
+ *
+ * Other writers: another Database object or process may write to the
+ * same file. Before matching, the file's write counter is compared with
+ * the one the in-memory state (posting cache, stop-list, Bloom filter,
+ * scheme) was loaded at; when it moved, that state is brought up to date
+ * from the change log, or reloaded if the log cannot tell what changed.
  */
 class Database {
 public:
-    explicit Database(const QString& filePath);
+    /// @param connectionName Qt SQL connection name; a unique one is
+    ///        generated when empty, so instances never clobber each other
+    explicit Database(const QString& filePath, const QString& connectionName = QString());
+    ~Database();
+
+    Database(const Database&) = delete;
+    Database& operator=(const Database&) = delete;
 
     /// Open SQLite database connection
     bool open(QString* err=nullptr);
 
-    /// Create schema if missing, setup indexes
+    /// Create schema if missing, setup indexes. Fails if the catalog's
+    /// fingerprint scheme is not compiled into this build.
     bool migrate(QString* err=nullptr);
 
+    /// Fingerprint scheme a new catalog is created with (default:
+    /// Fingerprint::SCHEME); set before migrate(). Existing catalogs keep
+    /// theirs.
+    void setScheme(int scheme) { m_scheme = scheme; }
+
+    /// Fingerprint scheme of the stored hashes (after migrate())
+    int scheme() const {
+        std::shared_lock<std::shared_mutex> state(m_stateLock);
+        return m_scheme;
+    }
+
+    /// Scheme recorded in the file, without migrating it (0 if none is
+    /// recorded yet), e.g. for a primary read by a replica
+    bool storedScheme(int& out, QString* err=nullptr);
+
+    /// False, with the reason, if hashes of `scheme` cannot be matched
+    /// against or stored in this catalog
+    bool checkScheme(int scheme, QString* err=nullptr) const;
+
     /// Insert a new song row, returning its generated ID
+    /// (s.id > 0 keeps that ID instead, as replicas do)
     bool insertSong(const SongRow& s, int& outId, QString* err=nullptr);
 
+    /// Remove a song with its fingerprints, constellation and sketch
+    bool deleteSong(int songId, QString* err=nullptr);
+
     /// Insert fingerprint hashes for a given song (transactional)
     bool insertFingerprints(int songId,
                             const std::vector<std::pair<uint32_t,int>>& hashes,
@@ -53,6 +293,309 @@ public:
                    int& voteCount,
                    QString* err=nullptr);
 
+    /// Match one query with explicit options (two-stage matching,
+    /// selectivity-ordered early termination, ...).
+    /// Returns false only on error; `out.found` tells whether a song matched.
+    bool match(const HashList& hashes,
+               const MatchOptions& opts,
+               MatchResult& out,
+               QString* err=nullptr);
+
+    /// Match several queries at once. The union of their hashes is
+    /// deduplicated and sorted, each posting list is fetched once and
+    /// distributed to per-query vote tables. `results[i]` answers `queries[i]`.
+    /// All queries must be hashed with `scheme` (see MatchOptions::scheme).
+    /// Hashes not looked up when `deadline` expires are left out, and the
+    /// queries that had any are flagged incomplete. In read-pool mode,
+    /// ranges of hashes are looked up by pool tasks on the caller's lane
+    /// (TaskPool::currentLane) and their votes merged per query.
+    /// With `topK` > 0 each result also lists its `topK` best songs (one
+    /// bin per song), e.g. for merging the answers of several shards.
+    bool bestMatchBatch(const std::vector<HashList>& queries,
+                        std::vector<MatchResult>& results,
+                        QString* err=nullptr,
+                        int scheme = Fingerprint::SCHEME,
+                        const Deadline& deadline = Deadline(),
+                        int topK = 0);
+
+    /// Look for an existing song that `hashes` (a whole recording) repeats:
+    /// an excerpt is matched against the catalog, and the winner counts as
+    /// a duplicate if enough of the excerpt aligns with it and both
+    /// recordings have about the same length. `excludeSongId` is ignored
+    /// as a candidate (for checking songs already stored).
+    bool findDuplicate(const HashList& hashes, DuplicateMatch& out,
+                       int excludeSongId = -1, QString* err=nullptr);
+
+    /// Mark `songId` as a copy of `originalId` (songs.duplicate_of)
+    bool setDuplicateOf(int songId, int originalId, QString* err=nullptr);
+
+    /// Check every fingerprinted song against the rest of the catalog.
+    /// Each pair is reported once, as (later song id, earlier song).
+    /// `progress` gets 0-100 and may return false to stop early.
+    bool duplicateReport(std::vector<std::pair<int,DuplicateMatch>>& out,
+                         const std::function<bool(int)>& progress = {},
+                         QString* err=nullptr);
+
+    /// Change log entries with seq > afterSeq, ascending, at most `limit`
+    bool readChanges(qint64 afterSeq, int limit, std::vector<Change>& out,
+                     QString* err=nullptr);
+
+    /// Highest seq in the change log (0 if empty)
+    bool lastChangeSeq(qint64& out, QString* err=nullptr);
+
+    /// Drop log entries up to `upToSeq` once every replica has applied them
+    bool pruneChanges(qint64 upToSeq, QString* err=nullptr);
+
+    /// Run `apply` (one write: insertSong, insertFingerprints, a re-index,
+    /// ...) so that it is logged under `seq` instead of the next local seq.
+    /// Used by replicas, whose log thereby mirrors the primary's.
+    bool replay(qint64 seq, const std::function<bool(QString*)>& apply, QString* err=nullptr);
+
+    /// Store a song's encoded peak constellation (Constellation::encode)
+    bool insertConstellation(int songId, const QByteArray& blob, QString* err=nullptr);
+
+    /// Read up to `limit` constellations with song_id > afterSongId, ascending
+    bool loadConstellations(int afterSongId, int limit,
+                            std::vector<std::pair<int,QByteArray>>& out,
+                            QString* err=nullptr);
+
+    /// Number of stored constellations
+    bool countConstellations(qint64& out, QString* err=nullptr);
+
+    /// Bulk regeneration of `fingerprints` for songs with a stored
+    /// constellation (driven by Reindexer). Songs without one keep their
+    /// current fingerprints, so a re-index into another `scheme` requires
+    /// every fingerprinted song to have one. begin -> append* -> finish,
+    /// or abort. `profile` is what the hashes are made with; it is logged
+    /// so that replicas regenerate the same ones.
+    bool beginReindex(int scheme, const FingerprintProfile& profile, QString* err=nullptr);
+    bool appendFingerprints(int songId, const HashList& hashes, QString* err=nullptr);
+    bool finishReindex(QString* err=nullptr);
+    void abortReindex();
+
+    /// Recompute `hash_stats` from scratch (GROUP BY over fingerprints)
+    bool rebuildHashStats(QString* err=nullptr);
+
+    /// Gather posting-length histogram, top-N heaviest hashes and size figures
+    bool indexStats(IndexStats& out, int topN=20, QString* err=nullptr);
+
+    /// Read idx_fp_hash, hash_stats and songs once so that their pages are
+    /// in the OS cache before the first query. `progress` gets 0-100 and
+    /// may return false to stop early (not an error).
+    bool warmIndex(const std::function<bool(int)>& progress = {}, QString* err=nullptr);
+
+    /// Install a hot-hash policy and reload the stop-list from `hash_stats`
+    bool setHotHashPolicy(const HotHashPolicy& policy, QString* err=nullptr);
+    const HotHashPolicy& hotHashPolicy() const { return m_hotPolicy; }
+
+    /// Number of hashes currently stop-listed
+    size_t stopListSize() const {
+        std::shared_lock<std::shared_mutex> state(m_stateLock);
+        return m_stopList.size();
+    }
+
+    /// Rebuild the hash Bloom filter from `hash_stats` and save it
+    bool rebuildBloomFilter(QString* err=nullptr);
+
+    /// Write the Bloom filter to `<file>.bloom` (also done on destruction
+    /// if it changed)
+    bool saveBloomFilter(QString* err=nullptr);
+
+    /// Memory held by the Bloom filter (0 before migrate())
+    size_t bloomFilterBytes() const;
+
+    /// Serve matching from per-thread read-only connections (see class notes).
+    /// Set before matching starts on other threads.
+    void setReadPool(bool enabled) { m_readPool = enabled; }
+    bool readPool() const { return m_readPool; }
+
+    /// Close the calling thread's pooled reader; call before a worker exits
+    void releaseThreadConnection();
+
+    /// Posting-list cache used by bestMatch (resize, inspect counters)
+    PostingCache& postingCache() { return m_cache; }
+    const PostingCache& postingCache() const { return m_cache; }
+
 private:
+    /// Connection for read-only matching queries on the calling thread:
+    /// the owner's connection, or this thread's pooled reader
+    QSqlDatabase readDb() const;
+
+    /// Name of the calling thread's pooled reader connection
+    QString readerName() const;
+
+    /// Make sure the calling thread's reader exists and is open (read pool only)
+    bool openReader(QString* err);
+
+    /// Fetch the posting list for one hash, from cache or SQLite.
+    /// `q` must already be prepared with the posting lookup statement.
+    bool fetchPostings(QSqlQuery& q, uint32_t hash, PostingList& out, QString* err);
+
+    /// The SQLite half of fetchPostings: read and cache one posting list
+    bool readPostings(QSqlQuery& q, uint32_t hash, PostingList& out, QString* err);
+
+    /// Write counter of the file: the last change_log seq, which every
+    /// committed write advances, whichever connection or process made it
+    bool writeToken(const QSqlDatabase& db, qint64& out, QString* err) const;
+
+    /// Bring the in-memory catalog state up to date with writes made
+    /// through other connections (see class notes). One small read when
+    /// nothing changed; safe from any matching thread.
+    bool syncCatalog(QString* err);
+
+    /// Open / commit the transaction of an owner write. The write is
+    /// counted as seen by syncCatalog unless another writer got in first.
+    bool beginWrite(QString* err);
+    bool commitWrite(QString* err);
+
+    /// Plain vote over every posting of every query hash, in query order
+    bool voteAll(const HashList& hashes, const MatchOptions& opts,
+                 VoteTable& votes, MatchResult& out, QString* err);
+
+    /// A distinct query hash with its catalog posting count and query
+    /// offsets; `list` holds its postings when they were already cached
+    struct SelectiveHash {
+        uint32_t hash;
+        qint64 postings;
+        std::vector<int> offsets;
+        PostingList list;
+    };
+
+    /// Early-termination test over hashes probed in selectivity order.
+    /// Votes are counted in weight (see postingWeight), so the bounds hold
+    /// under IDF weighting too.
+    class EarlyStop {
+    public:
+        EarlyStop(const std::vector<SelectiveHash>& order, const MatchOptions& opts,
+                  const Database& db);
+        void consume(size_t i);                     ///< Mark order[i] as probed
+        bool reached(const VoteTable& votes) const; ///< Leader is safe to return
+    private:
+        const MatchOptions& m_opts;
+        std::vector<double> m_weights; ///< Most each hash of `order` can add to one bin
+        double m_probed = 0.0;
+        double m_remaining = 0.0;
+    };
+
+    /// Distinct present query hashes sorted rarest-first. Lengths come from
+    /// cached posting lists, the rest from hash_stats in batched reads.
+    /// Once `deadline` expires the hashes not yet ranked are dropped and
+    /// `incomplete` is set.
+    bool selectivityOrder(const HashList& hashes, const Deadline& deadline,
+                          std::vector<SelectiveHash>& order, bool& incomplete, QString* err);
+
+    /// Vote in selectivity order with optional early termination
+    bool voteOrdered(const std::vector<SelectiveHash>& order, const MatchOptions& opts,
+                     VoteTable& votes, MatchResult& out, QString* err);
+
+    /// Coarse-to-fine vote (see MatchOptions::twoStage)
+    bool voteTwoStage(const HashList& hashes, const MatchOptions& opts,
+                      VoteTable& votes, MatchResult& out, QString* err);
+
+    /// Alignment vote restricted to `candidates`; `known[i]`, when set, is
+    /// the full posting list of order[i] (saves a lookup)
+    bool voteCandidates(const std::vector<SelectiveHash>& order,
+                        const std::vector<int>& candidates,
+                        const std::vector<PostingList>& known,
+                        const MatchOptions& opts,
+                        VoteTable& votes, MatchResult& out, QString* err);
+
+    /// Sketch-prefiltered vote (see MatchOptions::sketchPrefilter)
+    bool voteSketch(const HashList& hashes, const MatchOptions& opts,
+                    VoteTable& votes, MatchResult& out, QString* err);
+
+    /// Songs sharing the most sketch keys with the query, best first
+    bool sketchCandidates(const HashList& hashes, int limit,
+                          std::vector<int>& out, QString* err);
+
+    /// Fold `hashes` into the song's stored sketch and refresh its keys
+    /// (inside the caller's transaction)
+    bool storeSketch(int songId, const HashList& hashes, QString* err);
+
+    /// Sketch songs indexed before sketches existed
+    bool backfillSketches(QString* err);
+
+    /// ALTER TABLE ... ADD COLUMN unless `table` already has `column`
+    bool addColumnIfMissing(const QString& table, const QString& column,
+                            const QString& type, QString* err);
+
+    /// Stored song length: largest fingerprint offset (0 without fingerprints)
+    bool songLengthMs(int songId, int& out, QString* err);
+
+    /// Read or record meta.hash_scheme and check this build knows it
+    bool loadScheme(QString* err);
+
+    /// storedScheme on a given connection
+    bool storedScheme(const QSqlDatabase& db, int& out, QString* err) const;
+
+    /// checkScheme without locking (m_stateLock held by the caller)
+    QString schemeError(int scheme) const;
+
+    /// Append to change_log inside the caller's transaction
+    bool logChange(int op, int songId, const QByteArray& payload, QString* err);
+
+    /// Apply the hot-hash policy to a posting list of length n.
+    /// Returns false if it must be skipped, otherwise sets its vote weight.
+    bool postingWeight(qint64 n, double& weight) const;
+
+    /// Load one song's metadata by ID
+    bool loadSong(int songId, SongRow& out, QString* err);
+
+    /// Reload m_stopList and m_songCount according to m_hotPolicy
+    bool reloadStopList(const QSqlDatabase& db, QString* err);
+
+    /// True if the hash must be ignored under the current policy
+    bool isStopListed(uint32_t hash) const { return m_stopList.count(hash) != 0; }
+
+    /// `hashes` as stored: without stop-listed ones if the hot-hash policy
+    /// applies on insert (then copied into `kept`), else `hashes` itself
+    const HashList& insertable(const HashList& hashes, HashList& kept) const;
+
+    /// Load `<file>.bloom` if it matches the index, else rebuild it
+    bool loadBloomFilter(QString* err);
+
+    /// The saved filter if it matches the index, else a fresh one built
+    /// from `hash_stats` (`built` set), read through `db`
+    bool readBloomFilter(const QSqlDatabase& db, BloomFilter& out, bool& built, QString* err) const;
+
+    /// Filter sized for the current catalog, filled from `hash_stats`
+    bool buildBloomFilter(const QSqlDatabase& db, BloomFilter& out, QString* err) const;
+
+    /// Distinct hashes and total postings; identifies the index state a
+    /// saved Bloom filter was built from
+    bool catalogStamp(const QSqlDatabase& db, qint64& distinct, qint64& postings,
+                      QString* err) const;
+
+    /// Sidecar file of the Bloom filter (empty for in-memory databases)
+    QString bloomPath() const;
+
+    QString m_path;      ///< SQLite file, reopened by pooled readers
+    QString m_connName;  ///< Writer connection name (readers derive theirs from it)
     QSqlDatabase m_db;
+    QSqlQuery m_reindexInsert; ///< Prepared insert reused across appendFingerprints calls
+    int m_reindexScheme = 0;   ///< Scheme of the re-index in progress
+    FingerprintProfile m_reindexProfile; ///< and its hash density
+    PostingCache m_cache; ///< hash -> decoded postings, invalidated on insert
+
+    HotHashPolicy m_hotPolicy;              ///< Active hot-hash rules
+    std::unordered_set<uint32_t> m_stopList; ///< Hashes skipped by the policy
+    qint64 m_songCount = 0;                 ///< Cached song count (IDF denominator)
+    int m_scheme = Fingerprint::SCHEME;     ///< Fingerprint scheme of the catalog
+    BloomFilter m_bloom;                    ///< Every hash in `fingerprints`
+    bool m_bloomDirty = false;              ///< Changed since last saved
+    qint64 m_replaySeq = 0;                 ///< Seq for the next logChange (0 = next local)
+    bool m_replayLogged = false;            ///< logChange used m_replaySeq
+
+    /// Guards m_hotPolicy, m_stopList, m_songCount, m_scheme, m_bloom and
+    /// m_bloomDirty: matches hold it shared, the owner (or syncCatalog)
+    /// takes it exclusively to update them
+    mutable std::shared_mutex m_stateLock;
+
+    std::atomic<qint64> m_syncedToken{-1}; ///< writeToken the in-memory state reflects
+    qint64 m_writeBase = 0;                 ///< writeToken when the open write began
+    std::mutex m_syncMutex;                 ///< One syncCatalog refresh at a time
+
+    std::atomic<bool> m_readPool{false};
+    std::mutex m_readersMutex;
+    std::vector<QString> m_readerNames; ///< Pooled readers opened so far
 };
\ No newline at end of file
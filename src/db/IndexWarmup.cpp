@@ -0,0 +1,50 @@
+#include "IndexWarmup.h"
+#include "Database.h"
+#include "perf/Perf.h"
+
+IndexWarmup::IndexWarmup(const QString& dbPath, QObject* parent)
+    : QObject(parent), m_path(dbPath) {}
+
+IndexWarmup::~IndexWarmup() {
+    m_cancel = true;
+    if (m_thread.joinable()) m_thread.join();
+}
+
+void IndexWarmup::start() {
+    if (m_thread.joinable()) return;
+    m_thread = std::thread(&IndexWarmup::run, this);
+}
+
+/// Open + migrate + warm on a private connection, then report readiness
+void IndexWarmup::run() {
+    PERF_SCOPE("startup.warmup");
+
+    QString err;
+    {
+        // Created and destroyed on this thread: a QSqlDatabase connection
+        // may only be used by the thread that added it
+        Database db(m_path);
+
+        emit progress(0, "Opening catalog");
+        if (!db.open(&err) || !db.migrate(&err)) {
+            emit finished(false, err);
+            return;
+        }
+        if (m_cancel) return;
+
+        emit progress(0, "Loading index");
+        bool ok = db.warmIndex([this](int percent) {
+            emit progress(percent, "Loading index");
+            return !m_cancel;
+        }, &err);
+
+        if (m_cancel) return;
+        if (!ok) {
+            emit finished(false, err);
+            return;
+        }
+    }
+
+    m_ready = true;
+    emit finished(true, QString());
+}
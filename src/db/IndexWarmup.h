@@ -0,0 +1,52 @@
+#pragma once
+#include <QObject>
+#include <QString>
+#include <atomic>
+#include <thread>
+
+/**
+ * @class IndexWarmup
+ * @brief Prepares the catalog on a background thread at startup.
+ *
+ * The worker opens its own connection to `dbPath`, runs migrations (which
+ * also builds or loads the Bloom filter sidecar) and then reads the hash
+ * index with Database::warmIndex, so that the UI thread's own connection
+ * opens instantly and the first recognition hits warm pages.
+ *
+ * Signals are emitted from the worker thread; connections to GUI objects
+ * are therefore queued.
+ *
+ * Typical usage:
+ *   IndexWarmup warmup("music.db");
+ *   connect(&warmup, &IndexWarmup::finished, ...);
+ *   warmup.start();
+ */
+class IndexWarmup : public QObject {
+    Q_OBJECT
+public:
+    explicit IndexWarmup(const QString& dbPath, QObject* parent=nullptr);
+
+    /// Stops the worker at its next progress step and joins it
+    ~IndexWarmup();
+
+    /// Launch the background work (once)
+    void start();
+
+    /// True once finished(true, ...) has been emitted
+    bool isReady() const { return m_ready; }
+
+    signals:
+        /// Percentage done (0-100) and the current step
+        void progress(int percent, const QString& stage);
+
+        /// Emitted once; on failure `error` says why
+        void finished(bool ok, const QString& error);
+
+private:
+    void run();
+
+    QString m_path;
+    std::thread m_thread;
+    std::atomic<bool> m_cancel{false};
+    std::atomic<bool> m_ready{false};
+};
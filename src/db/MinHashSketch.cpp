@@ -0,0 +1,96 @@
+#include "MinHashSketch.h"
+#include <algorithm>
+#include <cstring>
+
+static const uint8_t MAGIC[4] = {'M','H','S','1'};
+static constexpr size_t HEADER_BYTES = 4 + 2 + 4;
+static constexpr int HOP_MS = MinHashSketch::WINDOW_MS / 2;
+
+/// splitmix64 finalizer: one "permutation" for every bucket
+static uint64_t mix(uint32_t key) {
+    uint64_t z = uint64_t(key) + 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+/// Each hash lands in the two windows overlapping its offset
+MinHashSketch MinHashSketch::build(const std::vector<std::pair<uint32_t,int>>& hashes) {
+    MinHashSketch s;
+
+    int maxOffset = -1;
+    for (auto& h : hashes) maxOffset = std::max(maxOffset, h.second);
+    if (maxOffset < 0) return s;
+
+    s.windows = maxOffset / HOP_MS + 1;
+    s.mins.assign(size_t(s.windows) * BUCKETS, EMPTY);
+
+    for (auto& h : hashes) {
+        if (h.second < 0) continue;
+
+        const uint64_t m = mix(h.first);
+        const int bucket = int(m % BUCKETS);
+        const uint32_t value = uint32_t(m >> 32);
+
+        const int last = h.second / HOP_MS;
+        for (int w = std::max(0, last - 1); w <= last; ++w) {
+            uint32_t& slot = s.mins[size_t(w) * BUCKETS + size_t(bucket)];
+            slot = std::min(slot, value);
+        }
+    }
+    return s;
+}
+
+void MinHashSketch::merge(const MinHashSketch& other) {
+    if (other.windows > windows) {
+        mins.resize(size_t(other.windows) * BUCKETS, EMPTY);
+        windows = other.windows;
+    }
+    for (size_t i = 0; i < other.mins.size(); ++i) mins[i] = std::min(mins[i], other.mins[i]);
+}
+
+std::vector<int64_t> MinHashSketch::keys() const {
+    std::vector<int64_t> out;
+    out.reserve(mins.size());
+    for (size_t i = 0; i < mins.size(); ++i) {
+        if (mins[i] == EMPTY) continue;
+        out.push_back(int64_t(i % BUCKETS) << 32 | int64_t(mins[i]));
+    }
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+    return out;
+}
+
+std::vector<uint8_t> MinHashSketch::encode() const {
+    std::vector<uint8_t> out;
+    out.reserve(HEADER_BYTES + mins.size() * 4);
+
+    for (uint8_t c : MAGIC) out.push_back(c);
+    out.push_back(uint8_t(BUCKETS));
+    out.push_back(uint8_t(BUCKETS >> 8));
+    for (int i = 0; i < 4; ++i) out.push_back(uint8_t(uint32_t(windows) >> (8 * i)));
+
+    for (uint32_t v : mins) {
+        for (int i = 0; i < 4; ++i) out.push_back(uint8_t(v >> (8 * i)));
+    }
+    return out;
+}
+
+bool MinHashSketch::decode(const uint8_t* data, size_t size, MinHashSketch& out) {
+    if (size < HEADER_BYTES || std::memcmp(data, MAGIC, 4) != 0) return false;
+
+    const int buckets = int(data[4]) | int(data[5]) << 8;
+    uint32_t windows = 0;
+    for (int i = 0; i < 4; ++i) windows |= uint32_t(data[6 + i]) << (8 * i);
+    if (buckets != BUCKETS || size != HEADER_BYTES + size_t(windows) * BUCKETS * 4) return false;
+
+    out.windows = int(windows);
+    out.mins.resize(size_t(windows) * BUCKETS);
+
+    const uint8_t* p = data + HEADER_BYTES;
+    for (uint32_t& v : out.mins) {
+        v = uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+        p += 4;
+    }
+    return true;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/**
+ * @struct MinHashSketch
+ * @brief Per-window MinHash signature of a song's (or query's) hash set.
+ *
+ * A whole song and a few seconds of it have almost nothing in common as
+ * sets, so the signature is taken over overlapping windows of
+ * WINDOW_MS (hop WINDOW_MS/2): any query shorter than half a window lies
+ * fully inside one of the song's windows.
+ *
+ * Each window uses one-permutation hashing: a hash is mixed once, the
+ * mix picks one of BUCKETS buckets and the bucket keeps the smallest
+ * value seen. Two windows agree on a bucket with probability equal to
+ * their Jaccard similarity, so the number of shared (bucket, min) keys
+ * ranks candidate songs for a query.
+ *
+ * Binary format (little-endian), see encode/decode:
+ *   "MHS1" | u16 buckets | u32 windows | u32 mins[windows*buckets]
+ * Empty buckets hold EMPTY.
+ */
+struct MinHashSketch {
+    static constexpr int BUCKETS = 64;
+    static constexpr int WINDOW_MS = 8000;
+    static constexpr uint32_t EMPTY = 0xFFFFFFFFu;
+
+    int windows = 0;
+    std::vector<uint32_t> mins; ///< Window-major, BUCKETS per window
+
+    /// Sketch of a (hash, offset_ms) list as produced by Fingerprint::compute
+    static MinHashSketch build(const std::vector<std::pair<uint32_t,int>>& hashes);
+
+    /// Fold another sketch of the same recording in (element-wise min)
+    void merge(const MinHashSketch& other);
+
+    /// Distinct lookup keys: (bucket << 32) | min, over all windows
+    std::vector<int64_t> keys() const;
+
+    std::vector<uint8_t> encode() const;
+
+    /// Parse encode() output; false on malformed input
+    static bool decode(const uint8_t* data, size_t size, MinHashSketch& out);
+};
@@ -0,0 +1,126 @@
+#include "PostingCache.h"
+
+PostingCache::PostingCache(size_t maxBytes) : m_maxBytes(maxBytes) {}
+
+/// Bytes charged for one cached list (vector payload + list/map bookkeeping)
+size_t PostingCache::entryBytes(size_t count) {
+    return count * sizeof(Posting) + sizeof(Entry) + sizeof(std::vector<Posting>) + 64;
+}
+
+/// Lookup a hash, promoting it to most-recently-used on hit
+PostingList PostingCache::lookup(uint32_t hash) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_map.find(hash);
+    if (it == m_map.end()) {
+        ++m_misses;
+        return nullptr;
+    }
+
+    // Move entry to the front of the LRU list
+    m_lru.splice(m_lru.begin(), m_lru, it->second);
+    ++m_hits;
+    return it->second->postings;
+}
+
+/// Insert a freshly decoded posting list
+void PostingCache::insert(uint32_t hash, PostingList postings) {
+    if (!postings) return;
+
+    const size_t bytes = entryBytes(postings->size());
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    insertLocked(hash, std::move(postings), bytes);
+}
+
+/// Insert a list read at `generation`, unless it may have gone stale since
+void PostingCache::insert(uint32_t hash, PostingList postings, uint64_t generation) {
+    if (!postings) return;
+
+    const size_t bytes = entryBytes(postings->size());
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (generation != m_generation) return;
+    insertLocked(hash, std::move(postings), bytes);
+}
+
+uint64_t PostingCache::generation() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_generation;
+}
+
+/// Remove a hash whose posting list is no longer current
+void PostingCache::invalidate(uint32_t hash) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Bumped even on a miss: a reader may be fetching this hash right now
+    ++m_generation;
+
+    auto it = m_map.find(hash);
+    if (it == m_map.end()) return;
+
+    eraseLocked(it->second);
+    ++m_invalidations;
+}
+
+/// Remove everything (counters are kept)
+void PostingCache::clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_generation;
+    m_invalidations += m_lru.size();
+    m_lru.clear();
+    m_map.clear();
+    m_bytes = 0;
+}
+
+/// Adjust the byte limit
+void PostingCache::setMaxBytes(size_t maxBytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_maxBytes = maxBytes;
+    evictLocked();
+}
+
+/// Snapshot counters
+PostingCacheStats PostingCache::stats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    PostingCacheStats s;
+    s.hits = m_hits;
+    s.misses = m_misses;
+    s.evictions = m_evictions;
+    s.invalidations = m_invalidations;
+    s.entries = m_lru.size();
+    s.bytes = m_bytes;
+    s.maxBytes = m_maxBytes;
+    return s;
+}
+
+/// Drop least-recently-used entries until the byte budget is respected
+void PostingCache::evictLocked() {
+    while (m_bytes > m_maxBytes && !m_lru.empty()) {
+        eraseLocked(std::prev(m_lru.end()));
+        ++m_evictions;
+    }
+}
+
+/// Link a new entry at the front, replacing any previous one for `hash`
+void PostingCache::insertLocked(uint32_t hash, PostingList postings, size_t bytes) {
+    // A single list larger than the whole budget is never cached
+    if (bytes > m_maxBytes) return;
+
+    auto it = m_map.find(hash);
+    if (it != m_map.end()) eraseLocked(it->second);
+
+    m_lru.push_front(Entry{hash, std::move(postings), bytes});
+    m_map[hash] = m_lru.begin();
+    m_bytes += bytes;
+
+    evictLocked();
+}
+
+/// Unlink one entry from both the list and the map
+void PostingCache::eraseLocked(std::list<Entry>::iterator it) {
+    m_bytes -= it->bytes;
+    m_map.erase(it->hash);
+    m_lru.erase(it);
+}
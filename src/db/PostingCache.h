@@ -0,0 +1,108 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @struct Posting
+ * @brief One entry of a hash's posting list: where the hash occurs.
+ */
+struct Posting {
+    int songId = -1;   ///< songs.id that contains the hash
+    int offsetMs = 0;  ///< Anchor time of the hash inside that song
+};
+
+/// Immutable, shareable posting list (readers never copy the vector)
+using PostingList = std::shared_ptr<const std::vector<Posting>>;
+
+/**
+ * @struct PostingCacheStats
+ * @brief Snapshot of cache counters, for diagnostics and tuning.
+ */
+struct PostingCacheStats {
+    uint64_t hits = 0;       ///< Lookups served from memory
+    uint64_t misses = 0;     ///< Lookups that had to go to SQLite
+    uint64_t evictions = 0;  ///< Entries dropped to stay under the byte limit
+    uint64_t invalidations = 0; ///< Entries dropped because the hash was re-inserted
+    size_t entries = 0;      ///< Posting lists currently cached
+    size_t bytes = 0;        ///< Approximate memory held by cached lists
+    size_t maxBytes = 0;     ///< Configured byte limit
+};
+
+/**
+ * @class PostingCache
+ * @brief Bounded, thread-safe LRU cache of hash -> decoded posting list.
+ *
+ * Sits between Database::bestMatch and the `fingerprints` table so that
+ * hashes seen in recent queries are answered without touching SQLite.
+ *
+ * Properties:
+ *   - Size limit in bytes (approximate: postings + per-entry overhead).
+ *   - Least-recently-used eviction.
+ *   - Hit/miss/eviction counters.
+ *   - Per-hash invalidation (called by Database::insertFingerprints).
+ *   - Generation-checked inserts for readers racing with writers.
+ *
+ * All public methods take an internal mutex, so a single cache may be
+ * shared by several threads.
+ */
+class PostingCache {
+public:
+    explicit PostingCache(size_t maxBytes = 64u * 1024u * 1024u);
+
+    /// Return the cached posting list for `hash`, or nullptr on miss
+    PostingList lookup(uint32_t hash);
+
+    /// Insert (or replace) the posting list for `hash`, evicting as needed
+    void insert(uint32_t hash, PostingList postings);
+
+    /// Insert only if nothing was invalidated since generation() returned
+    /// `generation`. Readers on other threads use this so that a list read
+    /// before a concurrent write cannot be cached after its invalidation.
+    void insert(uint32_t hash, PostingList postings, uint64_t generation);
+
+    /// Counter bumped by every invalidate()/clear()
+    uint64_t generation() const;
+
+    /// Drop a single hash (its posting list changed)
+    void invalidate(uint32_t hash);
+
+    /// Drop every cached entry
+    void clear();
+
+    /// Change the byte limit (evicts immediately if shrinking)
+    void setMaxBytes(size_t maxBytes);
+
+    /// Current counters
+    PostingCacheStats stats() const;
+
+    /// Approximate memory cost of caching a list of `count` postings
+    static size_t entryBytes(size_t count);
+
+private:
+    struct Entry {
+        uint32_t hash;
+        PostingList postings;
+        size_t bytes;
+    };
+
+    void insertLocked(uint32_t hash, PostingList postings, size_t bytes);
+    void evictLocked();                    ///< Evict LRU entries until under limit
+    void eraseLocked(std::list<Entry>::iterator it);
+
+    mutable std::mutex m_mutex;
+    std::list<Entry> m_lru;                ///< Front = most recently used
+    std::unordered_map<uint32_t, std::list<Entry>::iterator> m_map;
+
+    size_t m_maxBytes;
+    size_t m_bytes = 0;
+    uint64_t m_hits = 0;
+    uint64_t m_misses = 0;
+    uint64_t m_evictions = 0;
+    uint64_t m_invalidations = 0;
+    uint64_t m_generation = 0;
+};
@@ -0,0 +1,142 @@
+#include "Reindexer.h"
+#include "fingerprint/Fingerprint.h"
+#include "perf/Perf.h"
+#include "util/TaskPool.h"
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <memory>
+
+Reindexer::Reindexer(Database& db) : m_db(db) {}
+
+HashList Reindexer::defaultScheme(const Constellation& c) {
+    return Fingerprint::hashPeaks(c, Fingerprint::indexProfile());
+}
+
+/// Constellations are all extracted by Fingerprint, so only schemes with
+/// its STFT geometry can hash them
+bool Reindexer::rehash(int schemeId, const FingerprintProfile& profile, QString* err) {
+    const FingerprintKernels* kernels = FingerprintKernels::find(schemeId);
+    if (!kernels) {
+        if (err) *err = QString("Unknown fingerprint scheme %1").arg(schemeId);
+        return false;
+    }
+    if (kernels->windowSize != Fingerprint::windowSize() || kernels->hopSize != Fingerprint::hopSize()) {
+        if (err) {
+            *err = QString("Fingerprint scheme %1 analyses audio with another STFT; "
+                           "its catalog must be built by ingesting the audio").arg(schemeId);
+        }
+        return false;
+    }
+    return runAs(schemeId, profile, [kernels, profile](const Constellation& c) {
+        return kernels->hashPeaks(c, profile);
+    }, err);
+}
+
+/// Songs are pool tasks on the Background lane (songs vary in length)
+bool Reindexer::hashBatch(const Batch& batch, const HashScheme& scheme,
+                          std::vector<HashList>& out, int& badSongId, bool& stale) const {
+    PERF_SCOPE("reindex.hashBatch");
+
+    out.assign(batch.size(), HashList());
+    std::atomic<int> bad{-1};
+    std::atomic<bool> old{false};
+
+    TaskPool::instance().parallelFor(TaskLane::Background, batch.size(), [&](size_t i) {
+        Constellation c;
+        const QByteArray& blob = batch[i].second;
+        if (!Constellation::decode(reinterpret_cast<const uint8_t*>(blob.constData()),
+                                   size_t(blob.size()), c)) {
+            bad = batch[i].first;
+            return;
+        }
+        if (c.peakFormat != Constellation::PEAK_FORMAT) {
+            old = true;
+            bad = batch[i].first;
+            return;
+        }
+        out[i] = scheme(c);
+    }, m_threads);
+
+    badSongId = bad;
+    stale = old;
+    return badSongId < 0;
+}
+
+bool Reindexer::run(const HashScheme& scheme, QString* err) {
+    return runAs(m_db.scheme(), Fingerprint::indexProfile(), scheme, err);
+}
+
+/// Run the full re-index
+bool Reindexer::runAs(int schemeId, const FingerprintProfile& profile, const HashScheme& scheme,
+                      QString* err) {
+    PERF_SCOPE("reindex.run");
+
+    // One pipeline stage: a batch of blobs and, once hashed, its fingerprints.
+    // Stages live on the heap so the pool tasks' references stay valid.
+    struct Stage {
+        Batch batch;
+        std::vector<HashList> hashed;
+        int badSongId = -1;
+        bool stale = false;
+        std::future<bool> ready;
+    };
+
+    auto startHashing = [this, &scheme](Stage* st) {
+        st->ready = TaskPool::instance().async(TaskLane::Background, [this, &scheme, st] {
+            return hashBatch(st->batch, scheme, st->hashed, st->badSongId, st->stale);
+        });
+    };
+
+    qint64 total = 0;
+    if (!m_db.countConstellations(total, err)) return false;
+    if (!m_db.beginReindex(schemeId, profile, err)) return false;
+
+    const int batchSize = std::max(1, m_batchSize);
+    qint64 done = 0;
+
+    // Prime the pipeline with the first batch
+    auto current = std::make_unique<Stage>();
+    if (!m_db.loadConstellations(0, batchSize, current->batch, err)) {
+        m_db.abortReindex();
+        return false;
+    }
+    if (!current->batch.empty()) startHashing(current.get());
+
+    while (!current->batch.empty()) {
+        // Read the next batch while the workers hash the current one
+        auto next = std::make_unique<Stage>();
+        bool readOk = m_db.loadConstellations(current->batch.back().first, batchSize,
+                                              next->batch, err);
+
+        bool hashOk = current->ready.get();
+        if (!readOk || !hashOk) {
+            if (!hashOk && err) {
+                *err = current->stale
+                           ? QString("Song #%1 has peaks from an older peak picker, which cannot be "
+                                     "re-hashed; re-ingest the catalog").arg(current->badSongId)
+                           : QString("Corrupt constellation for song #%1").arg(current->badSongId);
+            }
+            m_db.abortReindex();
+            return false;
+        }
+
+        // Hash the next batch while this thread appends the current results
+        if (!next->batch.empty()) startHashing(next.get());
+
+        for (size_t i = 0; i < current->batch.size(); ++i) {
+            if (!m_db.appendFingerprints(current->batch[i].first, current->hashed[i], err)) {
+                if (next->ready.valid()) next->ready.wait();
+                m_db.abortReindex();
+                return false;
+            }
+        }
+
+        done += qint64(current->batch.size());
+        if (m_progress) m_progress(done, total);
+
+        current = std::move(next);
+    }
+
+    return m_db.finishReindex(err);
+}
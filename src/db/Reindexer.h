@@ -0,0 +1,80 @@
+#pragma once
+#include <QString>
+#include <functional>
+#include "Database.h"
+#include "fingerprint/Constellation.h"
+#include "fingerprint/Fingerprint.h"
+
+/**
+ * @class Reindexer
+ * @brief Regenerates the `fingerprints` table from stored constellations.
+ *
+ * When the index profile, the target zone, banding or hashPair change, the catalog
+ * does not need to be re-ingested: the peaks of every song are already
+ * stored, so only the (cheap) hashing stage is re-run.
+ *
+ * Pipeline (per batch of songs):
+ *   - the calling thread reads constellation blobs from SQLite,
+ *   - TaskPool workers decode + hash them in parallel on the Background
+ *     lane, so a re-index never delays interactive matching,
+ *   - the calling thread appends the previous batch's hashes while the
+ *     workers hash the next one.
+ *
+ * The whole re-index is one transaction (see Database::beginReindex),
+ * so a failure leaves the previous fingerprints untouched. rehash() can
+ * also move the catalog to another fingerprint scheme with the same STFT
+ * geometry; the new scheme is recorded when the re-index commits.
+ *
+ * Constellations stored by an older peak picker (see
+ * Constellation::peakFormat) would give hashes that match no query, so
+ * the re-index fails on them and the catalog has to be re-ingested.
+ */
+class Reindexer {
+public:
+    /// Hash scheme: constellation -> (hash, offset_ms) list
+    using HashScheme = std::function<HashList(const Constellation&)>;
+
+    /// Progress callback: (songs done, songs total), on the calling thread
+    using Progress = std::function<void(qint64, qint64)>;
+
+    explicit Reindexer(Database& db);
+
+    /// Songs hashed at once (default: every free TaskPool worker)
+    void setThreads(int n) { m_threads = n; }
+
+    /// Songs per pipeline batch
+    void setBatchSize(int n) { m_batchSize = n; }
+
+    void setProgress(Progress cb) { m_progress = std::move(cb); }
+
+    /// Re-hash every stored constellation with `scheme` (the hashes stay
+    /// labelled with the catalog's fingerprint scheme). Replicas replay
+    /// the re-index with the catalog's kernels at the index profile, so
+    /// `scheme` must produce those hashes for them to stay identical.
+    bool run(const HashScheme& scheme, QString* err=nullptr);
+
+    /// Re-hash every stored constellation with the kernels of fingerprint
+    /// scheme `schemeId` at `profile` density
+    bool rehash(int schemeId, const FingerprintProfile& profile, QString* err=nullptr);
+
+    /// Current scheme: Fingerprint::hashPeaks with the index profile
+    static HashList defaultScheme(const Constellation& c);
+
+private:
+    using Batch = std::vector<std::pair<int,QByteArray>>;
+
+    /// The pipeline, storing hashes of fingerprint scheme `schemeId`
+    /// made at `profile` density
+    bool runAs(int schemeId, const FingerprintProfile& profile, const HashScheme& scheme,
+               QString* err);
+
+    /// Decode + hash one batch on the worker threads; false on a corrupt
+    /// blob or one of an older peak format (`stale`)
+    bool hashBatch(const Batch& batch, const HashScheme& scheme,
+                   std::vector<HashList>& out, int& badSongId, bool& stale) const;
+
+    Database& m_db;
+    int m_threads = 0;
+    int m_batchSize = 256;
+    Progress m_progress;
+};
@@ -0,0 +1,105 @@
+#include "Replica.h"
+#include "Reindexer.h"
+#include "perf/Perf.h"
+
+Replica::Replica(Database& local, const QString& primaryPath)
+    : m_db(local), m_primary(primaryPath) {}
+
+bool Replica::openPrimary(QString* err) {
+    if (!m_primaryOpen) {
+        if (!m_primary.open(err)) return false;
+        m_primaryOpen = true;
+    }
+    return true;
+}
+
+bool Replica::primaryScheme(int& out, QString* err) {
+    return openPrimary(err) && m_primary.storedScheme(out, err);
+}
+
+/// Read the primary's log in batches until it has nothing newer
+bool Replica::poll(int& applied, QString* err) {
+    PERF_SCOPE("replica.poll");
+    applied = 0;
+
+    if (!openPrimary(err)) return false;
+    if (m_position < 0 && !m_db.lastChangeSeq(m_position, err)) return false;
+
+    std::vector<Change> changes;
+    for (;;) {
+        if (!m_primary.readChanges(m_position, m_batchSize, changes, err)) return false;
+        if (changes.empty()) return true;
+
+        for (const Change& c : changes) {
+            // Seqs are never reused, so a hole means the primary pruned
+            // entries this replica had not applied yet
+            if (c.seq != m_position + 1) {
+                if (err) {
+                    *err = QString("Change log has no entry %1 (next is %2); "
+                                   "re-seed the replica from a copy of the primary")
+                               .arg(m_position + 1).arg(c.seq);
+                }
+                return false;
+            }
+            if (!apply(c, err)) return false;
+
+            m_position = c.seq;
+            ++applied;
+        }
+        PERF_COUNT("replica.applied", changes.size());
+    }
+}
+
+bool Replica::apply(const Change& c, QString* err) {
+    auto corrupt = [&c, err] {
+        if (err) *err = QString("Malformed change %1 (op %2)").arg(c.seq).arg(c.op);
+        return false;
+    };
+
+    switch (c.op) {
+    case Change::SongInsert: {
+        SongRow s;
+        if (!Change::decodeSong(c.payload, s)) return corrupt();
+        s.id = c.songId;
+        return m_db.replay(c.seq, [this, &s](QString* e) {
+            int id = -1;
+            return m_db.insertSong(s, id, e);
+        }, err);
+    }
+    case Change::Fingerprints: {
+        HashList hashes;
+        if (!Change::decodeHashes(c.payload, hashes)) return corrupt();
+        return m_db.replay(c.seq, [this, &c, &hashes](QString* e) {
+            return m_db.insertFingerprints(c.songId, hashes, e);
+        }, err);
+    }
+    case Change::Constellation:
+        return m_db.replay(c.seq, [this, &c](QString* e) {
+            return m_db.insertConstellation(c.songId, c.payload, e);
+        }, err);
+    case Change::DuplicateOf: {
+        bool ok = false;
+        const int originalId = c.payload.toInt(&ok);
+        if (!ok) return corrupt();
+        return m_db.replay(c.seq, [this, &c, originalId](QString* e) {
+            return m_db.setDuplicateOf(c.songId, originalId, e);
+        }, err);
+    }
+    case Change::SongDelete:
+        return m_db.replay(c.seq, [this, &c](QString* e) {
+            return m_db.deleteSong(c.songId, e);
+        }, err);
+    case Change::Reindex: {
+        // Older entries name no profile (or no scheme): the defaults then
+        int scheme = m_db.scheme();
+        FingerprintProfile profile = Fingerprint::indexProfile();
+        if (!Change::decodeReindex(c.payload, scheme, profile)) return corrupt();
+        return m_db.replay(c.seq, [this, scheme, profile](QString* e) {
+            Reindexer reindexer(m_db);
+            return reindexer.rehash(scheme, profile, e);
+        }, err);
+    }
+    default:
+        return corrupt();
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <QString>
+#include "Database.h"
+
+/**
+ * @class Replica
+ * @brief Keeps a read-only copy of a catalog up to date from the
+ *        primary's change log.
+ *
+ * The transport is the primary's SQLite file: the replica opens it with a
+ * connection of its own (WAL lets it read while the primary writes) and
+ * tails `change_log`. Each change is applied to the local Database in one
+ * transaction together with its log entry, under the primary's seq, so:
+ *   - the local MAX(seq) is exactly how far the replica has got, and a
+ *     crash never applies a change twice or skips one;
+ *   - a replica can itself serve as the primary of another replica;
+ *   - a plain copy of the primary's file (at any moment) is a valid
+ *     starting point, as is an empty database if the primary's log is
+ *     complete from seq 1.
+ *
+ * Re-index entries are replayed by re-running Reindexer locally on the
+ * replicated constellations, into the fingerprint scheme and at the
+ * index profile the entry names.
+ * A new replica must be created with the primary's scheme (see
+ * primaryScheme and Database::setScheme).
+ *
+ * All calls must come from the thread that owns the local Database.
+ *
+ * Typical usage:
+ *   Replica replica(localDb, "/srv/primary/music.db");
+ *   int applied = 0;
+ *   replica.poll(applied, &err);   // e.g. from a QTimer
+ */
+class Replica {
+public:
+    Replica(Database& local, const QString& primaryPath);
+
+    /// Changes applied per read of the primary's log
+    void setBatchSize(int n) { m_batchSize = n; }
+
+    /// Apply everything the primary has logged since the last call.
+    /// `applied` gets the number of changes applied.
+    bool poll(int& applied, QString* err=nullptr);
+
+    /// Seq of the last applied change (-1 before the first poll)
+    qint64 position() const { return m_position; }
+
+    /// Fingerprint scheme recorded by the primary (0 if none yet)
+    bool primaryScheme(int& out, QString* err=nullptr);
+
+private:
+    bool openPrimary(QString* err);
+
+    /// Decode one change and replay it on the local database
+    bool apply(const Change& c, QString* err);
+
+    Database& m_db;
+    Database m_primary;
+    bool m_primaryOpen = false;
+    qint64 m_position = -1;
+    int m_batchSize = 256;
+};
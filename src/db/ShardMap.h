@@ -0,0 +1,34 @@
+#pragma once
+#include <QFileInfo>
+#include <QString>
+#include <cstdint>
+
+/**
+ * @class ShardMap
+ * @brief Placement of songs in a catalog split over several databases.
+ *
+ * A song is stored on the shard picked by a stable hash of its file name
+ * (not the whole path, so copies of one file in different folders land on
+ * the same shard and duplicate detection still sees them). Shard i of
+ * "music.db" is "music.shard<i>.db" in the same directory.
+ */
+class ShardMap {
+public:
+    /// Shard of the song stored from `path` (FNV-1a of the file name)
+    static int shardOf(const QString& path, int shards) {
+        if (shards <= 1) return 0;
+        uint32_t h = 2166136261u;
+        for (char c : QFileInfo(path).fileName().toUtf8()) {
+            h = (h ^ uint8_t(c)) * 16777619u;
+        }
+        return int(h % uint32_t(shards));
+    }
+
+    /// Database file of shard `shard` of the catalog `dbPath`
+    static QString shardDatabase(const QString& dbPath, int shard) {
+        const QString suffix = QFileInfo(dbPath).suffix();
+        if (suffix.isEmpty()) return QString("%1.shard%2").arg(dbPath).arg(shard);
+        return QString("%1.shard%2.%3").arg(dbPath.left(dbPath.size() - suffix.size() - 1))
+                                       .arg(shard).arg(suffix);
+    }
+};
@@ -0,0 +1,77 @@
+#include "VoteTable.h"
+#include <algorithm>
+
+/// Accumulate one vote and keep the leading bin up to date
+void VoteTable::add(int songId, int deltaMs, double weight) {
+    addBin(songId, deltaMs, weight, 1);
+}
+
+void VoteTable::addBin(int songId, int deltaMs, double score, int count) {
+    Bin& b = m_bins[key(songId, deltaMs)];
+    b.score += score;
+    b.count += count;
+
+    VoteBin bin{songId, deltaMs, b.score, b.count};
+
+    // Scores only grow, so when another song takes the lead the previous
+    // leader is necessarily the new runner-up
+    if (songId == m_best.songId) {
+        if (bin.score > m_best.score) m_best = bin;
+    } else if (bin.score > m_best.score) {
+        m_runnerUp = m_best;
+        m_best = bin;
+    } else if (bin.score > m_runnerUp.score) {
+        m_runnerUp = bin;
+    }
+}
+
+/// Vote all postings of a hash found at `queryOffsetMs` in the query
+void VoteTable::vote(const std::vector<Posting>& postings, int queryOffsetMs, double weight) {
+    for (const Posting& p : postings) {
+        add(p.songId, p.offsetMs - queryOffsetMs, weight);
+    }
+}
+
+/// Bins add up; merged scores only grow too, so add()'s tracking holds
+void VoteTable::merge(const VoteTable& other) {
+    for (auto& kv : other.m_bins) {
+        addBin(int(uint32_t(kv.first >> 32)), int(uint32_t(kv.first)), kv.second.score,
+               kv.second.count);
+    }
+}
+
+/// Best bin per song, then the k best songs
+std::vector<VoteBin> VoteTable::top(int k) const {
+    std::unordered_map<int, VoteBin> perSong;
+    for (auto& kv : m_bins) {
+        int songId = int(uint32_t(kv.first >> 32));
+        VoteBin& v = perSong[songId];
+        if (v.songId < 0 || kv.second.score > v.score) {
+            v.songId = songId;
+            v.deltaMs = int(uint32_t(kv.first));
+            v.score = kv.second.score;
+            v.count = kv.second.count;
+        }
+    }
+
+    std::vector<VoteBin> out;
+    out.reserve(perSong.size());
+    for (auto& kv : perSong) out.push_back(kv.second);
+
+    auto byScore = [](const VoteBin& a, const VoteBin& b) {
+        return a.score != b.score ? a.score > b.score : a.songId < b.songId;
+    };
+    if (k >= 0 && size_t(k) < out.size()) {
+        std::partial_sort(out.begin(), out.begin() + k, out.end(), byScore);
+        out.resize(k);
+    } else {
+        std::sort(out.begin(), out.end(), byScore);
+    }
+    return out;
+}
+
+void VoteTable::clear() {
+    m_bins.clear();
+    m_best = VoteBin();
+    m_runnerUp = VoteBin();
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "PostingCache.h"
+
+/**
+ * @struct VoteBin
+ * @brief One (song_id, time delta) alignment bin and its accumulated votes.
+ */
+struct VoteBin {
+    int songId = -1;    ///< Candidate song (-1 = no votes yet)
+    int deltaMs = 0;    ///< Stored offset minus query offset
+    double score = 0.0; ///< Weighted votes (== count without weighting)
+    int count = 0;      ///< Raw number of matching hashes
+};
+
+/**
+ * @class VoteTable
+ * @brief Accumulates (song_id, delta) votes for one query.
+ *
+ * The leading bin and the best bin of any *other* song (runner-up) are
+ * tracked incrementally, so both are O(1) and the table never has to be
+ * rescanned after voting.
+ */
+class VoteTable {
+public:
+    /// Add `weight` to bin (songId, deltaMs)
+    void add(int songId, int deltaMs, double weight = 1.0);
+
+    /// Vote every posting of one query hash anchored at `queryOffsetMs`
+    void vote(const std::vector<Posting>& postings, int queryOffsetMs, double weight = 1.0);
+
+    /// Add every bin of `other` (votes of the same query counted elsewhere)
+    void merge(const VoteTable& other);
+
+    /// Highest-scoring bin so far (songId == -1 if empty)
+    const VoteBin& best() const { return m_best; }
+
+    /// Highest-scoring bin whose song differs from best().songId
+    const VoteBin& runnerUp() const { return m_runnerUp; }
+
+    /// Top-k bins by score, at most one per song
+    std::vector<VoteBin> top(int k) const;
+
+    size_t size() const { return m_bins.size(); }
+    bool empty() const { return m_bins.empty(); }
+    void clear();
+
+private:
+    struct Bin { double score = 0.0; int count = 0; };
+
+    /// Grow one bin and keep best/runner-up up to date
+    void addBin(int songId, int deltaMs, double score, int count);
+
+    /// Pack (songId, delta) into one 64-bit key
+    static uint64_t key(int songId, int deltaMs) {
+        return (uint64_t(uint32_t(songId)) << 32) | uint32_t(deltaMs);
+    }
+
+    std::unordered_map<uint64_t, Bin> m_bins;
+    VoteBin m_best;
+    VoteBin m_runnerUp;
+};
@@ -0,0 +1,116 @@
+#include "Constellation.h"
+#include <algorithm>
+#include <cstring>
+
+// "CST" followed by the peak format as a digit ("CST1", "CST2", ...)
+static constexpr char MAGIC[3] = {'C', 'S', 'T'};
+
+static void putU16(std::vector<uint8_t>& out, uint32_t v) {
+    out.push_back(uint8_t(v));
+    out.push_back(uint8_t(v >> 8));
+}
+
+static void putU32(std::vector<uint8_t>& out, uint32_t v) {
+    for (int i = 0; i < 4; i++) out.push_back(uint8_t(v >> (8 * i)));
+}
+
+static void putVarint(std::vector<uint8_t>& out, uint32_t v) {
+    while (v >= 0x80) {
+        out.push_back(uint8_t(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(uint8_t(v));
+}
+
+/// Bounds-checked little-endian reader
+struct Reader {
+    const uint8_t* p;
+    const uint8_t* end;
+
+    bool u16(uint32_t& v) {
+        if (end - p < 2) return false;
+        v = uint32_t(p[0]) | (uint32_t(p[1]) << 8);
+        p += 2;
+        return true;
+    }
+
+    bool u32(uint32_t& v) {
+        if (end - p < 4) return false;
+        v = uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+        p += 4;
+        return true;
+    }
+
+    bool varint(uint32_t& v) {
+        v = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            if (p == end) return false;
+            uint8_t b = *p++;
+            v |= uint32_t(b & 0x7F) << shift;
+            if (!(b & 0x80)) return true;
+        }
+        return false;
+    }
+};
+
+std::vector<uint8_t> Constellation::encode() const {
+    std::vector<uint8_t> out;
+    out.reserve(16 + peaks.size() * 8);
+
+    for (char ch : MAGIC) out.push_back(uint8_t(ch));
+    out.push_back(uint8_t('0' + peakFormat));
+    putU32(out, uint32_t(sampleRate));
+    putU16(out, uint32_t(windowSize));
+    putU16(out, uint32_t(hopSize));
+    putU32(out, uint32_t(peaks.size()));
+
+    int prevFrame = 0;
+    for (const Peak& p : peaks) {
+        putVarint(out, uint32_t(p.frame - prevFrame));
+        putVarint(out, uint32_t(p.bin));
+        prevFrame = p.frame;
+
+        // Exact bits: anchors are ranked by power, so any rounding could
+        // reorder close peaks and change the re-hashed index
+        uint32_t bits = 0;
+        std::memcpy(&bits, &p.power, sizeof bits);
+        putU32(out, bits);
+    }
+
+    return out;
+}
+
+bool Constellation::decode(const uint8_t* data, size_t size, Constellation& out) {
+    Reader r{data, data + size};
+
+    if (size < 4 || !std::equal(MAGIC, MAGIC + 3, data)) return false;
+    const int format = int(data[3]) - '0';
+    if (format < 1 || format > PEAK_FORMAT) return false;
+    r.p += 4;
+
+    uint32_t sr = 0, win = 0, hop = 0, count = 0;
+    if (!r.u32(sr) || !r.u16(win) || !r.u16(hop) || !r.u32(count)) return false;
+
+    // Each peak takes at least 6 bytes; reject counts the payload cannot hold
+    if (count > size_t(r.end - r.p) / 6) return false;
+
+    out.peakFormat = format;
+    out.sampleRate = int(sr);
+    out.windowSize = int(win);
+    out.hopSize = int(hop);
+    out.peaks.clear();
+    out.peaks.reserve(count);
+
+    int frame = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t df = 0, bin = 0, bits = 0;
+        if (!r.varint(df) || !r.varint(bin) || !r.u32(bits)) return false;
+
+        frame += int(df);
+        float power = 0.f;
+        std::memcpy(&power, &bits, sizeof power);
+        out.peaks.push_back(Peak{frame, int(bin), power});
+    }
+
+    return r.p == r.end;
+}
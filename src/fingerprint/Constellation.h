@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @struct Peak
+ * @brief One spectral peak picked by Fingerprint::extractPeaks.
+ */
+struct Peak {
+    int frame = 0;      ///< STFT frame index
+    int bin = 0;        ///< FFT bin index
+    float power = 0.f;  ///< |X[bin]|^2 of that frame
+};
+
+/**
+ * @struct Constellation
+ * @brief All peaks of one recording plus the STFT geometry they came from.
+ *
+ * This is everything the hashing stage needs, so storing it per song lets
+ * the fingerprint table be regenerated under a new hash scheme without
+ * re-reading or re-FFTing the original audio.
+ *
+ * Peaks are kept in extraction order (frame-major); hashing depends on
+ * the order of peaks inside a frame, so encode/decode preserve it.
+ *
+ * Peaks are only worth re-hashing if they came from the current peak
+ * picker: `peakFormat` records which one, and Reindexer refuses older
+ * ones (a catalog holding them must be re-ingested).
+ *
+ * Binary format (little-endian), ~6-7 bytes per peak:
+ *   "CST" + peakFormat digit | u32 sampleRate | u16 windowSize | u16 hopSize | u32 count
+ *   then per peak: varint(frame - previousFrame) | varint(bin) | u32 power
+ * where power is the float's IEEE-754 bits, so re-hashing sees exactly
+ * the powers the song was first hashed with.
+ */
+struct Constellation {
+    /// Peak picker of this build: 1 was the fixed top-5-per-frame picker,
+    /// 2 is the adaptive time-frequency picker
+    static constexpr int PEAK_FORMAT = 2;
+
+    int peakFormat = PEAK_FORMAT;
+    int sampleRate = 44100;
+    int windowSize = 0;
+    int hopSize = 0;
+    std::vector<Peak> peaks;
+
+    /// Serialize to the compact binary format
+    std::vector<uint8_t> encode() const;
+
+    /// Parse the compact binary format; false on malformed input
+    static bool decode(const uint8_t* data, size_t size, Constellation& out);
+};
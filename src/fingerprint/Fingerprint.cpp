@@ -1,20 +1,20 @@
 #include "Fingerprint.h"
 #include "FFT.h"
+#include "perf/Perf.h"
+#include "util/TaskPool.h"
 #include <algorithm>
 #include <cmath>
+#include <cstdlib>
+#include <limits>
 
 #if USE_OPENCL
 #include "OpenCLAccel.h"     // for GPU-based acceleration
 static OpenCLAccel g_opencl; // Global/shared OpenCL accelerator
 #endif
 
-// ---- Parameters tuned for 44.1 kHz audio ----
-static constexpr int WINDOW_SIZE   = 2048;   // ~46 ms
-static constexpr int HOP_SIZE      = 1024;   // 50% overlap
-static constexpr int TOP_PEAKS     = 5;      // strongest peaks per frame
-static constexpr int FANOUT        = 5;      // max target pairs per anchor
-static constexpr int TARGET_DT_MIN = 1;      // frames (min lookahead)
-static constexpr int TARGET_DT_MAX = 20;     // frames (~1s lookahead)
+// ---- Silence gate (frame RMS in int16 units, hysteresis) ----
+static constexpr int GATE_OPEN_RMS  = 32;   // ~-60 dBFS: analysis starts
+static constexpr int GATE_CLOSE_RMS = 16;   // ~-66 dBFS: analysis stops
 
 // Map FFT bin index to a coarse frequency band (logarithmic-ish)
 static int freqToBand(int bin, int fftSize, int sr) {
@@ -29,44 +29,178 @@ static int freqToBand(int bin, int fftSize, int sr) {
 }
 
 /// Encode two frequency bins and time delta into a 32-bit hash
-uint32_t Fingerprint::hashPair(int f1, int f2, int dt) {
-    // Pack bits: f1(10) | f2(10) | dt(12)
-    if (f1 > 1023) f1 = 1023;
-    if (f2 > 1023) f2 = 1023;
-    if (dt > 4095) dt = 4095;
-
-    return (uint32_t)((f1 & 0x3FF) << 22) |
-           ((f2 & 0x3FF) << 12) |
-           (dt & 0xFFF);
+template <class S>
+uint32_t BasicFingerprint<S>::hashPair(int f1, int f2, int dt) {
+    // Pack bits: f1(F_BITS) | f2(F_BITS) | dt(DT_BITS)
+    static_assert(2 * S::F_BITS + S::DT_BITS == 32, "hash layout fills 32 bits");
+    constexpr int fMax = (1 << S::F_BITS) - 1;
+    constexpr int dtMax = (1 << S::DT_BITS) - 1;
+    if (f1 > fMax) f1 = fMax;
+    if (f2 > fMax) f2 = fMax;
+    if (dt > dtMax) dt = dtMax;
+
+    return (uint32_t(f1 & fMax) << (S::F_BITS + S::DT_BITS)) |
+           (uint32_t(f2 & fMax) << S::DT_BITS) |
+           uint32_t(dt & dtMax);
+}
+
+template <class S>
+FingerprintProfile BasicFingerprint<S>::indexProfile() {
+    return FingerprintProfile();
+}
+
+template <class S>
+FingerprintProfile BasicFingerprint<S>::queryProfile() {
+    FingerprintProfile p;
+    p.hashesPerSec = 480.0;
+    p.fanout = 10;
+    p.phases = 2;
+    return p;
+}
+
+/// Compute audio fingerprints, one pass per phase
+template <class S>
+std::vector<std::pair<uint32_t,int>> BasicFingerprint<S>::compute(const std::vector<int16_t>& pcm, int sr,
+                                                                  const FingerprintProfile& profile,
+                                                                  const Deadline& deadline,
+                                                                  bool* incomplete) {
+    PERF_SCOPE("fingerprint.compute");
+
+    // Pass p starts p/phases of a hop into the signal; its offsets are
+    // shifted back so that every pass is timed from the first sample.
+    // Passes run as pool tasks on the caller's lane and are concatenated
+    // in phase order, so the result does not depend on scheduling; under
+    // a deadline each pass keeps what it extracted in time.
+    const int phases = std::max(1, std::min(profile.phases, S::HOP_SIZE));
+    std::vector<std::vector<std::pair<uint32_t,int>>> passes(static_cast<size_t>(phases));
+    std::vector<char> cuts(static_cast<size_t>(phases), 0);
+    TaskPool::instance().parallelFor(TaskPool::currentLane(), size_t(phases), [&](size_t p) {
+        const size_t shift = p * S::HOP_SIZE / size_t(phases);
+        if (shift >= pcm.size()) return;
+        if (deadline.expired()) {
+            cuts[p] = 1;
+            return;
+        }
+
+        const Constellation c = extractPeaks(pcm.data() + shift, pcm.size() - shift, sr, 0,
+                                             nullptr, deadline);
+        cuts[p] = deadline.expired(); // expiry is final, so this catches an STFT that stopped early
+        passes[p] = hashPeaks(c, profile);
+        const int shiftMs = int(shift * 1000 / size_t(sr));
+        if (shiftMs != 0) {
+            for (auto& h : passes[p]) h.second += shiftMs;
+        }
+    });
+
+    std::vector<std::pair<uint32_t,int>> hashes = std::move(passes[0]);
+    bool cut = cuts[0] != 0;
+    for (size_t p = 1; p < passes.size(); ++p) {
+        hashes.insert(hashes.end(), passes[p].begin(), passes[p].end());
+        cut = cut || cuts[p] != 0;
+    }
+    if (cut) PERF_COUNT("fingerprint.deadlineCut", 1);
+    if (incomplete) *incomplete = cut;
+    PERF_VALUE("fingerprint.hashesPerSec", hashesPerSecond(hashes.size(), pcm.size(), sr));
+    return hashes;
+}
+
+template <class S>
+double BasicFingerprint<S>::hashesPerSecond(size_t hashes, size_t samples, int sr) {
+    if (samples == 0 || sr <= 0) return 0.0;
+    return double(hashes) * sr / double(samples);
 }
 
-/// Compute audio fingerprints
-std::vector<std::pair<uint32_t,int>> Fingerprint::compute(const std::vector<int16_t>& pcm, int sr) {
-    const int N = (int)pcm.size();
-    if (N < WINDOW_SIZE) return {};
+/// Stages 1-3: STFT and per-frame peak picking
+template <class S>
+Constellation BasicFingerprint<S>::extractPeaks(const std::vector<int16_t>& pcm, int sr) {
+    return extractPeaks(pcm.data(), pcm.size(), sr, 0);
+}
+
+/// Stages 1-3 over a frame-aligned slice
+template <class S>
+Constellation BasicFingerprint<S>::extractPeaks(const int16_t* pcm, size_t n, int sr, int firstFrame,
+                                                Gate* gate, const Deadline& deadline) {
+    constexpr int WINDOW_SIZE = S::WINDOW_SIZE;
+    constexpr int HOP_SIZE = S::HOP_SIZE;
+    constexpr int MIN_BIN = S::MIN_BIN;
+    static_assert(WINDOW_SIZE % HOP_SIZE == 0, "gate sums whole hop blocks");
+
+    Constellation c;
+    c.sampleRate = sr;
+    c.windowSize = WINDOW_SIZE;
+    c.hopSize = HOP_SIZE;
+
+    const int N = (int)n;
+    if (N < WINDOW_SIZE) return c;
+
+    // Per-phase time, accumulated over all frames
+    PERF_PHASE(tWindow, "fingerprint.window");
+    PERF_PHASE(tFft,    "fingerprint.fft");
+    PERF_PHASE(tPower,  "fingerprint.power");
+    PERF_PHASE(tPeaks,  "fingerprint.peaks");
+    PERF_PHASE(tGate,   "fingerprint.gate");
+
+    // ---- Frame energies, exact in int64: frames overlap by whole hop
+    // blocks, so each sample is squared once ----
+    PERF_PHASE_START(tGate);
+    const int blocksPerFrame = WINDOW_SIZE / HOP_SIZE;
+    const int frames = (N - WINDOW_SIZE) / HOP_SIZE + 1;
+    std::vector<int64_t> blockEnergy(size_t(frames + blocksPerFrame - 1), 0);
+    for (size_t b = 0; b < blockEnergy.size(); ++b) {
+        const int16_t* s = pcm + b * HOP_SIZE;
+        int64_t e = 0;
+        for (int i = 0; i < HOP_SIZE; ++i) e += int32_t(s[i]) * s[i];
+        blockEnergy[b] = e;
+    }
+    PERF_PHASE_STOP(tGate);
+
+    const int64_t openEnergy = int64_t(GATE_OPEN_RMS) * GATE_OPEN_RMS * WINDOW_SIZE;
+    const int64_t closeEnergy = int64_t(GATE_CLOSE_RMS) * GATE_CLOSE_RMS * WINDOW_SIZE;
+    Gate localGate;
+    Gate& g = gate ? *gate : localGate;
+    int gated = 0;
 
     // Precompute Hann window
     std::vector<double> window(WINDOW_SIZE);
     miniFFT::hannWindow(window);
 
-    std::vector<std::pair<int,int>> peaksPerFrame; // (bin, frameIdx)
-    peaksPerFrame.reserve(N / HOP_SIZE * TOP_PEAKS);
+    c.peaks.reserve(N / HOP_SIZE * 4);
 
     std::vector<miniFFT::cpx> buf(WINDOW_SIZE);
     std::vector<double> mag(WINDOW_SIZE/2);
+    std::vector<std::pair<double,int>> bins;
+    bins.reserve(WINDOW_SIZE/2);
 
-    int frameIdx = 0;
+    int frameIdx = firstFrame;
     for (int start = 0; start + WINDOW_SIZE <= N; start += HOP_SIZE, ++frameIdx) {
+        // ---- Silence gate ----
+        const int f = frameIdx - firstFrame;
+        int64_t energy = 0;
+        for (int b = 0; b < blocksPerFrame; ++b) energy += blockEnergy[size_t(f + b)];
+        g.open = energy >= (g.open ? closeEnergy : openEnergy);
+        if (!g.open) {
+            ++gated;
+            continue;
+        }
+
+        // Out of time: the peaks so far are the result
+        if (deadline.expired()) break;
+
         // ---- Windowed frame ----
+        PERF_PHASE_START(tWindow);
         for (int i = 0; i < WINDOW_SIZE; i++) {
             double s = pcm[start+i] / 32768.0; // normalize
             buf[i] = miniFFT::cpx(s * window[i], 0.0);
         }
+        PERF_PHASE_STOP(tWindow);
 
         // ---- FFT ----
+        PERF_PHASE_START(tFft);
         miniFFT::fft(buf);
+        PERF_PHASE_STOP(tFft);
 
         // ---- Magnitude and power spectrum (GPU first, CPU fallback) ----
+        PERF_PHASE_START(tPower);
         bool usedGPU = false;
         #if USE_OPENCL
         if (g_opencl.ok()) {
@@ -94,65 +228,196 @@ std::vector<std::pair<uint32_t,int>> Fingerprint::compute(const std::vector<int1
                 mag[k] = std::norm(buf[k]); // CPU-accelerated power spectrum
             }
         }
+        PERF_PHASE_STOP(tPower);
 
         // ---- Peak selection ----
-        std::vector<std::pair<double,int>> bins;
-        bins.reserve(WINDOW_SIZE/2);
-        for (int k = 5; k < WINDOW_SIZE/2; k++) {
-            bins.emplace_back(mag[k], k);
-        }
+        PERF_PHASE_START(tPeaks);
+        double mean = 0.0;
+        for (int k = MIN_BIN; k < WINDOW_SIZE/2; k++) mean += mag[k];
+        mean /= double(WINDOW_SIZE/2 - MIN_BIN);
+        const double threshold = std::max(S::PEAK_ABS_FLOOR, mean * S::PEAK_REL_THRESHOLD);
 
-        // Keep top-N strongest bins
-        std::nth_element(bins.begin(),
-                         bins.begin() + std::min(TOP_PEAKS, (int)bins.size()),
-                         bins.end(),
-                         [](auto& a, auto& b){ return a.first > b.first; });
+        // Spectral local maxima above the threshold (ties go to the lower bin)
+        bins.clear();
+        for (int k = MIN_BIN; k < WINDOW_SIZE/2; k++) {
+            if (mag[k] < threshold) continue;
+
+            const int lo = std::max(MIN_BIN, k - S::PEAK_FREQ_NBHD);
+            const int hi = std::min(WINDOW_SIZE/2 - 1, k + S::PEAK_FREQ_NBHD);
+            bool isMax = true;
+            for (int j = lo; j <= hi && isMax; j++) {
+                if (j < k) isMax = mag[j] < mag[k];
+                else if (j > k) isMax = mag[j] <= mag[k];
+            }
+            if (isMax) bins.emplace_back(mag[k], k);
+        }
 
-        int take = std::min(TOP_PEAKS, (int)bins.size());
+        // Strongest first; hashPeaks relies on this order
+        int take = std::min(S::MAX_FRAME_PEAKS, (int)bins.size());
+        std::partial_sort(bins.begin(), bins.begin() + take, bins.end(), [](auto& a, auto& b) {
+            return a.first != b.first ? a.first > b.first : a.second < b.second;
+        });
         for (int i = 0; i < take; i++) {
-            peaksPerFrame.emplace_back(bins[i].second, frameIdx);
+            c.peaks.push_back(Peak{frameIdx, bins[i].second, float(bins[i].first)});
         }
+        PERF_PHASE_STOP(tPeaks);
     }
 
-    // ---- Build hash pairs ----
+    PERF_COUNT("fingerprint.frames", frameIdx - firstFrame);
+    PERF_COUNT("fingerprint.gatedFrames", gated);
+
+    return c;
+}
+
+/// Stages 4-6: pick anchors, pair them with targets and encode hashes
+template <class S>
+std::vector<std::pair<uint32_t,int>> BasicFingerprint<S>::hashPeaks(const Constellation& c,
+                                                                    const FingerprintProfile& profile) {
+    return hashPeaks(c, std::numeric_limits<int>::min(), std::numeric_limits<int>::max(),
+                     profile);
+}
+
+/// Stages 4-6 restricted to a range of anchor frames
+template <class S>
+std::vector<std::pair<uint32_t,int>> BasicFingerprint<S>::hashPeaks(const Constellation& c,
+                                                                    int anchorBegin, int anchorEnd,
+                                                                    const FingerprintProfile& profile) {
     std::vector<std::pair<uint32_t,int>> out;
-    out.reserve(peaksPerFrame.size() * 2);
+    if (c.peaks.empty() || c.windowSize != S::WINDOW_SIZE || c.hopSize != S::HOP_SIZE) return out;
+
+    PERF_PHASE(tSelect, "fingerprint.select");
+    PERF_PHASE(tPairing, "fingerprint.pairing");
+    PERF_PHASE_START(tSelect);
+
+    // STFT geometry the peaks were extracted with
+    const int sr = c.sampleRate;
+    constexpr int windowSize = S::WINDOW_SIZE;
+    constexpr int hopSize = S::HOP_SIZE;
+    const auto& peaks = c.peaks;
+
+    // Index peaks by frame (peaks are stored frame-major): peaks of frame f
+    // are [first[f], first[f+1]). Frames are relative to the first stored
+    // frame so a window of a long stream stays small.
+    const int baseFrame = peaks.front().frame;
+    const int totalFrames = peaks.back().frame - baseFrame + 1;
+    std::vector<int> first(totalFrames + 1, 0);
+    for (auto& p : peaks) ++first[p.frame - baseFrame + 1];
+    for (int f = 0; f < totalFrames; ++f) first[f + 1] += first[f];
 
-    // Index peaks by frame
-    int totalFrames = frameIdx;
-    std::vector<std::vector<int>> peaksInFrame(totalFrames);
-    for (auto& p : peaksPerFrame) {
-        peaksInFrame[p.second].push_back(p.first);
+    // Strict order so that equal powers never keep or drop both peaks
+    auto stronger = [&peaks](int i, int j) {
+        const Peak& p = peaks[i];
+        const Peak& q = peaks[j];
+        if (p.power != q.power) return p.power > q.power;
+        if (p.frame != q.frame) return p.frame < q.frame;
+        return p.bin < q.bin;
+    };
+
+    // ---- Time-frequency local maxima ----
+    std::vector<char> survivor(peaks.size(), 1);
+    for (int f = 0; f < totalFrames; ++f) {
+        const int g0 = std::max(0, f - S::TF_TIME_NBHD);
+        const int g1 = std::min(totalFrames - 1, f + S::TF_TIME_NBHD);
+        for (int i = first[f]; i < first[f + 1]; ++i) {
+            for (int j = first[g0]; j < first[g1 + 1] && survivor[i]; ++j) {
+                if (j != i && std::abs(peaks[j].bin - peaks[i].bin) <= S::TF_FREQ_NBHD &&
+                    stronger(j, i)) {
+                    survivor[i] = 0;
+                }
+            }
+        }
     }
 
-    // Anchor peak -> pair with targets in future frames
-    for (int a = 0; a < totalFrames; ++a) {
-        auto& A = peaksInFrame[a];
-        if (A.empty()) continue;
+    // ---- Anchors: survivors ranked within +-BUDGET_HALF_WINDOW frames ----
+    // A survivor anchors if fewer than `maxAnchors` stronger survivors lie
+    // in its window; the window spans ~1 s, so this caps anchors per second
+    const int fanout = std::max(1, profile.fanout);
+    const double windowSec = double(2 * S::BUDGET_HALF_WINDOW + 1) * hopSize / sr;
+    const double maxAnchors = profile.hashesPerSec > 0 ? profile.hashesPerSec / fanout * windowSec
+                                                       : std::numeric_limits<double>::infinity();
 
-        int targetsAdded = 0;
-        for (int t = a + TARGET_DT_MIN; t <= std::min(a + TARGET_DT_MAX, totalFrames-1); ++t) {
-            auto& T = peaksInFrame[t];
-            for (int f1 : A) {
-                for (int f2 : T) {
-                    // Reduce dimensionality with banding
-                    int b1 = freqToBand(f1, WINDOW_SIZE, sr) * 128 + (f1 % 128);
-                    int b2 = freqToBand(f2, WINDOW_SIZE, sr) * 128 + (f2 % 128);
+    const int firstAnchor = int(std::max<int64_t>(0, int64_t(anchorBegin) - baseFrame));
+    const int endAnchor = int(std::min<int64_t>(totalFrames, int64_t(anchorEnd) - baseFrame));
+
+    std::vector<int> anchors;
+    for (int a = firstAnchor; a < endAnchor; ++a) {
+        const int g0 = std::max(0, a - S::BUDGET_HALF_WINDOW);
+        const int g1 = std::min(totalFrames - 1, a + S::BUDGET_HALF_WINDOW);
+        for (int i = first[a]; i < first[a + 1]; ++i) {
+            if (!survivor[i]) continue;
 
-                    uint32_t h = hashPair(b1, b2, t - a);
+            int rank = 0;
+            for (int j = first[g0]; j < first[g1 + 1] && rank < maxAnchors; ++j) {
+                if (survivor[j] && stronger(j, i)) ++rank;
+            }
+            if (rank < maxAnchors) anchors.push_back(i);
+        }
+    }
+    PERF_PHASE_STOP(tSelect);
+    PERF_COUNT("fingerprint.anchors", anchors.size());
+
+    // ---- Pair each anchor with the nearest survivors in its target zone ----
+    PERF_PHASE_START(tPairing);
+    out.reserve(anchors.size() * fanout);
 
-                    // Anchor time in ms
-                    int offset_ms = int((a * HOP_SIZE * 1000.0) / sr);
+    for (int i : anchors) {
+        const int a = peaks[i].frame - baseFrame;
+        const int f1 = peaks[i].bin;
 
-                    out.emplace_back(h, offset_ms);
+        // Anchor time in ms
+        const int offset_ms = int(((a + baseFrame) * hopSize * 1000.0) / sr);
 
-                    if (++targetsAdded >= FANOUT) break;
+        int targetsAdded = 0;
+        for (int t = a + S::TARGET_DT_MIN; t <= std::min(a + S::TARGET_DT_MAX, totalFrames-1); ++t) {
+            for (int j = first[t]; j < first[t + 1]; ++j) {
+                const int f2 = peaks[j].bin;
+                if (!survivor[j] || std::abs(f2 - f1) > S::TARGET_DF_MAX) continue;
+
+                if constexpr (S::BANDED) {
+                    // Reduce dimensionality with banding
+                    int b1 = freqToBand(f1, windowSize, sr) * 128 + (f1 % 128);
+                    int b2 = freqToBand(f2, windowSize, sr) * 128 + (f2 % 128);
+                    out.emplace_back(hashPair(b1, b2, t - a), offset_ms);
+                } else {
+                    out.emplace_back(hashPair(f1, f2, t - a), offset_ms);
                 }
-                if (targetsAdded >= FANOUT) break;
+
+                if (++targetsAdded >= fanout) break;
             }
-            if (targetsAdded >= FANOUT) break;
+            if (targetsAdded >= fanout) break;
         }
     }
 
+    PERF_PHASE_STOP(tPairing);
+    PERF_COUNT("fingerprint.hashes", out.size());
+
     return out;
 }
+
+// ---- Compiled-in schemes ----
+template class BasicFingerprint<FingerprintSchemeV1>;
+template class BasicFingerprint<FingerprintSchemeV2>;
+
+template <class S>
+static FingerprintKernels kernelsOf() {
+    using F = BasicFingerprint<S>;
+    FingerprintKernels k;
+    k.scheme = S::ID;
+    k.windowSize = S::WINDOW_SIZE;
+    k.hopSize = S::HOP_SIZE;
+    k.compute = &F::compute;
+    k.hashPeaks = static_cast<FingerprintKernels::Hashes (*)(const Constellation&, const FingerprintProfile&)>(
+        &F::hashPeaks);
+    return k;
+}
+
+const FingerprintKernels* FingerprintKernels::find(int id) {
+    static const FingerprintKernels all[] = {
+        kernelsOf<FingerprintSchemeV1>(),
+        kernelsOf<FingerprintSchemeV2>(),
+    };
+    for (const FingerprintKernels& k : all) {
+        if (k.scheme == id) return &k;
+    }
+    return nullptr;
+}
@@ -1,17 +1,110 @@
 #pragma once
 #include <vector>
 #include <cstdint>
+#include "Constellation.h"
+#include "util/Deadline.h"
 
 /**
- * @class Fingerprint
- * @brief Computes audio fingerprints from PCM16 samples.
+ * @struct FingerprintProfile
+ * @brief How densely a signal is fingerprinted.
+ *
+ * The catalog and the queries need not use the same density: a sparse
+ * index keeps posting lists short, while a short query clip can afford to
+ * emit many more hashes to raise its chance of hitting them. Any query
+ * profile matches any index profile as long as the query is at least as
+ * dense, because every setting below only adds hashes on top of the ones
+ * a sparser profile emits:
+ *   - more anchors per second (hashesPerSec / fanout) rank more anchors
+ *     in, never different ones,
+ *   - a larger fanout pairs each anchor with further targets after the
+ *     same nearest ones,
+ *   - extra phases fingerprint the signal again at fractions of a hop, so
+ *     some pass lines up with the catalog's frames to within
+ *     hop / (2 * phases) samples, wherever the clip was cut.
+ *
+ * The STFT geometry itself (window, hop, target zone) is shared by every
+ * profile: hashes encode Δt in frames and are only comparable on one grid.
+ * It belongs to the scheme (see FingerprintSchemeV1).
+ */
+struct FingerprintProfile {
+    double hashesPerSec = 60.0;  ///< Anchor budget, upper bound (0 = every time-frequency peak anchors)
+    int fanout = 5;              ///< Max target pairs per anchor
+    int phases = 1;              ///< STFT passes, offset by hop/phases samples each
+};
+
+/**
+ * @struct FingerprintSchemeV1
+ * @brief Compile-time parameters of a fingerprint scheme: everything that
+ *        decides which hash a given sound produces.
+ *
+ * Hashes of different schemes are not comparable, so a catalog records
+ * the scheme (ID) its fingerprints were made with and rejects queries
+ * made with another one (see Database::scheme). Each scheme gets its own
+ * instantiation of BasicFingerprint, with every parameter folded into
+ * the kernels.
+ *
+ * A new scheme derives from an existing one and overrides what differs,
+ * under a new ID; it must also be instantiated in Fingerprint.cpp.
+ */
+struct FingerprintSchemeV1 {
+    static constexpr int ID = 1;
+
+    // ---- STFT, tuned for 44.1 kHz audio ----
+    static constexpr int WINDOW_SIZE   = 2048;   // ~46 ms
+    static constexpr int HOP_SIZE      = 1024;   // 50% overlap
+    static constexpr int MIN_BIN       = 5;      // ignore DC / rumble bins
+
+    // ---- Peak picking ----
+    static constexpr int    MAX_FRAME_PEAKS    = 10;     // candidates kept per frame
+    static constexpr int    PEAK_FREQ_NBHD     = 3;      // bins: spectral local maximum
+    static constexpr double PEAK_REL_THRESHOLD = 4.0;    // x frame mean power (~6 dB)
+    static constexpr double PEAK_ABS_FLOOR     = 1e-4;   // power floor (~-70 dBFS), drops silence
+    static constexpr int    TF_TIME_NBHD       = 3;      // frames: time-frequency local maximum
+    static constexpr int    TF_FREQ_NBHD       = 8;      // bins
+    static constexpr int    BUDGET_HALF_WINDOW = 21;     // frames: anchors ranked over ~1 s
+
+    // ---- Target zone ----
+    static constexpr int TARGET_DT_MIN = 1;      // frames (min lookahead)
+    static constexpr int TARGET_DT_MAX = 20;     // frames (~0.5s lookahead)
+    static constexpr int TARGET_DF_MAX = 96;     // bins (~2 kHz either side of the anchor)
+
+    // ---- Hash layout: f1 | f2 | Δt ----
+    static constexpr bool BANDED  = true;  // bins folded into 7 log-spaced bands of 128
+    static constexpr int  F_BITS  = 10;
+    static constexpr int  DT_BITS = 12;
+};
+
+/**
+ * @struct FingerprintSchemeV2
+ * @brief V1 with exact frequency bins in the hash.
+ *
+ * V1's banding keeps only bin % 128 inside each band, so above ~3 kHz
+ * unrelated bins share hashes. V2 stores the bin itself (an FFT of 2048
+ * has 1024 bins: 10 bits), which makes hashes more selective and posting
+ * lists shorter. Peaks are the same as V1's, so a V1 catalog converts by
+ * re-hashing its constellations (`--reindex --scheme=2`).
+ */
+struct FingerprintSchemeV2 : FingerprintSchemeV1 {
+    static constexpr int ID = 2;
+    static constexpr bool BANDED = false;
+};
+
+/**
+ * @class BasicFingerprint
+ * @brief Computes audio fingerprints from PCM16 samples, with the
+ *        parameters of `Scheme` fixed at compile time.
  *
  * Pipeline:
+ *   0. Skip frames whose energy (int16 domain) is below a silence gate
+ *      with hysteresis: no FFT, no peaks, no hashes.
  *   1. Split signal into overlapping frames with Hann window.
  *   2. Run FFT on each frame and compute magnitude and power spectrum.
- *   3. Select strongest spectral peaks per frame.
- *   4. Pair anchor peaks with future peaks (target zone).
- *   5. Encode each (f1, f2, Δt) tuple into a 32-bit hash.
+ *   3. Select spectral local maxima standing out from the frame's mean
+ *      power (silence and flat noise give few or no peaks).
+ *   4. Keep peaks that are maxima of their time-frequency neighbourhood;
+ *      the strongest of those become anchors, up to a hashes/sec budget.
+ *   5. Pair anchors with peaks in a target zone bounded in time and frequency.
+ *   6. Encode each (f1, f2, Δt) tuple into a 32-bit hash.
  *
  * Output:
  *   Vector of (hash, offset_ms), where offset_ms is the time (ms)
@@ -19,17 +112,125 @@
  *
  * These fingerprints are robust to noise and time shifts,
  * enabling fast lookup and matching in a database.
+ *
+ * Steps 1-3 (extractPeaks) and 4-6 (hashPeaks) are also exposed
+ * separately, so a stored Constellation can be re-hashed later
+ * without touching the audio again.
+ *
+ * Every selection in steps 4-5 only looks at a fixed neighbourhood of
+ * frames, so a clip picks the same anchors as the full recording it was
+ * cut from (away from the clip's edges).
+ *
+ * With a Deadline, the STFT stops at the first frame past it and the
+ * peaks found so far are hashed: the hashes then cover a prefix of the
+ * signal (and of each phase), which is still a usable, smaller query.
+ *
+ * `Fingerprint` is the default scheme; code that serves catalogs of
+ * several schemes looks them up with FingerprintKernels.
  */
-class Fingerprint {
+template <class Scheme>
+class BasicFingerprint {
 public:
+    /// Scheme ID recorded by catalogs built with this fingerprinter
+    static constexpr int SCHEME = Scheme::ID;
+
+    /// What songs are stored with (the defaults of FingerprintProfile)
+    static FingerprintProfile indexProfile();
+
+    /// What recognition queries are fingerprinted with: denser than the
+    /// index in every respect
+    static FingerprintProfile queryProfile();
+
+    /// Silence gate state, carried across the slices of one signal so that
+    /// sliced and whole-signal extraction gate the same frames
+    struct Gate {
+        bool open = false;
+    };
+
     /// Compute fingerprints for a PCM16 mono signal
     /// @param pcm Raw audio samples
     /// @param sampleRate Sampling rate (Hz)
+    /// @param profile Hash density (defaults to the index profile)
+    /// @param deadline Stop analysing the signal once it expires
+    /// @param incomplete Set to whether the deadline cut the analysis short
     /// @return Vector of (hash, offset_ms)
     static std::vector<std::pair<uint32_t,int>> compute(const std::vector<int16_t>& pcm,
-                                                        int sampleRate);
+                                                        int sampleRate,
+                                                        const FingerprintProfile& profile = FingerprintProfile(),
+                                                        const Deadline& deadline = Deadline(),
+                                                        bool* incomplete = nullptr);
+
+    /// Steps 1-3: STFT + peak picking (the song's constellation)
+    static Constellation extractPeaks(const std::vector<int16_t>& pcm, int sampleRate);
+
+    /// Steps 1-3 over a slice of a longer signal. `pcm` must start on a
+    /// frame boundary; peaks are numbered from `firstFrame`. Pass the same
+    /// `gate` for consecutive slices (nullptr: start closed). Frames after
+    /// `deadline` expires are not analysed.
+    static Constellation extractPeaks(const int16_t* pcm, size_t n, int sampleRate,
+                                      int firstFrame, Gate* gate = nullptr,
+                                      const Deadline& deadline = Deadline());
+
+    /// Steps 4-6: pick anchors, pair them with targets and hash them
+    /// (single pass: `profile.phases` is ignored). `c` must have this
+    /// scheme's geometry (windowSize, hopSize).
+    static std::vector<std::pair<uint32_t,int>> hashPeaks(const Constellation& c,
+                                                          const FingerprintProfile& profile = FingerprintProfile());
+
+    /// Steps 4-6 for anchors with frame in [anchorBegin, anchorEnd) only.
+    /// Peaks from lookbehindFrames() before anchorBegin up to
+    /// lookaheadFrames() after the last anchor must be present.
+    static std::vector<std::pair<uint32_t,int>> hashPeaks(const Constellation& c,
+                                                          int anchorBegin, int anchorEnd,
+                                                          const FingerprintProfile& profile = FingerprintProfile());
+
+    /// STFT geometry and the context hashPeaks reads around an anchor
+    /// (frames), for incremental callers
+    static constexpr int windowSize() { return Scheme::WINDOW_SIZE; }
+    static constexpr int hopSize() { return Scheme::HOP_SIZE; }
+
+    // An anchor's rank reads survivors BUDGET_HALF_WINDOW frames away, its
+    // targets TARGET_DT_MAX frames ahead, and survival itself TF_TIME_NBHD more
+    static constexpr int lookaheadFrames() {
+        return (Scheme::BUDGET_HALF_WINDOW > Scheme::TARGET_DT_MAX ? Scheme::BUDGET_HALF_WINDOW
+                                                                   : Scheme::TARGET_DT_MAX) +
+               Scheme::TF_TIME_NBHD;
+    }
+    static constexpr int lookbehindFrames() { return Scheme::BUDGET_HALF_WINDOW + Scheme::TF_TIME_NBHD; }
+
+    /// Hash density of a fingerprinted signal, for index-size reporting
+    static double hashesPerSecond(size_t hashes, size_t samples, int sampleRate);
 
 private:
     /// Pack frequency pair + time delta into a 32-bit hash
     static uint32_t hashPair(int f1, int f2, int dt);
 };
+
+/// The default scheme: what songs and queries are fingerprinted with
+/// unless a catalog says otherwise
+using Fingerprint = BasicFingerprint<FingerprintSchemeV1>;
+
+/**
+ * @struct FingerprintKernels
+ * @brief The schemes compiled into this build, looked up by ID at run time.
+ *
+ * For code that follows a catalog's scheme (server, re-indexing): the
+ * lookup is one indirect call per signal, the kernels behind it are the
+ * fully specialized ones.
+ */
+struct FingerprintKernels {
+    using Hashes = std::vector<std::pair<uint32_t,int>>;
+
+    int scheme = 0;
+    int windowSize = 0;  ///< STFT geometry its constellations have
+    int hopSize = 0;
+    Hashes (*compute)(const std::vector<int16_t>&, int, const FingerprintProfile&,
+                      const Deadline&, bool*) = nullptr;
+    Hashes (*hashPeaks)(const Constellation&, const FingerprintProfile&) = nullptr;
+
+    /// Kernels of scheme `id`, nullptr if this build does not have it
+    static const FingerprintKernels* find(int id);
+};
+
+extern template class BasicFingerprint<FingerprintSchemeV1>;
+extern template class BasicFingerprint<FingerprintSchemeV2>;
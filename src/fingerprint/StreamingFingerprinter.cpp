@@ -0,0 +1,104 @@
+#include "StreamingFingerprinter.h"
+#include "perf/Perf.h"
+#include <algorithm>
+#include <numeric>
+
+StreamingFingerprinter::StreamingFingerprinter(int sampleRate, const FingerprintProfile& profile)
+    : m_sampleRate(sampleRate), m_profile(profile) {
+    // Rebasing by a multiple of this many frames shifts anchor times by a
+    // whole number of milliseconds, so offsets round exactly as in batch mode
+    const int64_t hopMs = int64_t(Fingerprint::hopSize()) * 1000;
+    m_rebasePeriod = m_sampleRate / std::gcd(hopMs, int64_t(m_sampleRate));
+    reset();
+}
+
+void StreamingFingerprinter::reset() {
+    m_samplesIn = 0;
+    m_tail.clear();
+    m_nextFrame = 0;
+    m_nextAnchor = 0;
+    m_baseFrame = 0;
+    m_gate = Fingerprint::Gate();
+    m_peaks = Constellation();
+    m_peaks.sampleRate = m_sampleRate;
+    m_peaks.windowSize = Fingerprint::windowSize();
+    m_peaks.hopSize = Fingerprint::hopSize();
+}
+
+void StreamingFingerprinter::recordPeaks(Constellation* sink) {
+    m_sink = sink;
+    if (!m_sink) return;
+    m_sink->sampleRate = m_sampleRate;
+    m_sink->windowSize = Fingerprint::windowSize();
+    m_sink->hopSize = Fingerprint::hopSize();
+}
+
+int64_t StreamingFingerprinter::elapsedMs() const {
+    return m_samplesIn * 1000 / m_sampleRate;
+}
+
+/// Analyse complete frames, then hash every anchor whose context is complete
+void StreamingFingerprinter::push(const int16_t* pcm, size_t n, std::vector<StreamHash>& out) {
+    PERF_SCOPE("stream.push");
+
+    m_samplesIn += int64_t(n);
+    m_tail.insert(m_tail.end(), pcm, pcm + n);
+
+    const size_t window = size_t(Fingerprint::windowSize());
+    const size_t hop = size_t(Fingerprint::hopSize());
+    if (m_tail.size() < window) return;
+
+    // ---- Peaks of the newly completed frames ----
+    const size_t frames = (m_tail.size() - window) / hop + 1;
+    const size_t used = (frames - 1) * hop + window;
+    Constellation c = Fingerprint::extractPeaks(m_tail.data(), used, m_sampleRate,
+                                                int(m_nextFrame - m_baseFrame), &m_gate);
+    m_peaks.peaks.insert(m_peaks.peaks.end(), c.peaks.begin(), c.peaks.end());
+    if (m_sink) {
+        for (Peak p : c.peaks) {
+            p.frame += int(m_baseFrame);
+            m_sink->peaks.push_back(p);
+        }
+    }
+
+    m_tail.erase(m_tail.begin(), m_tail.begin() + std::ptrdiff_t(frames * hop));
+    m_nextFrame += int64_t(frames);
+
+    // ---- Hash anchors whose whole look-ahead has been analysed ----
+    const int64_t anchorEnd = m_nextFrame - Fingerprint::lookaheadFrames();
+    if (anchorEnd <= m_nextAnchor) return;
+
+    const int64_t baseMs = m_baseFrame * int64_t(hop) * 1000 / m_sampleRate;
+    for (auto& h : Fingerprint::hashPeaks(m_peaks, int(m_nextAnchor - m_baseFrame),
+                                          int(anchorEnd - m_baseFrame), m_profile)) {
+        out.push_back(StreamHash{h.first, baseMs + h.second});
+    }
+    m_nextAnchor = anchorEnd;
+
+    // ---- Drop peaks no later anchor can see ----
+    const int64_t keepAbs = m_nextAnchor - Fingerprint::lookbehindFrames();
+    const int keepFrom = int(std::max<int64_t>(0, keepAbs - m_baseFrame));
+    auto& peaks = m_peaks.peaks;
+    peaks.erase(peaks.begin(), std::find_if(peaks.begin(), peaks.end(), [keepFrom](const Peak& p) {
+        return p.frame >= keepFrom;
+    }));
+
+    // ---- Keep relative frame numbers small ----
+    const int64_t shift = keepFrom / m_rebasePeriod * m_rebasePeriod;
+    if (shift > 0) {
+        for (auto& p : peaks) p.frame -= int(shift);
+        m_baseFrame += shift;
+    }
+}
+
+/// No more frames will come: every remaining anchor has all its context
+void StreamingFingerprinter::finish(std::vector<StreamHash>& out) {
+    if (m_nextFrame <= m_nextAnchor) return;
+
+    const int64_t baseMs = m_baseFrame * int64_t(Fingerprint::hopSize()) * 1000 / m_sampleRate;
+    for (auto& h : Fingerprint::hashPeaks(m_peaks, int(m_nextAnchor - m_baseFrame),
+                                          int(m_nextFrame - m_baseFrame), m_profile)) {
+        out.push_back(StreamHash{h.first, baseMs + h.second});
+    }
+    m_nextAnchor = m_nextFrame;
+}
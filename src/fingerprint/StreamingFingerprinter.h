@@ -0,0 +1,72 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Constellation.h"
+#include "Fingerprint.h"
+
+/**
+ * @struct StreamHash
+ * @brief One fingerprint of a live stream, timed from the start of the stream.
+ */
+struct StreamHash {
+    uint32_t hash = 0;
+    int64_t timeMs = 0;  ///< Anchor time since the stream started (never wraps)
+};
+
+/**
+ * @class StreamingFingerprinter
+ * @brief Incremental Fingerprint for unbounded PCM16 input.
+ *
+ * PCM is pushed in chunks of any size. Frames are analysed as soon as
+ * they are complete and an anchor is hashed once all the context
+ * Fingerprint::hashPeaks reads around it has been seen, so the output is
+ * exactly what Fingerprint::compute would produce on the concatenated
+ * signal (up to that look-ahead, ~0.55 s at 44.1 kHz).
+ *
+ * Memory is bounded: only the samples of the next incomplete frame and
+ * the peaks around the pending anchors are kept. Frame numbers are
+ * periodically rebased, so streams may run indefinitely.
+ *
+ * Hashes are those of the default scheme (Fingerprint::SCHEME).
+ */
+class StreamingFingerprinter {
+public:
+    /// Single pass: `profile.phases` is ignored
+    explicit StreamingFingerprinter(int sampleRate = 44100,
+                                    const FingerprintProfile& profile = FingerprintProfile());
+
+    /// Consume `n` samples, appending newly completed hashes to `out`
+    void push(const int16_t* pcm, size_t n, std::vector<StreamHash>& out);
+
+    /// End of a finite stream: hash the anchors still waiting for
+    /// look-ahead. Together with push() this yields exactly
+    /// Fingerprint::compute of the whole signal.
+    void finish(std::vector<StreamHash>& out);
+
+    /// Also append every extracted peak to `sink` (absolute frame numbers,
+    /// geometry filled in), e.g. to store a file's constellation while
+    /// streaming it; nullptr stops recording
+    void recordPeaks(Constellation* sink);
+
+    /// Forget all state and restart the stream clock at 0
+    void reset();
+
+    /// Audio consumed so far (ms)
+    int64_t elapsedMs() const;
+
+    int sampleRate() const { return m_sampleRate; }
+
+private:
+    int m_sampleRate;
+    FingerprintProfile m_profile;  ///< Budget and fanout passed to hashPeaks
+    int64_t m_samplesIn = 0;       ///< Total samples pushed
+    std::vector<int16_t> m_tail;   ///< Samples from frame m_nextFrame onward
+    int64_t m_nextFrame = 0;       ///< Next frame to analyse (absolute)
+    int64_t m_nextAnchor = 0;      ///< Next anchor frame to hash (absolute)
+    int64_t m_baseFrame = 0;       ///< m_peaks frame numbers are relative to this
+    int64_t m_rebasePeriod = 1;    ///< Frames whose duration is a whole number of ms
+    Fingerprint::Gate m_gate;      ///< Silence gate state at m_nextFrame
+    Constellation m_peaks;         ///< Peaks of frames >= m_nextAnchor - lookbehind
+    Constellation* m_sink = nullptr; ///< See recordPeaks
+};
@@ -1,5 +1,261 @@
 #include <QApplication>
+#include <QFileInfo>
+#include <QTextStream>
+#include <algorithm>
+#include <cstring>
 #include "ui/MainWindow.h"
+#include "audio/Ingestor.h"
+#include "db/Reindexer.h"
+#include "db/ShardMap.h"
+#include "monitor/RecordingScanner.h"
+#include "perf/Perf.h"
+#include "util/TaskPool.h"
+
+/// "--index-hashes-per-sec=N" / "--index-fanout=N": density songs are
+/// stored with. False if `arg` is neither.
+static bool parseIndexProfile(const QString& arg, FingerprintProfile& profile) {
+    if (arg.startsWith("--index-hashes-per-sec=")) {
+        profile.hashesPerSec = arg.section('=', 1).toDouble();
+        return true;
+    }
+    if (arg.startsWith("--index-fanout=")) {
+        profile.fanout = arg.section('=', 1).toInt();
+        return true;
+    }
+    return false;
+}
+
+/// Per-lane use of the shared TaskPool after a headless run
+static void printPoolStats(QTextStream& out) {
+    out << "Task pool (" << TaskPool::instance().threads() << " threads):\n"
+        << QString::fromStdString(TaskPool::instance().summary());
+}
+
+/// Headless maintenance: regenerate fingerprints from stored constellations,
+/// in `scheme` (0: the catalog's own)
+static int runReindex(const QString& dbPath, const FingerprintProfile& profile, int scheme) {
+    QTextStream out(stdout);
+    QString err;
+
+    Database db(dbPath);
+    if (!db.open(&err) || !db.migrate(&err)) {
+        out << "DB error: " << err << "\n";
+        return 1;
+    }
+
+    Reindexer reindexer(db);
+    reindexer.setProgress([&out](qint64 done, qint64 total) {
+        out << QString("\rRe-indexed %1 / %2 songs").arg(done).arg(total);
+        out.flush();
+    });
+
+    if (!reindexer.rehash(scheme > 0 ? scheme : db.scheme(), profile, &err)) {
+        out << "\nRe-index failed: " << err << "\n";
+        return 1;
+    }
+
+    out << QString("\nRe-index complete (fingerprint scheme %1).\n").arg(db.scheme());
+    printPoolStats(out);
+    return 0;
+}
+
+/// Import `files` into one catalog database; false with `err` set if it
+/// could not be opened or the import failed
+static bool ingestInto(const QString& dbPath, const QStringList& files, DuplicatePolicy duplicates,
+                       const FingerprintProfile& profile, QTextStream& out, qint64& skipped,
+                       QString* err) {
+    Database db(dbPath);
+    if (!db.open(err) || !db.migrate(err)) {
+        *err = QString("DB error: %1").arg(*err);
+        return false;
+    }
+
+    Ingestor ingestor(db);
+    ingestor.setDuplicatePolicy(duplicates);
+    ingestor.setProfile(profile);
+    ingestor.setDuplicate([&out](const QString& path, const DuplicateMatch& dup) {
+        out << QString("\nDuplicate %1: song #%2 (%3, by %4), %5% aligned\n")
+                   .arg(path).arg(dup.song.id).arg(dup.song.title, dup.song.artist)
+                   .arg(dup.coverage * 100, 0, 'f', 0);
+    });
+    ingestor.setProgress([&out](qint64 done, qint64 total) {
+        out << QString("\rIngested %1 / %2 files").arg(done).arg(total);
+        out.flush();
+    });
+    ingestor.setFailure([&out, &skipped](const QString& path, const QString& error) {
+        out << QString("\nSkipped %1: %2\n").arg(path, error);
+        ++skipped;
+    });
+
+    if (!ingestor.run(files, err)) {
+        *err = QString("Ingest failed: %1").arg(*err);
+        return false;
+    }
+    return true;
+}
+
+/// Headless bulk import: decode, fingerprint and store audio files/folders.
+/// With `shards` > 1 every file goes to its ShardMap shard of the catalog.
+static int runIngest(const QString& dbPath, const QStringList& inputs,
+                     DuplicatePolicy duplicates, const FingerprintProfile& profile, int shards) {
+    QTextStream out(stdout);
+    QString err;
+
+    QStringList files;
+    for (const QString& in : inputs) {
+        if (QFileInfo(in).isDir()) files << Ingestor::audioFiles(in);
+        else files << in;
+    }
+
+    qint64 skipped = 0;
+    if (shards <= 1) {
+        if (!ingestInto(dbPath, files, duplicates, profile, out, skipped, &err)) {
+            out << "\n" << err << "\n";
+            return 1;
+        }
+    } else {
+        std::vector<QStringList> perShard(static_cast<size_t>(shards));
+        for (const QString& f : files) perShard[size_t(ShardMap::shardOf(f, shards))] << f;
+
+        for (int s = 0; s < shards; ++s) {
+            const QString shardDb = ShardMap::shardDatabase(dbPath, s);
+            out << QString("Shard %1 (%2): %3 files\n").arg(s).arg(shardDb).arg(perShard[size_t(s)].size());
+            if (!ingestInto(shardDb, perShard[size_t(s)], duplicates, profile, out, skipped, &err)) {
+                out << "\n" << err << "\n";
+                return 1;
+            }
+            out << "\n";
+        }
+    }
+
+    out << QString("\nIngest complete (%1 skipped).\n").arg(skipped);
+    printPoolStats(out);
+    return 0;
+}
+
+/// Headless maintenance: list songs that duplicate an earlier one
+static int runDedupReport(const QString& dbPath) {
+    QTextStream out(stdout);
+    QString err;
+
+    Database db(dbPath);
+    if (!db.open(&err) || !db.migrate(&err)) {
+        out << "DB error: " << err << "\n";
+        return 1;
+    }
+
+    std::vector<std::pair<int,DuplicateMatch>> pairs;
+    bool ok = db.duplicateReport(pairs, [&out](int percent) {
+        out << QString("\rChecked %1%").arg(percent);
+        out.flush();
+        return true;
+    }, &err);
+    if (!ok) {
+        out << "\nDuplicate check failed: " << err << "\n";
+        return 1;
+    }
+
+    out << QString("\n%1 duplicate(s)\n").arg(pairs.size());
+    for (auto& p : pairs) {
+        out << QString("  song #%1 duplicates #%2 (%3, by %4), %5% aligned\n")
+                   .arg(p.first).arg(p.second.song.id)
+                   .arg(p.second.song.title, p.second.song.artist)
+                   .arg(p.second.coverage * 100, 0, 'f', 0);
+    }
+    return 0;
+}
+
+/// Headless maintenance: drop the change log entries every given replica
+/// has applied (all of them if no replica follows the catalog)
+static int runPruneChanges(const QString& dbPath, const QStringList& replicas) {
+    QTextStream out(stdout);
+    QString err;
+
+    Database db(dbPath);
+    if (!db.open(&err) || !db.migrate(&err)) {
+        out << "DB error: " << err << "\n";
+        return 1;
+    }
+
+    // A replica's own log ends at the last primary entry it applied
+    qint64 upTo = 0;
+    if (!db.lastChangeSeq(upTo, &err)) {
+        out << "DB error: " << err << "\n";
+        return 1;
+    }
+    for (const QString& path : replicas) {
+        Database replica(path);
+        qint64 applied = 0;
+        if (!replica.open(&err) || !replica.lastChangeSeq(applied, &err)) {
+            out << QString("Replica %1: %2\n").arg(path, err);
+            return 1;
+        }
+        out << QString("Replica %1 has applied change %2\n").arg(path).arg(applied);
+        upTo = std::min(upTo, applied);
+    }
+
+    if (!db.pruneChanges(upTo, &err)) {
+        out << "Pruning failed: " << err << "\n";
+        return 1;
+    }
+    out << QString("Pruned change log entries up to %1.\n").arg(upTo);
+    return 0;
+}
+
+/// "h:mm:ss" for scan timelines
+static QString clockTime(qint64 ms) {
+    const qint64 s = ms / 1000;
+    return QString("%1:%2:%3").arg(s / 3600)
+                              .arg(s / 60 % 60, 2, 10, QChar('0'))
+                              .arg(s % 60, 2, 10, QChar('0'));
+}
+
+/// Headless search: timeline of the catalog songs played in a long recording
+static int runScan(const QString& dbPath, const QString& path, const ScanConfig& cfg) {
+    QTextStream out(stdout);
+    QString err;
+
+    Database db(dbPath);
+    if (!db.open(&err) || !db.migrate(&err)) {
+        out << "DB error: " << err << "\n";
+        return 1;
+    }
+    db.setReadPool(true);
+
+    // Fingerprinted once, as densely as a query; the peaks are not needed
+    out << QString("Fingerprinting %1\n").arg(path);
+    out.flush();
+    DecodedTrack track;
+    if (!Ingestor::fingerprintFile(path, track, &err, Fingerprint::queryProfile(), false)) {
+        out << "Decoding failed: " << err << "\n";
+        return 1;
+    }
+
+    RecordingScanner scanner(db, cfg);
+    scanner.setProgress([&out](int percent) {
+        out << QString("\rScanned %1%").arg(percent);
+        out.flush();
+        return true;
+    });
+
+    std::vector<ScanSegment> segments;
+    if (!scanner.scan(track.hashes, segments, &err)) {
+        out << "\nScan failed: " << err << "\n";
+        return 1;
+    }
+
+    out << QString("\n%1 segment(s) in %2\n").arg(segments.size())
+               .arg(clockTime(track.sampleRate > 0 ? track.samples * 1000 / track.sampleRate : 0));
+    for (const ScanSegment& seg : segments) {
+        out << QString("  %1 - %2  %3, by %4 (song #%5 from %6, %7% aligned)\n")
+                   .arg(clockTime(seg.startMs), clockTime(seg.endMs))
+                   .arg(seg.song.title, seg.song.artist)
+                   .arg(seg.song.id).arg(clockTime(seg.songOffsetMs))
+                   .arg(seg.confidence * 100, 0, 'f', 0);
+    }
+    printPoolStats(out);
+    return 0;
+}
 
 /**
  * @brief Entry point of the Music Recognition application.
@@ -9,13 +265,92 @@
  * application-wide resources and the event dispatch system.
  */
 int main(int argc, char *argv[]) {
+    // "--reindex [--scheme=N] [--index-...=N]": re-hash the catalog (into
+    // fingerprint scheme N) without starting the GUI
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--reindex") == 0) {
+            QCoreApplication app(argc, argv);
+            FingerprintProfile profile = Fingerprint::indexProfile();
+            int scheme = 0;
+            for (int j = i + 1; j < argc; ++j) {
+                const QString arg = QString::fromLocal8Bit(argv[j]);
+                if (arg.startsWith("--scheme=")) scheme = arg.section('=', 1).toInt();
+                else parseIndexProfile(arg, profile);
+            }
+            return runReindex("music.db", profile, scheme);
+        }
+        // "--ingest [--duplicates=skip|link|flag|allow] [--index-...=N] [--shards=N]
+        // <file|folder>...": bulk import without starting the GUI, split over N
+        // shard catalogs if given
+        if (std::strcmp(argv[i], "--ingest") == 0) {
+            QCoreApplication app(argc, argv);
+            DuplicatePolicy duplicates = DuplicatePolicy::Skip;
+            FingerprintProfile profile = Fingerprint::indexProfile();
+            int shards = 1;
+            QStringList inputs;
+            for (int j = i + 1; j < argc; ++j) {
+                const QString arg = QString::fromLocal8Bit(argv[j]);
+                if (arg == "--duplicates=link") duplicates = DuplicatePolicy::Link;
+                else if (arg == "--duplicates=flag") duplicates = DuplicatePolicy::Flag;
+                else if (arg == "--duplicates=allow") duplicates = DuplicatePolicy::Allow;
+                else if (parseIndexProfile(arg, profile)) continue;
+                else if (arg.startsWith("--shards=")) shards = std::max(1, arg.section('=', 1).toInt());
+                else if (arg != "--duplicates=skip") inputs << arg;
+            }
+            return runIngest("music.db", inputs, duplicates, profile, shards);
+        }
+        // "--scan [--two-stage|--sketch-prefilter] <file>": list the catalog
+        // songs played in a long recording
+        if (std::strcmp(argv[i], "--scan") == 0 && i + 1 < argc) {
+            QCoreApplication app(argc, argv);
+            ScanConfig cfg;
+            QString path;
+            for (int j = i + 1; j < argc; ++j) {
+                const QString arg = QString::fromLocal8Bit(argv[j]);
+                if (arg == "--two-stage") cfg.match.twoStage = true;
+                else if (arg == "--sketch-prefilter") cfg.match.sketchPrefilter = true;
+                else path = arg;
+            }
+            return runScan("music.db", path, cfg);
+        }
+        // "--prune-changes [replica.db]...": trim the change log behind the
+        // slowest of the catalog's replicas
+        if (std::strcmp(argv[i], "--prune-changes") == 0) {
+            QCoreApplication app(argc, argv);
+            QStringList replicas;
+            for (int j = i + 1; j < argc; ++j) replicas << QString::fromLocal8Bit(argv[j]);
+            return runPruneChanges("music.db", replicas);
+        }
+        // "--dedup-report": list duplicate songs already in the catalog
+        if (std::strcmp(argv[i], "--dedup-report") == 0) {
+            QCoreApplication app(argc, argv);
+            return runDedupReport("music.db");
+        }
+    }
+
     // Initialize the Qt application with command-line arguments
     QApplication app(argc, argv);
 
+#if USE_PERF
+    // Instrumentation output is controlled by environment variables:
+    //   MRA_PERF_JSON=<file>   counters + histograms on exit
+    //   MRA_PERF_TRACE=<file>  Chrome trace events on exit (enables tracing)
+    const QByteArray perfJson = qgetenv("MRA_PERF_JSON");
+    const QByteArray perfTrace = qgetenv("MRA_PERF_TRACE");
+    perf::Registry::instance().setTracing(!perfTrace.isEmpty());
+#endif
+
     // Create and display the main application window
     MainWindow w;
     w.show();
 
     // Enter Qt's event loop until the application exits
-    return app.exec();
+    int rc = app.exec();
+
+#if USE_PERF
+    if (!perfJson.isEmpty()) perf::Registry::instance().exportJson(perfJson.toStdString());
+    if (!perfTrace.isEmpty()) perf::Registry::instance().exportChromeTrace(perfTrace.toStdString());
+#endif
+
+    return rc;
 }
\ No newline at end of file
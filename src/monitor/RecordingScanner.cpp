@@ -0,0 +1,205 @@
+#include "RecordingScanner.h"
+#include "perf/Perf.h"
+#include "util/TaskPool.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+
+RecordingScanner::RecordingScanner(Database& db, const ScanConfig& cfg)
+    : m_db(db), m_cfg(cfg) {}
+
+/// Match runs of windows on the pool, then chain the winners
+bool RecordingScanner::scan(const HashList& hashes, std::vector<ScanSegment>& out,
+                            QString* err, int scheme) {
+    PERF_SCOPE("scan.run");
+    out.clear();
+    if (hashes.empty()) return true;
+
+    // Windows are cut from the hashes in time order
+    HashList sorted(hashes);
+    std::stable_sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) {
+        return a.second < b.second;
+    });
+    const qint64 lengthMs = sorted.back().second;
+
+    const qint64 windowMs = std::max(1, m_cfg.windowMs);
+    const qint64 hopMs = std::max(1, m_cfg.hopMs);
+    const qint64 beyond = std::max<qint64>(0, lengthMs + 1 - windowMs);
+    const int windows = 1 + int((beyond + hopMs - 1) / hopMs);
+    const int batch = std::max(1, m_cfg.batchWindows);
+    const int runs = (windows + batch - 1) / batch;
+
+    int threads = std::max(0, m_cfg.threads); // 0: as many as the pool runs
+    if (!m_db.readPool()) threads = 1;
+    PERF_COUNT("scan.windows", windows);
+
+    std::vector<Detection> detections(static_cast<size_t>(windows));
+    auto byOffset = [](const std::pair<uint32_t,int>& h, qint64 t) { return h.second < t; };
+    const bool perWindow = m_cfg.match.twoStage || m_cfg.match.sketchPrefilter;
+
+    // One run: its windows' queries, offsets relative to each window start
+    auto matchRun = [&](int run, QString* e) {
+        PERF_SCOPE("scan.matchRun");
+        const int first = run * batch;
+        const int last = std::min(windows, first + batch);
+
+        std::vector<HashList> queries;
+        queries.reserve(size_t(last - first));
+        for (int w = first; w < last; ++w) {
+            const qint64 from = w * hopMs;
+            const auto lo = std::lower_bound(sorted.begin(), sorted.end(), from, byOffset);
+            const auto hi = std::lower_bound(lo, sorted.end(), from + windowMs, byOffset);
+            const size_t n = size_t(hi - lo);
+            const size_t limit = std::max<size_t>(1, m_cfg.maxWindowHashes);
+            const size_t stride = std::max<size_t>(1, (n + limit - 1) / limit);
+
+            HashList q;
+            q.reserve(n / stride + 1);
+            for (size_t i = 0; i < n; i += stride) {
+                q.emplace_back(lo[i].first, int(lo[i].second - from));
+            }
+            detections[size_t(w)].queryHashes = int(q.size());
+            queries.push_back(std::move(q));
+        }
+
+        // Shortlisting strategies are per query: no shared posting reads
+        if (perWindow) {
+            MatchOptions opts = m_cfg.match;
+            opts.scheme = scheme;
+            for (int w = first; w < last; ++w) {
+                if (!m_db.match(queries[size_t(w - first)], opts, detections[size_t(w)].match, e)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        std::vector<MatchResult> results;
+        if (!m_db.bestMatchBatch(queries, results, e, scheme)) return false;
+        for (int w = first; w < last; ++w) {
+            detections[size_t(w)].match = std::move(results[size_t(w - first)]);
+        }
+        return true;
+    };
+
+    std::atomic<int> runsDone{0};
+    std::atomic<bool> stop{false};
+    std::mutex errorMutex;
+    QString error;
+
+    // Runs are pool tasks on the Normal lane; the calling thread matches
+    // too, and is the one reporting progress
+    const std::thread::id caller = std::this_thread::get_id();
+    TaskPool::instance().parallelFor(TaskLane::Normal, size_t(runs), [&](size_t run) {
+        if (stop) return;
+        QString e;
+        if (!matchRun(int(run), &e)) {
+            std::lock_guard<std::mutex> lock(errorMutex);
+            if (error.isEmpty()) error = e.isEmpty() ? QString("Scan failed") : e;
+            stop = true;
+            return;
+        }
+        const int done = ++runsDone;
+        if (std::this_thread::get_id() == caller && m_progress &&
+            !m_progress(int(qint64(done) * 100 / runs))) {
+            stop = true;
+        }
+    }, threads);
+
+    if (!error.isEmpty()) {
+        if (err) *err = error;
+        return false;
+    }
+
+    buildTimeline(detections, lengthMs, out);
+    PERF_VALUE("scan.segments", out.size());
+    return true;
+}
+
+void RecordingScanner::buildTimeline(const std::vector<Detection>& windows, qint64 lengthMs,
+                                     std::vector<ScanSegment>& out) const {
+    // A segment still accepting windows
+    struct Open {
+        ScanSegment seg;
+        qint64 alignMs = 0;    ///< Alignment of its latest window
+        int lastWindow = 0;
+        double coverage = 0.0; ///< Sum over its windows
+    };
+
+    const qint64 windowMs = std::max(1, m_cfg.windowMs);
+    const qint64 hopMs = std::max(1, m_cfg.hopMs);
+    const int reach = 1 + std::max(0, m_cfg.maxMissedWindows);
+    std::vector<Open> open;
+
+    auto close = [this, &out](Open& o) {
+        if (o.seg.windows < m_cfg.minWindows) return;
+        o.seg.confidence = o.coverage / o.seg.windows;
+        out.push_back(o.seg);
+    };
+
+    for (int w = 0; w < int(windows.size()); ++w) {
+        // Segments too far behind to be extended are final
+        for (auto it = open.begin(); it != open.end(); ) {
+            if (w - it->lastWindow > reach) {
+                close(*it);
+                it = open.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        const Detection& d = windows[size_t(w)];
+        if (!d.match.found || d.match.votes < m_cfg.minVotes) continue;
+
+        // Song offset minus recording time: constant during a play
+        const qint64 from = w * hopMs;
+        const qint64 align = qint64(d.match.deltaMs) - from;
+
+        Open* seg = nullptr;
+        for (Open& o : open) {
+            if (o.seg.song.id != d.match.song.id) continue;
+            const qint64 drift = std::llabs(o.alignMs - align);
+            if (drift <= m_cfg.deltaToleranceMs &&
+                (!seg || drift < std::llabs(seg->alignMs - align))) {
+                seg = &o;
+            }
+        }
+        if (!seg) {
+            Open o;
+            o.seg.song = d.match.song;
+            // Song start if it is inside the window, else the window start
+            o.seg.startMs = std::max(from, -align);
+            o.seg.songOffsetMs = align + o.seg.startMs;
+            open.push_back(o);
+            seg = &open.back();
+        }
+
+        seg->alignMs = align;
+        seg->lastWindow = w;
+        seg->seg.endMs = std::min(from + windowMs, lengthMs);
+        seg->seg.windows += 1;
+        seg->seg.votes += d.match.votes;
+        seg->coverage += double(d.match.votes) / std::max(1, d.queryHashes);
+    }
+    for (Open& o : open) close(o);
+
+    std::sort(out.begin(), out.end(), [](const ScanSegment& a, const ScanSegment& b) {
+        return a.startMs < b.startMs;
+    });
+
+    // Consecutive plays overlap by up to a window (crossfades, window
+    // granularity): split the overlap halfway. A segment nested inside
+    // another (a jingle over a track) is kept as is.
+    for (size_t i = 1; i < out.size(); ++i) {
+        ScanSegment& prev = out[i - 1];
+        ScanSegment& cur = out[i];
+        if (cur.startMs >= prev.endMs || cur.endMs <= prev.endMs) continue;
+
+        const qint64 mid = (cur.startMs + prev.endMs) / 2;
+        cur.songOffsetMs += mid - cur.startMs;
+        cur.startMs = mid;
+        prev.endMs = mid;
+    }
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <QString>
+#include <functional>
+#include <vector>
+#include "db/Database.h"
+
+/**
+ * @struct ScanConfig
+ * @brief Tuning knobs for RecordingScanner.
+ */
+struct ScanConfig {
+    int windowMs = 10000;      ///< Audio matched per analysis window
+    int hopMs = 5000;          ///< Window start spacing (boundaries are accurate to about this)
+    int batchWindows = 16;     ///< Consecutive windows matched per bestMatchBatch call
+    int threads = 0;           ///< Runs matched at once (0: every free TaskPool worker)
+    int minVotes = 8;          ///< Window winners below this are ignored (noise/talk)
+    int deltaToleranceMs = 150; ///< Alignment drift between consecutive windows of one play
+    int maxMissedWindows = 1;  ///< Windows without a detection a segment still bridges
+    int minWindows = 2;        ///< Segments detected by fewer windows are dropped
+    size_t maxWindowHashes = 3000; ///< CPU bound: window hashes are subsampled beyond this
+    MatchOptions match;        ///< With twoStage or sketchPrefilter set, windows are matched
+                               ///< one at a time with it instead of by bestMatchBatch
+};
+
+/**
+ * @struct ScanSegment
+ * @brief One play of a catalog song inside a scanned recording.
+ */
+struct ScanSegment {
+    SongRow song;
+    qint64 startMs = 0;       ///< Recording time the play starts
+    qint64 endMs = 0;         ///< Recording time the play ends
+    qint64 songOffsetMs = 0;  ///< Position inside the song at startMs
+    double confidence = 0.0;  ///< Share of window hashes aligned with the song, averaged (0-1)
+    int windows = 0;          ///< Windows that detected the play
+    int votes = 0;            ///< Their votes, summed
+};
+
+/**
+ * @class RecordingScanner
+ * @brief Offline search for every catalog track in a long recording
+ *        (DJ set, broadcast archive, ...).
+ *
+ * The recording is fingerprinted once by the caller (e.g. with
+ * Ingestor::fingerprintFile and Fingerprint::queryProfile). Its hashes
+ * are cut into windows of `windowMs` every `hopMs`; runs of
+ * `batchWindows` consecutive windows are matched with one
+ * Database::bestMatchBatch call, so that a hash shared by overlapping
+ * windows is looked up once, and the runs are spread over the TaskPool
+ * on the Normal lane (below interactive recognition, above imports).
+ *
+ * The window winners are then chained into segments: a window extends a
+ * segment of the same song if its alignment (song offset minus recording
+ * time) is within `deltaToleranceMs` of the segment's previous window,
+ * which also follows the slow drift of a tempo-adjusted mix, and if at
+ * most `maxMissedWindows` windows lie in between. Segments of different
+ * songs may interleave during a crossfade; where they overlap in the
+ * final timeline the boundary is put halfway.
+ *
+ * Matching runs on several threads only in read-pool mode
+ * (Database::setReadPool), otherwise on the calling thread.
+ */
+class RecordingScanner {
+public:
+    /// Progress callback: 0-100, on the calling thread (at the runs it
+    /// matches itself); false stops the scan (the timeline then covers the
+    /// windows matched so far)
+    using Progress = std::function<bool(int)>;
+
+    explicit RecordingScanner(Database& db, const ScanConfig& cfg = ScanConfig());
+
+    void setProgress(Progress cb) { m_progress = std::move(cb); }
+
+    /// Locate catalog songs in a recording. `hashes` are (hash, offset_ms)
+    /// of the whole recording, in any order, hashed with `scheme`.
+    /// `out` gets the segments ordered by start time.
+    bool scan(const HashList& hashes, std::vector<ScanSegment>& out, QString* err=nullptr,
+              int scheme = Fingerprint::SCHEME);
+
+private:
+    /// Winner of one window
+    struct Detection {
+        MatchResult match;
+        int queryHashes = 0;
+    };
+
+    /// Chain window winners into segments and resolve overlaps
+    void buildTimeline(const std::vector<Detection>& windows, qint64 lengthMs,
+                       std::vector<ScanSegment>& out) const;
+
+    Database& m_db;
+    ScanConfig m_cfg;
+    Progress m_progress;
+};
@@ -0,0 +1,161 @@
+#include "TrackMonitor.h"
+#include "perf/Perf.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+// Plays whose decayed score falls below this are forgotten
+static constexpr double PRUNE_SCORE = 0.5;
+
+TrackMonitor::TrackMonitor(Database& db, int sampleRate, const MonitorConfig& cfg)
+    : m_db(db), m_cfg(cfg), m_fp(sampleRate, cfg.fingerprint) {
+    m_nextEvalMs = m_cfg.hopMs;
+}
+
+/// Fingerprint new audio; evaluate at most once per push (when due)
+bool TrackMonitor::push(const int16_t* pcm, size_t n, QString* err) {
+    PERF_SCOPE("monitor.push");
+
+    m_fresh.clear();
+    m_fp.push(pcm, n, m_fresh);
+    m_window.insert(m_window.end(), m_fresh.begin(), m_fresh.end());
+
+    // A consumer that falls behind skips evaluations instead of queueing them
+    const qint64 now = m_fp.elapsedMs();
+    if (now < m_nextEvalMs) return true;
+    m_nextEvalMs = now + m_cfg.hopMs;
+    return evaluate(now, err);
+}
+
+/// Match the rolling window and update the per-song plays
+bool TrackMonitor::evaluate(qint64 nowMs, QString* err) {
+    PERF_SCOPE("monitor.evaluate");
+
+    // ---- Slide the window ----
+    const qint64 from = nowMs - m_cfg.windowMs;
+    while (!m_window.empty() && m_window.front().timeMs < from) m_window.pop_front();
+
+    decay(nowMs - m_lastEvalMs);
+    m_lastEvalMs = nowMs;
+
+    if (!m_window.empty()) {
+        // Query offsets relative to the window start (subsampled if dense)
+        const qint64 base = m_window.front().timeMs;
+        const size_t limit = std::max<size_t>(1, m_cfg.maxWindowHashes);
+        const size_t stride = (m_window.size() + limit - 1) / limit;
+
+        m_query.clear();
+        for (size_t i = 0; i < m_window.size(); i += stride) {
+            m_query.emplace_back(m_window[i].hash, int(m_window[i].timeMs - base));
+        }
+        PERF_VALUE("monitor.windowHashes", m_query.size());
+
+        MatchResult r;
+        if (!m_db.match(m_query, m_cfg.match, r, err)) return false;
+
+        if (r.found && r.votes >= m_cfg.minVotes) {
+            // Song offset minus stream time: constant for as long as the play lasts
+            const qint64 align = qint64(r.deltaMs) - base;
+
+            auto it = m_plays.find(r.song.id);
+            if (it != m_plays.end() &&
+                std::llabs(it->second.alignMs - align) > m_cfg.deltaToleranceMs) {
+                // Same song at a new alignment: a replay, so the old play is over
+                if (m_active == r.song.id) {
+                    emitEvent(TrackEvent::Ended, it->second, it->second.lastMs);
+                    m_active = -1;
+                }
+                m_plays.erase(it);
+                it = m_plays.end();
+            }
+            if (it == m_plays.end()) {
+                Play p;
+                p.alignMs = align;
+                // Song start if it is inside the window, else the window start
+                p.firstMs = std::max(base, -align);
+                it = m_plays.emplace(r.song.id, p).first;
+            }
+
+            Play& p = it->second;
+            p.song = r.song;
+            p.score += r.votes;
+            p.lastMs = nowMs;
+        }
+    }
+
+    updateActive();
+
+    // ---- Forget faded plays (keeps the table small on long streams) ----
+    for (auto it = m_plays.begin(); it != m_plays.end(); ) {
+        if (it->first != m_active && it->second.score < PRUNE_SCORE) it = m_plays.erase(it);
+        else ++it;
+    }
+    return true;
+}
+
+/// Exponential decay of every play's score
+void TrackMonitor::decay(qint64 elapsedMs) {
+    if (elapsedMs <= 0 || m_cfg.halfLifeMs <= 0) return;
+    const double f = std::pow(0.5, double(elapsedMs) / m_cfg.halfLifeMs);
+    for (auto& kv : m_plays) kv.second.score *= f;
+}
+
+/// Start/end events with hysteresis between startScore and endScore
+void TrackMonitor::updateActive() {
+    // Active play faded out
+    if (m_active >= 0) {
+        auto it = m_plays.find(m_active);
+        if (it == m_plays.end() || it->second.score < m_cfg.endScore) {
+            if (it != m_plays.end()) emitEvent(TrackEvent::Ended, it->second, it->second.lastMs);
+            m_active = -1;
+        }
+    }
+
+    // Strongest play overall
+    int leadId = -1;
+    const Play* lead = nullptr;
+    for (auto& kv : m_plays) {
+        if (!lead || kv.second.score > lead->score) {
+            leadId = kv.first;
+            lead = &kv.second;
+        }
+    }
+    if (!lead || leadId == m_active || lead->score < m_cfg.startScore) return;
+
+    // Another song overtook the active one: the stream has moved on
+    if (m_active >= 0) {
+        const Play& current = m_plays.at(m_active);
+        emitEvent(TrackEvent::Ended, current, current.lastMs);
+    }
+
+    m_active = leadId;
+    emitEvent(TrackEvent::Started, *lead, lead->firstMs);
+}
+
+void TrackMonitor::emitEvent(TrackEvent::Type type, const Play& p, qint64 atMs) {
+    PERF_COUNT(type == TrackEvent::Started ? "monitor.started" : "monitor.ended", 1);
+    if (!m_onEvent) return;
+
+    TrackEvent ev;
+    ev.type = type;
+    ev.song = p.song;
+    ev.streamMs = atMs;
+    ev.songOffsetMs = p.alignMs + atMs;
+    ev.score = p.score;
+    m_onEvent(ev);
+}
+
+/// Close the active track and start over
+void TrackMonitor::finish() {
+    if (m_active >= 0) {
+        auto it = m_plays.find(m_active);
+        if (it != m_plays.end()) emitEvent(TrackEvent::Ended, it->second, it->second.lastMs);
+    }
+
+    m_fp.reset();
+    m_window.clear();
+    m_plays.clear();
+    m_active = -1;
+    m_nextEvalMs = m_cfg.hopMs;
+    m_lastEvalMs = 0;
+}
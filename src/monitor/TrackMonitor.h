@@ -0,0 +1,115 @@
+#pragma once
+#include <QString>
+#include <deque>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include "db/Database.h"
+#include "fingerprint/StreamingFingerprinter.h"
+
+/**
+ * @struct MonitorConfig
+ * @brief Tuning knobs for TrackMonitor.
+ */
+struct MonitorConfig {
+    int windowMs = 8000;       ///< Audio matched per evaluation
+    int hopMs = 2000;          ///< Time between evaluations
+    int halfLifeMs = 6000;     ///< Half-life of the per-song decayed scores
+    int minVotes = 6;          ///< Evaluation winners below this are ignored (noise/talk)
+    double startScore = 24.0;  ///< Decayed score at which a track is declared started
+    double endScore = 6.0;     ///< Decayed score below which the active track has ended
+    int deltaToleranceMs = 120; ///< Alignment drift still counted as the same play
+    size_t maxWindowHashes = 3000; ///< CPU bound: window hashes are subsampled beyond this
+
+    /// Density of the stream's hashes (single pass: phases are ignored)
+    FingerprintProfile fingerprint = Fingerprint::queryProfile();
+
+    /// Per-evaluation match settings; early termination keeps CPU per
+    /// stream bounded once a song clearly leads
+    MatchOptions match = [] {
+        MatchOptions o;
+        o.earlyTermination = true;
+        return o;
+    }();
+};
+
+/**
+ * @struct TrackEvent
+ * @brief A detected track boundary in a monitored stream.
+ */
+struct TrackEvent {
+    enum Type { Started, Ended };
+    Type type = Started;
+    SongRow song;
+    qint64 streamMs = 0;     ///< Stream time of the boundary
+    qint64 songOffsetMs = 0; ///< Position inside the song at streamMs
+    double score = 0.0;      ///< Decayed score when the event fired
+};
+
+/**
+ * @class TrackMonitor
+ * @brief Continuous recognition of one live stream (radio, line-in, ...).
+ *
+ * Audio is fingerprinted incrementally (StreamingFingerprinter). Every
+ * `hopMs` the last `windowMs` of hashes are matched; the winner's votes
+ * feed a per-song score that decays with `halfLifeMs`, keyed by the
+ * song's alignment in the stream so that a replay counts as a new play.
+ * Started/Ended events fire when the leading score crosses
+ * startScore/endScore (hysteresis avoids flapping).
+ *
+ * Bounded resources per stream: the hash window, the fingerprinter and
+ * the score table (pruned as scores decay) do not grow with stream
+ * length; each evaluation matches at most maxWindowHashes hashes.
+ *
+ * One TrackMonitor per stream. Several monitors can run on different
+ * threads against one Database in read-pool mode (Database::setReadPool).
+ */
+class TrackMonitor {
+public:
+    using EventHandler = std::function<void(const TrackEvent&)>;
+
+    TrackMonitor(Database& db, int sampleRate, const MonitorConfig& cfg = MonitorConfig());
+
+    void setEventHandler(EventHandler handler) { m_onEvent = std::move(handler); }
+
+    /// Feed live PCM16 mono; evaluates the window once `hopMs` has passed
+    bool push(const int16_t* pcm, size_t n, QString* err=nullptr);
+
+    /// End of stream: close the active track (emits Ended) and reset
+    void finish();
+
+    /// Stream time consumed so far (ms)
+    qint64 streamMs() const { return m_fp.elapsedMs(); }
+
+    /// Song currently playing, or -1
+    int activeSongId() const { return m_active; }
+
+private:
+    /// One play of a song: decayed score plus where it aligns in the stream
+    struct Play {
+        SongRow song;
+        double score = 0.0;
+        qint64 alignMs = 0;   ///< songOffset - streamTime (constant during a play)
+        qint64 firstMs = 0;   ///< First evaluation window that matched
+        qint64 lastMs = 0;    ///< Last evaluation that matched
+    };
+
+    bool evaluate(qint64 nowMs, QString* err);
+    void decay(qint64 elapsedMs);
+    void updateActive();
+    void emitEvent(TrackEvent::Type type, const Play& p, qint64 atMs);
+
+    Database& m_db;
+    MonitorConfig m_cfg;
+    StreamingFingerprinter m_fp;
+
+    std::deque<StreamHash> m_window;      ///< Hashes of the last windowMs
+    std::vector<StreamHash> m_fresh;      ///< Scratch for push()
+    HashList m_query;                     ///< Scratch for evaluate()
+    std::unordered_map<int, Play> m_plays; ///< songId -> current play
+    int m_active = -1;
+    qint64 m_nextEvalMs = 0;
+    qint64 m_lastEvalMs = 0;
+
+    EventHandler m_onEvent;
+};
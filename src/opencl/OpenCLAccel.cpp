@@ -1,6 +1,7 @@
 #include "OpenCLAccel.h"
 
 #if USE_OPENCL
+#include "perf/Perf.h"
 #include <fstream>
 #include <string>
 
@@ -65,6 +66,7 @@ bool OpenCLAccel::magnitudeBatch(const std::vector<float>& frames,
 #if USE_OPENCL
     if (!m_ok) return false;
 
+    PERF_SCOPE("opencl.magnitudeBatch");
     cl_int err = 0;
 
     // Create kernel
@@ -79,9 +81,13 @@ bool OpenCLAccel::magnitudeBatch(const std::vector<float>& frames,
     // Assumes frames is laid out [frameCount][frameSize*2] as interleaved float2
     const cl_float2* inPtr = reinterpret_cast<const cl_float2*>(frames.data());
 
-    // Allocate device buffers
+    // Allocate device buffers (host -> device copy happens here)
+    PERF_PHASE(tUpload, "opencl.upload");
+    PERF_PHASE_START(tUpload);
     cl_mem bufIn  = clCreateBuffer(m_ctx, CL_MEM_READ_ONLY  | CL_MEM_COPY_HOST_PTR,
                                    inBytes, (void*)inPtr, &err);
+    PERF_PHASE_STOP(tUpload);
+    PERF_COUNT("opencl.bytesUploaded", inBytes);
     if (err != CL_SUCCESS) { clReleaseKernel(kernel); return false; }
 
     cl_mem bufOut = clCreateBuffer(m_ctx, CL_MEM_WRITE_ONLY,
@@ -98,16 +104,23 @@ bool OpenCLAccel::magnitudeBatch(const std::vector<float>& frames,
     }
 
     // Launch kernel (1 work-item per FFT bin)
+    PERF_PHASE(tKernel, "opencl.kernel");
+    PERF_PHASE_START(tKernel);
     size_t globalSize = totalElems;
     err = clEnqueueNDRangeKernel(m_q, kernel, 1, nullptr, &globalSize, nullptr, 0, nullptr, nullptr);
+    PERF_PHASE_STOP(tKernel);
     if (err != CL_SUCCESS) {
         clReleaseMemObject(bufIn); clReleaseMemObject(bufOut); clReleaseKernel(kernel);
         return false;
     }
 
-    // Read results back
+    // Read results back (blocking, so this also waits for the kernel)
+    PERF_PHASE(tDownload, "opencl.download");
+    PERF_PHASE_START(tDownload);
     outPower.resize(totalElems);
     err = clEnqueueReadBuffer(m_q, bufOut, CL_TRUE, 0, outBytes, outPower.data(), 0, nullptr, nullptr);
+    PERF_PHASE_STOP(tDownload);
+    PERF_COUNT("opencl.bytesDownloaded", outBytes);
     if (err != CL_SUCCESS) {
         clReleaseMemObject(bufIn); clReleaseMemObject(bufOut); clReleaseKernel(kernel);
         return false;
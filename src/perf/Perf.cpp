@@ -0,0 +1,189 @@
+#include "Perf.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+using namespace perf;
+
+// Escape a metric name for JSON output (names are plain identifiers in practice)
+static std::string jsonString(const std::string& s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out + "\"";
+}
+
+/// Add one value to the distribution
+void Histogram::add(double v) {
+    if (count == 0 || v < min) min = v;
+    if (count == 0 || v > max) max = v;
+    ++count;
+    sum += v;
+
+    size_t bucket = 0;
+    for (uint64_t x = v > 1.0 ? uint64_t(v) : 1; x > 1; x >>= 1) ++bucket;
+    if (buckets.size() <= bucket) buckets.resize(bucket + 1, 0);
+    ++buckets[bucket];
+}
+
+Registry::Registry() : m_epoch(Clock::now()) {}
+
+Registry& Registry::instance() {
+    static Registry r;
+    return r;
+}
+
+int Registry::threadId() {
+    static std::atomic<int> next{1};
+    thread_local int id = next++;
+    return id;
+}
+
+void Registry::count(const char* name, int64_t delta) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_counters[name] += delta;
+}
+
+void Registry::record(const char* name, double value) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_histograms[name].add(value);
+}
+
+void Registry::traceEvent(const char* name, Clock::time_point start, Clock::time_point end) {
+    if (!m_tracing) return;
+
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+    TraceEvent e{name,
+                 duration_cast<microseconds>(start - m_epoch).count(),
+                 duration_cast<microseconds>(end - start).count(),
+                 threadId()};
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_events.size() >= m_maxEvents) { ++m_droppedEvents; return; }
+    m_events.push_back(e);
+}
+
+void Registry::setMaxEvents(size_t n) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_maxEvents = n;
+}
+
+void Registry::reset() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_counters.clear();
+    m_histograms.clear();
+    m_events.clear();
+    m_droppedEvents = 0;
+    m_epoch = Clock::now();
+}
+
+/// {"counters": {...}, "histograms": {name: {count,sum,min,max,mean,buckets}}}
+bool Registry::exportJson(const std::string& path, std::string* err) const {
+    std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+    if (!ofs) {
+        if (err) *err = "Cannot write " + path;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Sorted output keeps diffs between runs readable
+    std::map<std::string, int64_t> counters(m_counters.begin(), m_counters.end());
+    std::map<std::string, Histogram> hists(m_histograms.begin(), m_histograms.end());
+
+    ofs << "{\n  \"counters\": {";
+    bool first = true;
+    for (auto& c : counters) {
+        ofs << (first ? "\n" : ",\n") << "    " << jsonString(c.first) << ": " << c.second;
+        first = false;
+    }
+    ofs << "\n  },\n  \"histograms\": {";
+
+    first = true;
+    for (auto& h : hists) {
+        const Histogram& v = h.second;
+        ofs << (first ? "\n" : ",\n") << "    " << jsonString(h.first) << ": {"
+            << "\"count\": " << v.count
+            << ", \"sum\": " << v.sum
+            << ", \"min\": " << v.min
+            << ", \"max\": " << v.max
+            << ", \"mean\": " << (v.count ? v.sum / v.count : 0.0)
+            << ", \"buckets\": [";
+        for (size_t i = 0; i < v.buckets.size(); ++i) ofs << (i ? ", " : "") << v.buckets[i];
+        ofs << "]}";
+        first = false;
+    }
+    ofs << "\n  },\n  \"droppedTraceEvents\": " << m_droppedEvents << "\n}\n";
+
+    return bool(ofs);
+}
+
+/// {"traceEvents": [{"name","ph":"X","ts","dur","pid","tid"}, ...]}
+bool Registry::exportChromeTrace(const std::string& path, std::string* err) const {
+    std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+    if (!ofs) {
+        if (err) *err = "Cannot write " + path;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    ofs << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    for (size_t i = 0; i < m_events.size(); ++i) {
+        const TraceEvent& e = m_events[i];
+        ofs << (i ? ",\n" : "\n")
+            << "{\"name\": " << jsonString(e.name)
+            << ", \"ph\": \"X\", \"ts\": " << e.tsUs
+            << ", \"dur\": " << e.durUs
+            << ", \"pid\": 1, \"tid\": " << e.tid << "}";
+    }
+    ofs << "\n]}\n";
+
+    return bool(ofs);
+}
+
+std::string Registry::summary() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::map<std::string, Histogram> hists(m_histograms.begin(), m_histograms.end());
+    std::map<std::string, int64_t> counters(m_counters.begin(), m_counters.end());
+
+    // Timer histograms are in nanoseconds; other histograms are raw values
+    std::ostringstream os;
+    char line[256];
+    for (auto& h : hists) {
+        const Histogram& v = h.second;
+        std::snprintf(line, sizeof(line), "%-32s n=%-8llu mean=%-12.0f max=%.0f\n",
+                      h.first.c_str(), (unsigned long long)v.count,
+                      v.count ? v.sum / v.count : 0.0, v.max);
+        os << line;
+    }
+    for (auto& c : counters) {
+        std::snprintf(line, sizeof(line), "%-32s %lld\n", c.first.c_str(), (long long)c.second);
+        os << line;
+    }
+    return os.str();
+}
+
+ScopedTimer::~ScopedTimer() {
+    auto end = Clock::now();
+    auto& r = Registry::instance();
+    r.record(m_name, double(std::chrono::duration_cast<std::chrono::nanoseconds>(end - m_start).count()));
+    r.traceEvent(m_name, m_start, end);
+}
+
+PhaseTimer::~PhaseTimer() {
+    if (!m_started) return;
+
+    auto& r = Registry::instance();
+    r.record(m_name, double(std::chrono::duration_cast<std::chrono::nanoseconds>(m_total).count()));
+
+    // Shown in the trace as one block whose length is the accumulated time
+    r.traceEvent(m_name, m_first, m_first + m_total);
+}
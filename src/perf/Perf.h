@@ -0,0 +1,165 @@
+#pragma once
+
+// Compile-time toggle: CMake sets USE_PERF=0 unless ENABLE_PERF=ON.
+// When disabled, every PERF_* macro below expands to nothing.
+#ifndef USE_PERF
+#define USE_PERF 0
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @namespace perf
+ * @brief Lightweight counters, histograms and scoped timers.
+ *
+ * Provides:
+ *  - Named counters (monotonic 64-bit sums).
+ *  - Named histograms (count/sum/min/max + log2 buckets).
+ *  - Scoped timers that feed a histogram and, when tracing is on,
+ *    record a Chrome trace "complete" event.
+ *  - Phase timers that accumulate many short intervals (e.g. the FFT
+ *    of every frame) and report them once.
+ *  - Export as plain JSON and as a Chrome trace-event file
+ *    (load it in chrome://tracing or https://ui.perfetto.dev).
+ *
+ * Instrumented code should only use the PERF_* macros so it compiles
+ * to nothing when USE_PERF=0.
+ */
+namespace perf {
+    using Clock = std::chrono::steady_clock;
+
+    /// Aggregated distribution of recorded values (timers record ns)
+    struct Histogram {
+        uint64_t count = 0;
+        double sum = 0.0;
+        double min = 0.0;
+        double max = 0.0;
+        std::vector<uint64_t> buckets; ///< bucket i: values in [2^i, 2^(i+1))
+
+        void add(double v);
+    };
+
+    /// One Chrome trace "X" (complete) event
+    struct TraceEvent {
+        const char* name;  ///< Must be a string literal
+        int64_t tsUs;      ///< Start, microseconds since registry epoch
+        int64_t durUs;     ///< Duration, microseconds
+        int tid;           ///< Small per-thread id
+    };
+
+    /**
+     * @class Registry
+     * @brief Process-wide store for all counters, histograms and events.
+     */
+    class Registry {
+    public:
+        static Registry& instance();
+
+        void count(const char* name, int64_t delta);
+        void record(const char* name, double value);
+        void traceEvent(const char* name, Clock::time_point start, Clock::time_point end);
+
+        /// Enable/disable trace-event capture (counters and histograms are always on)
+        void setTracing(bool on) { m_tracing = on; }
+        bool tracing() const { return m_tracing; }
+
+        /// Upper bound on buffered trace events; extra events are dropped and counted
+        void setMaxEvents(size_t n);
+
+        /// Forget everything recorded so far
+        void reset();
+
+        /// Write counters + histograms as JSON
+        bool exportJson(const std::string& path, std::string* err=nullptr) const;
+
+        /// Write buffered trace events in Chrome trace-event format
+        bool exportChromeTrace(const std::string& path, std::string* err=nullptr) const;
+
+        /// Short human-readable summary (one line per histogram/counter)
+        std::string summary() const;
+
+        /// Small stable id for the calling thread
+        static int threadId();
+
+    private:
+        Registry();
+
+        mutable std::mutex m_mutex;
+        std::unordered_map<std::string, int64_t> m_counters;
+        std::unordered_map<std::string, Histogram> m_histograms;
+        std::vector<TraceEvent> m_events;
+        size_t m_maxEvents = 1u << 20;
+        uint64_t m_droppedEvents = 0;
+        std::atomic<bool> m_tracing{false};
+        Clock::time_point m_epoch;
+    };
+
+    /**
+     * @class ScopedTimer
+     * @brief Times its own lifetime into histogram `name` (ns).
+     */
+    class ScopedTimer {
+    public:
+        explicit ScopedTimer(const char* name) : m_name(name), m_start(Clock::now()) {}
+        ~ScopedTimer();
+
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    private:
+        const char* m_name;
+        Clock::time_point m_start;
+    };
+
+    /**
+     * @class PhaseTimer
+     * @brief Accumulates many start()/stop() intervals; reports the total
+     *        as one histogram sample and one trace event on destruction.
+     */
+    class PhaseTimer {
+    public:
+        explicit PhaseTimer(const char* name) : m_name(name) {}
+        ~PhaseTimer();
+
+        void start() { m_t0 = Clock::now(); if (!m_started) { m_first = m_t0; m_started = true; } }
+        void stop() { m_total += Clock::now() - m_t0; }
+
+        PhaseTimer(const PhaseTimer&) = delete;
+        PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+    private:
+        const char* m_name;
+        bool m_started = false;
+        Clock::time_point m_first, m_t0;
+        Clock::duration m_total{0};
+    };
+}
+
+#define PERF_CAT_(a, b) a##b
+#define PERF_CAT(a, b) PERF_CAT_(a, b)
+
+#if USE_PERF
+/// Time the enclosing scope
+#define PERF_SCOPE(name) perf::ScopedTimer PERF_CAT(perfScope_, __LINE__)(name)
+/// Add `n` to counter `name`
+#define PERF_COUNT(name, n) perf::Registry::instance().count(name, (int64_t)(n))
+/// Record value `v` into histogram `name`
+#define PERF_VALUE(name, v) perf::Registry::instance().record(name, (double)(v))
+/// Declare an accumulating phase timer / mark its intervals
+#define PERF_PHASE(var, name) perf::PhaseTimer var(name)
+#define PERF_PHASE_START(var) var.start()
+#define PERF_PHASE_STOP(var) var.stop()
+#else
+#define PERF_SCOPE(name)
+#define PERF_COUNT(name, n) ((void)0)
+#define PERF_VALUE(name, v) ((void)0)
+#define PERF_PHASE(var, name)
+#define PERF_PHASE_START(var) ((void)0)
+#define PERF_PHASE_STOP(var) ((void)0)
+#endif
@@ -0,0 +1,109 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+/**
+ * @class BoundedQueue
+ * @brief Fixed-capacity multi-producer / multi-consumer FIFO.
+ *
+ * Used between the stages of RecognitionServer. Producers either fail fast
+ * (tryPush, for admission control) or block until there is room (push).
+ * close() wakes everyone: pushes fail, pops drain what is left and then
+ * return false.
+ */
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : m_capacity(capacity ? capacity : 1) {}
+
+    /// Enqueue without waiting; false if full or closed
+    bool tryPush(T&& item) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_closed || m_items.size() >= m_capacity) return false;
+            m_items.push_back(std::move(item));
+        }
+        m_notEmpty.notify_one();
+        return true;
+    }
+
+    /// Enqueue, waiting for room; false if the queue was closed
+    bool push(T&& item) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_notFull.wait(lock, [this] { return m_closed || m_items.size() < m_capacity; });
+            if (m_closed) return false;
+            m_items.push_back(std::move(item));
+        }
+        m_notEmpty.notify_one();
+        return true;
+    }
+
+    /// Dequeue one item, waiting for it; false once closed and drained
+    bool pop(T& out) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_notEmpty.wait(lock, [this] { return m_closed || !m_items.empty(); });
+            if (m_items.empty()) return false;
+            out = std::move(m_items.front());
+            m_items.pop_front();
+        }
+        m_notFull.notify_one();
+        return true;
+    }
+
+    /// Dequeue up to `maxItems`: wait for the first one, then keep collecting
+    /// for at most `window` so that bursts are handled together.
+    /// False once closed and drained.
+    bool popBatch(std::vector<T>& out, size_t maxItems, std::chrono::microseconds window) {
+        out.clear();
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_notEmpty.wait(lock, [this] { return m_closed || !m_items.empty(); });
+            if (m_items.empty()) return false;
+
+            const auto deadline = std::chrono::steady_clock::now() + window;
+            while (out.size() < maxItems) {
+                if (m_items.empty()) {
+                    if (m_closed || !m_notEmpty.wait_until(lock, deadline, [this] {
+                            return m_closed || !m_items.empty();
+                        })) break;
+                    if (m_items.empty()) break;
+                }
+                out.push_back(std::move(m_items.front()));
+                m_items.pop_front();
+            }
+        }
+        m_notFull.notify_all();
+        return true;
+    }
+
+    /// Reject further pushes and wake all waiters
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed = true;
+        }
+        m_notEmpty.notify_all();
+        m_notFull.notify_all();
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_items.size();
+    }
+
+    size_t capacity() const { return m_capacity; }
+
+private:
+    const size_t m_capacity;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_notEmpty;
+    std::condition_variable m_notFull;
+    std::deque<T> m_items;
+    bool m_closed = false;
+};
@@ -0,0 +1,582 @@
+#include "RecognitionServer.h"
+#include "fingerprint/Fingerprint.h"
+#include "perf/Perf.h"
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMetaObject>
+#include <QTextStream>
+#include <QTimer>
+#include <QtEndian>
+#include <algorithm>
+
+using Clock = std::chrono::steady_clock;
+
+static constexpr int MIN_SAMPLE_RATE = 8000;
+static constexpr int MAX_SAMPLE_RATE = 192000;
+static constexpr int HEADER_BYTES    = 8;      // requestId + sampleRate
+static constexpr quint32 HASH_QUERY_BYTES = 12; // scheme + topK + budgetMs
+
+// A batch runs under the earliest deadline of its jobs; a later job joins
+// only while that still leaves it this share of its own remaining time
+static constexpr int BATCH_BUDGET_SHARE_PCT = 75;
+
+static qint64 msBetween(Clock::time_point a, Clock::time_point b) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(b - a).count();
+}
+
+/// Whether a job expiring at `later` may be matched under `earliest`
+/// (both as Deadline::expiry(), max meaning none)
+static bool sharesDeadline(Clock::time_point earliest, Clock::time_point later,
+                           Clock::time_point now) {
+    if (earliest == Clock::time_point::max()) return true;
+    if (later == Clock::time_point::max()) return false;
+    return (earliest - now) * 100 >= (later - now) * BATCH_BUDGET_SHARE_PCT;
+}
+
+RecognitionServer::RecognitionServer(const ServerConfig& cfg, QObject* parent)
+    : QObject(parent),
+      m_cfg(cfg),
+      m_matchQueue(size_t(std::max(1, cfg.maxPending))) {}
+
+RecognitionServer::~RecognitionServer() {
+    stop();
+}
+
+/// Open the catalog and start the matchers, or connect to the shards; then listen
+bool RecognitionServer::start(QString* err) {
+    if (m_running) return true;
+
+    // Fingerprinting runs on the process-wide pool. Sized first: opening a
+    // replica replays changes, and a replayed re-index already uses it.
+    TaskPool::setDefaultThreads(m_cfg.workers);
+
+    if (m_cfg.shards.isEmpty()) {
+        if (!openCatalog(err)) return false;
+        for (int i = 0; i < std::max(1, m_cfg.matchers); ++i) {
+            m_matchers.emplace_back(&RecognitionServer::matchLoop, this);
+        }
+    } else {
+        // Coordinator: the catalog lives in the shards
+        m_coordinator = new ShardCoordinator(m_cfg.shards, this);
+        m_coordinator->setTopK(m_cfg.topK);
+        m_coordinator->setTimeoutMs(m_cfg.shardTimeoutMs);
+        m_coordinator->setScheme(m_cfg.scheme);
+        QString shardErr;
+        if (!m_coordinator->start(&shardErr)) {
+            if (err) *err = "Shards: " + shardErr;
+            delete m_coordinator;
+            m_coordinator = nullptr;
+            return false;
+        }
+        // Requests are fingerprinted here with the shards' scheme
+        m_scheme = m_coordinator->scheme();
+        if (!FingerprintKernels::find(m_scheme)) {
+            if (err) *err = QString("Shards serve fingerprint scheme %1, which this build does not have")
+                                .arg(m_scheme.load());
+            delete m_coordinator;
+            m_coordinator = nullptr;
+            return false;
+        }
+    }
+
+    m_fingerprinting = std::make_unique<TaskGroup>();
+    m_running = true;
+
+    m_server = new QLocalServer(this);
+    connect(m_server, &QLocalServer::newConnection, this, &RecognitionServer::onNewConnection);
+
+    // A stale socket file from a crashed instance would make listen() fail
+    QLocalServer::removeServer(m_cfg.socketName);
+    if (!m_server->listen(m_cfg.socketName)) {
+        if (err) *err = "Listen: " + m_server->errorString();
+        stop();
+        return false;
+    }
+
+    if (m_replica) {
+        m_replicaTimer = new QTimer(this);
+        connect(m_replicaTimer, &QTimer::timeout, this, &RecognitionServer::pollReplica);
+        m_replicaTimer->start(std::max(10, m_cfg.replicaPollMs));
+    }
+    return true;
+}
+
+/// Opened (and migrated) here; matcher threads only read through their
+/// own pooled connections
+bool RecognitionServer::openCatalog(QString* err) {
+    m_db = std::make_unique<Database>(m_cfg.dbPath);
+    QString dbErr;
+    if (!m_db->open(&dbErr)) {
+        if (err) *err = "DB: " + dbErr;
+        m_db.reset();
+        return false;
+    }
+    // A new replica takes the primary's fingerprint scheme
+    int primaryScheme = 0;
+    if (!m_cfg.replicaOf.isEmpty()) {
+        m_replica = std::make_unique<Replica>(*m_db, m_cfg.replicaOf);
+        if (!m_replica->primaryScheme(primaryScheme, &dbErr)) {
+            if (err) *err = "Replica: " + dbErr;
+            m_replica.reset();
+            m_db.reset();
+            return false;
+        }
+        if (primaryScheme > 0) m_db->setScheme(primaryScheme);
+    }
+    if (!m_db->migrate(&dbErr)) {
+        if (err) *err = "DB: " + dbErr;
+        m_replica.reset();
+        m_db.reset();
+        return false;
+    }
+    if (!m_db->setHotHashPolicy(m_cfg.hotHashes, &dbErr)) {
+        if (err) *err = "DB: " + dbErr;
+        m_replica.reset();
+        m_db.reset();
+        return false;
+    }
+    // Read replica: catch up with the primary before serving anything
+    if (m_replica) {
+        int applied = 0;
+        if (!m_replica->poll(applied, &dbErr)) {
+            if (err) *err = "Replica: " + dbErr;
+            m_replica.reset();
+            m_db.reset();
+            return false;
+        }
+    }
+    // First requests should not pay for cold index pages
+    if (!m_db->warmIndex({}, &dbErr)) {
+        if (err) *err = "DB: " + dbErr;
+        m_db.reset();
+        return false;
+    }
+    m_db->setReadPool(true);
+    m_scheme = m_db->scheme();
+    return true;
+}
+
+/// Errors (e.g. the primary is busy or unreachable) are reported once and
+/// retried on the next tick
+void RecognitionServer::pollReplica() {
+    int applied = 0;
+    QString err;
+    const bool ok = m_replica->poll(applied, &err);
+    m_scheme = m_db->scheme(); // a replayed re-index may have converted the catalog
+    if (ok) {
+        m_replicaError.clear();
+        return;
+    }
+    if (err != m_replicaError) {
+        QTextStream(stderr) << "Replication: " << err << "\n";
+        m_replicaError = err;
+    }
+}
+
+/// Stop accepting, let queued work drain, join the matchers
+void RecognitionServer::stop() {
+    m_running = false; // admit() turns new requests away from here on
+    if (m_server) m_server->close();
+    if (m_replicaTimer) m_replicaTimer->stop();
+
+    // Fingerprinting finishes before the matcher queue closes, so
+    // everything already admitted still gets matched
+    if (m_fingerprinting) m_fingerprinting->wait();
+    if (m_coordinator) m_coordinator->stop();
+
+    m_matchQueue.close();
+    for (auto& t : m_matchers) t.join();
+    m_matchers.clear();
+}
+
+quint32 RecognitionServer::maxFrameBytes() const {
+    return quint32(HEADER_BYTES) + quint32(std::max(1, m_cfg.maxSeconds)) * MAX_SAMPLE_RATE * 2;
+}
+
+// ---- Event-loop side ----
+
+void RecognitionServer::onNewConnection() {
+    while (QLocalSocket* socket = m_server->nextPendingConnection()) {
+        const quint64 id = m_nextClientId++;
+        m_clients[id].socket = socket;
+
+        connect(socket, &QLocalSocket::readyRead, this, [this, id] { onReadyRead(id); });
+        connect(socket, &QLocalSocket::disconnected, this, [this, id] { onDisconnected(id); });
+        PERF_COUNT("server.connections", 1);
+    }
+}
+
+void RecognitionServer::onDisconnected(quint64 clientId) {
+    auto it = m_clients.find(clientId);
+    if (it == m_clients.end()) return;
+
+    // Replies still in flight for this client are dropped in deliver()
+    it->second.socket->deleteLater();
+    m_clients.erase(it);
+}
+
+void RecognitionServer::onReadyRead(quint64 clientId) {
+    auto it = m_clients.find(clientId);
+    if (it == m_clients.end()) return;
+
+    Client& c = it->second;
+    c.buffer.append(c.socket->readAll());
+
+    if (!parseFrames(clientId, c)) {
+        // Framing is lost; nothing after this point can be trusted
+        c.socket->write(errorLine(0, "bad frame"));
+        c.socket->disconnectFromServer();
+    }
+}
+
+/// Split the buffer into frames; each complete frame becomes a Job
+bool RecognitionServer::parseFrames(quint64 clientId, Client& c) {
+    while (c.buffer.size() >= 4) {
+        const uchar* p = reinterpret_cast<const uchar*>(c.buffer.constData());
+        const quint32 len = qFromLittleEndian<quint32>(p);
+
+        if (len < quint32(HEADER_BYTES) || len > maxFrameBytes()) return false;
+        if (qint64(c.buffer.size()) < 4 + qint64(len)) break; // wait for the rest
+
+        auto job = std::make_unique<Job>();
+        job->clientId = clientId;
+        job->requestId = qFromLittleEndian<quint32>(p + 4);
+        job->sampleRate = int(qFromLittleEndian<quint32>(p + 8));
+        job->received = Clock::now();
+        if (m_cfg.deadlineMs > 0) {
+            job->deadline = Deadline::at(job->received + std::chrono::milliseconds(m_cfg.deadlineMs));
+        }
+
+        // Sample rate 0: a hash query
+        if (job->sampleRate == 0) {
+            if (len < quint32(HEADER_BYTES + HASH_QUERY_BYTES) ||
+                (len - HEADER_BYTES - HASH_QUERY_BYTES) % 8 != 0) {
+                return false;
+            }
+            const bool ours = parseHashQuery(*job, p + 4 + HEADER_BYTES, len - HEADER_BYTES);
+            c.buffer.remove(0, 4 + qsizetype(len));
+            if (job->scheme == 0 && len == quint32(HEADER_BYTES + HASH_QUERY_BYTES)) {
+                // Scheme 0 without hashes: which scheme is served here
+                deliver(clientId, schemeLine(job->requestId, m_scheme), false);
+            } else if (m_coordinator) {
+                deliver(clientId, errorLine(job->requestId, "hash queries go to the shards"), false);
+            } else if (!ours) {
+                deliver(clientId, errorLine(job->requestId,
+                                            QString("fingerprint scheme %1 not served (catalog: %2)")
+                                                .arg(job->scheme).arg(m_scheme.load())), false);
+            } else {
+                admit(std::move(job));
+            }
+            continue;
+        }
+        if ((len - HEADER_BYTES) % 2 != 0) return false;
+
+        const qsizetype samples = qsizetype(len - HEADER_BYTES) / 2;
+        job->pcm.resize(size_t(samples));
+        qFromLittleEndian<qint16>(p + 4 + HEADER_BYTES, samples, job->pcm.data());
+
+        c.buffer.remove(0, 4 + qsizetype(len));
+
+        if (job->sampleRate < MIN_SAMPLE_RATE || job->sampleRate > MAX_SAMPLE_RATE) {
+            deliver(clientId, errorLine(job->requestId, "unsupported sample rate"), false);
+            continue;
+        }
+        if (samples > qsizetype(m_cfg.maxSeconds) * job->sampleRate) {
+            deliver(clientId, errorLine(job->requestId, "clip too long"), false);
+            continue;
+        }
+
+        admit(std::move(job));
+    }
+    return true;
+}
+
+/// Scheme, top-K, budget and hashes; false if the scheme is not ours
+bool RecognitionServer::parseHashQuery(Job& job, const uchar* p, quint32 bytes) const {
+    job.hashQuery = true;
+    job.scheme = int(qFromLittleEndian<quint32>(p));
+    job.topK = std::max(1, int(qFromLittleEndian<quint32>(p + 4)));
+    const quint32 budgetMs = qFromLittleEndian<quint32>(p + 8);
+    if (budgetMs > 0) {
+        const Clock::time_point until = job.received + std::chrono::milliseconds(budgetMs);
+        if (until < job.deadline.expiry()) job.deadline = Deadline::at(until);
+    }
+    if (job.scheme != m_scheme) return false;
+
+    const quint32 n = (bytes - HASH_QUERY_BYTES) / 8;
+    job.hashes.reserve(n);
+    for (const uchar* h = p + HASH_QUERY_BYTES; h < p + bytes; h += 8) {
+        job.hashes.emplace_back(qFromLittleEndian<quint32>(h), qFromLittleEndian<qint32>(h + 4));
+    }
+    return true;
+}
+
+/// Reject instead of queueing once maxPending requests are in flight
+void RecognitionServer::admit(JobPtr job) {
+    const quint64 clientId = job->clientId;
+    const quint32 requestId = job->requestId;
+
+    if (!m_running || m_pending >= m_cfg.maxPending) {
+        PERF_COUNT("server.rejected", 1);
+        deliver(clientId, errorLine(requestId, "busy"), false);
+        return;
+    }
+
+    ++m_pending;
+    PERF_COUNT("server.admitted", 1);
+    PERF_VALUE("server.pending", m_pending);
+
+    // Fingerprinted by the sender; the queue has room for every admitted job
+    if (job->hashQuery) {
+        job->matchQueued = Clock::now();
+        m_matchQueue.push(std::move(job));
+        return;
+    }
+
+    // Tasks must be copyable; the job moves out when the task runs
+    auto held = std::make_shared<JobPtr>(std::move(job));
+    m_fingerprinting->submit(TaskLane::Interactive, [this, held] {
+        fingerprint(std::move(*held));
+    });
+}
+
+void RecognitionServer::deliver(quint64 clientId, const QByteArray& line, bool completesJob) {
+    if (completesJob) --m_pending;
+
+    auto it = m_clients.find(clientId);
+    if (it == m_clients.end()) return;
+    it->second.socket->write(line);
+}
+
+void RecognitionServer::postReply(quint64 clientId, const QByteArray& line) {
+    QMetaObject::invokeMethod(this, [this, clientId, line] {
+        deliver(clientId, line, true);
+    }, Qt::QueuedConnection);
+}
+
+QByteArray RecognitionServer::errorLine(quint32 requestId, const QString& error) {
+    QJsonObject o;
+    o["id"] = qint64(requestId);
+    o["error"] = error;
+    return QJsonDocument(o).toJson(QJsonDocument::Compact) + '\n';
+}
+
+QByteArray RecognitionServer::schemeLine(quint32 requestId, int scheme) {
+    QJsonObject o;
+    o["id"] = qint64(requestId);
+    o["scheme"] = scheme;
+    return QJsonDocument(o).toJson(QJsonDocument::Compact) + '\n';
+}
+
+QByteArray RecognitionServer::resultLine(const Job& job, const MatchResult& r,
+                                         Clock::time_point now) {
+    QJsonObject o;
+    o["id"] = qint64(job.requestId);
+    o["found"] = r.found;
+    if (job.incomplete || r.incomplete) o["incomplete"] = true;
+    if (r.found) {
+        o["songId"] = r.song.id;
+        o["title"] = r.song.title;
+        o["artist"] = r.song.artist;
+        o["album"] = r.song.album;
+        o["year"] = r.song.year;
+        o["genre"] = r.song.genre;
+        o["votes"] = r.votes;
+        o["deltaMs"] = r.deltaMs;
+    }
+    o["queueMs"] = msBetween(job.matchQueued, now);
+    o["totalMs"] = msBetween(job.received, now);
+    return QJsonDocument(o).toJson(QJsonDocument::Compact) + '\n';
+}
+
+/// Shard reply to a hash query: its top-K songs
+QByteArray RecognitionServer::candidatesLine(const Job& job, const MatchResult& r,
+                                             Clock::time_point now) {
+    QJsonArray candidates;
+    for (size_t i = 0; i < r.candidates.size() && int(i) < job.topK; ++i) {
+        candidates.append(ShardCoordinator::toJson(r.candidates[i]));
+    }
+
+    QJsonObject o;
+    o["id"] = qint64(job.requestId);
+    o["candidates"] = candidates;
+    if (job.incomplete || r.incomplete) o["incomplete"] = true;
+    o["queueMs"] = msBetween(job.matchQueued, now);
+    o["totalMs"] = msBetween(job.received, now);
+    return QJsonDocument(o).toJson(QJsonDocument::Compact) + '\n';
+}
+
+/// Coordinator reply: the merged winner in the usual fields, plus where it
+/// lives and how many shards answered
+QByteArray RecognitionServer::clusterLine(const Job& job, const ClusterResult& r,
+                                          Clock::time_point now) {
+    QJsonObject o;
+    o["id"] = qint64(job.requestId);
+    o["found"] = !r.candidates.empty();
+    if (job.incomplete || r.incomplete) o["incomplete"] = true;
+    if (!r.candidates.empty()) {
+        const ShardCandidate& best = r.candidates.front();
+        const QJsonObject winner = ShardCoordinator::toJson(best.match);
+        for (auto it = winner.begin(); it != winner.end(); ++it) o[it.key()] = it.value();
+        o["shard"] = best.shard;
+
+        QJsonArray candidates;
+        for (const ShardCandidate& c : r.candidates) {
+            QJsonObject co = ShardCoordinator::toJson(c.match);
+            co["shard"] = c.shard;
+            candidates.append(co);
+        }
+        o["candidates"] = candidates;
+    }
+    o["shards"] = r.shards;
+    o["shardsAnswered"] = r.answered;
+    o["queueMs"] = msBetween(job.matchQueued, now);
+    o["totalMs"] = msBetween(job.received, now);
+    return QJsonDocument(o).toJson(QJsonDocument::Compact) + '\n';
+}
+
+// ---- Worker side ----
+
+/// PCM -> fingerprints, then on to the matcher
+void RecognitionServer::fingerprint(JobPtr job) {
+    {
+        PERF_SCOPE("server.fingerprint");
+        job->scheme = m_scheme;
+        const FingerprintKernels* kernels = FingerprintKernels::find(job->scheme);
+        if (!kernels) {
+            postReply(job->clientId, errorLine(job->requestId,
+                                               QString("fingerprint scheme %1 not in this build")
+                                                   .arg(job->scheme)));
+            return;
+        }
+        job->hashes = kernels->compute(job->pcm, job->sampleRate, m_cfg.query,
+                                       job->deadline, &job->incomplete);
+    }
+    std::vector<int16_t>().swap(job->pcm); // audio is no longer needed
+
+    job->matchQueued = Clock::now();
+    if (m_coordinator) {
+        // The shard sockets belong to the event-loop thread
+        auto held = std::make_shared<JobPtr>(std::move(job));
+        QMetaObject::invokeMethod(this, [this, held] { route(std::move(*held)); },
+                                  Qt::QueuedConnection);
+        return;
+    }
+    m_matchQueue.push(std::move(job)); // open until every fingerprint task is done
+}
+
+void RecognitionServer::route(JobPtr job) {
+    PERF_SCOPE("server.route");
+    std::shared_ptr<Job> routed(std::move(job));
+    m_coordinator->query(routed->hashes, routed->scheme, routed->deadline,
+                         [this, routed](const ClusterResult& r) {
+        deliver(routed->clientId, clusterLine(*routed, r, Clock::now()), true);
+    });
+    HashList().swap(routed->hashes); // sent; only the reply is still to come
+}
+
+/// Matches queries in batches sharing posting lookups
+void RecognitionServer::matchLoop() {
+    // Lookups bestMatchBatch hands to the pool outrank background work
+    TaskPool::LaneScope lane(TaskLane::Interactive);
+    QString err;
+    std::vector<JobPtr> batch;
+    std::vector<HashList> queries;
+    std::vector<MatchResult> results;
+    const auto window = std::chrono::microseconds(std::max(0, m_cfg.batchWindowUs));
+
+    const bool perQuery = m_cfg.match.twoStage || m_cfg.match.sketchPrefilter;
+    MatchResult result;
+    std::vector<Job*> live;
+
+    auto reply = [this](const Job& job, const MatchResult& r, Clock::time_point now) {
+        postReply(job.clientId, job.hashQuery ? candidatesLine(job, r, now)
+                                              : resultLine(job, r, now));
+    };
+
+    while (m_matchQueue.popBatch(batch, size_t(std::max(1, m_cfg.maxBatch)), window)) {
+        PERF_SCOPE("server.matchBatch");
+        PERF_VALUE("server.batchSize", batch.size());
+
+        // Shortlisting strategies match each query on its own
+        if (perQuery) {
+            for (auto& job : batch) {
+                MatchOptions opts = m_cfg.match;
+                opts.scheme = job->scheme;
+                opts.deadline = job->deadline;
+                opts.topK = job->topK;
+                bool ok = true;
+                if (job->deadline.expired()) {
+                    job->incomplete = true;
+                    result = MatchResult();
+                } else {
+                    ok = m_db->match(job->hashes, opts, result, &err);
+                }
+                if (!ok) {
+                    postReply(job->clientId, errorLine(job->requestId, err));
+                    continue;
+                }
+                reply(*job, result, Clock::now());
+            }
+            continue;
+        }
+
+        // Jobs hashed before a replayed re-index changed the scheme cannot
+        // share the batch; they get an error and may be resent. Jobs out of
+        // time while queued are answered as is.
+        const int scheme = batch.front()->scheme;
+        live.clear();
+        for (auto& job : batch) {
+            if (job->scheme != scheme) {
+                postReply(job->clientId, errorLine(job->requestId, "fingerprint scheme changed"));
+            } else if (job->deadline.expired()) {
+                job->incomplete = true;
+                reply(*job, MatchResult(), Clock::now());
+            } else {
+                live.push_back(job.get());
+            }
+        }
+
+        // Runs of jobs with close deadlines share one bestMatchBatch (see
+        // sharesDeadline); a job with a much shorter budget runs alone
+        // rather than cutting the others short
+        std::sort(live.begin(), live.end(), [](const Job* a, const Job* b) {
+            return a->deadline.expiry() < b->deadline.expiry();
+        });
+        for (size_t from = 0; from < live.size(); ) {
+            const Clock::time_point expiry = live[from]->deadline.expiry();
+            const Clock::time_point now = Clock::now();
+            size_t to = from + 1;
+            while (to < live.size() &&
+                   sharesDeadline(expiry, live[to]->deadline.expiry(), now)) {
+                ++to;
+            }
+            PERF_VALUE("server.deadlineGroup", to - from);
+
+            int topK = 0;
+            queries.clear();
+            for (size_t i = from; i < to; ++i) {
+                queries.push_back(std::move(live[i]->hashes));
+                topK = std::max(topK, live[i]->topK);
+            }
+            const Deadline deadline = expiry == Clock::time_point::max() ? Deadline()
+                                                                         : Deadline::at(expiry);
+
+            const bool ok = m_db->bestMatchBatch(queries, results, &err, scheme, deadline, topK);
+            const auto done = Clock::now();
+            for (size_t i = from; i < to; ++i) {
+                if (!ok) {
+                    postReply(live[i]->clientId, errorLine(live[i]->requestId, err));
+                } else {
+                    reply(*live[i], results[i - from], done);
+                }
+            }
+            from = to;
+        }
+    }
+
+    m_db->releaseThreadConnection();
+}
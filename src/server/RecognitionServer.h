@@ -0,0 +1,206 @@
+#pragma once
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QStringList>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "BoundedQueue.h"
+#include "ShardCoordinator.h"
+#include "db/Database.h"
+#include "db/Replica.h"
+#include "fingerprint/Fingerprint.h"
+#include "util/TaskPool.h"
+
+class QLocalServer;
+class QLocalSocket;
+class QTimer;
+
+/**
+ * @struct ServerConfig
+ * @brief Tuning knobs for RecognitionServer.
+ */
+struct ServerConfig {
+    QString socketName = "music-recognition"; ///< QLocalServer name (Unix socket path/name)
+    QString dbPath = "music.db";              ///< Catalog database
+    int workers = 0;          ///< TaskPool threads if the pool is not running yet (0 = hardware concurrency)
+    int matchers = 2;         ///< Matching threads, each with its own read-only connection
+    int maxPending = 64;      ///< Admission limit: requests accepted but not yet answered
+    int maxBatch = 16;        ///< Queries matched together by bestMatchBatch
+    int batchWindowUs = 2000; ///< How long the matcher waits to fill a batch
+    int maxSeconds = 30;      ///< Longest accepted query clip
+    int deadlineMs = 0;       ///< Budget per request from its arrival (0 = unbounded)
+    FingerprintProfile query = Fingerprint::queryProfile(); ///< Density of query fingerprints
+    QString replicaOf;        ///< Primary catalog to follow (empty = serve dbPath as is)
+    int replicaPollMs = 500;  ///< How often the primary's change log is read
+    QStringList shards;       ///< Shard servers' sockets: coordinator mode, no local catalog
+    int shardTimeoutMs = 1000; ///< Coordinator: longest wait for a shard's answer
+    int topK = 5;             ///< Coordinator: candidates asked from each shard and returned
+    int scheme = 0;           ///< Coordinator: scheme the shards must serve (0 = whichever they agree on)
+    HotHashPolicy hotHashes;  ///< Stop-list and vote weighting of the served catalog
+    MatchOptions match;       ///< Matching strategy; with twoStage or sketchPrefilter set, queries
+                              ///< are matched one at a time with it instead of in batches
+};
+
+/**
+ * @class RecognitionServer
+ * @brief Headless daemon answering recognition requests over a local socket.
+ *
+ * One process keeps the catalog open (and its posting cache warm) for any
+ * number of local clients.
+ *
+ * Pipeline:
+ *   - GUI-less event loop: accepts connections, parses frames, applies
+ *     admission control and writes replies,
+ *   - TaskPool tasks on the Interactive lane: PCM -> fingerprints (query
+ *     profile), with the kernels of the catalog's fingerprint scheme; an
+ *     import or scan in the same process only gets the cores requests
+ *     leave over,
+ *   - `matchers` threads sharing one Database in read-pool mode (one
+ *     read-only SQLite connection each, one posting cache): each drains
+ *     up to `maxBatch` fingerprinted queries at a time into bestMatchBatch,
+ *     whose lookups also run on the Interactive lane. With a shortlisting
+ *     strategy in `match` (two-stage or sketch prefilter), each query is
+ *     matched on its own by Database::match instead: shortlists are per
+ *     query, so the batch's shared posting reads would not apply.
+ *
+ * Wire protocol (little-endian):
+ *   request:  u32 length | u32 requestId | u32 sampleRate | int16 pcm[]
+ *             (length counts the bytes after itself, mono PCM16)
+ *   response: one JSON object per line, e.g.
+ *             {"id":7,"found":true,"songId":3,"title":"...","artist":"...",
+ *              "album":"...","year":1999,"genre":"...","votes":41,
+ *              "deltaMs":12040,"queueMs":3,"totalMs":58}
+ *             {"id":8,"error":"busy"}
+ *   hash query (already fingerprinted, e.g. by a coordinator):
+ *             u32 length | u32 requestId | u32 0 | u32 scheme | u32 topK |
+ *             u32 budgetMs | (u32 hash, i32 offsetMs)[]
+ *   response: {"id":9,"candidates":[{"songId":3,...,"score":41.0},...],
+ *              "queueMs":1,"totalMs":4}
+ *   scheme request: a hash query of scheme 0 without hashes
+ *   response: {"id":10,"scheme":1}
+ *
+ * Requests beyond `maxPending` are rejected immediately with "busy" rather
+ * than queued, so latency stays bounded under overload. With `deadlineMs`
+ * set, each request carries a Deadline from the moment it is parsed:
+ * fingerprinting and matching stop when it expires and the reply holds
+ * the best match so far plus "incomplete":true, so a slow query or a
+ * queue backlog costs at most the budget (plus one posting lookup). Replies on one
+ * connection may arrive out of order; match them by id.
+ *
+ * With `replicaOf` set the server is a read replica: it catches up with
+ * the primary's change log before listening, then keeps applying new
+ * changes on the event-loop thread while the matchers serve queries.
+ *
+ * With `shards` set the server is a coordinator: it opens no catalog and
+ * runs no matchers. Requests are fingerprinted as usual, then sent as
+ * hash queries to every shard server by a ShardCoordinator, whose merged
+ * top-K answers them. The reply names the winner's "shard" (its index in
+ * `shards`; song ids are local to it), lists the merged "candidates" and
+ * reports "shardsAnswered" out of "shards"; missing shards make it
+ * "incomplete".
+ */
+class RecognitionServer : public QObject {
+    Q_OBJECT
+public:
+    explicit RecognitionServer(const ServerConfig& cfg, QObject* parent = nullptr);
+    ~RecognitionServer();
+
+    /// Open the catalog (or connect to the shards), start the threads and listen on the socket
+    bool start(QString* err=nullptr);
+
+    /// Stop listening, drain in-flight work and join the matchers
+    void stop();
+
+private:
+    /// One recognition request travelling through the pipeline
+    struct Job {
+        quint64 clientId = 0;
+        quint32 requestId = 0;
+        int sampleRate = 0;
+        std::vector<int16_t> pcm;
+        HashList hashes;
+        int scheme = 0;   ///< Fingerprint scheme `hashes` were made with
+        Deadline deadline;        ///< Budget from arrival (ServerConfig::deadlineMs)
+        bool incomplete = false;  ///< Fingerprinting was cut short by the deadline
+        bool hashQuery = false;   ///< Arrived fingerprinted: reply with `topK` candidates
+        int topK = 0;
+        std::chrono::steady_clock::time_point received;
+        std::chrono::steady_clock::time_point matchQueued;
+    };
+    using JobPtr = std::unique_ptr<Job>;
+
+    /// Per-connection state (event-loop thread only)
+    struct Client {
+        QLocalSocket* socket = nullptr;
+        QByteArray buffer; ///< Bytes received but not yet parsed into frames
+    };
+
+    void onNewConnection();
+    void onReadyRead(quint64 clientId);
+    void onDisconnected(quint64 clientId);
+
+    /// Parse complete frames out of the client's buffer; false on a bad frame
+    bool parseFrames(quint64 clientId, Client& c);
+
+    /// Open, migrate and warm the catalog (and catch up as a replica)
+    bool openCatalog(QString* err);
+
+    /// Fill a hash-query job from the bytes after the frame header; false
+    /// if it was hashed with another scheme than the catalog's
+    bool parseHashQuery(Job& job, const uchar* p, quint32 bytes) const;
+
+    /// Admission control, then hand the job to the pool for fingerprinting
+    void admit(JobPtr job);
+
+    /// Write one reply line; runs on the event-loop thread
+    void deliver(quint64 clientId, const QByteArray& line, bool completesJob);
+
+    /// Post a reply to the event-loop thread from a worker/matcher thread
+    void postReply(quint64 clientId, const QByteArray& line);
+
+    static QByteArray errorLine(quint32 requestId, const QString& error);
+    static QByteArray schemeLine(quint32 requestId, int scheme);
+    static QByteArray resultLine(const Job& job, const MatchResult& r,
+                                 std::chrono::steady_clock::time_point now);
+    static QByteArray candidatesLine(const Job& job, const MatchResult& r,
+                                     std::chrono::steady_clock::time_point now);
+    static QByteArray clusterLine(const Job& job, const ClusterResult& r,
+                                  std::chrono::steady_clock::time_point now);
+
+    /// Largest acceptable frame (maxSeconds of 192 kHz audio)
+    quint32 maxFrameBytes() const;
+
+    /// PCM -> fingerprints of one job (pool task), then on to the matchers
+    void fingerprint(JobPtr job);
+    void matchLoop();
+
+    /// Coordinator mode: fan a fingerprinted job out to the shards
+    /// (event-loop thread)
+    void route(JobPtr job);
+
+    /// Apply the primary's new changes (replica mode, event-loop thread)
+    void pollReplica();
+
+    ServerConfig m_cfg;
+    std::unique_ptr<Database> m_db;
+    std::unique_ptr<Replica> m_replica;
+    ShardCoordinator* m_coordinator = nullptr; ///< Coordinator mode only
+    QTimer* m_replicaTimer = nullptr;
+    QString m_replicaError; ///< Last reported replication error
+    QLocalServer* m_server = nullptr;
+    std::unordered_map<quint64, Client> m_clients;
+    quint64 m_nextClientId = 1;
+    int m_pending = 0; ///< Accepted, not yet answered (event-loop thread only)
+
+    std::unique_ptr<TaskGroup> m_fingerprinting; ///< Jobs being fingerprinted
+    BoundedQueue<JobPtr> m_matchQueue;
+    std::vector<std::thread> m_matchers;
+    std::atomic<bool> m_running{false};
+    std::atomic<int> m_scheme{0}; ///< Catalog's fingerprint scheme (may change on a replica)
+};
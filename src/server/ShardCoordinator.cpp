@@ -0,0 +1,325 @@
+#include "ShardCoordinator.h"
+#include "perf/Perf.h"
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QLocalSocket>
+#include <QTimer>
+#include <QtEndian>
+#include <chrono>
+
+// Shards get this much less than the coordinator waits, so that a reply
+// cut short by its budget still arrives in time
+static constexpr int SHARD_REPLY_MARGIN_MS = 20;
+
+// Query ids start at 1; 0 is the scheme request sent on connecting
+static constexpr quint32 SCHEME_REQUEST_ID = 0;
+
+ShardCoordinator::ShardCoordinator(const QStringList& shardSockets, QObject* parent)
+    : QObject(parent) {
+    m_shards.resize(size_t(shardSockets.size()));
+    for (int i = 0; i < shardSockets.size(); ++i) m_shards[size_t(i)].name = shardSockets[i];
+}
+
+ShardCoordinator::~ShardCoordinator() {
+    stop();
+}
+
+bool ShardCoordinator::start(QString* err) {
+    for (int i = 0; i < shards(); ++i) {
+        connectShard(i);
+        Shard& s = m_shards[size_t(i)];
+        if (s.socket->waitForConnected(m_timeoutMs)) onConnected(i);
+    }
+
+    // Every reachable shard reports its scheme; a silent one counts as down
+    for (int i = 0; i < shards(); ++i) {
+        Shard& s = m_shards[size_t(i)];
+        while (s.linked && s.scheme < 0 && s.socket->waitForReadyRead(m_timeoutMs)) onReadyRead(i);
+    }
+
+    int agreed = m_scheme;
+    int first = -1;
+    for (int i = 0; i < shards(); ++i) {
+        const Shard& s = m_shards[size_t(i)];
+        if (s.scheme < 0) continue;
+        if (agreed == 0) {
+            agreed = s.scheme;
+            first = i;
+        } else if (s.scheme != agreed) {
+            if (err) {
+                *err = first >= 0
+                           ? QString("Shards %1 and %2 serve different fingerprint schemes (%3, %4)")
+                                 .arg(m_shards[size_t(first)].name, s.name).arg(agreed).arg(s.scheme)
+                           : QString("Shard %1 serves fingerprint scheme %2, not %3")
+                                 .arg(s.name).arg(s.scheme).arg(agreed);
+            }
+            return false;
+        }
+    }
+    if (agreed == 0) {
+        if (err) *err = QString("No shard reachable (%1)").arg(m_shards.empty() ? QString("none given")
+                                                               : m_shards.front().socket->errorString());
+        return false;
+    }
+
+    m_scheme = agreed;
+    m_started = true;
+    for (int i = 0; i < shards(); ++i) {
+        if (m_shards[size_t(i)].scheme == m_scheme) onScheme(i, m_scheme);
+    }
+
+    m_reconnect = new QTimer(this);
+    connect(m_reconnect, &QTimer::timeout, this, &ShardCoordinator::reconnect);
+    m_reconnect->start(m_reconnectMs);
+    return true;
+}
+
+void ShardCoordinator::stop() {
+    if (m_reconnect) m_reconnect->stop();
+
+    std::vector<quint32> ids;
+    ids.reserve(m_pending.size());
+    for (auto& kv : m_pending) ids.push_back(kv.first);
+    for (quint32 id : ids) finish(id);
+}
+
+int ShardCoordinator::connectedShards() const {
+    int n = 0;
+    for (const Shard& s : m_shards) n += s.connected ? 1 : 0;
+    return n;
+}
+
+/// (Re)create the socket; it reports back through its signals
+void ShardCoordinator::connectShard(int shard) {
+    Shard& s = m_shards[size_t(shard)];
+    if (s.socket) s.socket->deleteLater();
+    s.buffer.clear();
+    s.linked = false;
+    s.scheme = -1;
+    s.connected = false;
+
+    s.socket = new QLocalSocket(this);
+    QLocalSocket* socket = s.socket;
+    connect(socket, &QLocalSocket::connected, this, [this, shard, socket] {
+        if (m_shards[size_t(shard)].socket == socket) onConnected(shard);
+    });
+    connect(socket, &QLocalSocket::disconnected, this, [this, shard, socket] {
+        if (m_shards[size_t(shard)].socket == socket) onLost(shard);
+    });
+    connect(socket, &QLocalSocket::errorOccurred, this, [this, shard, socket] {
+        if (m_shards[size_t(shard)].socket == socket) onLost(shard);
+    });
+    connect(socket, &QLocalSocket::readyRead, this, [this, shard, socket] {
+        if (m_shards[size_t(shard)].socket == socket) onReadyRead(shard);
+    });
+    socket->connectToServer(s.name);
+}
+
+/// Queries go to the shard once it has confirmed its scheme (onScheme)
+void ShardCoordinator::onConnected(int shard) {
+    Shard& s = m_shards[size_t(shard)];
+    if (s.linked) return;
+    s.linked = true;
+    s.scheme = -1;
+    s.socket->write(encodeQuery(SCHEME_REQUEST_ID, 0, 0, 0, HashList()));
+}
+
+/// Before start() has settled the scheme this only records the answer
+void ShardCoordinator::onScheme(int shard, int scheme) {
+    Shard& s = m_shards[size_t(shard)];
+    s.scheme = scheme;
+    if (!m_started || s.connected) return;
+
+    if (scheme != m_scheme) {
+        // Retried by reconnect(), in case its catalog is converted back
+        PERF_COUNT("cluster.shardSchemeMismatch", 1);
+        s.socket->disconnectFromServer();
+        return;
+    }
+    s.connected = true;
+    PERF_COUNT("cluster.shardConnected", 1);
+}
+
+/// Queries still waiting for the shard get no answer from it
+void ShardCoordinator::onLost(int shard) {
+    Shard& s = m_shards[size_t(shard)];
+    const bool wasConnected = s.connected;
+    s.linked = false;
+    s.connected = false;
+    if (!wasConnected) return;
+    PERF_COUNT("cluster.shardLost", 1);
+
+    std::vector<quint32> ids;
+    for (auto& kv : m_pending) {
+        if (kv.second.waiting[size_t(shard)]) ids.push_back(kv.first);
+    }
+    for (quint32 id : ids) {
+        auto it = m_pending.find(id);
+        if (it != m_pending.end()) release(id, it->second, shard, true);
+    }
+}
+
+void ShardCoordinator::reconnect() {
+    for (int i = 0; i < shards(); ++i) {
+        const Shard& s = m_shards[size_t(i)];
+        if (!s.linked && (!s.socket || s.socket->state() == QLocalSocket::UnconnectedState)) {
+            connectShard(i);
+        }
+    }
+}
+
+void ShardCoordinator::query(const HashList& hashes, int scheme, const Deadline& deadline,
+                             Done done) {
+    PERF_COUNT("cluster.queries", 1);
+
+    // Wait for the shards no longer than the query's own budget
+    int waitMs = m_timeoutMs;
+    if (deadline.expiry() != Deadline::Clock::time_point::max()) {
+        const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline.expiry() - Deadline::Clock::now()).count();
+        waitMs = int(std::max<qint64>(0, std::min<qint64>(waitMs, left)));
+    }
+
+    const quint32 id = m_nextId++;
+    Pending& p = m_pending[id];
+    p.done = std::move(done);
+    p.result.shards = shards();
+    p.waiting.assign(m_shards.size(), 0);
+
+    if (waitMs > 0) {
+        const QByteArray frame = encodeQuery(id, scheme, m_topK,
+                                             std::max(1, waitMs - SHARD_REPLY_MARGIN_MS), hashes);
+        for (int i = 0; i < shards(); ++i) {
+            Shard& s = m_shards[size_t(i)];
+            if (!s.connected) continue;
+            s.socket->write(frame);
+            p.waiting[size_t(i)] = 1;
+            ++p.outstanding;
+        }
+    }
+    if (p.outstanding < p.result.shards) p.result.incomplete = true;
+    if (p.outstanding == 0) {
+        finish(id);
+        return;
+    }
+
+    // Whatever has not arrived by then is left out
+    QTimer::singleShot(waitMs, this, [this, id] {
+        if (m_pending.count(id)) PERF_COUNT("cluster.timeouts", 1);
+        finish(id);
+    });
+}
+
+/// Replies are JSON lines; their "id" is the coordinator's query id
+void ShardCoordinator::onReadyRead(int shard) {
+    Shard& s = m_shards[size_t(shard)];
+    s.buffer.append(s.socket->readAll());
+
+    qsizetype start = 0;
+    for (qsizetype nl = s.buffer.indexOf('\n'); nl >= 0; nl = s.buffer.indexOf('\n', start)) {
+        const QJsonDocument doc = QJsonDocument::fromJson(s.buffer.mid(start, nl - start));
+        start = nl + 1;
+        if (doc.isObject()) onReply(shard, doc.object());
+    }
+    s.buffer.remove(0, start);
+}
+
+void ShardCoordinator::onReply(int shard, const QJsonObject& reply) {
+    const quint32 id = quint32(reply.value("id").toInteger());
+    if (id == SCHEME_REQUEST_ID) {
+        if (reply.contains("scheme")) onScheme(shard, reply.value("scheme").toInt());
+        return;
+    }
+    auto it = m_pending.find(id);
+    if (it == m_pending.end()) return; // timed out already
+    Pending& p = it->second;
+    if (!p.waiting[size_t(shard)]) return;
+
+    const bool failed = reply.contains("error");
+    if (!failed) {
+        if (reply.value("incomplete").toBool()) p.result.incomplete = true;
+        for (const QJsonValue& v : reply.value("candidates").toArray()) {
+            p.result.candidates.push_back(ShardCandidate{shard, fromJson(v.toObject())});
+        }
+        ++p.result.answered;
+    }
+    release(id, p, shard, failed);
+}
+
+void ShardCoordinator::release(quint32 id, Pending& p, int shard, bool failed) {
+    p.waiting[size_t(shard)] = 0;
+    --p.outstanding;
+    if (failed) p.result.incomplete = true;
+    if (p.outstanding == 0) finish(id);
+}
+
+/// Songs never span shards: the merged top-K is the best of the union
+void ShardCoordinator::finish(quint32 id) {
+    auto it = m_pending.find(id);
+    if (it == m_pending.end()) return;
+
+    ClusterResult result = std::move(it->second.result);
+    Done done = std::move(it->second.done);
+    if (it->second.outstanding > 0) result.incomplete = true;
+    m_pending.erase(it);
+
+    auto& c = result.candidates;
+    std::sort(c.begin(), c.end(), [](const ShardCandidate& a, const ShardCandidate& b) {
+        if (a.match.score != b.match.score) return a.match.score > b.match.score;
+        if (a.match.votes != b.match.votes) return a.match.votes > b.match.votes;
+        return a.shard != b.shard ? a.shard < b.shard : a.match.song.id < b.match.song.id;
+    });
+    if (c.size() > size_t(m_topK)) c.resize(size_t(m_topK));
+
+    PERF_VALUE("cluster.shardsAnswered", result.answered);
+    if (done) done(result);
+}
+
+QByteArray ShardCoordinator::encodeQuery(quint32 requestId, int scheme, int topK, int budgetMs,
+                                         const HashList& hashes) {
+    // u32 length | u32 requestId | u32 0 | u32 scheme | u32 topK | u32 budgetMs | (u32, i32)[]
+    const quint32 len = 20 + quint32(hashes.size()) * 8;
+    QByteArray frame(int(4 + len), Qt::Uninitialized);
+    uchar* p = reinterpret_cast<uchar*>(frame.data());
+    qToLittleEndian<quint32>(len, p);
+    qToLittleEndian<quint32>(requestId, p + 4);
+    qToLittleEndian<quint32>(0, p + 8);
+    qToLittleEndian<quint32>(quint32(scheme), p + 12);
+    qToLittleEndian<quint32>(quint32(topK), p + 16);
+    qToLittleEndian<quint32>(quint32(std::max(0, budgetMs)), p + 20);
+    p += 24;
+    for (const auto& h : hashes) {
+        qToLittleEndian<quint32>(h.first, p);
+        qToLittleEndian<qint32>(h.second, p + 4);
+        p += 8;
+    }
+    return frame;
+}
+
+QJsonObject ShardCoordinator::toJson(const MatchCandidate& c) {
+    QJsonObject o;
+    o["songId"] = c.song.id;
+    o["title"] = c.song.title;
+    o["artist"] = c.song.artist;
+    o["album"] = c.song.album;
+    o["year"] = c.song.year;
+    o["genre"] = c.song.genre;
+    o["votes"] = c.votes;
+    o["score"] = c.score;
+    o["deltaMs"] = c.deltaMs;
+    return o;
+}
+
+MatchCandidate ShardCoordinator::fromJson(const QJsonObject& o) {
+    MatchCandidate c;
+    c.song.id = o.value("songId").toInt(-1);
+    c.song.title = o.value("title").toString();
+    c.song.artist = o.value("artist").toString();
+    c.song.album = o.value("album").toString();
+    c.song.year = o.value("year").toInt();
+    c.song.genre = o.value("genre").toString();
+    c.votes = o.value("votes").toInt();
+    c.score = o.value("score").toDouble();
+    c.deltaMs = o.value("deltaMs").toInt();
+    return c;
+}
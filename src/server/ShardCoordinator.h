@@ -0,0 +1,151 @@
+#pragma once
+#include <QByteArray>
+#include <QJsonObject>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include "db/Database.h"
+#include "util/Deadline.h"
+
+class QLocalSocket;
+class QTimer;
+
+/**
+ * @struct ShardCandidate
+ * @brief A candidate song and the shard that holds it.
+ */
+struct ShardCandidate {
+    int shard = -1;        ///< Index into the coordinator's shard list
+    MatchCandidate match;  ///< Song ids are local to that shard
+};
+
+/**
+ * @struct ClusterResult
+ * @brief Merged answer of all shards to one query.
+ */
+struct ClusterResult {
+    std::vector<ShardCandidate> candidates; ///< Top-K over all shards, best first
+    int shards = 0;          ///< Shards the query was meant for
+    int answered = 0;        ///< Shards that replied in time without error
+    bool incomplete = false; ///< A shard was down, failed, timed out or was cut short
+};
+
+/**
+ * @class ShardCoordinator
+ * @brief Fans queries out to shard servers and merges their answers.
+ *
+ * A catalog too large for one database is split over several shard
+ * databases (see ShardMap), each served by its own RecognitionServer.
+ * The coordinator sends a query's hashes to every connected shard as one
+ * hash-query frame (see RecognitionServer), collects each shard's top-K
+ * (song, delta) bins and merges them by score into one top-K. Songs
+ * never span shards, so merging is a sort of the union.
+ *
+ * Each query waits at most `timeoutMs` (less if its Deadline ends
+ * sooner). A shard that has not replied by then, replies with an error,
+ * is down or is cut short by its budget leaves the result incomplete;
+ * the others still answer. Lost shards are reconnected every
+ * `reconnectMs` in the background.
+ *
+ * Every shard must serve the same fingerprint scheme, since a query is
+ * hashed once for all of them. start() asks each reachable shard for its
+ * scheme (a hash query of scheme 0 without hashes) and fails if they
+ * disagree, or differ from the one set with setScheme(); a reconnected
+ * shard is only queried again once it has confirmed the scheme.
+ *
+ * Scores are weighted by each shard's own posting statistics, so shards
+ * should hold comparable slices of the catalog (ShardMap spreads songs
+ * evenly).
+ *
+ * Lives on one thread (the event loop that owns the shard sockets).
+ */
+class ShardCoordinator : public QObject {
+    Q_OBJECT
+public:
+    /// Called once per query, on the coordinator's thread
+    using Done = std::function<void(const ClusterResult&)>;
+
+    /// @param shardSockets Local socket names of the shard servers
+    explicit ShardCoordinator(const QStringList& shardSockets, QObject* parent = nullptr);
+    ~ShardCoordinator();
+
+    void setTopK(int k) { m_topK = std::max(1, k); }
+    void setTimeoutMs(int ms) { m_timeoutMs = std::max(1, ms); }
+    void setReconnectMs(int ms) { m_reconnectMs = std::max(10, ms); }
+
+    /// Fingerprint scheme the shards must serve (0: whichever they agree on)
+    void setScheme(int scheme) { m_scheme = std::max(0, scheme); }
+
+    /// Scheme of the shards' catalogs (after start())
+    int scheme() const { return m_scheme; }
+
+    /// Connect to the shards and ask each for its scheme (waiting up to
+    /// timeoutMs for each); false if none is reachable or they serve
+    /// different schemes. Unreachable ones are retried in the background.
+    bool start(QString* err=nullptr);
+
+    /// Answer every query in flight with what has arrived
+    void stop();
+
+    /// Ask every connected shard for the top-K songs of `hashes` (hashed
+    /// with `scheme`). `done` may run before query() returns if no shard
+    /// can be asked.
+    void query(const HashList& hashes, int scheme, const Deadline& deadline, Done done);
+
+    int shards() const { return int(m_shards.size()); }
+    int connectedShards() const;
+
+    /// Hash-query frame, as parsed by RecognitionServer (budgetMs 0: none)
+    static QByteArray encodeQuery(quint32 requestId, int scheme, int topK, int budgetMs,
+                                  const HashList& hashes);
+
+    /// Candidate as sent in shard replies and coordinator answers
+    static QJsonObject toJson(const MatchCandidate& c);
+    static MatchCandidate fromJson(const QJsonObject& o);
+
+private:
+    struct Shard {
+        QString name;
+        QLocalSocket* socket = nullptr;
+        QByteArray buffer;      ///< Reply bytes not yet split into lines
+        bool linked = false;    ///< Socket connected, scheme asked
+        int scheme = -1;        ///< Scheme the shard reported (-1: not yet)
+        bool connected = false; ///< Linked and serving our scheme: queried
+    };
+
+    /// One query waiting for its shards
+    struct Pending {
+        ClusterResult result;
+        std::vector<char> waiting; ///< Per shard: reply still expected
+        int outstanding = 0;
+        Done done;
+    };
+
+    void connectShard(int shard);
+    void onConnected(int shard);
+    void onLost(int shard);
+    void onReadyRead(int shard);
+    void onReply(int shard, const QJsonObject& reply);
+    void onScheme(int shard, int scheme);
+    void reconnect();
+
+    /// No reply expected from `shard` for this query any more
+    void release(quint32 id, Pending& p, int shard, bool failed);
+
+    /// Merge, answer and forget one query
+    void finish(quint32 id);
+
+    std::vector<Shard> m_shards;
+    std::unordered_map<quint32, Pending> m_pending;
+    quint32 m_nextId = 1;
+    int m_topK = 5;
+    int m_timeoutMs = 1000;
+    int m_reconnectMs = 1000;
+    int m_scheme = 0;
+    bool m_started = false;  ///< Schemes agreed: later replies are checked against m_scheme
+    QTimer* m_reconnect = nullptr;
+};
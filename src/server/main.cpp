@@ -0,0 +1,223 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QProcess>
+#include <QTextStream>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include "RecognitionServer.h"
+#include "perf/Perf.h"
+
+// A spawned shard must open and warm its catalog within this time
+static constexpr int SHARD_START_TIMEOUT_MS = 120000;
+
+/// Start one local shard server per catalog (sockets "<socket>.shard<i>")
+/// and wait until each listens. The cores are split between them.
+static bool spawnShards(const QStringList& dbs, const ServerConfig& cfg,
+                        std::vector<QProcess*>& procs, QStringList& sockets, QString* err) {
+    const int cores = std::max(1, int(std::thread::hardware_concurrency()));
+    const int workers = std::max(1, cores / std::max(1, int(dbs.size())));
+
+    for (int i = 0; i < dbs.size(); ++i) {
+        const QString socket = QString("%1.shard%2").arg(cfg.socketName).arg(i);
+        auto* p = new QProcess;
+        p->setProgram(QCoreApplication::applicationFilePath());
+        QStringList args = {"--db", dbs[i], "--socket", socket,
+                            "--workers", QString::number(workers),
+                            "--matchers", QString::number(cfg.matchers),
+                            "--max-pending", QString::number(cfg.maxPending),
+                            "--max-postings", QString::number(cfg.hotHashes.maxPostings),
+                            "--max-song-fraction", QString::number(cfg.hotHashes.maxSongFraction)};
+        if (cfg.hotHashes.idfWeighting) args << "--idf";
+        if (cfg.match.twoStage) args << "--two-stage";
+        if (cfg.match.sketchPrefilter) args << "--sketch-prefilter";
+        p->setArguments(args);
+        p->setProcessChannelMode(QProcess::MergedChannels);
+        p->start();
+        procs.push_back(p);
+        sockets << socket;
+    }
+
+    // All start at once; each reports "Listening on" when ready
+    for (int i = 0; i < int(procs.size()); ++i) {
+        QProcess* p = procs[size_t(i)];
+        QByteArray output;
+        while (!output.contains("Listening on")) {
+            if (!p->waitForReadyRead(SHARD_START_TIMEOUT_MS)) {
+                if (err) {
+                    *err = QString("Shard %1 (%2) did not start: %3")
+                               .arg(i).arg(dbs[i], QString::fromLocal8Bit(output).trimmed());
+                }
+                return false;
+            }
+            output += p->readAll();
+        }
+        // Later output is not needed, but the pipe must not fill up
+        QObject::connect(p, &QProcess::readyRead, p, [p] { p->readAll(); });
+    }
+    return true;
+}
+
+static void stopShards(std::vector<QProcess*>& procs) {
+    for (QProcess* p : procs) p->terminate();
+    for (QProcess* p : procs) {
+        if (!p->waitForFinished(5000)) p->kill();
+        delete p;
+    }
+    procs.clear();
+}
+
+/**
+ * @brief Entry point of the headless recognition daemon.
+ *
+ * Loads the catalog once and serves recognition requests from local
+ * clients over a QLocalServer socket (see RecognitionServer for the
+ * wire protocol). With --shard or --spawn-shard it holds no catalog and
+ * coordinates shard servers instead (see ShardCoordinator).
+ */
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("MusicRecognitionServer");
+
+    ServerConfig cfg;
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Music recognition daemon");
+    parser.addHelpOption();
+
+    QCommandLineOption dbOpt("db", "Catalog database.", "file", cfg.dbPath);
+    QCommandLineOption socketOpt("socket", "Local socket name.", "name", cfg.socketName);
+    QCommandLineOption workersOpt("workers", "Task pool threads for fingerprinting and lookups (0 = all cores).",
+                                  "n", QString::number(cfg.workers));
+    QCommandLineOption matchersOpt("matchers", "Matching threads (one DB connection each).",
+                                   "n", QString::number(cfg.matchers));
+    QCommandLineOption pendingOpt("max-pending", "Requests in flight before replying busy.",
+                                  "n", QString::number(cfg.maxPending));
+    QCommandLineOption batchOpt("max-batch", "Queries matched together.",
+                                "n", QString::number(cfg.maxBatch));
+    QCommandLineOption windowOpt("batch-window-us", "Time spent filling a batch.",
+                                 "us", QString::number(cfg.batchWindowUs));
+    QCommandLineOption secondsOpt("max-seconds", "Longest accepted query clip.",
+                                  "s", QString::number(cfg.maxSeconds));
+    QCommandLineOption deadlineOpt("deadline-ms", "Budget per request; answer with the best match so far "
+                                   "when it runs out (0 = none).",
+                                   "ms", QString::number(cfg.deadlineMs));
+    QCommandLineOption replicaOpt("replica-of", "Follow this primary catalog's change log.",
+                                  "file");
+    QCommandLineOption replicaPollOpt("replica-poll-ms", "Change log polling interval.",
+                                      "ms", QString::number(cfg.replicaPollMs));
+    QCommandLineOption queryRateOpt("query-hashes-per-sec", "Anchor budget of query fingerprints.",
+                                    "n", QString::number(cfg.query.hashesPerSec));
+    QCommandLineOption queryFanoutOpt("query-fanout", "Target pairs per query anchor.",
+                                      "n", QString::number(cfg.query.fanout));
+    QCommandLineOption queryPhasesOpt("query-phases", "STFT passes per query, a fraction of a hop apart.",
+                                      "n", QString::number(cfg.query.phases));
+    QCommandLineOption shardOpt("shard", "Coordinate this shard server (repeatable); no local catalog.",
+                                "socket");
+    QCommandLineOption spawnOpt("spawn-shard", "Start a local shard server on this catalog and "
+                                "coordinate it (repeatable).", "file");
+    QCommandLineOption shardTimeoutOpt("shard-timeout-ms", "Longest wait for a shard's answer.",
+                                       "ms", QString::number(cfg.shardTimeoutMs));
+    QCommandLineOption topKOpt("top-k", "Candidates asked from each shard and returned.",
+                               "n", QString::number(cfg.topK));
+    QCommandLineOption schemeOpt("scheme", "Fingerprint scheme the shards' catalogs must use "
+                                 "(0 = whichever they all report).",
+                                 "n", QString::number(cfg.scheme));
+    QCommandLineOption maxPostingsOpt("max-postings", "Skip hashes with more postings than this (0 = no limit).",
+                                      "n", QString::number(cfg.hotHashes.maxPostings));
+    QCommandLineOption songFractionOpt("max-song-fraction", "Skip hashes found in more than this fraction "
+                                       "of songs (0 = no limit).",
+                                       "f", QString::number(cfg.hotHashes.maxSongFraction));
+    QCommandLineOption idfOpt("idf", "Weight votes by how rare each hash is.");
+    QCommandLineOption twoStageOpt("two-stage", "Shortlist songs from the rarest query hashes, then "
+                                   "align only those (queries are not batched).");
+    QCommandLineOption sketchOpt("sketch-prefilter", "Shortlist songs by MinHash sketch similarity, then "
+                                 "align only those (queries are not batched).");
+    QCommandLineOption indexStatsOpt("index-stats", "Print the catalog's index statistics and exit.");
+    for (auto* o : {&dbOpt, &socketOpt, &workersOpt, &matchersOpt, &pendingOpt, &batchOpt, &windowOpt, &secondsOpt,
+                    &deadlineOpt, &replicaOpt, &replicaPollOpt, &queryRateOpt, &queryFanoutOpt, &queryPhasesOpt,
+                    &shardOpt, &spawnOpt, &shardTimeoutOpt, &topKOpt, &schemeOpt, &maxPostingsOpt,
+                    &songFractionOpt, &idfOpt, &twoStageOpt, &sketchOpt, &indexStatsOpt}) {
+        parser.addOption(*o);
+    }
+    parser.process(app);
+
+    cfg.dbPath = parser.value(dbOpt);
+    cfg.socketName = parser.value(socketOpt);
+    cfg.workers = parser.value(workersOpt).toInt();
+    cfg.matchers = parser.value(matchersOpt).toInt();
+    cfg.maxPending = parser.value(pendingOpt).toInt();
+    cfg.maxBatch = parser.value(batchOpt).toInt();
+    cfg.batchWindowUs = parser.value(windowOpt).toInt();
+    cfg.maxSeconds = parser.value(secondsOpt).toInt();
+    cfg.deadlineMs = parser.value(deadlineOpt).toInt();
+    cfg.replicaOf = parser.value(replicaOpt);
+    cfg.replicaPollMs = parser.value(replicaPollOpt).toInt();
+    cfg.query.hashesPerSec = parser.value(queryRateOpt).toDouble();
+    cfg.query.fanout = parser.value(queryFanoutOpt).toInt();
+    cfg.query.phases = parser.value(queryPhasesOpt).toInt();
+    cfg.shards = parser.values(shardOpt);
+    cfg.shardTimeoutMs = parser.value(shardTimeoutOpt).toInt();
+    cfg.topK = parser.value(topKOpt).toInt();
+    cfg.scheme = parser.value(schemeOpt).toInt();
+    cfg.hotHashes.maxPostings = parser.value(maxPostingsOpt).toLongLong();
+    cfg.hotHashes.maxSongFraction = parser.value(songFractionOpt).toDouble();
+    cfg.hotHashes.idfWeighting = parser.isSet(idfOpt);
+    cfg.match.twoStage = parser.isSet(twoStageOpt);
+    cfg.match.sketchPrefilter = parser.isSet(sketchOpt);
+
+#if USE_PERF
+    const QByteArray perfJson = qgetenv("MRA_PERF_JSON");
+    const QByteArray perfTrace = qgetenv("MRA_PERF_TRACE");
+    perf::Registry::instance().setTracing(!perfTrace.isEmpty());
+#endif
+
+    QTextStream out(stdout);
+    QString err;
+
+    // Index shape, and what the hot-hash policy would stop-list in it
+    if (parser.isSet(indexStatsOpt)) {
+        Database db(cfg.dbPath);
+        IndexStats stats;
+        if (!db.open(&err) || !db.migrate(&err) || !db.setHotHashPolicy(cfg.hotHashes, &err) ||
+            !db.indexStats(stats, 20, &err)) {
+            out << "Index stats failed: " << err << "\n";
+            return 1;
+        }
+        out << stats.summary() << "\n";
+        out << "Stop-listed hashes: " << qulonglong(db.stopListSize()) << "\n";
+        return 0;
+    }
+
+    // Local cluster for testing: shard processes next to the coordinator
+    std::vector<QProcess*> shards;
+    const QStringList spawn = parser.values(spawnOpt);
+    if (!spawn.isEmpty() && !spawnShards(spawn, cfg, shards, cfg.shards, &err)) {
+        out << "Server failed to start: " << err << "\n";
+        stopShards(shards);
+        return 1;
+    }
+
+    RecognitionServer server(cfg);
+    if (!server.start(&err)) {
+        out << "Server failed to start: " << err << "\n";
+        stopShards(shards);
+        return 1;
+    }
+    out << "Listening on " << cfg.socketName << "\n";
+    out.flush();
+
+    // Drain in-flight requests before the event loop object goes away
+    QObject::connect(&app, &QCoreApplication::aboutToQuit, &server, [&server] { server.stop(); });
+
+    int rc = app.exec();
+    stopShards(shards);
+    out << "Task pool:\n" << QString::fromStdString(TaskPool::instance().summary());
+
+#if USE_PERF
+    if (!perfJson.isEmpty()) perf::Registry::instance().exportJson(perfJson.toStdString());
+    if (!perfTrace.isEmpty()) perf::Registry::instance().exportChromeTrace(perfTrace.toStdString());
+#endif
+
+    return rc;
+}
@@ -1,14 +1,19 @@
 #include "MainWindow.h"
 #include "ui_mainwindow.h"
-#include "audio/WavFile.h"
+#include "audio/Ingestor.h"
 #include "fingerprint/Fingerprint.h"
+#include "util/TaskPool.h"
 #include "MetadataDialog.h"
 
 #include <QFileDialog>
 #include <QMessageBox>
+#include <QMetaObject>
+#include <QStatusBar>
+
+static const char* DB_PATH = "music.db";
 
 MainWindow::MainWindow(QWidget *parent)
-    : QMainWindow(parent), ui(new Ui::MainWindow), m_db("music.db") {
+    : QMainWindow(parent), ui(new Ui::MainWindow), m_db(DB_PATH) {
     ui->setupUi(this);
 
     // Connect UI buttons to their respective handlers
@@ -16,15 +21,21 @@ MainWindow::MainWindow(QWidget *parent)
     connect(ui->btnRecord, &QPushButton::clicked, this, &MainWindow::onRecord);
     connect(ui->btnPlay,   &QPushButton::clicked, this, &MainWindow::onPlay);
     connect(ui->btnStop,   &QPushButton::clicked, this, &MainWindow::onStop);
+    connect(ui->btnMonitor, &QPushButton::toggled, this, &MainWindow::onMonitor);
 
     // Signal: recording finished -> attempt recognition
     connect(&m_capture, &AudioCapture::finished, this, &MainWindow::onCaptureFinished);
 
-    // Initialize and migrate database
-    QString err;
-    if (!m_db.open(&err) || !m_db.migrate(&err)) {
-        QMessageBox::critical(this, "DB Error", err);
-    }
+    // Signal: live audio available -> feed the monitor
+    connect(&m_capture, &AudioCapture::samplesAvailable, this, &MainWindow::onMonitorSamples);
+
+    // Open, migrate and warm the database in the background; the window
+    // shows immediately and catalog actions unlock once it is ready
+    setCatalogActionsEnabled(false);
+    m_warmup = std::make_unique<IndexWarmup>(DB_PATH);
+    connect(m_warmup.get(), &IndexWarmup::progress, this, &MainWindow::onWarmupProgress);
+    connect(m_warmup.get(), &IndexWarmup::finished, this, &MainWindow::onCatalogReady);
+    m_warmup->start();
 }
 
 MainWindow::~MainWindow() { delete ui; }
@@ -34,27 +45,94 @@ void MainWindow::appendResult(const QString& s) {
     ui->txtResults->append(s);
 }
 
-/// Handle "Upload WAV..." button
+void MainWindow::setCatalogActionsEnabled(bool on) {
+    ui->btnUpload->setEnabled(on);
+    ui->btnRecord->setEnabled(on);
+    ui->btnMonitor->setEnabled(on);
+}
+
+void MainWindow::onWarmupProgress(int percent, const QString& stage) {
+    statusBar()->showMessage(QString("%1... %2%").arg(stage).arg(percent));
+}
+
+/// Schema and index are prepared: open this thread's connection (fast now)
+void MainWindow::onCatalogReady(bool ok, const QString& error) {
+    QString err = error;
+    if (ok) ok = m_db.open(&err) && m_db.migrate(&err);
+
+    if (!ok) {
+        statusBar()->showMessage("Catalog unavailable");
+        QMessageBox::critical(this, "DB Error", err);
+        return;
+    }
+
+    // Live monitoring matches on pool threads, each with its own reader
+    m_db.setReadPool(true);
+    setCatalogActionsEnabled(true);
+    statusBar()->showMessage("Catalog ready", 3000);
+}
+
+/// Handle "Upload Audio..." button
 void MainWindow::onUpload() {
-    QString path = QFileDialog::getOpenFileName(this, "Select WAV", QString(), "WAV files (*.wav)");
+    QString filter = QString("Audio files (%1)").arg(Ingestor::nameFilters().join(" "));
+    QString path = QFileDialog::getOpenFileName(this, "Select Audio", QString(), filter);
     if (path.isEmpty()) return;
     fingerprintAndStore(path);
 }
 
-/// Load a WAV file, fingerprint it, and store song+hashes in DB
-void MainWindow::fingerprintAndStore(const QString& wavPath) {
-    std::vector<int16_t> samples;
-    WavInfo info; QString err;
+/// Decode an audio file, fingerprint it, and store song+hashes in DB
+void MainWindow::fingerprintAndStore(const QString& audioPath) {
+    QString err;
+
+    if (!m_db.checkScheme(Fingerprint::SCHEME, &err)) {
+        QMessageBox::warning(this, "DB", err);
+        return;
+    }
 
-    // Load PCM16 samples from WAV file
-    if (!WavFile::loadPcm16(wavPath, samples, info, &err)) {
-        QMessageBox::warning(this, "WAV", "Failed to load WAV file: " + err);
+    // Decode and fingerprint in one streaming pass (the file is never held
+    // as PCM), keeping the peak constellation so the song can be re-hashed
+    // later without the audio
+    DecodedTrack track;
+    setCatalogActionsEnabled(false); // the decoder runs a nested event loop
+    const bool decoded = Ingestor::fingerprintFile(audioPath, track, &err);
+    setCatalogActionsEnabled(true);
+    if (!decoded) {
+        QMessageBox::warning(this, "Audio", "Failed to decode audio file: " + err);
         return;
     }
 
-    // Compute fingerprints (hashes) from audio samples
-    auto hashes = Fingerprint::compute(samples, info.sampleRate);
-    appendResult(QString("Computed %1 hashes").arg(hashes.size()));
+    const HashList& hashes = track.hashes;
+    appendResult(QString("Computed %1 hashes (%2 hashes/s)")
+                     .arg(hashes.size())
+                     .arg(Fingerprint::hashesPerSecond(hashes.size(), size_t(track.samples),
+                                                       track.sampleRate),
+                          0, 'f', 1));
+
+    // Same recording already in the catalog? Let the user decide
+    DuplicateMatch dup;
+    bool linkOnly = false;
+    if (!m_db.findDuplicate(hashes, dup, -1, &err)) {
+        QMessageBox::warning(this, "DB", "Duplicate check failed: " + err); return;
+    }
+    if (dup.found) {
+        QMessageBox box(QMessageBox::Question, "Duplicate",
+                        QString("This recording is already stored as song #%1: %2, by %3 "
+                                "(%4% aligned).")
+                            .arg(dup.song.id).arg(dup.song.title, dup.song.artist)
+                            .arg(dup.coverage * 100, 0, 'f', 0),
+                        QMessageBox::NoButton, this);
+        QPushButton* skip = box.addButton("Skip", QMessageBox::RejectRole);
+        QPushButton* link = box.addButton("Link to Existing", QMessageBox::AcceptRole);
+        box.addButton("Store Anyway", QMessageBox::AcceptRole);
+        box.setDefaultButton(skip);
+        box.exec();
+
+        if (box.clickedButton() == skip) {
+            appendResult(QString("Duplicate of song #%1; not storing.").arg(dup.song.id));
+            return;
+        }
+        linkOnly = box.clickedButton() == link;
+    }
 
     // Prompt user for song metadata (title, artist, album, etc.)
     MetadataDialog dlg(this);
@@ -74,21 +152,43 @@ void MainWindow::fingerprintAndStore(const QString& wavPath) {
         QMessageBox::warning(this, "DB", "Insert song failed: " + err); return;
     }
 
+    // Duplicates are marked; a linked one shares the original's postings
+    if (dup.found && !m_db.setDuplicateOf(songId, dup.song.id, &err)) {
+        QMessageBox::warning(this, "DB", "Marking duplicate failed: " + err); return;
+    }
+    if (linkOnly) {
+        appendResult(QString("Stored song #%1 as a link to #%2").arg(songId).arg(dup.song.id));
+        return;
+    }
+
     // Store computed fingerprints in DB
     if (!m_db.insertFingerprints(songId, hashes, &err)) {
         QMessageBox::warning(this, "DB", "Insert fingerprints failed: " + err); return;
     }
 
+    // Store the compact constellation for future re-indexing
+    std::vector<uint8_t> blob = track.peaks.encode();
+    if (!m_db.insertConstellation(songId, QByteArray(reinterpret_cast<const char*>(blob.data()),
+                                                     int(blob.size())), &err)) {
+        QMessageBox::warning(this, "DB", "Insert constellation failed: " + err); return;
+    }
+
     appendResult(QString("Stored song #%1: %2, by %3").arg(songId).arg(s.title, s.artist));
 
-    // Keep audio buffer for playback
-    m_loadedPcm = std::move(samples);
-    m_loadedSr = info.sampleRate;
-    m_player.setBuffer(m_loadedPcm, m_loadedSr);
+    // Preview playback streams from the file itself (no PCM kept in memory);
+    // only WAV files can be streamed, other formats are stored without one
+    if (!AudioPlayer::canPlay(audioPath)) {
+        m_player.clear();
+        appendResult("No preview for this format (WAV only).");
+    } else if (!m_player.setFile(audioPath, &err)) {
+        m_player.clear();
+        appendResult("Playback unavailable: " + err);
+    }
 }
 
 /// Handle "Record" button: capture 10 seconds of audio
 void MainWindow::onRecord() {
+    if (m_monitor) ui->btnMonitor->setChecked(false); // one capture at a time
     appendResult("Recording for 10 seconds...");
     m_capture.start(10);
 }
@@ -101,13 +201,16 @@ void MainWindow::onCaptureFinished() {
 
 /// Compute fingerprints from captured buffer and find best match in DB
 void MainWindow::recognizeFromBuffer(const std::vector<int16_t>& pcm, int sr) {
-    auto hashes = Fingerprint::compute(pcm, sr);
+    // The user is waiting: the query's pool tasks go ahead of any import
+    TaskPool::LaneScope lane(TaskLane::Interactive);
+    auto hashes = Fingerprint::compute(pcm, sr, Fingerprint::queryProfile());
 
     QString err;
     SongRow best; int votes = 0;
 
+    // bestMatch fails without an error when nothing matched
     if (!m_db.bestMatch(hashes, best, votes, &err)) {
-        appendResult("No match found.");
+        appendResult(err.isEmpty() ? QString("No match found.") : "Recognition failed: " + err);
         return;
     }
 
@@ -115,9 +218,90 @@ void MainWindow::recognizeFromBuffer(const std::vector<int16_t>& pcm, int sr) {
                  .arg(best.title, best.artist).arg(votes));
 }
 
+/// Handle "Monitor (Live)" toggle: recognize the input continuously
+void MainWindow::onMonitor(bool on) {
+    if (on) {
+        ++m_monitorRun;
+        m_monitor = std::make_unique<TrackMonitor>(m_db, m_capture.sampleRate());
+        // Events fire on the feeding task's thread; log them on this one
+        m_monitor->setEventHandler([this](const TrackEvent& ev) {
+            QMetaObject::invokeMethod(this, [this, ev] { onTrackEvent(ev); }, Qt::AutoConnection);
+        });
+        m_capture.startContinuous();
+        appendResult("Live monitoring started.");
+        return;
+    }
+
+    if (!m_monitor) return;
+    m_capture.stop();
+    m_monitoring.wait();
+    ++m_monitorRun; // completions still queued belong to the old session
+    m_monitorBusy = false;
+    m_monitorPending.clear();
+    m_monitor->finish();
+    m_monitor.reset();
+    appendResult("Live monitoring stopped.");
+}
+
+/// Drain captured audio into the monitor
+void MainWindow::onMonitorSamples() {
+    if (!m_monitor) return;
+
+    m_capture.takeSamples(m_monitorChunk);
+    m_monitorPending.insert(m_monitorPending.end(), m_monitorChunk.begin(), m_monitorChunk.end());
+    feedMonitor();
+}
+
+/// Fingerprinting and matching run on the pool's Interactive lane, one
+/// task at a time per stream (the monitor is not thread-safe); audio
+/// captured meanwhile is queued and handed over when the task finishes.
+void MainWindow::feedMonitor() {
+    if (!m_monitor || m_monitorBusy || m_monitorPending.empty()) return;
+
+    m_monitorBusy = true;
+    m_monitorFeeding.swap(m_monitorPending);
+    m_monitorPending.clear();
+
+    TrackMonitor* monitor = m_monitor.get();
+    const int run = m_monitorRun;
+    m_monitoring.submit(TaskLane::Interactive, [this, monitor, run] {
+        QString err;
+        const bool ok = monitor->push(m_monitorFeeding.data(), m_monitorFeeding.size(), &err);
+        QMetaObject::invokeMethod(this, [this, run, ok, err] { onMonitorFed(run, ok, err); },
+                                  Qt::QueuedConnection);
+    });
+}
+
+void MainWindow::onMonitorFed(int run, bool ok, const QString& err) {
+    if (run != m_monitorRun) return;
+    m_monitorBusy = false;
+
+    if (!ok) {
+        appendResult("Monitor error: " + err);
+        ui->btnMonitor->setChecked(false);
+        return;
+    }
+    feedMonitor();
+}
+
+/// Log a track boundary as "[hh:mm:ss] ..."
+void MainWindow::onTrackEvent(const TrackEvent& ev) {
+    const qint64 s = ev.streamMs / 1000;
+    const QString at = QString("%1:%2:%3")
+                           .arg(s / 3600, 2, 10, QChar('0'))
+                           .arg((s / 60) % 60, 2, 10, QChar('0'))
+                           .arg(s % 60, 2, 10, QChar('0'));
+
+    if (ev.type == TrackEvent::Started) {
+        appendResult(QString("[%1] Now playing: %2, by %3").arg(at, ev.song.title, ev.song.artist));
+    } else {
+        appendResult(QString("[%1] Ended: %2, by %3").arg(at, ev.song.title, ev.song.artist));
+    }
+}
+
 /// Handle "Play" button
 void MainWindow::onPlay() {
-    if (!m_loadedPcm.empty()) m_player.play();
+    if (m_player.hasSource()) m_player.play();
 }
 
 /// Handle "Stop" button
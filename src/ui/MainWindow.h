@@ -5,6 +5,10 @@
 #include "audio/AudioPlayer.h"
 #include "audio/AudioCapture.h"
 #include "db/Database.h"
+#include "db/IndexWarmup.h"
+#include "monitor/TrackMonitor.h"
+#include "util/TaskPool.h"
+#include <memory>
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
@@ -26,23 +30,38 @@ public:
 
 private slots:
     // UI event handlers
-    void onUpload();           ///< Upload and fingerprint a WAV file
+    void onUpload();           ///< Upload and fingerprint an audio file
     void onRecord();           ///< Record audio from microphone
     void onPlay();             ///< Play last loaded/recorded audio
     void onStop();             ///< Stop playback
     void onCaptureFinished();  ///< Triggered after recording ends
+    void onMonitor(bool on);   ///< Toggle continuous live monitoring
+    void onMonitorSamples();   ///< Feed newly captured audio to the monitor
+    void onWarmupProgress(int percent, const QString& stage); ///< Startup progress
+    void onCatalogReady(bool ok, const QString& error);       ///< Startup finished
 
 private:
     void appendResult(const QString& s);                  ///< Append status text to results panel
-    void fingerprintAndStore(const QString& wavPath);     ///< Fingerprint a WAV file and save to DB
+    void fingerprintAndStore(const QString& audioPath);   ///< Fingerprint an audio file and save to DB
     void recognizeFromBuffer(const std::vector<int16_t>& pcm, int sr); ///< Match audio against DB
+    void onTrackEvent(const TrackEvent& ev);              ///< Log a monitor start/end event
+    void feedMonitor();                                   ///< Hand pending audio to a pool task
+    void onMonitorFed(int run, bool ok, const QString& err); ///< A feeding task finished
+    void setCatalogActionsEnabled(bool on);               ///< Buttons that need the DB
 
     Ui::MainWindow *ui;   ///< Qt UI components
     AudioPlayer m_player; ///< Handles audio playback
     AudioCapture m_capture; ///< Manages microphone recording
     Database m_db;        ///< SQLite wrapper for songs & fingerprints
 
-    // Buffers for the most recently loaded/recorded audio
-    std::vector<int16_t> m_loadedPcm;
-    int m_loadedSr = 44100;
+    std::unique_ptr<TrackMonitor> m_monitor; ///< Active while live monitoring
+    std::vector<int16_t> m_monitorChunk;     ///< Reused capture hand-off buffer
+    std::vector<int16_t> m_monitorPending;   ///< Captured while the monitor was busy
+    std::vector<int16_t> m_monitorFeeding;   ///< Owned by the feeding task while busy
+    bool m_monitorBusy = false;              ///< A feeding task is running
+    int m_monitorRun = 0;                    ///< Bumped per monitoring session
+    TaskGroup m_monitoring;                  ///< Feeding tasks; waited for before m_monitor goes
+
+    /// Startup catalog preparation; declared last so it is stopped first
+    std::unique_ptr<IndexWarmup> m_warmup;
 };
\ No newline at end of file
@@ -0,0 +1,62 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+/**
+ * @class Deadline
+ * @brief Time budget and cancellation token for one bounded operation.
+ *
+ * Long-running calls (Fingerprint::compute, Database::match, ...) poll
+ * expired() between units of work (an STFT frame, a posting lookup) and
+ * stop there, returning what they have so far together with an
+ * "incomplete" flag. Expiry is final: once expired() returns true it
+ * keeps doing so, so a caller may also test it after the call.
+ *
+ * Copies share the cancellation flag: cancel() on any copy (from any
+ * thread) expires all of them. A default-constructed Deadline never
+ * expires and costs one branch per poll.
+ */
+class Deadline {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /// Never expires
+    Deadline() = default;
+
+    /// Expires `budget` from now, or when cancelled
+    template <class Rep, class Period>
+    static Deadline in(std::chrono::duration<Rep, Period> budget) {
+        return at(Clock::now() + std::chrono::duration_cast<Clock::duration>(budget));
+    }
+
+    /// Expires at `when` (Clock::time_point::max(): only when cancelled)
+    static Deadline at(Clock::time_point when) {
+        Deadline d;
+        d.m_when = when;
+        d.m_cancelled = std::make_shared<std::atomic<bool>>(false);
+        return d;
+    }
+
+    /// No time limit, but cancel() works
+    static Deadline cancellable() { return at(Clock::time_point::max()); }
+
+    /// Expire every copy now (no-op on a default-constructed Deadline)
+    void cancel() const {
+        if (m_cancelled) m_cancelled->store(true, std::memory_order_relaxed);
+    }
+
+    /// True once the time is up or cancel() was called
+    bool expired() const {
+        if (!m_cancelled) return false;
+        if (m_cancelled->load(std::memory_order_relaxed)) return true;
+        return m_when != Clock::time_point::max() && Clock::now() >= m_when;
+    }
+
+    /// When the time is up (Clock::time_point::max() if never)
+    Clock::time_point expiry() const { return m_when; }
+
+private:
+    Clock::time_point m_when = Clock::time_point::max();
+    std::shared_ptr<std::atomic<bool>> m_cancelled; ///< Shared by copies; null if unbounded
+};
@@ -0,0 +1,322 @@
+#include "TaskPool.h"
+#include "perf/Perf.h"
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+
+namespace {
+
+std::atomic<int> s_defaultThreads{0};
+
+// Pool and worker index of the calling thread (-1: not a pool worker)
+thread_local const TaskPool* t_pool = nullptr;
+thread_local int t_worker = -1;
+thread_local TaskLane t_lane = TaskLane::Normal;
+
+// Metric names must be literals: one per lane
+const char* const kWaitMetric[TaskPool::LANES] = {
+    "pool.interactive.waitUs", "pool.normal.waitUs", "pool.background.waitUs"};
+
+uint64_t nanos(TaskPool::Clock::duration d) {
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+}
+
+} // namespace
+
+TaskPool& TaskPool::instance() {
+    static TaskPool pool(s_defaultThreads.load());
+    return pool;
+}
+
+void TaskPool::setDefaultThreads(int n) {
+    s_defaultThreads = n;
+}
+
+TaskPool::TaskPool(int threads) : m_started(Clock::now()) {
+    if (threads <= 0) threads = int(std::thread::hardware_concurrency());
+    threads = std::max(1, threads);
+    m_backgroundLimit = std::max(1, threads - 1);
+
+    // Every deque exists before any worker starts stealing
+    m_workers.reserve(size_t(threads));
+    for (int i = 0; i < threads; ++i) m_workers.push_back(std::make_unique<Worker>());
+    m_threads.reserve(size_t(threads));
+    for (int i = 0; i < threads; ++i) m_threads.emplace_back(&TaskPool::workerLoop, this, i);
+}
+
+TaskPool::~TaskPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (auto& th : m_threads) th.join();
+}
+
+const char* TaskPool::laneName(TaskLane lane) {
+    switch (lane) {
+    case TaskLane::Interactive: return "interactive";
+    case TaskLane::Normal: return "normal";
+    case TaskLane::Background: return "background";
+    }
+    return "?";
+}
+
+TaskLane TaskPool::currentLane() {
+    return t_lane;
+}
+
+TaskPool::LaneScope::LaneScope(TaskLane lane) : m_previous(t_lane) {
+    t_lane = lane;
+}
+
+TaskPool::LaneScope::~LaneScope() {
+    t_lane = m_previous;
+}
+
+void TaskPool::setBackgroundLimit(int n) {
+    m_backgroundLimit = std::max(1, n);
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+    }
+    m_wake.notify_all();
+}
+
+/// Workers push onto their own deque, everyone else onto the shared queue
+void TaskPool::submit(TaskLane lane, Task task) {
+    const int l = int(lane);
+    LaneCounters& c = m_lanes[size_t(l)];
+    ++c.submitted;
+    ++c.queued; // before the push, so a worker never sees it go negative
+
+    Item item{std::move(task), Clock::now()};
+    if (t_pool == this && t_worker >= 0) {
+        Worker& w = *m_workers[size_t(t_worker)];
+        std::lock_guard<std::mutex> lock(w.mutex);
+        w.lanes[size_t(l)].push_back(std::move(item));
+    } else {
+        std::lock_guard<std::mutex> lock(m_sharedMutex);
+        m_shared[size_t(l)].push_back(std::move(item));
+    }
+
+    // Sleepers test runnable() under m_sleepMutex: taking it here means
+    // the notification cannot fall between their test and their wait
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+    }
+    m_wake.notify_one();
+}
+
+void TaskPool::parallelFor(TaskLane lane, size_t n, const std::function<void(size_t)>& body,
+                           int maxParallel) {
+    if (n == 0) return;
+
+    // Shared with the helper tasks, which may start after the range is
+    // done: they then find nothing to claim and never touch `body`
+    struct State {
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> done{0};
+        size_t n = 0;
+        const std::function<void(size_t)>* body = nullptr;
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+    auto state = std::make_shared<State>();
+    state->n = n;
+    state->body = &body;
+
+    auto drain = [state] {
+        for (size_t i = state->next++; i < state->n; i = state->next++) {
+            (*state->body)(i);
+            if (++state->done == state->n) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->finished.notify_all();
+            }
+        }
+    };
+
+    const size_t limit = maxParallel > 0 ? size_t(maxParallel) : size_t(threads()) + 1;
+    const size_t helpers = std::min(n, limit) - 1;
+    for (size_t h = 0; h < helpers; ++h) submit(lane, drain);
+
+    {
+        LaneScope scope(lane);
+        drain();
+    }
+
+    // Items claimed by helpers may still be running
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->finished.wait(lock, [&] { return state->done.load() == n; });
+}
+
+void TaskPool::workerLoop(int index) {
+    t_pool = this;
+    t_worker = index;
+
+    for (;;) {
+        {
+            Item item;
+            int lane = 0;
+            if (take(index, item, lane)) {
+                run(item, lane);
+                continue;
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_wake.wait(lock, [this] { return m_stop || runnable(); });
+        if (m_stop) {
+            bool queued = false;
+            for (const LaneCounters& c : m_lanes) queued = queued || c.queued > 0;
+            if (!queued) return;
+        }
+    }
+}
+
+bool TaskPool::runnable() const {
+    const LaneCounters& bg = m_lanes[size_t(TaskLane::Background)];
+    return m_lanes[size_t(TaskLane::Interactive)].queued > 0 ||
+           m_lanes[size_t(TaskLane::Normal)].queued > 0 ||
+           (bg.queued > 0 && bg.running < m_backgroundLimit);
+}
+
+bool TaskPool::take(int index, Item& item, int& lane) {
+    for (int l = 0; l < LANES; ++l) {
+        LaneCounters& c = m_lanes[size_t(l)];
+        if (c.queued <= 0) continue;
+
+        // Background work first reserves one of its limited slots
+        if (l == int(TaskLane::Background)) {
+            int running = c.running.load();
+            bool reserved = false;
+            while (running < m_backgroundLimit && !reserved) {
+                reserved = c.running.compare_exchange_weak(running, running + 1);
+            }
+            if (!reserved) continue;
+        } else {
+            ++c.running;
+        }
+
+        if (popLane(index, l, item)) {
+            --c.queued;
+            lane = l;
+            return true;
+        }
+        --c.running;
+    }
+    return false;
+}
+
+/// Own deque newest first (still in cache), then oldest of the others
+bool TaskPool::popLane(int index, int lane, Item& item) {
+    const size_t l = size_t(lane);
+    {
+        Worker& own = *m_workers[size_t(index)];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.lanes[l].empty()) {
+            item = std::move(own.lanes[l].back());
+            own.lanes[l].pop_back();
+            return true;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_sharedMutex);
+        if (!m_shared[l].empty()) {
+            item = std::move(m_shared[l].front());
+            m_shared[l].pop_front();
+            return true;
+        }
+    }
+    const size_t n = m_workers.size();
+    for (size_t k = 1; k < n; ++k) {
+        Worker& victim = *m_workers[(size_t(index) + k) % n];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.lanes[l].empty()) {
+            item = std::move(victim.lanes[l].front());
+            victim.lanes[l].pop_front();
+            PERF_COUNT("pool.steals", 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Run one task on its lane; `running` was counted by take()
+void TaskPool::run(Item& item, int lane) {
+    LaneCounters& c = m_lanes[size_t(lane)];
+    const Clock::time_point start = Clock::now();
+    const uint64_t waited = nanos(start - item.queued);
+    c.waitNs += waited;
+    PERF_VALUE(kWaitMetric[lane], waited / 1000);
+
+    const TaskLane previous = t_lane;
+    t_lane = TaskLane(lane);
+    item.fn();
+    item.fn = nullptr; // captured state goes with the task
+    t_lane = previous;
+
+    c.busyNs += nanos(Clock::now() - start);
+    ++c.completed;
+    --c.running;
+
+    // A Background slot came free: a worker may be waiting for it
+    if (lane == int(TaskLane::Background)) {
+        {
+            std::lock_guard<std::mutex> lock(m_sleepMutex);
+        }
+        m_wake.notify_one();
+    }
+}
+
+TaskPool::LaneStats TaskPool::stats(TaskLane lane) const {
+    const LaneCounters& c = m_lanes[size_t(lane)];
+    LaneStats s;
+    s.submitted = c.submitted;
+    s.completed = c.completed;
+    s.queued = std::max(0, c.queued.load());
+    s.running = c.running;
+    s.waitSec = c.waitNs / 1e9;
+    s.busySec = c.busyNs / 1e9;
+
+    const double elapsed = std::chrono::duration<double>(Clock::now() - m_started).count();
+    if (elapsed > 0.0) s.utilization = s.busySec / (elapsed * threads());
+    return s;
+}
+
+std::string TaskPool::summary() const {
+    std::ostringstream os;
+    char line[256];
+    for (int l = 0; l < LANES; ++l) {
+        const TaskLane lane = TaskLane(l);
+        const LaneStats s = stats(lane);
+        std::snprintf(line, sizeof(line),
+                      "%-12s tasks=%-8llu queued=%-4d running=%-3d wait=%.2fms/task busy=%.2fs (%.1f%%)\n",
+                      laneName(lane), (unsigned long long)s.completed, s.queued, s.running,
+                      s.completed ? s.waitSec * 1e3 / s.completed : 0.0, s.busySec,
+                      s.utilization * 100.0);
+        os << line;
+    }
+    return os.str();
+}
+
+void TaskGroup::submit(TaskLane lane, TaskPool::Task task) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_pending;
+    }
+    m_pool.submit(lane, [this, task = std::move(task)] {
+        task();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (--m_pending == 0) m_idle.notify_all();
+    });
+}
+
+void TaskGroup::wait() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this] { return m_pending == 0; });
+}
+
+int TaskGroup::pending() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_pending;
+}
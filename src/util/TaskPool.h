@@ -0,0 +1,221 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// Priority lanes of TaskPool, most urgent first
+enum class TaskLane {
+    Interactive = 0, ///< A user or client is waiting: recognition, queries
+    Normal = 1,      ///< Foreground batch work: scans, re-index on request
+    Background = 2   ///< Bulk ingest and maintenance
+};
+
+/**
+ * @class TaskPool
+ * @brief Process-wide work-stealing scheduler shared by fingerprinting,
+ *        ingest, re-indexing and matching.
+ *
+ * One set of worker threads serves every parallel stage, so stages that
+ * run at the same time (a bulk import while queries are served) share
+ * the cores instead of each spawning its own threads.
+ *
+ * Scheduling:
+ *   - each worker has its own deque per lane; tasks submitted from a
+ *     worker go to its deque (run LIFO by it, stolen FIFO by idle
+ *     workers), tasks from other threads go to a shared queue;
+ *   - a worker always takes the most urgent lane that has work, so a
+ *     queued Interactive task starts before any queued Background one;
+ *   - Background tasks run on at most backgroundLimit() workers at once
+ *     (default: all but one), so interactive work never waits for a long
+ *     import task to finish.
+ *
+ * Tasks are not preempted: long jobs should be submitted in pieces
+ * (parallelFor does that). Nested submission is fine; a thread running a
+ * task inherits its lane (currentLane) for what it submits.
+ *
+ * Per lane, stats() reports tasks submitted/completed, queued and
+ * running now, time spent queued and running, and utilization (share of
+ * the workers' time spent on the lane).
+ */
+class TaskPool {
+public:
+    using Task = std::function<void()>;
+    using Clock = std::chrono::steady_clock;
+    static constexpr int LANES = 3;
+
+    /// Counters of one lane since the pool started
+    struct LaneStats {
+        uint64_t submitted = 0;
+        uint64_t completed = 0;
+        int queued = 0;          ///< Waiting now
+        int running = 0;         ///< Executing now
+        double waitSec = 0.0;    ///< Total time tasks spent queued
+        double busySec = 0.0;    ///< Total time tasks spent running
+        double utilization = 0.0; ///< busySec / (threads * seconds since start)
+    };
+
+    /// The process-wide pool, created on first use
+    static TaskPool& instance();
+
+    /// Worker count of instance() (0 = hardware concurrency). Only takes
+    /// effect before the first instance() call.
+    static void setDefaultThreads(int n);
+
+    explicit TaskPool(int threads = 0);
+
+    /// Runs every queued task, then joins the workers
+    ~TaskPool();
+
+    TaskPool(const TaskPool&) = delete;
+    TaskPool& operator=(const TaskPool&) = delete;
+
+    int threads() const { return int(m_threads.size()); }
+
+    /// Queue a task on `lane`
+    void submit(TaskLane lane, Task task);
+
+    /// submit() with a future for the result. Do not wait for it from a
+    /// task: that can use up every worker.
+    template <class F>
+    auto async(TaskLane lane, F&& f) -> std::future<decltype(f())>;
+
+    /// Run body(0) ... body(n - 1) on the calling thread and idle workers,
+    /// at most `maxParallel` at once (0 = threads() + 1); returns when all
+    /// have run. Safe from inside a task: the caller works through the
+    /// range itself if no worker is free.
+    void parallelFor(TaskLane lane, size_t n, const std::function<void(size_t)>& body,
+                     int maxParallel = 0);
+
+    /// Workers allowed to run Background tasks at once
+    void setBackgroundLimit(int n);
+    int backgroundLimit() const { return m_backgroundLimit; }
+
+    LaneStats stats(TaskLane lane) const;
+
+    /// Human-readable per-lane report
+    std::string summary() const;
+
+    static const char* laneName(TaskLane lane);
+
+    /// Lane of the task the calling thread is running, else the one set
+    /// by a LaneScope (default: Normal)
+    static TaskLane currentLane();
+
+    /**
+     * @class LaneScope
+     * @brief Sets currentLane() of the calling thread for its lifetime,
+     *        e.g. for a matcher thread that is not a pool worker.
+     */
+    class LaneScope {
+    public:
+        explicit LaneScope(TaskLane lane);
+        ~LaneScope();
+
+        LaneScope(const LaneScope&) = delete;
+        LaneScope& operator=(const LaneScope&) = delete;
+
+    private:
+        TaskLane m_previous;
+    };
+
+private:
+    struct Item {
+        Task fn;
+        Clock::time_point queued;
+    };
+
+    /// One worker's deques, guarded by their own mutex (thieves lock it)
+    struct Worker {
+        std::mutex mutex;
+        std::array<std::deque<Item>, LANES> lanes;
+    };
+
+    /// Per-lane counters (all atomics: read by stats() at any time)
+    struct LaneCounters {
+        std::atomic<uint64_t> submitted{0};
+        std::atomic<uint64_t> completed{0};
+        std::atomic<int> queued{0};
+        std::atomic<int> running{0};
+        std::atomic<uint64_t> waitNs{0};
+        std::atomic<uint64_t> busyNs{0};
+    };
+
+    void workerLoop(int index);
+
+    /// Pop the most urgent runnable task: own deque, shared queue, then
+    /// other workers' deques. A Background task comes with a reserved slot.
+    bool take(int index, Item& item, int& lane);
+    bool popLane(int index, int lane, Item& item);
+
+    /// A worker has something to do (called under m_sleepMutex)
+    bool runnable() const;
+
+    void run(Item& item, int lane);
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_sharedMutex;
+    std::array<std::deque<Item>, LANES> m_shared; ///< Tasks from non-worker threads
+
+    mutable std::mutex m_sleepMutex;
+    std::condition_variable m_wake;
+    bool m_stop = false;
+
+    std::array<LaneCounters, LANES> m_lanes;
+    std::atomic<int> m_backgroundLimit{1};
+    Clock::time_point m_started;
+};
+
+template <class F>
+auto TaskPool::async(TaskLane lane, F&& f) -> std::future<decltype(f())> {
+    using R = decltype(f());
+    auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+    std::future<R> result = task->get_future();
+    submit(lane, [task] { (*task)(); });
+    return result;
+}
+
+/**
+ * @class TaskGroup
+ * @brief Tasks submitted together and waited for together.
+ *
+ * For stages whose tasks are independent and whose owner must know when
+ * they are all done (e.g. before shutting down the stage after them).
+ * wait() blocks without helping, so call it from outside the pool.
+ */
+class TaskGroup {
+public:
+    explicit TaskGroup(TaskPool& pool = TaskPool::instance()) : m_pool(pool) {}
+
+    /// Waits for every task
+    ~TaskGroup() { wait(); }
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    void submit(TaskLane lane, TaskPool::Task task);
+
+    /// Block until every task submitted so far has finished
+    void wait();
+
+    /// Tasks submitted and not finished yet
+    int pending() const;
+
+private:
+    TaskPool& m_pool;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_idle;
+    int m_pending = 0;
+};
@@ -0,0 +1,107 @@
+#include "Check.h"
+#include "db/BloomFilter.h"
+
+namespace {
+
+/// Distinct pseudo-random keys (odd multiplier: a bijection on uint32)
+uint32_t keyAt(uint32_t i) { return i * 2654435761u + 12345u; }
+
+} // namespace
+
+TEST_CASE(emptyFilterAnswersMaybe) {
+    BloomFilter f;
+    CHECK(f.empty());
+    CHECK(f.mayContain(1));
+    CHECK(f.mayContain(0xFFFFFFFFu));
+    f.add(7);  // no-op
+    CHECK_EQ(f.keyCount(), size_t(0));
+    CHECK_EQ(f.bits(), size_t(0));
+}
+
+TEST_CASE(noFalseNegatives) {
+    BloomFilter f;
+    f.reset(10000);
+    CHECK(!f.empty());
+    CHECK(f.bits() >= size_t(10000 * 12));
+    CHECK_EQ(f.bytes() % 64, size_t(0));
+
+    for (uint32_t i = 0; i < 10000; ++i) f.add(keyAt(i));
+    bool all = true;
+    for (uint32_t i = 0; i < 10000; ++i) all = all && f.mayContain(keyAt(i));
+    CHECK(all);
+
+    // Repeats are not counted; a few fresh keys may collide completely
+    const size_t keys = f.keyCount();
+    CHECK(keys > 9900 && keys <= 10000);
+    f.add(keyAt(0));
+    CHECK_EQ(f.keyCount(), keys);
+}
+
+TEST_CASE(falsePositiveRateIsLow) {
+    BloomFilter f;
+    f.reset(20000);
+    for (uint32_t i = 0; i < 20000; ++i) f.add(keyAt(i));
+
+    int falsePositives = 0;
+    const int probes = 200000;
+    for (uint32_t i = 0; i < uint32_t(probes); ++i) {
+        if (f.mayContain(keyAt(1000000 + i))) ++falsePositives;
+    }
+    // Documented: under 0.5% at 12 bits per key; allow some slack
+    CHECK(falsePositives < probes / 100);
+}
+
+TEST_CASE(encodeDecodeRoundTrip) {
+    BloomFilter f;
+    f.reset(3000);
+    for (uint32_t i = 0; i < 3000; ++i) f.add(keyAt(i));
+
+    const std::vector<uint8_t> bytes = f.encode(0x1122334455667788ull, 42);
+    CHECK_EQ(bytes.size(), 32 + f.bytes());
+
+    BloomFilter g;
+    uint64_t a = 0, b = 0;
+    CHECK(BloomFilter::decode(bytes.data(), bytes.size(), g, a, b));
+    CHECK_EQ(a, 0x1122334455667788ull);
+    CHECK_EQ(b, uint64_t(42));
+    CHECK_EQ(g.keyCount(), f.keyCount());
+    CHECK_EQ(g.bits(), f.bits());
+
+    bool same = true;
+    for (uint32_t i = 0; i < 50000; ++i) same = same && f.mayContain(keyAt(i)) == g.mayContain(keyAt(i));
+    CHECK(same);
+    CHECK(g.encode(a, b) == bytes);
+}
+
+TEST_CASE(decodeRejectsMalformedInput) {
+    BloomFilter f;
+    f.reset(100);
+    f.add(1);
+    std::vector<uint8_t> bytes = f.encode(0, 0);
+
+    BloomFilter g;
+    uint64_t a = 0, b = 0;
+    CHECK(!BloomFilter::decode(bytes.data(), 10, g, a, b));
+    CHECK(!BloomFilter::decode(bytes.data(), bytes.size() - 1, g, a, b));
+
+    std::vector<uint8_t> badMagic = bytes;
+    badMagic[3] = '2';
+    CHECK(!BloomFilter::decode(badMagic.data(), badMagic.size(), g, a, b));
+
+    std::vector<uint8_t> noBlocks(bytes.begin(), bytes.begin() + 32);
+    noBlocks[4] = noBlocks[5] = noBlocks[6] = noBlocks[7] = 0;
+    CHECK(!BloomFilter::decode(noBlocks.data(), noBlocks.size(), g, a, b));
+}
+
+TEST_CASE(clearDropsTheBits) {
+    BloomFilter f;
+    f.reset(100);
+    for (uint32_t i = 0; i < 100; ++i) f.add(keyAt(i));
+    f.clear();
+    CHECK(f.empty());
+    CHECK_EQ(f.keyCount(), size_t(0));
+    CHECK(f.mayContain(keyAt(5000)));
+
+    f.reset(100);
+    CHECK(!f.mayContain(keyAt(0)));
+}
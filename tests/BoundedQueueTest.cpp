@@ -0,0 +1,107 @@
+#include "Check.h"
+#include "server/BoundedQueue.h"
+#include <atomic>
+#include <thread>
+
+using namespace std::chrono_literals;
+
+TEST_CASE(itemsLeaveInOrderUpToCapacity) {
+    BoundedQueue<int> q(2);
+    CHECK_EQ(q.capacity(), size_t(2));
+    CHECK(q.tryPush(1));
+    CHECK(q.tryPush(2));
+    CHECK(!q.tryPush(3));  // full: admission control rejects it
+    CHECK_EQ(q.size(), size_t(2));
+
+    int v = 0;
+    CHECK(q.pop(v));
+    CHECK_EQ(v, 1);
+    CHECK(q.tryPush(3));
+    CHECK(q.pop(v));
+    CHECK_EQ(v, 2);
+    CHECK(q.pop(v));
+    CHECK_EQ(v, 3);
+    CHECK_EQ(q.size(), size_t(0));
+
+    CHECK_EQ(BoundedQueue<int>(0).capacity(), size_t(1));
+}
+
+TEST_CASE(pushWaitsForRoom) {
+    BoundedQueue<int> q(1);
+    CHECK(q.tryPush(1));
+
+    std::atomic<bool> pushed{false};
+    std::thread producer([&] {
+        CHECK(q.push(2));
+        pushed = true;
+    });
+    std::this_thread::sleep_for(20ms);
+    CHECK(!pushed.load());
+
+    int v = 0;
+    CHECK(q.pop(v));
+    CHECK_EQ(v, 1);
+    CHECK(q.pop(v));  // waits for the producer
+    CHECK_EQ(v, 2);
+    producer.join();
+    CHECK(pushed.load());
+}
+
+TEST_CASE(popBatchTakesWhatIsThere) {
+    BoundedQueue<int> q(8);
+    for (int i = 1; i <= 3; ++i) CHECK(q.tryPush(int(i)));
+
+    std::vector<int> batch;
+    CHECK(q.popBatch(batch, 2, 0us));
+    CHECK(batch == std::vector<int>({1, 2}));
+    CHECK(q.popBatch(batch, 2, 1ms));  // the window passes without more
+    CHECK(batch == std::vector<int>({3}));
+}
+
+TEST_CASE(popBatchCollectsABurst) {
+    BoundedQueue<int> q(8);
+    std::thread producer([&q] {
+        q.push(1);
+        std::this_thread::sleep_for(5ms);
+        q.push(2);
+        q.push(3);
+    });
+
+    // Waits for the first item, then keeps collecting within the window
+    std::vector<int> batch;
+    CHECK(q.popBatch(batch, 3, 5s));
+    producer.join();
+    CHECK(batch == std::vector<int>({1, 2, 3}));
+}
+
+TEST_CASE(closeDrainsAndWakesEveryone) {
+    BoundedQueue<int> q(4);
+    CHECK(q.tryPush(1));
+    CHECK(q.tryPush(2));
+    q.close();
+    CHECK(!q.tryPush(3));
+    CHECK(!q.push(3));
+
+    // What was queued is still handed out, then pops fail
+    int v = 0;
+    CHECK(q.pop(v));
+    CHECK_EQ(v, 1);
+    std::vector<int> batch;
+    CHECK(q.popBatch(batch, 4, 1s));
+    CHECK(batch == std::vector<int>({2}));
+    CHECK(!q.pop(v));
+    CHECK(!q.popBatch(batch, 4, 1s));
+    CHECK(batch.empty());
+
+    // A consumer blocked on an empty queue is released
+    BoundedQueue<int> idle(1);
+    std::atomic<bool> result{true};
+    std::thread consumer([&] {
+        int item = 0;
+        result = idle.pop(item);
+    });
+    std::this_thread::sleep_for(20ms);
+    idle.close();
+    consumer.join();
+    CHECK(!result.load());
+}
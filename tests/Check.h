@@ -0,0 +1,60 @@
+#pragma once
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+/**
+ * @file Check.h
+ * @brief Minimal self-registering checks for the CTest executables.
+ *
+ * Each test file defines cases with TEST_CASE(name) { ... } and checks
+ * with CHECK / CHECK_EQ; a failed check is reported with its location
+ * and the case goes on. Link the file with tests/Main.cpp: the process
+ * exits non-zero if any check failed, which is what CTest looks at.
+ */
+namespace check {
+
+struct Case {
+    const char* name;
+    std::function<void()> body;
+};
+
+inline std::vector<Case>& cases() {
+    static std::vector<Case> all;
+    return all;
+}
+
+inline int& failures() {
+    static int n = 0;
+    return n;
+}
+
+struct Register {
+    Register(const char* name, std::function<void()> body) {
+        cases().push_back({name, std::move(body)});
+    }
+};
+
+inline bool report(bool ok, const char* expr, const char* file, int line) {
+    if (!ok) {
+        ++failures();
+        std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expr);
+    }
+    return ok;
+}
+
+} // namespace check
+
+#define CHECK_CAT_(a, b) a##b
+#define CHECK_CAT(a, b) CHECK_CAT_(a, b)
+
+/// Define and register one case
+#define TEST_CASE(name)                                                         \
+    static void CHECK_CAT(test_, name)();                                      \
+    static const check::Register CHECK_CAT(reg_, name)(#name, &CHECK_CAT(test_, name)); \
+    static void CHECK_CAT(test_, name)()
+
+/// Record a failure unless `expr` holds; evaluates to `expr`
+#define CHECK(expr) check::report(bool(expr), #expr, __FILE__, __LINE__)
+
+#define CHECK_EQ(a, b) check::report((a) == (b), #a " == " #b, __FILE__, __LINE__)
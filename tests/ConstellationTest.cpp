@@ -0,0 +1,94 @@
+#include "Check.h"
+#include "fingerprint/Constellation.h"
+
+namespace {
+
+Constellation sample() {
+    Constellation c;
+    c.sampleRate = 22050;
+    c.windowSize = 4096;
+    c.hopSize = 1024;
+    // Several peaks per frame, in extraction (not bin) order, and a gap
+    c.peaks = {{0, 40, 1.0f},    {0, 12, 2.5e-3f}, {0, 300, 7.0e4f},
+               {1, 41, 0.9f},    {5, 2047, 1e-12f}, {5, 3, 123.0f},
+               {1000, 500, 3.3f}};
+    return c;
+}
+
+} // namespace
+
+TEST_CASE(roundTripKeepsPeaksAndGeometry) {
+    const Constellation c = sample();
+    const std::vector<uint8_t> bytes = c.encode();
+    CHECK(bytes.size() < 16 + c.peaks.size() * 8);
+
+    Constellation d;
+    CHECK(Constellation::decode(bytes.data(), bytes.size(), d));
+    CHECK_EQ(d.peakFormat, Constellation::PEAK_FORMAT);
+    CHECK_EQ(d.sampleRate, c.sampleRate);
+    CHECK_EQ(d.windowSize, c.windowSize);
+    CHECK_EQ(d.hopSize, c.hopSize);
+    CHECK_EQ(d.peaks.size(), c.peaks.size());
+
+    for (size_t i = 0; i < c.peaks.size() && i < d.peaks.size(); ++i) {
+        CHECK_EQ(d.peaks[i].frame, c.peaks[i].frame);
+        CHECK_EQ(d.peaks[i].bin, c.peaks[i].bin);
+        // Power is kept exactly: re-hashing ranks peaks by it
+        CHECK_EQ(d.peaks[i].power, c.peaks[i].power);
+    }
+}
+
+TEST_CASE(silentPeaksStaySilent) {
+    Constellation c;
+    c.windowSize = 1024;
+    c.hopSize = 512;
+    c.peaks = {{3, 7, 0.0f}};
+    const std::vector<uint8_t> bytes = c.encode();
+
+    Constellation d;
+    CHECK(Constellation::decode(bytes.data(), bytes.size(), d));
+    CHECK_EQ(d.peaks.size(), size_t(1));
+    CHECK_EQ(d.peaks[0].power, 0.f);
+}
+
+TEST_CASE(peakFormatIsRecorded) {
+    Constellation c = sample();
+    std::vector<uint8_t> bytes = c.encode();
+    CHECK_EQ(bytes[0], uint8_t('C'));
+    CHECK_EQ(bytes[3], uint8_t('0' + Constellation::PEAK_FORMAT));
+
+    // Peaks of an older picker decode, flagged as such
+    c.peakFormat = 1;
+    bytes = c.encode();
+    Constellation d;
+    CHECK(Constellation::decode(bytes.data(), bytes.size(), d));
+    CHECK_EQ(d.peakFormat, 1);
+    CHECK_EQ(d.peaks.size(), c.peaks.size());
+
+    // A newer picker than this build knows is refused
+    bytes[3] = uint8_t('0' + Constellation::PEAK_FORMAT + 1);
+    CHECK(!Constellation::decode(bytes.data(), bytes.size(), d));
+    bytes[3] = uint8_t('0');
+    CHECK(!Constellation::decode(bytes.data(), bytes.size(), d));
+}
+
+TEST_CASE(decodeRejectsMalformedInput) {
+    const std::vector<uint8_t> bytes = sample().encode();
+    Constellation d;
+    CHECK(!Constellation::decode(bytes.data(), 3, d));
+    CHECK(!Constellation::decode(bytes.data(), 12, d));
+    CHECK(!Constellation::decode(bytes.data(), bytes.size() - 1, d));
+
+    std::vector<uint8_t> trailing = bytes;
+    trailing.push_back(0);
+    CHECK(!Constellation::decode(trailing.data(), trailing.size(), d));
+
+    std::vector<uint8_t> badMagic = bytes;
+    badMagic[1] = 'X';
+    CHECK(!Constellation::decode(badMagic.data(), badMagic.size(), d));
+
+    // Peak count larger than the payload can hold
+    std::vector<uint8_t> hugeCount = bytes;
+    hugeCount[12] = hugeCount[13] = hugeCount[14] = hugeCount[15] = 0xFF;
+    CHECK(!Constellation::decode(hugeCount.data(), hugeCount.size(), d));
+}
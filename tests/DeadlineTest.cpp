@@ -0,0 +1,66 @@
+#include "Check.h"
+#include "TestAudio.h"
+#include "fingerprint/Fingerprint.h"
+#include "util/Deadline.h"
+#include <chrono>
+#include <thread>
+
+using namespace std::chrono_literals;
+
+TEST_CASE(defaultNeverExpires) {
+    const Deadline d;
+    CHECK(!d.expired());
+    d.cancel();  // no-op without a budget
+    CHECK(!d.expired());
+    CHECK(d.expiry() == Deadline::Clock::time_point::max());
+}
+
+TEST_CASE(budgetRunsOut) {
+    CHECK(Deadline::in(0ms).expired());
+    CHECK(Deadline::at(Deadline::Clock::now() - 1s).expired());
+    CHECK(!Deadline::in(1h).expired());
+
+    const Deadline d = Deadline::in(20ms);
+    CHECK(!d.expired());
+    std::this_thread::sleep_for(40ms);
+    CHECK(d.expired());
+    CHECK(d.expired());  // expiry is final
+}
+
+TEST_CASE(cancelReachesEveryCopy) {
+    const Deadline d = Deadline::cancellable();
+    const Deadline copy = d;
+    CHECK(!d.expired());
+    CHECK(d.expiry() == Deadline::Clock::time_point::max());
+
+    std::thread other([copy] { copy.cancel(); });
+    other.join();
+    CHECK(d.expired());
+    CHECK(copy.expired());
+
+    // Independent deadlines do not share the flag
+    const Deadline e = Deadline::in(1h);
+    Deadline::in(1h).cancel();
+    CHECK(!e.expired());
+}
+
+TEST_CASE(fingerprintingStopsAtTheDeadline) {
+    const int rate = testaudio::SAMPLE_RATE;
+    const std::vector<int16_t> pcm = testaudio::tones(1, 6);
+
+    bool incomplete = true;
+    const auto full = Fingerprint::compute(pcm, rate, FingerprintProfile(), Deadline(), &incomplete);
+    CHECK(!incomplete);
+    CHECK(!full.empty());
+
+    const auto none = Fingerprint::compute(pcm, rate, FingerprintProfile(), Deadline::in(0ms),
+                                           &incomplete);
+    CHECK(incomplete);
+    CHECK(none.size() < full.size());
+
+    const Deadline cancelled = Deadline::cancellable();
+    cancelled.cancel();
+    incomplete = false;
+    Fingerprint::compute(pcm, rate, FingerprintProfile(), cancelled, &incomplete);
+    CHECK(incomplete);
+}
@@ -0,0 +1,118 @@
+#include "Check.h"
+#include "TestAudio.h"
+#include "db/Database.h"
+#include "fingerprint/Fingerprint.h"
+#include <QTemporaryDir>
+#include <cstdlib>
+
+namespace {
+
+constexpr int SONG_SECONDS = 40;
+
+/// Leading silence of a re-recording: a whole number of STFT hops, so
+/// that its peaks fall on the same frames as the original's
+constexpr size_t LEAD_IN = 43 * size_t(Fingerprint::hopSize());
+
+HashList recording(uint32_t seed, size_t leadIn = 0, double seconds = SONG_SECONDS) {
+    return Fingerprint::compute(testaudio::padded(testaudio::tones(seed, seconds), leadIn),
+                                testaudio::SAMPLE_RATE);
+}
+
+/// Catalog of songs 1 and 2, ids by seed
+struct Catalog {
+    QTemporaryDir dir;
+    Database db{dir.filePath("catalog.db")};
+    int ids[3] = {-1, -1, -1};
+
+    bool build(QString* err) {
+        if (!db.open(err) || !db.migrate(err)) return false;
+        for (uint32_t seed = 1; seed <= 2; ++seed) {
+            if (!add(QString("Song %1").arg(seed), recording(seed), ids[seed], err)) return false;
+        }
+        return true;
+    }
+
+    bool add(const QString& title, const HashList& hashes, int& id, QString* err) {
+        SongRow s;
+        s.title = title;
+        s.artist = "Test";
+        return db.insertSong(s, id, err) && db.insertFingerprints(id, hashes, err);
+    }
+};
+
+} // namespace
+
+TEST_CASE(sameRecordingIsADuplicate) {
+    Catalog catalog;
+    QString err;
+    CHECK(catalog.build(&err));
+
+    DuplicateMatch d;
+    CHECK(catalog.db.findDuplicate(recording(1), d, -1, &err));
+    CHECK(d.found);
+    CHECK_EQ(d.song.id, catalog.ids[1]);
+    CHECK(d.coverage > 0.95 && d.coverage <= 1.0);
+    CHECK_EQ(d.deltaMs, 0);
+
+    // Not against itself
+    CHECK(catalog.db.findDuplicate(recording(1), d, catalog.ids[1], &err));
+    CHECK(!d.found);
+}
+
+TEST_CASE(reRecordingIsADuplicate) {
+    Catalog catalog;
+    QString err;
+    CHECK(catalog.build(&err));
+
+    DuplicateMatch d;
+    CHECK(catalog.db.findDuplicate(recording(2, LEAD_IN), d, -1, &err));
+    CHECK(d.found);
+    CHECK_EQ(d.song.id, catalog.ids[2]);
+    CHECK(d.coverage >= 0.25);
+    const int leadInMs = int(LEAD_IN * 1000 / testaudio::SAMPLE_RATE);
+    CHECK(std::abs(d.deltaMs + leadInMs) <= 5);
+}
+
+TEST_CASE(clipsAndOtherSongsAreNotDuplicates) {
+    Catalog catalog;
+    QString err;
+    CHECK(catalog.build(&err));
+
+    // Aligns perfectly, but is much shorter than the stored song
+    DuplicateMatch d;
+    CHECK(catalog.db.findDuplicate(recording(1, 0, 15), d, -1, &err));
+    CHECK(!d.found);
+    CHECK(d.coverage > 0.9);
+
+    CHECK(catalog.db.findDuplicate(recording(3), d, -1, &err));
+    CHECK(!d.found);
+    CHECK(d.coverage < 0.25);
+
+    CHECK(catalog.db.findDuplicate({}, d, -1, &err));
+    CHECK(!d.found);
+}
+
+TEST_CASE(reportListsEachPairOnce) {
+    Catalog catalog;
+    QString err;
+    CHECK(catalog.build(&err));
+    int copy = -1;
+    CHECK(catalog.add("Song 1 (again)", recording(1, LEAD_IN), copy, &err));
+
+    std::vector<std::pair<int,DuplicateMatch>> report;
+    int last = -1;
+    CHECK(catalog.db.duplicateReport(report, [&last](int percent) {
+        last = percent;
+        return true;
+    }, &err));
+    CHECK_EQ(last, 100);
+    CHECK_EQ(report.size(), size_t(1));
+    if (!report.empty()) {
+        CHECK_EQ(report[0].first, copy);
+        CHECK_EQ(report[0].second.song.id, catalog.ids[1]);
+    }
+
+    // Stopped by the progress callback: not an error
+    CHECK(catalog.db.duplicateReport(report, [](int) { return false; }, &err));
+    CHECK(report.empty());
+}
@@ -0,0 +1,144 @@
+#include "Check.h"
+#include "TestAudio.h"
+#include "fingerprint/Fingerprint.h"
+#include "fingerprint/StreamingFingerprinter.h"
+#include <algorithm>
+#include <cstddef>
+#include <set>
+
+namespace {
+
+using Hashes = std::vector<std::pair<uint32_t,int>>;
+
+std::set<std::pair<uint32_t,int>> asSet(const Hashes& h) {
+    return std::set<std::pair<uint32_t,int>>(h.begin(), h.end());
+}
+
+/// Share of `part`'s hashes that `whole` also has
+double covered(const Hashes& part, const Hashes& whole) {
+    if (part.empty()) return 0.0;
+    const auto all = asSet(whole);
+    size_t n = 0;
+    for (auto& h : part) n += all.count(h);
+    return double(n) / double(part.size());
+}
+
+} // namespace
+
+TEST_CASE(silenceHasNoFingerprints) {
+    const std::vector<int16_t> silence(size_t(testaudio::SAMPLE_RATE) * 3, 0);
+    CHECK(Fingerprint::compute(silence, testaudio::SAMPLE_RATE).empty());
+    CHECK(Fingerprint::extractPeaks(silence, testaudio::SAMPLE_RATE).peaks.empty());
+
+    // Low-level hiss stays below the gate as well
+    std::vector<int16_t> hiss(silence.size());
+    uint32_t x = 1;
+    for (int16_t& s : hiss) {
+        x = x * 1664525u + 1013904223u;
+        s = int16_t(int(x >> 29) - 4);
+    }
+    CHECK(Fingerprint::compute(hiss, testaudio::SAMPLE_RATE).empty());
+}
+
+TEST_CASE(computeIsExtractThenHash) {
+    const std::vector<int16_t> pcm = testaudio::tones(3, 5);
+    const Constellation c = Fingerprint::extractPeaks(pcm, testaudio::SAMPLE_RATE);
+    CHECK_EQ(c.windowSize, Fingerprint::windowSize());
+    CHECK_EQ(c.hopSize, Fingerprint::hopSize());
+    CHECK_EQ(c.peakFormat, Constellation::PEAK_FORMAT);
+    CHECK(Fingerprint::hashPeaks(c) == Fingerprint::compute(pcm, testaudio::SAMPLE_RATE));
+}
+
+TEST_CASE(indexProfileStaysWithinItsBudget) {
+    const std::vector<int16_t> pcm = testaudio::tones(4, 20);
+    const FingerprintProfile index = Fingerprint::indexProfile();
+    const Hashes h = Fingerprint::compute(pcm, testaudio::SAMPLE_RATE, index);
+    const double rate = Fingerprint::hashesPerSecond(h.size(), pcm.size(), testaudio::SAMPLE_RATE);
+    CHECK(rate > index.hashesPerSec / 4);
+    CHECK(rate <= index.hashesPerSec * 1.05);
+}
+
+TEST_CASE(queryProfileAddsToTheIndexHashes) {
+    const std::vector<int16_t> pcm = testaudio::tones(5, 10);
+    const int rate = testaudio::SAMPLE_RATE;
+    const Hashes index = Fingerprint::compute(pcm, rate, Fingerprint::indexProfile());
+    const Hashes query = Fingerprint::compute(pcm, rate, Fingerprint::queryProfile());
+    CHECK(query.size() > 2 * index.size());
+    CHECK_EQ(covered(index, query), 1.0);
+}
+
+TEST_CASE(clipPicksTheRecordingsAnchors) {
+    const std::vector<int16_t> pcm = testaudio::tones(6, 12);
+    const Hashes whole = Fingerprint::compute(pcm, testaudio::SAMPLE_RATE);
+
+    // Cut on a frame boundary, so offsets shift by a whole number of hops
+    const size_t hops = 200;
+    const size_t from = hops * size_t(Fingerprint::hopSize());
+    const auto begin = pcm.begin() + std::ptrdiff_t(from);
+    const std::vector<int16_t> part(begin, begin + 4 * testaudio::SAMPLE_RATE);
+    Hashes clip = Fingerprint::compute(part, testaudio::SAMPLE_RATE);
+    const int shiftMs = int(int64_t(from) * 1000 / testaudio::SAMPLE_RATE);
+    for (auto& h : clip) h.second += shiftMs;
+
+    // Away from the clip's edges the anchors are the same
+    Hashes inner;
+    for (auto& h : clip) {
+        if (h.second > shiftMs + 1000 && h.second < shiftMs + 3000) inner.push_back(h);
+    }
+    CHECK(!inner.empty());
+    // Offsets are rounded to ms on both sides: allow one ms either way
+    Hashes widened = whole;
+    for (auto& h : whole) {
+        widened.push_back({h.first, h.second - 1});
+        widened.push_back({h.first, h.second + 1});
+    }
+    CHECK(covered(inner, widened) > 0.95);
+}
+
+TEST_CASE(streamingMatchesWholeSignal) {
+    const std::vector<int16_t> pcm = testaudio::padded(testaudio::tones(7, 6), 5000, 3000);
+    const Hashes whole = Fingerprint::compute(pcm, testaudio::SAMPLE_RATE);
+
+    StreamingFingerprinter fp(testaudio::SAMPLE_RATE);
+    Constellation peaks;
+    fp.recordPeaks(&peaks);
+    std::vector<StreamHash> out;
+    const size_t chunks[] = {1, 777, 4096, 13, 20000};
+    size_t at = 0;
+    for (int i = 0; at < pcm.size(); ++i) {
+        const size_t n = std::min(chunks[i % 5], pcm.size() - at);
+        fp.push(pcm.data() + at, n, out);
+        at += n;
+    }
+    fp.finish(out);
+
+    Hashes streamed;
+    for (const StreamHash& h : out) streamed.emplace_back(h.hash, int(h.timeMs));
+    CHECK(asSet(streamed) == asSet(whole));
+    CHECK_EQ(streamed.size(), whole.size());
+    CHECK_EQ(fp.elapsedMs(), int64_t(pcm.size()) * 1000 / testaudio::SAMPLE_RATE);
+
+    const Constellation direct = Fingerprint::extractPeaks(pcm, testaudio::SAMPLE_RATE);
+    CHECK_EQ(peaks.peaks.size(), direct.peaks.size());
+    CHECK_EQ(peaks.windowSize, direct.windowSize);
+
+    fp.reset();
+    CHECK_EQ(fp.elapsedMs(), int64_t(0));
+}
+
+TEST_CASE(schemesAreLookedUpById) {
+    const FingerprintKernels* v1 = FingerprintKernels::find(Fingerprint::SCHEME);
+    const FingerprintKernels* v2 = FingerprintKernels::find(FingerprintSchemeV2::ID);
+    CHECK(v1 && v2);
+    CHECK(!FingerprintKernels::find(0));
+    CHECK(!FingerprintKernels::find(99));
+    if (!v1 || !v2) return;
+
+    const std::vector<int16_t> pcm = testaudio::tones(8, 4);
+    const int rate = testaudio::SAMPLE_RATE;
+    const Hashes a = v1->compute(pcm, rate, FingerprintProfile(), Deadline(), nullptr);
+    CHECK(a == Fingerprint::compute(pcm, rate));
+    const Hashes b = v2->compute(pcm, rate, FingerprintProfile(), Deadline(), nullptr);
+    CHECK(!b.empty());
+    CHECK(covered(b, a) < 0.5);
+}
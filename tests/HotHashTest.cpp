@@ -0,0 +1,194 @@
+#include "Check.h"
+#include "db/Database.h"
+#include <QTemporaryDir>
+
+namespace {
+
+constexpr uint32_t HOT = 7;     ///< In one song, four times
+constexpr uint32_t SHARED = 9;  ///< Once in every song
+constexpr int UNIQUE = 30;      ///< Hashes of each song no other song has
+
+/// Hash i of song `n` that no other song has
+uint32_t unique(int n, int i) { return uint32_t(1000 * n + i); }
+
+/// Hand-made catalog: songs 1-3 (ids by number), song 1 holding HOT
+struct Catalog {
+    QTemporaryDir dir;
+    Database db{dir.filePath("catalog.db")};
+    int ids[4] = {-1, -1, -1, -1};
+
+    bool build(QString* err) {
+        if (!db.open(err) || !db.migrate(err)) return false;
+        for (int n = 1; n <= 3; ++n) {
+            HashList hashes = {{SHARED, 40}};
+            for (int i = 0; i < UNIQUE; ++i) hashes.emplace_back(unique(n, i), i * 50);
+            if (n == 1) {
+                for (int t : {0, 100, 200}) hashes.emplace_back(HOT, t);
+            }
+            SongRow s;
+            s.title = QString("Song %1").arg(n);
+            s.artist = "Test";
+            if (!db.insertSong(s, ids[n], err) || !db.insertFingerprints(ids[n], hashes, err)) {
+                return false;
+            }
+        }
+        // Fingerprints may arrive in several calls: the song is not new to HOT
+        return db.insertFingerprints(ids[1], {{HOT, 300}}, err);
+    }
+};
+
+/// Hashes 10..UNIQUE of song `n`, offset so that they align at 500 ms
+HashList query(int n) {
+    HashList out;
+    for (int i = 10; i < UNIQUE; ++i) out.emplace_back(unique(n, i), (i - 10) * 50);
+    return out;
+}
+
+/// True if `hash` alone finds no song
+bool stopListed(Database& db, uint32_t hash) {
+    MatchResult r;
+    QString err;
+    return db.match({{hash, 0}}, MatchOptions(), r, &err) && !r.found;
+}
+
+} // namespace
+
+TEST_CASE(songFractionCountsEachSongOnce) {
+    Catalog catalog;
+    QString err;
+    CHECK(catalog.build(&err));
+
+    // At most 2 of the 3 songs: SHARED is in 3, HOT in 1 (four postings)
+    HotHashPolicy policy;
+    policy.maxSongFraction = 0.5;
+    CHECK(catalog.db.setHotHashPolicy(policy, &err));
+    CHECK_EQ(catalog.db.stopListSize(), size_t(1));
+    CHECK(stopListed(catalog.db, SHARED));
+    CHECK(!stopListed(catalog.db, HOT));
+
+    // The same from statistics rebuilt from scratch
+    CHECK(catalog.db.rebuildHashStats(&err));
+    CHECK(catalog.db.setHotHashPolicy(policy, &err));
+    CHECK_EQ(catalog.db.stopListSize(), size_t(1));
+    CHECK(!stopListed(catalog.db, HOT));
+}
+
+TEST_CASE(postingLimitStopListsLongLists) {
+    Catalog catalog;
+    QString err;
+    CHECK(catalog.build(&err));
+
+    HotHashPolicy policy;
+    policy.maxPostings = 3;
+    CHECK(catalog.db.setHotHashPolicy(policy, &err));
+    CHECK_EQ(catalog.db.stopListSize(), size_t(1));
+    CHECK(stopListed(catalog.db, HOT));
+    CHECK(!stopListed(catalog.db, SHARED));
+
+    // Deleting the song takes its postings out of the statistics
+    CHECK(catalog.db.deleteSong(catalog.ids[1], &err));
+    CHECK(catalog.db.setHotHashPolicy(policy, &err));
+    CHECK_EQ(catalog.db.stopListSize(), size_t(0));
+
+    // No limits, no stop-list
+    CHECK(catalog.db.setHotHashPolicy(HotHashPolicy(), &err));
+    CHECK_EQ(catalog.db.stopListSize(), size_t(0));
+}
+
+TEST_CASE(stopListedHashesDoNotVote) {
+    Catalog catalog;
+    QString err;
+    CHECK(catalog.build(&err));
+
+    HashList q = query(2);
+    q.emplace_back(SHARED, 0);
+    MatchResult before;
+    CHECK(catalog.db.match(q, MatchOptions(), before, &err));
+
+    HotHashPolicy policy;
+    policy.maxSongFraction = 0.5;
+    CHECK(catalog.db.setHotHashPolicy(policy, &err));
+    MatchResult after;
+    CHECK(catalog.db.match(q, MatchOptions(), after, &err));
+    CHECK_EQ(after.song.id, catalog.ids[2]);
+    CHECK_EQ(after.deltaMs, 500);
+    CHECK_EQ(after.votes, UNIQUE - 10);
+    CHECK_EQ(before.votes, after.votes);  // SHARED never aligned anyway
+}
+
+TEST_CASE(applyOnInsertKeepsHotHashesOut) {
+    Catalog catalog;
+    QString err;
+    CHECK(catalog.build(&err));
+
+    HotHashPolicy policy;
+    policy.maxSongFraction = 0.5;
+    policy.applyOnInsert = true;
+    CHECK(catalog.db.setHotHashPolicy(policy, &err));
+
+    IndexStats before, after;
+    CHECK(catalog.db.indexStats(before, 20, &err));
+    int id = -1;
+    SongRow s;
+    s.title = "Song 4";
+    s.artist = "Test";
+    CHECK(catalog.db.insertSong(s, id, &err));
+    CHECK(catalog.db.insertFingerprints(id, {{SHARED, 0}, {unique(4, 0), 0}}, &err));
+    CHECK(catalog.db.indexStats(after, 20, &err));
+    CHECK_EQ(after.postings, before.postings + 1);
+    CHECK_EQ(after.songs, before.songs + 1);
+
+    // Replicas are sent what was stored, not what was passed in
+    qint64 seq = 0;
+    std::vector<Change> changes;
+    HashList logged;
+    CHECK(catalog.db.lastChangeSeq(seq, &err));
+    CHECK(catalog.db.readChanges(seq - 1, 1, changes, &err));
+    CHECK(changes.size() == 1 && Change::decodeHashes(changes[0].payload, logged));
+    CHECK(logged == HashList({{unique(4, 0), 0}}));
+}
+
+TEST_CASE(idfWeightingFavoursRareHashes) {
+    Catalog catalog;
+    QString err;
+    CHECK(catalog.build(&err));
+
+    // Two aligned votes of HOT (four postings) against one of a hash
+    // only song 2 has
+    const HashList q = {{HOT, 0}, {HOT, 100}, {unique(2, 0), 0}};
+    SongRow song;
+    int votes = 0;
+    CHECK(catalog.db.bestMatch(q, song, votes, &err));
+    CHECK_EQ(song.id, catalog.ids[1]);
+    CHECK_EQ(votes, 2);
+
+    // Weighted log(1 + 3/4) each, against log(1 + 3/1)
+    HotHashPolicy policy;
+    policy.idfWeighting = true;
+    CHECK(catalog.db.setHotHashPolicy(policy, &err));
+    CHECK_EQ(catalog.db.stopListSize(), size_t(0));
+    CHECK(catalog.db.bestMatch(q, song, votes, &err));
+    CHECK_EQ(song.id, catalog.ids[2]);
+    CHECK_EQ(votes, 1);
+}
+
+TEST_CASE(indexStatsDescribeTheCatalog) {
+    Catalog catalog;
+    QString err;
+    CHECK(catalog.build(&err));
+
+    IndexStats stats;
+    CHECK(catalog.db.indexStats(stats, 1, &err));
+    CHECK_EQ(stats.songs, qint64(3));
+    CHECK_EQ(stats.postings, qint64(3 * (UNIQUE + 1) + 4));
+    CHECK_EQ(stats.distinctHashes, qint64(3 * UNIQUE + 2));
+    CHECK_EQ(stats.heaviest.size(), size_t(1));
+    if (!stats.heaviest.empty()) {
+        CHECK_EQ(stats.heaviest[0].first, HOT);
+        CHECK_EQ(stats.heaviest[0].second, qint64(4));
+    }
+    qint64 hashes = 0;
+    for (qint64 n : stats.postingHistogram) hashes += n;
+    CHECK_EQ(hashes, stats.distinctHashes);
+    CHECK(!stats.summary().isEmpty());
+}
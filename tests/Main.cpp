@@ -0,0 +1,22 @@
+#include "Check.h"
+#if CHECK_QT_APP
+#include <QCoreApplication>
+#endif
+
+/// Run every registered case; non-zero exit if a check failed
+int main(int argc, char** argv) {
+#if CHECK_QT_APP
+    // Sql drivers and event loops need the application object
+    QCoreApplication app(argc, argv);
+#else
+    (void)argc;
+    (void)argv;
+#endif
+    for (const check::Case& c : check::cases()) {
+        const int before = check::failures();
+        c.body();
+        std::printf("%s %s\n", check::failures() == before ? "PASS" : "FAIL", c.name);
+    }
+    std::printf("%d check(s) failed\n", check::failures());
+    return check::failures() == 0 ? 0 : 1;
+}
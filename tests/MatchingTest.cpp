@@ -0,0 +1,182 @@
+#include "Check.h"
+#include "TestCatalog.h"
+#include <algorithm>
+#include <cstdlib>
+
+namespace {
+
+constexpr int SONGS = 6;
+constexpr int SONG_SECONDS = 20;
+
+using testcatalog::Catalog;
+
+/// Query hashes of `seconds` of song `seed` from `fromMs`
+HashList clip(uint32_t seed, int fromMs, int seconds = 3) {
+    const std::vector<int16_t> pcm = testaudio::tones(seed, SONG_SECONDS);
+    const size_t from = size_t(fromMs) * testaudio::SAMPLE_RATE / 1000;
+    const std::vector<int16_t> part(pcm.begin() + from,
+                                    pcm.begin() + from + size_t(seconds) * testaudio::SAMPLE_RATE);
+    return Fingerprint::compute(part, testaudio::SAMPLE_RATE, Fingerprint::queryProfile());
+}
+
+/// `r` is song `seed` of `catalog`, aligned at `fromMs` to a few STFT hops;
+/// early termination stops once the leader is clear, with fewer votes
+void checkFound(const Catalog& catalog, const MatchOptions& opts, const MatchResult& r,
+                uint32_t seed, int fromMs) {
+    CHECK(r.found);
+    CHECK(!r.incomplete);
+    CHECK_EQ(r.song.id, catalog.ids[seed]);
+    CHECK(std::abs(r.deltaMs - fromMs) <= 50);
+    CHECK(r.votes >= (opts.earlyTermination ? opts.minLeaderVotes : 20));
+}
+
+} // namespace
+
+TEST_CASE(everyMatchPathFindsTheSong) {
+    Catalog catalog;
+    QString err;
+    CHECK(catalog.build(SONGS, SONG_SECONDS, &err));
+
+    MatchOptions twoStage;
+    twoStage.twoStage = true;
+    MatchOptions early;
+    early.earlyTermination = true;
+    MatchOptions sketch;
+    sketch.sketchPrefilter = true;
+    sketch.sketchCandidates = 3;
+    const MatchOptions paths[] = {MatchOptions(), twoStage, early, sketch};
+
+    for (uint32_t seed = 1; seed <= SONGS; ++seed) {
+        const int fromMs = 1000 + int(seed) * 1500;
+        const HashList query = clip(seed, fromMs);
+        for (const MatchOptions& opts : paths) {
+            MatchResult r;
+            CHECK(catalog.db.match(query, opts, r, &err));
+            checkFound(catalog, opts, r, seed, fromMs);
+        }
+    }
+}
+
+TEST_CASE(earlyTerminationProbesFewerHashes) {
+    Catalog catalog;
+    QString err;
+    CHECK(catalog.build(SONGS, SONG_SECONDS, &err));
+
+    MatchOptions early;
+    early.earlyTermination = true;
+    MatchResult full, stopped;
+    const HashList query = clip(2, 4000, 8);
+    CHECK(catalog.db.match(query, MatchOptions(), full, &err));
+    CHECK(catalog.db.match(query, early, stopped, &err));
+    CHECK_EQ(stopped.song.id, full.song.id);
+    CHECK(std::abs(stopped.deltaMs - full.deltaMs) <= 50);  // a neighbouring bin may lead
+    CHECK(stopped.hashesProbed < stopped.hashesTotal);
+}
+
+TEST_CASE(batchAnswersLikeSingleQueries) {
+    Catalog catalog;
+    QString err;
+    CHECK(catalog.build(SONGS, SONG_SECONDS, &err));
+
+    std::vector<HashList> queries;
+    for (uint32_t seed = 1; seed <= SONGS; ++seed) {
+        queries.push_back(clip(seed, 2000 * int(seed)));
+    }
+    queries.push_back(clip(3, 500));  // the same song twice in one batch
+    queries.push_back({});
+
+    std::vector<MatchResult> batch;
+    CHECK(catalog.db.bestMatchBatch(queries, batch, &err));
+    CHECK_EQ(batch.size(), queries.size());
+    for (size_t i = 0; i < queries.size() && i < batch.size(); ++i) {
+        MatchResult single;
+        CHECK(catalog.db.match(queries[i], MatchOptions(), single, &err));
+        CHECK_EQ(batch[i].found, single.found);
+        CHECK_EQ(batch[i].song.id, single.song.id);
+        CHECK_EQ(batch[i].votes, single.votes);
+        CHECK_EQ(batch[i].deltaMs, single.deltaMs);
+
+        // Without a deadline every distinct hash of the query is probed
+        std::vector<uint32_t> distinct;
+        for (const auto& h : queries[i]) distinct.push_back(h.first);
+        std::sort(distinct.begin(), distinct.end());
+        distinct.erase(std::unique(distinct.begin(), distinct.end()), distinct.end());
+        CHECK_EQ(batch[i].hashesTotal, int(distinct.size()));
+        CHECK_EQ(batch[i].hashesProbed, batch[i].hashesTotal);
+    }
+    for (uint32_t seed = 1; seed <= SONGS && seed <= batch.size(); ++seed) {
+        CHECK_EQ(batch[seed - 1].song.id, catalog.ids[seed]);
+    }
+    CHECK(!batch.back().found);
+
+    // The same in read-pool mode, where lookups are spread over the pool
+    catalog.db.setReadPool(true);
+    std::vector<MatchResult> pooled;
+    CHECK(catalog.db.bestMatchBatch(queries, pooled, &err));
+    CHECK_EQ(pooled.size(), batch.size());
+    for (size_t i = 0; i < pooled.size() && i < batch.size(); ++i) {
+        CHECK_EQ(pooled[i].song.id, batch[i].song.id);
+        CHECK_EQ(pooled[i].votes, batch[i].votes);
+    }
+}
+
+TEST_CASE(topKRanksOneEntryPerSong) {
+    Catalog catalog;
+    QString err;
+    CHECK(catalog.build(SONGS, SONG_SECONDS, &err));
+
+    MatchOptions opts;
+    opts.topK = 3;
+    MatchResult r;
+    CHECK(catalog.db.match(clip(5, 6000), opts, r, &err));
+    CHECK(!r.candidates.empty() && r.candidates.size() <= 3);
+    if (!r.candidates.empty()) {
+        CHECK_EQ(r.candidates[0].song.id, r.song.id);
+        CHECK_EQ(r.candidates[0].votes, r.votes);
+    }
+    for (size_t i = 1; i < r.candidates.size(); ++i) {
+        CHECK(r.candidates[i].score <= r.candidates[i - 1].score);
+        CHECK(r.candidates[i].song.id != r.candidates[0].song.id);
+    }
+}
+
+TEST_CASE(expiredDeadlineFlagsTheResult) {
+    Catalog catalog;
+    QString err;
+    CHECK(catalog.build(SONGS, SONG_SECONDS, &err));
+
+    MatchOptions opts;
+    opts.deadline = Deadline::cancellable();
+    opts.deadline.cancel();
+    MatchResult r;
+    CHECK(catalog.db.match(clip(1, 3000), opts, r, &err));
+    CHECK(r.incomplete);
+    CHECK(r.hashesProbed < r.hashesTotal);
+
+    // A batch cut before its lookups probed only what the Bloom filter ruled out
+    std::vector<MatchResult> batch;
+    CHECK(catalog.db.bestMatchBatch({clip(1, 3000), clip(2, 3000)}, batch, &err,
+                                    Fingerprint::SCHEME, opts.deadline));
+    for (const MatchResult& b : batch) {
+        CHECK(b.incomplete);
+        CHECK(b.hashesTotal > 0);
+        CHECK(b.hashesProbed < b.hashesTotal);
+    }
+}
+
+TEST_CASE(otherSchemesAreRejected) {
+    Catalog catalog;
+    QString err;
+    CHECK(catalog.build(SONGS, SONG_SECONDS, &err));
+    CHECK_EQ(catalog.db.scheme(), Fingerprint::SCHEME);
+
+    MatchOptions opts;
+    opts.scheme = Fingerprint::SCHEME + 1;
+    MatchResult r;
+    err.clear();
+    CHECK(!catalog.db.match(clip(1, 3000), opts, r, &err));
+    CHECK(!err.isEmpty());
+
+    std::vector<MatchResult> batch;
+    CHECK(!catalog.db.bestMatchBatch({clip(1, 3000)}, batch, &err, Fingerprint::SCHEME + 1));
+}
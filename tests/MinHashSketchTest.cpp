@@ -0,0 +1,113 @@
+#include "Check.h"
+#include "db/MinHashSketch.h"
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+
+namespace {
+
+using Hashes = std::vector<std::pair<uint32_t,int>>;
+
+/// `count` hashes spread evenly over `durationMs`, from a seeded LCG
+Hashes song(uint32_t seed, int count, int durationMs) {
+    Hashes out;
+    uint32_t x = seed;
+    for (int i = 0; i < count; ++i) {
+        x = x * 1664525u + 1013904223u;
+        out.push_back({x, int(int64_t(i) * durationMs / count)});
+    }
+    return out;
+}
+
+/// Hashes of `from` with offsets in [startMs, endMs), re-anchored at 0
+Hashes excerpt(const Hashes& from, int startMs, int endMs) {
+    Hashes out;
+    for (auto& h : from) {
+        if (h.second >= startMs && h.second < endMs) out.push_back({h.first, h.second - startMs});
+    }
+    return out;
+}
+
+size_t sharedKeys(const MinHashSketch& a, const MinHashSketch& b) {
+    const std::vector<int64_t> ka = a.keys(), kb = b.keys();
+    std::vector<int64_t> both;
+    std::set_intersection(ka.begin(), ka.end(), kb.begin(), kb.end(), std::back_inserter(both));
+    return both.size();
+}
+
+} // namespace
+
+TEST_CASE(emptyInputHasNoWindows) {
+    const MinHashSketch s = MinHashSketch::build({});
+    CHECK_EQ(s.windows, 0);
+    CHECK(s.mins.empty());
+    CHECK(s.keys().empty());
+}
+
+TEST_CASE(windowsCoverTheRecording) {
+    const Hashes h = song(1, 20000, 60000);
+    const MinHashSketch s = MinHashSketch::build(h);
+    const int hop = MinHashSketch::WINDOW_MS / 2;
+    CHECK_EQ(s.windows, h.back().second / hop + 1);
+    CHECK_EQ(s.mins.size(), size_t(s.windows) * MinHashSketch::BUCKETS);
+
+    // Dense input: every bucket of every full window gets a value
+    CHECK(std::count(s.mins.begin(), s.mins.end() - MinHashSketch::BUCKETS,
+                     MinHashSketch::EMPTY) == 0);
+}
+
+TEST_CASE(excerptSharesKeysWithItsSong) {
+    const Hashes a = song(11, 6000, 120000);
+    const Hashes b = song(22, 6000, 120000);
+    const MinHashSketch songA = MinHashSketch::build(a);
+    const MinHashSketch songB = MinHashSketch::build(b);
+
+    // A query shorter than half a window lies inside one of the song's
+    // windows, wherever it starts
+    for (int start : {0, 13500, 61000, 110000}) {
+        const MinHashSketch query = MinHashSketch::build(excerpt(a, start, start + 4000));
+        const size_t own = sharedKeys(query, songA);
+        const size_t other = sharedKeys(query, songB);
+        CHECK(own >= size_t(MinHashSketch::BUCKETS / 4));
+        CHECK(own > 4 * other);
+    }
+}
+
+TEST_CASE(mergeEqualsBuildingFromTheUnion) {
+    const Hashes a = song(5, 2000, 40000);
+    Hashes first(a.begin(), a.begin() + 700), second(a.begin() + 700, a.end());
+
+    MinHashSketch merged = MinHashSketch::build(first);
+    merged.merge(MinHashSketch::build(second));
+    const MinHashSketch whole = MinHashSketch::build(a);
+
+    CHECK_EQ(merged.windows, whole.windows);
+    CHECK(merged.mins == whole.mins);
+}
+
+TEST_CASE(encodeDecodeRoundTrip) {
+    const MinHashSketch s = MinHashSketch::build(song(9, 1500, 30000));
+    const std::vector<uint8_t> bytes = s.encode();
+    CHECK_EQ(bytes.size(), 10 + s.mins.size() * 4);
+
+    MinHashSketch t;
+    CHECK(MinHashSketch::decode(bytes.data(), bytes.size(), t));
+    CHECK_EQ(t.windows, s.windows);
+    CHECK(t.mins == s.mins);
+    CHECK(t.keys() == s.keys());
+}
+
+TEST_CASE(decodeRejectsMalformedInput) {
+    const std::vector<uint8_t> bytes = MinHashSketch::build(song(3, 200, 9000)).encode();
+    MinHashSketch t;
+    CHECK(!MinHashSketch::decode(bytes.data(), 6, t));
+    CHECK(!MinHashSketch::decode(bytes.data(), bytes.size() - 4, t));
+
+    std::vector<uint8_t> badMagic = bytes;
+    badMagic[0] = 'X';
+    CHECK(!MinHashSketch::decode(badMagic.data(), badMagic.size(), t));
+
+    std::vector<uint8_t> badBuckets = bytes;
+    badBuckets[4] = uint8_t(MinHashSketch::BUCKETS + 1);
+    CHECK(!MinHashSketch::decode(badBuckets.data(), badBuckets.size(), t));
+}
@@ -0,0 +1,165 @@
+// The PERF_* macros are compiled in for this file only; the registry
+// behind them is built whatever USE_PERF says
+#undef USE_PERF
+#define USE_PERF 1
+
+#include "Check.h"
+#include "perf/Perf.h"
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+namespace {
+
+/// A file in the temp directory, removed with the object
+struct TempFile {
+    std::string path;
+
+    explicit TempFile(const char* name) {
+        const auto stamp = std::chrono::steady_clock::now().time_since_epoch().count();
+        path = (std::filesystem::temp_directory_path() /
+                ("perftest-" + std::to_string(stamp) + "-" + name)).string();
+    }
+    ~TempFile() { std::remove(path.c_str()); }
+
+    std::string read() const {
+        std::ifstream in(path, std::ios::binary);
+        std::ostringstream os;
+        os << in.rdbuf();
+        return os.str();
+    }
+};
+
+size_t occurrences(const std::string& text, const std::string& what) {
+    size_t n = 0;
+    for (size_t at = text.find(what); at != std::string::npos; at = text.find(what, at + 1)) ++n;
+    return n;
+}
+
+/// Fresh registry with tracing `on` and the default event limit
+perf::Registry& fresh(bool tracing) {
+    perf::Registry& r = perf::Registry::instance();
+    r.reset();
+    r.setTracing(tracing);
+    r.setMaxEvents(1u << 20);
+    return r;
+}
+
+} // namespace
+
+TEST_CASE(histogramBucketsByPowersOfTwo) {
+    perf::Histogram h;
+    for (double v : {0.5, 1.0, 3.0, 1024.0}) h.add(v);
+    CHECK_EQ(h.count, uint64_t(4));
+    CHECK_EQ(h.sum, 1028.5);
+    CHECK_EQ(h.min, 0.5);
+    CHECK_EQ(h.max, 1024.0);
+    CHECK_EQ(h.buckets.size(), size_t(11));
+    if (h.buckets.size() == 11) {
+        CHECK_EQ(h.buckets[0], uint64_t(2));  // values up to 2 land in bucket 0
+        CHECK_EQ(h.buckets[1], uint64_t(1));
+        CHECK_EQ(h.buckets[10], uint64_t(1));
+    }
+}
+
+TEST_CASE(countersAndValuesExportAsJson) {
+    perf::Registry& r = fresh(false);
+    PERF_COUNT("test.count", 2);
+    PERF_COUNT("test.count", 3);
+    PERF_VALUE("test.value", 8);
+    PERF_VALUE("test.value", 4);
+
+    TempFile file("perf.json");
+    std::string err;
+    CHECK(r.exportJson(file.path, &err));
+    const std::string json = file.read();
+    CHECK(json.find("\"test.count\": 5") != std::string::npos);
+    CHECK(json.find("\"test.value\": {\"count\": 2, \"sum\": 12, \"min\": 4, \"max\": 8, "
+                    "\"mean\": 6") != std::string::npos);
+    CHECK(json.find("\"droppedTraceEvents\": 0") != std::string::npos);
+
+    const std::string summary = r.summary();
+    CHECK(summary.find("test.count") != std::string::npos);
+    CHECK(summary.find("test.value") != std::string::npos);
+
+    r.reset();
+    CHECK(r.summary().empty());
+}
+
+TEST_CASE(timersFeedHistogramsAndTraceEvents) {
+    perf::Registry& r = fresh(true);
+    {
+        PERF_SCOPE("test.scope");
+        PERF_PHASE(phase, "test.phase");
+        for (int i = 0; i < 3; ++i) {
+            PERF_PHASE_START(phase);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            PERF_PHASE_STOP(phase);
+        }
+    }
+    // A phase that never started reports nothing
+    { PERF_PHASE(idle, "test.idle"); }
+
+    TempFile trace("trace.json");
+    TempFile json("perf.json");
+    CHECK(r.exportChromeTrace(trace.path));
+    CHECK(r.exportJson(json.path));
+
+    // The three phase intervals make one event and one sample
+    const std::string events = trace.read();
+    CHECK(events.find("\"traceEvents\"") != std::string::npos);
+    CHECK_EQ(occurrences(events, "\"name\": \"test.scope\", \"ph\": \"X\""), size_t(1));
+    CHECK_EQ(occurrences(events, "\"name\": \"test.phase\", \"ph\": \"X\""), size_t(1));
+    CHECK_EQ(occurrences(events, "test.idle"), size_t(0));
+
+    const std::string stats = json.read();
+    CHECK(stats.find("\"test.scope\": {\"count\": 1") != std::string::npos);
+    CHECK(stats.find("\"test.phase\": {\"count\": 1") != std::string::npos);
+    CHECK_EQ(occurrences(stats, "test.idle"), size_t(0));
+    r.setTracing(false);
+}
+
+TEST_CASE(traceEventsAreCappedAndCounted) {
+    perf::Registry& r = fresh(false);
+    { PERF_SCOPE("test.untraced"); }
+
+    r.setTracing(true);
+    r.setMaxEvents(2);
+    for (int i = 0; i < 5; ++i) {
+        PERF_SCOPE("test.capped");
+    }
+
+    TempFile trace("trace.json");
+    TempFile json("perf.json");
+    CHECK(r.exportChromeTrace(trace.path));
+    CHECK(r.exportJson(json.path));
+    CHECK_EQ(occurrences(trace.read(), "\"name\""), size_t(2));
+    CHECK_EQ(occurrences(trace.read(), "test.untraced"), size_t(0));
+    CHECK(json.read().find("\"droppedTraceEvents\": 3") != std::string::npos);
+
+    // Histograms still see every sample
+    CHECK(json.read().find("\"test.capped\": {\"count\": 5") != std::string::npos);
+    CHECK(json.read().find("\"test.untraced\": {\"count\": 1") != std::string::npos);
+    fresh(false);
+}
+
+TEST_CASE(unwritablePathsAreReported) {
+    perf::Registry& r = fresh(false);
+    std::string err;
+    CHECK(!r.exportJson("/nonexistent-perftest-dir/perf.json", &err));
+    CHECK(err.find("Cannot write") != std::string::npos);
+    err.clear();
+    CHECK(!r.exportChromeTrace("/nonexistent-perftest-dir/trace.json", &err));
+    CHECK(err.find("Cannot write") != std::string::npos);
+}
+
+TEST_CASE(threadIdsAreStablePerThread) {
+    const int mine = perf::Registry::threadId();
+    CHECK_EQ(perf::Registry::threadId(), mine);
+    int other = mine;
+    std::thread([&other] { other = perf::Registry::threadId(); }).join();
+    CHECK(other != mine);
+    CHECK(other > 0);
+}
@@ -0,0 +1,97 @@
+#include "Check.h"
+#include "db/PostingCache.h"
+#include <memory>
+
+namespace {
+
+PostingList list(int songId, size_t count) {
+    auto v = std::make_shared<std::vector<Posting>>();
+    for (size_t i = 0; i < count; ++i) v->push_back({songId, int(i) * 10});
+    return v;
+}
+
+} // namespace
+
+TEST_CASE(hitsAndMisses) {
+    PostingCache cache;
+    CHECK(!cache.lookup(1));
+    cache.insert(1, list(3, 4));
+    const PostingList got = cache.lookup(1);
+    CHECK(got && got->size() == 4 && (*got)[0].songId == 3);
+    CHECK(!cache.lookup(2));
+
+    const PostingCacheStats s = cache.stats();
+    CHECK_EQ(s.hits, uint64_t(1));
+    CHECK_EQ(s.misses, uint64_t(2));
+    CHECK_EQ(s.entries, size_t(1));
+    CHECK_EQ(s.bytes, PostingCache::entryBytes(4));
+}
+
+TEST_CASE(evictsLeastRecentlyUsed) {
+    const size_t entry = PostingCache::entryBytes(8);
+    PostingCache cache(3 * entry);
+    cache.insert(1, list(1, 8));
+    cache.insert(2, list(2, 8));
+    cache.insert(3, list(3, 8));
+    CHECK(cache.lookup(1));           // 2 is now the oldest
+    cache.insert(4, list(4, 8));
+
+    CHECK(!cache.lookup(2));
+    CHECK(cache.lookup(1) && cache.lookup(3) && cache.lookup(4));
+    const PostingCacheStats s = cache.stats();
+    CHECK_EQ(s.evictions, uint64_t(1));
+    CHECK_EQ(s.entries, size_t(3));
+    CHECK(s.bytes <= s.maxBytes);
+
+    // Shrinking evicts at once, oldest first
+    cache.setMaxBytes(entry);
+    CHECK_EQ(cache.stats().entries, size_t(1));
+    CHECK(cache.lookup(4));
+}
+
+TEST_CASE(replacingAnEntryKeepsTheByteCount) {
+    PostingCache cache;
+    cache.insert(7, list(1, 100));
+    cache.insert(7, list(2, 10));
+    CHECK_EQ(cache.stats().entries, size_t(1));
+    CHECK_EQ(cache.stats().bytes, PostingCache::entryBytes(10));
+    CHECK_EQ((*cache.lookup(7))[0].songId, 2);
+}
+
+TEST_CASE(oversizedListsAreNotCached) {
+    PostingCache cache(PostingCache::entryBytes(10));
+    cache.insert(1, list(1, 11));
+    CHECK(!cache.lookup(1));
+    cache.insert(2, nullptr);
+    CHECK_EQ(cache.stats().entries, size_t(0));
+}
+
+TEST_CASE(invalidationDropsStaleLists) {
+    PostingCache cache;
+    cache.insert(1, list(1, 2));
+    cache.insert(2, list(2, 2));
+    cache.invalidate(1);
+    CHECK(!cache.lookup(1));
+    CHECK(cache.lookup(2));
+    CHECK_EQ(cache.stats().invalidations, uint64_t(1));
+
+    cache.clear();
+    CHECK(!cache.lookup(2));
+    CHECK_EQ(cache.stats().entries, size_t(0));
+    CHECK_EQ(cache.stats().bytes, size_t(0));
+}
+
+TEST_CASE(readsRacingAWriteAreNotCached) {
+    PostingCache cache;
+
+    // A reader notes the generation, reads the list from SQLite...
+    const uint64_t before = cache.generation();
+    // ...a writer changes that hash meanwhile (a miss still counts)...
+    cache.invalidate(5);
+    // ...and the reader's now stale list must not be cached
+    cache.insert(5, list(1, 3), before);
+    CHECK(!cache.lookup(5));
+
+    cache.insert(5, list(1, 3), cache.generation());
+    CHECK(cache.lookup(5));
+}
@@ -0,0 +1,112 @@
+#include "Check.h"
+#include "TestCatalog.h"
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+constexpr int SONGS = 3;
+constexpr int SONG_SECONDS = 15;
+constexpr int MATCHERS = 3;
+constexpr int ROUNDS = 6;  ///< Songs the owner adds and deletes again
+
+using testcatalog::Catalog;
+
+/// Three seconds of song `seed` from 5 s
+HashList clip(uint32_t seed) {
+    const std::vector<int16_t> pcm = testaudio::tones(seed, SONG_SECONDS);
+    const std::vector<int16_t> part(pcm.begin() + 5 * testaudio::SAMPLE_RATE,
+                                    pcm.begin() + 8 * testaudio::SAMPLE_RATE);
+    return Fingerprint::compute(part, testaudio::SAMPLE_RATE, Fingerprint::queryProfile());
+}
+
+/// What the matcher threads saw go wrong
+struct Failures {
+    std::mutex mutex;
+    std::vector<QString> errors;
+    int wrong = 0;
+
+    void error(const QString& e) {
+        std::lock_guard<std::mutex> lock(mutex);
+        errors.push_back(e);
+    }
+    void mismatch() {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++wrong;
+    }
+};
+
+} // namespace
+
+TEST_CASE(matchersRunAlongsideTheWriter) {
+    Catalog catalog;
+    QString err;
+    CHECK(catalog.build(SONGS, SONG_SECONDS, &err));
+    catalog.db.setReadPool(true);
+
+    std::vector<HashList> queries;
+    for (uint32_t seed = 1; seed <= SONGS; ++seed) queries.push_back(clip(seed));
+
+    // Songs 1..SONGS stay put: every answer about them must hold throughout
+    std::atomic<bool> writing{true};
+    Failures failures;
+    auto matcher = [&](int n) {
+        QString e;
+        for (int i = 0; writing || i < 2; ++i) {
+            if ((i + n) % 2 == 0) {
+                const uint32_t seed = uint32_t((i + n) % SONGS) + 1;
+                MatchResult r;
+                if (!catalog.db.match(queries[seed - 1], MatchOptions(), r, &e)) {
+                    failures.error(e);
+                } else if (r.song.id != catalog.ids[seed]) {
+                    failures.mismatch();
+                }
+            } else {
+                std::vector<MatchResult> batch;
+                if (!catalog.db.bestMatchBatch(queries, batch, &e)) {
+                    failures.error(e);
+                    continue;
+                }
+                for (size_t k = 0; k < batch.size(); ++k) {
+                    if (batch[k].song.id != catalog.ids[k + 1]) failures.mismatch();
+                }
+            }
+        }
+        catalog.db.releaseThreadConnection();
+    };
+    std::vector<std::thread> matchers;
+    for (int n = 0; n < MATCHERS; ++n) matchers.emplace_back(matcher, n);
+
+    // The owner keeps writing meanwhile
+    const uint32_t extra = SONGS + 1;
+    const HashList extraHashes = Fingerprint::compute(testaudio::tones(extra, SONG_SECONDS),
+                                                      testaudio::SAMPLE_RATE);
+    for (int round = 0; round < ROUNDS; ++round) {
+        SongRow s;
+        s.title = QString("Extra %1").arg(round);
+        s.artist = "Test";
+        int id = -1;
+        CHECK(catalog.db.insertSong(s, id, &err));
+        CHECK(catalog.db.insertFingerprints(id, extraHashes, &err));
+        MatchResult r;
+        CHECK(catalog.db.match(clip(extra), MatchOptions(), r, &err));
+        CHECK_EQ(r.song.id, id);
+        CHECK(catalog.db.deleteSong(id, &err));
+    }
+    writing = false;
+    for (std::thread& t : matchers) t.join();
+
+    CHECK_EQ(failures.wrong, 0);
+    CHECK(failures.errors.empty());
+    for (const QString& e : failures.errors) {
+        CHECK(!e.contains("locked"));
+        std::fprintf(stderr, "matcher: %s\n", e.toStdString().c_str());
+    }
+
+    // The last extra song is gone for everyone
+    MatchResult r;
+    CHECK(catalog.db.match(clip(extra), MatchOptions(), r, &err));
+    CHECK(!r.found || r.song.id <= catalog.ids[SONGS]);
+}
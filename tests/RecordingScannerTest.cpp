@@ -0,0 +1,134 @@
+#include "Check.h"
+#include "TestCatalog.h"
+#include "monitor/RecordingScanner.h"
+#include <cstdlib>
+
+namespace {
+
+constexpr int SONG_SECONDS = 30;
+
+/// Samples in `ms` of audio
+size_t samples(qint64 ms) { return size_t(ms * testaudio::SAMPLE_RATE / 1000); }
+
+/// One play inside the synthetic recording
+struct Play {
+    uint32_t seed;
+    qint64 startMs;       ///< Recording time
+    qint64 endMs;
+    qint64 songOffsetMs;  ///< Song position at startMs
+};
+
+/// Silence, then song 2 from 6 s, song 1 whole, song 3's first 20 s,
+/// back to back, then silence
+const std::vector<Play> PLAYS = {
+    {2, 4000, 24000, 6000},
+    {1, 24000, 54000, 0},
+    {3, 54000, 74000, 0},
+};
+constexpr qint64 RECORDING_MS = 78000;
+
+using testcatalog::Catalog;
+
+/// Fingerprints of the recording described by PLAYS
+HashList recording() {
+    std::vector<int16_t> pcm(samples(RECORDING_MS), 0);
+    for (const Play& p : PLAYS) {
+        const std::vector<int16_t> song = testaudio::tones(p.seed, SONG_SECONDS);
+        const qint64 lengthMs = p.endMs - p.startMs;
+        std::copy(song.begin() + samples(p.songOffsetMs),
+                  song.begin() + samples(p.songOffsetMs + lengthMs),
+                  pcm.begin() + samples(p.startMs));
+    }
+    return Fingerprint::compute(pcm, testaudio::SAMPLE_RATE, Fingerprint::queryProfile());
+}
+
+/// `out` has one segment per play, in order, within a hop of the truth
+void checkTimeline(const Catalog& catalog, const ScanConfig& cfg,
+                   const std::vector<ScanSegment>& out) {
+    CHECK_EQ(out.size(), PLAYS.size());
+    for (size_t i = 0; i < out.size() && i < PLAYS.size(); ++i) {
+        const ScanSegment& s = out[i];
+        const Play& p = PLAYS[i];
+        CHECK_EQ(s.song.id, catalog.ids[p.seed]);
+        CHECK(std::llabs(s.startMs - p.startMs) <= cfg.hopMs);
+        CHECK(std::llabs(s.endMs - p.endMs) <= cfg.hopMs);
+        // The alignment itself is exact to a few STFT hops
+        CHECK(std::llabs((s.songOffsetMs - s.startMs) - (p.songOffsetMs - p.startMs)) <= 150);
+        CHECK(s.windows >= cfg.minWindows);
+        CHECK(s.confidence > 0.0 && s.confidence <= 1.0);
+    }
+}
+
+} // namespace
+
+TEST_CASE(emptyRecordingHasNoSegments) {
+    Catalog catalog;
+    QString err;
+    CHECK(catalog.build(3, SONG_SECONDS, &err));
+    RecordingScanner scanner(catalog.db);
+    std::vector<ScanSegment> out(1);
+    CHECK(scanner.scan({}, out, &err));
+    CHECK(out.empty());
+}
+
+TEST_CASE(scanFindsEveryPlayInOrder) {
+    Catalog catalog;
+    QString err;
+    CHECK(catalog.build(3, SONG_SECONDS, &err));
+
+    ScanConfig cfg;
+    cfg.batchWindows = 3;  // several runs
+    RecordingScanner scanner(catalog.db, cfg);
+    std::vector<ScanSegment> out;
+    CHECK(scanner.scan(recording(), out, &err));
+    checkTimeline(catalog, cfg, out);
+}
+
+TEST_CASE(readPoolScanMatchesTheSameTimeline) {
+    Catalog catalog;
+    QString err;
+    CHECK(catalog.build(3, SONG_SECONDS, &err));
+    catalog.db.setReadPool(true);
+
+    ScanConfig cfg;
+    cfg.batchWindows = 1;  // one run per window, spread over the pool
+    RecordingScanner scanner(catalog.db, cfg);
+    std::vector<ScanSegment> out;
+    CHECK(scanner.scan(recording(), out, &err));
+    checkTimeline(catalog, cfg, out);
+}
+
+TEST_CASE(perWindowMatchingMatchesTheSameTimeline) {
+    Catalog catalog;
+    QString err;
+    CHECK(catalog.build(3, SONG_SECONDS, &err));
+
+    ScanConfig cfg;
+    cfg.match.twoStage = true;
+    RecordingScanner scanner(catalog.db, cfg);
+    std::vector<ScanSegment> out;
+    CHECK(scanner.scan(recording(), out, &err));
+    checkTimeline(catalog, cfg, out);
+}
+
+TEST_CASE(progressCanStopTheScan) {
+    Catalog catalog;
+    QString err;
+    CHECK(catalog.build(3, SONG_SECONDS, &err));
+
+    ScanConfig cfg;
+    cfg.batchWindows = 2;
+    RecordingScanner scanner(catalog.db, cfg);
+    std::vector<int> reported;
+    scanner.setProgress([&reported](int percent) {
+        reported.push_back(percent);
+        return false;
+    });
+
+    // Single-threaded (no read pool): the first run is the only one
+    std::vector<ScanSegment> out;
+    CHECK(scanner.scan(recording(), out, &err));
+    CHECK_EQ(reported.size(), size_t(1));
+    CHECK(out.size() < PLAYS.size());
+    for (const ScanSegment& s : out) CHECK(s.startMs < qint64(cfg.windowMs + cfg.hopMs));
+}
@@ -0,0 +1,169 @@
+#include "Check.h"
+#include "TestAudio.h"
+#include "db/Database.h"
+#include "db/Reindexer.h"
+#include "fingerprint/Fingerprint.h"
+#include <QTemporaryDir>
+
+namespace {
+
+constexpr int SONG_SECONDS = 10;
+
+QByteArray blob(const Constellation& c) {
+    const std::vector<uint8_t> bytes = c.encode();
+    return QByteArray(reinterpret_cast<const char*>(bytes.data()), int(bytes.size()));
+}
+
+/// Catalog of songs 1-3 stored the way Ingestor::store does, ids by seed
+struct Catalog {
+    QTemporaryDir dir;
+    Database db{dir.filePath("catalog.db")};
+    int ids[4] = {-1, -1, -1, -1};
+
+    bool build(QString* err) {
+        if (!db.open(err) || !db.migrate(err)) return false;
+        for (uint32_t seed = 1; seed <= 3; ++seed) {
+            if (!add(seed, ids[seed], err)) return false;
+        }
+        return true;
+    }
+
+    /// A song whose peaks come from `peakFormat`'s picker
+    bool add(uint32_t seed, int& id, QString* err, int peakFormat = Constellation::PEAK_FORMAT) {
+        Constellation peaks = Fingerprint::extractPeaks(testaudio::tones(seed, SONG_SECONDS),
+                                                        testaudio::SAMPLE_RATE);
+        SongRow s;
+        s.title = QString("Song %1").arg(seed);
+        s.artist = "Test";
+        if (!db.insertSong(s, id, err) ||
+            !db.insertFingerprints(id, Fingerprint::hashPeaks(peaks), err)) {
+            return false;
+        }
+        peaks.peakFormat = peakFormat;
+        return db.insertConstellation(id, blob(peaks), err);
+    }
+
+    /// Song matched by three seconds of recording `seed`
+    int recognize(uint32_t seed, const MatchOptions& opts = MatchOptions()) {
+        const std::vector<int16_t> pcm = testaudio::tones(seed, SONG_SECONDS);
+        const std::vector<int16_t> clip(pcm.begin() + 4 * testaudio::SAMPLE_RATE,
+                                        pcm.begin() + 7 * testaudio::SAMPLE_RATE);
+        MatchResult r;
+        QString err;
+        if (!db.match(Fingerprint::compute(clip, testaudio::SAMPLE_RATE,
+                                           Fingerprint::queryProfile()), opts, r, &err)) {
+            return -2;
+        }
+        return r.found ? r.song.id : -1;
+    }
+
+    IndexStats stats() {
+        IndexStats out;
+        db.indexStats(out);
+        return out;
+    }
+};
+
+bool sameIndex(const IndexStats& a, const IndexStats& b) {
+    return a.songs == b.songs && a.postings == b.postings &&
+           a.distinctHashes == b.distinctHashes && a.postingHistogram == b.postingHistogram;
+}
+
+} // namespace
+
+TEST_CASE(rehashAtTheIndexProfileReproducesTheIndex) {
+    Catalog catalog;
+    QString err;
+    CHECK(catalog.build(&err));
+    const IndexStats before = catalog.stats();
+
+    Reindexer reindexer(catalog.db);
+    reindexer.setBatchSize(2);  // a full batch and a partial one
+    reindexer.setThreads(2);
+    std::vector<std::pair<qint64,qint64>> progress;
+    reindexer.setProgress([&progress](qint64 done, qint64 total) {
+        progress.emplace_back(done, total);
+    });
+    CHECK(reindexer.rehash(Fingerprint::SCHEME, Fingerprint::indexProfile(), &err));
+
+    CHECK(sameIndex(catalog.stats(), before));
+    CHECK_EQ(catalog.db.scheme(), Fingerprint::SCHEME);
+    CHECK_EQ(progress.size(), size_t(2));
+    if (progress.size() == 2) {
+        CHECK(progress[0] == std::make_pair(qint64(2), qint64(3)));
+        CHECK(progress[1] == std::make_pair(qint64(3), qint64(3)));
+    }
+
+    // Sketches are regenerated with the postings
+    MatchOptions sketch;
+    sketch.sketchPrefilter = true;
+    for (uint32_t seed = 1; seed <= 3; ++seed) {
+        CHECK_EQ(catalog.recognize(seed), catalog.ids[seed]);
+        CHECK_EQ(catalog.recognize(seed, sketch), catalog.ids[seed]);
+    }
+}
+
+TEST_CASE(profileChangesAreReversible) {
+    Catalog catalog;
+    QString err;
+    CHECK(catalog.build(&err));
+    const IndexStats before = catalog.stats();
+
+    FingerprintProfile denser = Fingerprint::indexProfile();
+    denser.hashesPerSec *= 2;
+    denser.fanout += 2;
+    Reindexer reindexer(catalog.db);
+    CHECK(reindexer.rehash(Fingerprint::SCHEME, denser, &err));
+    CHECK(catalog.stats().postings > before.postings);
+    CHECK_EQ(catalog.recognize(2), catalog.ids[2]);
+
+    // Back to the stored index, through a custom hash scheme this time
+    CHECK(reindexer.run(&Reindexer::defaultScheme, &err));
+    CHECK(sameIndex(catalog.stats(), before));
+}
+
+TEST_CASE(staleConstellationsAreRefused) {
+    Catalog catalog;
+    QString err;
+    CHECK(catalog.build(&err));
+    int old = -1;
+    CHECK(catalog.add(4, old, &err, Constellation::PEAK_FORMAT - 1));
+    const IndexStats before = catalog.stats();
+
+    Reindexer reindexer(catalog.db);
+    err.clear();
+    CHECK(!reindexer.rehash(Fingerprint::SCHEME, Fingerprint::indexProfile(), &err));
+    CHECK(err.contains("older peak picker"));
+    CHECK(err.contains(QString("#%1").arg(old)));
+
+    // The failed re-index left the previous fingerprints in place
+    CHECK(sameIndex(catalog.stats(), before));
+    CHECK_EQ(catalog.recognize(1), catalog.ids[1]);
+    CHECK_EQ(catalog.recognize(4), old);
+}
+
+TEST_CASE(corruptConstellationsAreRefused) {
+    Catalog catalog;
+    QString err;
+    CHECK(catalog.build(&err));
+    CHECK(catalog.db.insertConstellation(catalog.ids[2], QByteArray("CST2 not peaks"), &err));
+    const IndexStats before = catalog.stats();
+
+    Reindexer reindexer(catalog.db);
+    err.clear();
+    CHECK(!reindexer.rehash(Fingerprint::SCHEME, Fingerprint::indexProfile(), &err));
+    CHECK(err.contains(QString("Corrupt constellation for song #%1").arg(catalog.ids[2])));
+    CHECK(sameIndex(catalog.stats(), before));
+}
+
+TEST_CASE(unknownSchemesAreRefused) {
+    Catalog catalog;
+    QString err;
+    CHECK(catalog.build(&err));
+
+    Reindexer reindexer(catalog.db);
+    err.clear();
+    CHECK(!reindexer.rehash(99, Fingerprint::indexProfile(), &err));
+    CHECK(err.contains("Unknown fingerprint scheme 99"));
+    CHECK_EQ(catalog.db.scheme(), Fingerprint::SCHEME);
+}
@@ -0,0 +1,224 @@
+#include "Check.h"
+#include "TestAudio.h"
+#include "db/Database.h"
+#include "db/Reindexer.h"
+#include "db/Replica.h"
+#include "fingerprint/Fingerprint.h"
+#include <QTemporaryDir>
+
+namespace {
+
+/// Ingest one synthetic song the way Ingestor::store does
+bool addSong(Database& db, const QString& title, uint32_t seed, int& id, QString* err) {
+    const Constellation peaks = Fingerprint::extractPeaks(testaudio::tones(seed, 8),
+                                                          testaudio::SAMPLE_RATE);
+    SongRow s;
+    s.title = title;
+    s.artist = "Test";
+    s.year = 2000 + int(seed);
+    if (!db.insertSong(s, id, err) ||
+        !db.insertFingerprints(id, Fingerprint::hashPeaks(peaks), err)) {
+        return false;
+    }
+    const std::vector<uint8_t> blob = peaks.encode();
+    return db.insertConstellation(id, QByteArray(reinterpret_cast<const char*>(blob.data()),
+                                                 int(blob.size())), err);
+}
+
+/// Song matched by three seconds of recording `seed`
+int recognize(Database& db, uint32_t seed) {
+    const std::vector<int16_t> pcm = testaudio::tones(seed, 8);
+    const std::vector<int16_t> clip(pcm.begin() + 2 * testaudio::SAMPLE_RATE,
+                                    pcm.begin() + 5 * testaudio::SAMPLE_RATE);
+    MatchResult r;
+    QString err;
+    if (!db.match(Fingerprint::compute(clip, testaudio::SAMPLE_RATE, Fingerprint::queryProfile()),
+                  MatchOptions(), r, &err)) {
+        return -2;
+    }
+    return r.found ? r.song.id : -1;
+}
+
+/// The whole change log
+std::vector<Change> changeLog(Database& db) {
+    std::vector<Change> out;
+    db.readChanges(0, 1 << 20, out);
+    return out;
+}
+
+bool sameLog(Database& a, Database& b) {
+    const std::vector<Change> la = changeLog(a), lb = changeLog(b);
+    if (la.size() != lb.size()) return false;
+    for (size_t i = 0; i < la.size(); ++i) {
+        if (la[i].seq != lb[i].seq || la[i].op != lb[i].op || la[i].songId != lb[i].songId ||
+            la[i].payload != lb[i].payload) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool sameIndex(Database& a, Database& b) {
+    IndexStats sa, sb;
+    if (!a.indexStats(sa) || !b.indexStats(sb)) return false;
+    return sa.songs == sb.songs && sa.postings == sb.postings &&
+           sa.distinctHashes == sb.distinctHashes && sa.postingHistogram == sb.postingHistogram;
+}
+
+/// Open a replica database the way RecognitionServer does
+bool openReplica(Database& local, Replica& replica, QString* err) {
+    int scheme = 0;
+    if (!local.open(err) || !replica.primaryScheme(scheme, err)) return false;
+    if (scheme > 0) local.setScheme(scheme);
+    return local.migrate(err);
+}
+
+} // namespace
+
+TEST_CASE(changePayloadsRoundTrip) {
+    SongRow s;
+    s.title = "Title \"quoted\"";
+    s.artist = "Artist";
+    s.album = "Album";
+    s.genre = "Genre";
+    s.year = 1999;
+    SongRow t;
+    CHECK(Change::decodeSong(Change::encodeSong(s), t));
+    CHECK(t.title == s.title && t.artist == s.artist && t.album == s.album &&
+          t.genre == s.genre && t.year == s.year);
+
+    const HashList hashes = {{0u, 0}, {0xFFFFFFFFu, 123456}, {42u, -5}};
+    HashList back;
+    CHECK(Change::decodeHashes(Change::encodeHashes(hashes), back));
+    CHECK(back == hashes);
+    CHECK(!Change::decodeHashes(QByteArray("abc"), back));
+
+    FingerprintProfile profile;
+    profile.hashesPerSec = 33.5;
+    profile.fanout = 7;
+    profile.phases = 3;
+    int scheme = 0;
+    FingerprintProfile decoded;
+    CHECK(Change::decodeReindex(Change::encodeReindex(2, profile), scheme, decoded));
+    CHECK_EQ(scheme, 2);
+    CHECK_EQ(decoded.hashesPerSec, 33.5);
+    CHECK_EQ(decoded.fanout, 7);
+    CHECK_EQ(decoded.phases, 3);
+}
+
+TEST_CASE(olderReindexPayloadsKeepTheDefaults) {
+    const FingerprintProfile defaults = Fingerprint::indexProfile();
+
+    int scheme = 5;
+    FingerprintProfile profile = defaults;
+    CHECK(Change::decodeReindex(QByteArray(), scheme, profile));
+    CHECK_EQ(scheme, 5);
+    CHECK_EQ(profile.fanout, defaults.fanout);
+
+    CHECK(!Change::decodeReindex(QByteArray("not a payload"), scheme, profile));
+}
+
+TEST_CASE(replicaConvergesWithThePrimary) {
+    QTemporaryDir dir;
+    CHECK(dir.isValid());
+    QString err;
+
+    Database primary(dir.filePath("primary.db"));
+    CHECK(primary.open(&err) && primary.migrate(&err));
+    int a = -1, b = -1, c = -1;
+    CHECK(addSong(primary, "A", 1, a, &err));
+    CHECK(addSong(primary, "B", 2, b, &err));
+    CHECK(addSong(primary, "C", 3, c, &err));
+    CHECK(primary.setDuplicateOf(c, a, &err));
+    CHECK(primary.deleteSong(b, &err));
+
+    Database local(dir.filePath("replica.db"));
+    Replica replica(local, dir.filePath("primary.db"));
+    replica.setBatchSize(2);  // several reads of the primary's log
+    CHECK(openReplica(local, replica, &err));
+    CHECK_EQ(local.scheme(), primary.scheme());
+
+    int applied = 0;
+    CHECK(replica.poll(applied, &err));
+    qint64 last = 0;
+    CHECK(primary.lastChangeSeq(last, &err));
+    CHECK(last > 0);
+    CHECK_EQ(qint64(applied), last);
+    CHECK_EQ(replica.position(), last);
+    CHECK(sameLog(primary, local));
+    CHECK(sameIndex(primary, local));
+    CHECK_EQ(recognize(local, 1), a);
+    CHECK(recognize(local, 2) != b);  // deleted on the primary
+
+    // Nothing new: nothing applied
+    CHECK(replica.poll(applied, &err));
+    CHECK_EQ(applied, 0);
+
+    // Later writes follow
+    int d = -1;
+    CHECK(addSong(primary, "D", 4, d, &err));
+    CHECK(replica.poll(applied, &err));
+    CHECK_EQ(applied, 3);  // song, fingerprints, constellation
+    CHECK_EQ(recognize(local, 4), d);
+    CHECK(sameLog(primary, local));
+}
+
+TEST_CASE(replicaReplaysReindexAtThePrimarysProfile) {
+    QTemporaryDir dir;
+    QString err;
+
+    Database primary(dir.filePath("primary.db"));
+    CHECK(primary.open(&err) && primary.migrate(&err));
+    int a = -1, b = -1;
+    CHECK(addSong(primary, "A", 1, a, &err));
+    CHECK(addSong(primary, "B", 2, b, &err));
+
+    Database local(dir.filePath("replica.db"));
+    Replica replica(local, dir.filePath("primary.db"));
+    CHECK(openReplica(local, replica, &err));
+    int applied = 0;
+    CHECK(replica.poll(applied, &err));
+
+    // A denser index than the default one
+    FingerprintProfile denser = Fingerprint::indexProfile();
+    denser.hashesPerSec *= 2;
+    denser.fanout += 2;
+    Reindexer reindexer(primary);
+    CHECK(reindexer.rehash(primary.scheme(), denser, &err));
+
+    CHECK(replica.poll(applied, &err));
+    CHECK_EQ(applied, 1);
+    CHECK(sameIndex(primary, local));
+    CHECK_EQ(recognize(local, 1), a);
+    CHECK_EQ(recognize(local, 2), b);
+}
+
+TEST_CASE(replicaRefusesAPrunedLog) {
+    QTemporaryDir dir;
+    QString err;
+
+    Database primary(dir.filePath("primary.db"));
+    CHECK(primary.open(&err) && primary.migrate(&err));
+    int a = -1, b = -1;
+    CHECK(addSong(primary, "A", 1, a, &err));
+
+    // A replica that has applied everything so far may let the primary
+    // prune up to its position...
+    Database first(dir.filePath("first.db"));
+    Replica upToDate(first, dir.filePath("primary.db"));
+    CHECK(openReplica(first, upToDate, &err));
+    int applied = 0;
+    CHECK(upToDate.poll(applied, &err));
+    CHECK(primary.pruneChanges(upToDate.position(), &err));
+    CHECK(addSong(primary, "B", 2, b, &err));
+    CHECK(upToDate.poll(applied, &err));
+    CHECK_EQ(recognize(first, 2), b);
+
+    // ...but an empty replica can no longer start from seq 1
+    Database second(dir.filePath("second.db"));
+    Replica fresh(second, dir.filePath("primary.db"));
+    CHECK(openReplica(second, fresh, &err));
+    err.clear();
+    CHECK(!fresh.poll(applied, &err));
+    CHECK(err.contains("re-seed"));
+}
@@ -0,0 +1,200 @@
+#include "Check.h"
+#include "TestAudio.h"
+#include "db/Database.h"
+#include "db/Reindexer.h"
+#include "fingerprint/Fingerprint.h"
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QTemporaryDir>
+
+namespace {
+
+using FingerprintV2 = BasicFingerprint<FingerprintSchemeV2>;
+
+constexpr int SONG_SECONDS = 10;
+
+/// Run one statement on `file` behind the Database's back
+bool execRaw(const QString& file, const QString& sql) {
+    const QString name = "scheme-test-raw";
+    bool ok = false;
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", name);
+        db.setDatabaseName(file);
+        if (db.open()) {
+            QSqlQuery q(db);
+            ok = q.exec(sql);
+        }
+        db.close();
+    }
+    QSqlDatabase::removeDatabase(name);
+    return ok;
+}
+
+/// Open and migrate `db`, created with `scheme` if it is a new catalog
+bool openCatalog(Database& db, int scheme, QString* err) {
+    if (scheme > 0) db.setScheme(scheme);
+    return db.open(err) && db.migrate(err);
+}
+
+/// Store song `seed` with its constellation, hashed with `kernels`
+bool addSong(Database& db, uint32_t seed, const FingerprintKernels& kernels, int& id,
+             QString* err) {
+    const Constellation peaks = Fingerprint::extractPeaks(testaudio::tones(seed, SONG_SECONDS),
+                                                          testaudio::SAMPLE_RATE);
+    SongRow s;
+    s.title = QString("Song %1").arg(seed);
+    s.artist = "Test";
+    if (!db.insertSong(s, id, err) ||
+        !db.insertFingerprints(id, kernels.hashPeaks(peaks, FingerprintProfile()), err)) {
+        return false;
+    }
+    const std::vector<uint8_t> blob = peaks.encode();
+    return db.insertConstellation(id, QByteArray(reinterpret_cast<const char*>(blob.data()),
+                                                 int(blob.size())), err);
+}
+
+/// Three seconds of recording `seed`, hashed with `kernels`
+HashList clip(uint32_t seed, const FingerprintKernels& kernels) {
+    const std::vector<int16_t> pcm = testaudio::tones(seed, SONG_SECONDS);
+    const std::vector<int16_t> part(pcm.begin() + 3 * testaudio::SAMPLE_RATE,
+                                    pcm.begin() + 6 * testaudio::SAMPLE_RATE);
+    return kernels.compute(part, testaudio::SAMPLE_RATE, Fingerprint::queryProfile(),
+                           Deadline(), nullptr);
+}
+
+/// Song matched by `query` hashed with `scheme`; -1 if none, -2 on error
+int recognize(Database& db, const HashList& query, int scheme, QString* err = nullptr) {
+    MatchOptions opts;
+    opts.scheme = scheme;
+    MatchResult r;
+    if (!db.match(query, opts, r, err)) return -2;
+    return r.found ? r.song.id : -1;
+}
+
+const FingerprintKernels& v1() { return *FingerprintKernels::find(FingerprintSchemeV1::ID); }
+const FingerprintKernels& v2() { return *FingerprintKernels::find(FingerprintSchemeV2::ID); }
+
+} // namespace
+
+TEST_CASE(newCatalogsRecordTheirScheme) {
+    QTemporaryDir dir;
+    const QString file = dir.filePath("catalog.db");
+    QString err;
+    int id = -1;
+    {
+        Database db(file);
+        CHECK(openCatalog(db, FingerprintSchemeV2::ID, &err));
+        CHECK_EQ(db.scheme(), FingerprintSchemeV2::ID);
+        CHECK(addSong(db, 1, v2(), id, &err));
+        CHECK_EQ(recognize(db, clip(1, v2()), FingerprintSchemeV2::ID), id);
+    }
+
+    // The stored scheme wins over the one a new catalog would get
+    Database db(file);
+    CHECK(openCatalog(db, 0, &err));
+    CHECK_EQ(db.scheme(), FingerprintSchemeV2::ID);
+    int stored = -1;
+    CHECK(db.storedScheme(stored, &err));
+    CHECK_EQ(stored, FingerprintSchemeV2::ID);
+    CHECK(db.checkScheme(FingerprintSchemeV2::ID, &err));
+
+    // Queries of another scheme are rejected, not mismatched
+    err.clear();
+    CHECK(!db.checkScheme(FingerprintSchemeV1::ID, &err));
+    CHECK_EQ(recognize(db, clip(1, v1()), FingerprintSchemeV1::ID, &err), -2);
+    CHECK(err.contains("scheme 1"));
+}
+
+TEST_CASE(reindexingConvertsTheScheme) {
+    QTemporaryDir dir;
+    const QString file = dir.filePath("catalog.db");
+    QString err;
+    int a = -1, b = -1;
+    {
+        Database db(file);
+        CHECK(openCatalog(db, 0, &err));
+        CHECK_EQ(db.scheme(), Fingerprint::SCHEME);
+        CHECK(addSong(db, 1, v1(), a, &err));
+        CHECK(addSong(db, 2, v1(), b, &err));
+
+        Reindexer reindexer(db);
+        CHECK(reindexer.rehash(FingerprintSchemeV2::ID, FingerprintV2::indexProfile(), &err));
+        CHECK_EQ(db.scheme(), FingerprintSchemeV2::ID);
+        CHECK_EQ(recognize(db, clip(2, v2()), FingerprintSchemeV2::ID), b);
+    }
+
+    Database db(file);
+    CHECK(openCatalog(db, 0, &err));
+    CHECK_EQ(db.scheme(), FingerprintSchemeV2::ID);
+    CHECK_EQ(recognize(db, clip(1, v2()), FingerprintSchemeV2::ID), a);
+}
+
+TEST_CASE(songsWithoutPeaksBlockAConversion) {
+    QTemporaryDir dir;
+    Database db(dir.filePath("catalog.db"));
+    QString err;
+    CHECK(openCatalog(db, 0, &err));
+    int a = -1, b = -1;
+    CHECK(addSong(db, 1, v1(), a, &err));
+
+    // Ingested without a constellation: its hashes cannot be converted
+    SongRow s;
+    s.title = "No peaks";
+    s.artist = "Test";
+    CHECK(db.insertSong(s, b, &err));
+    CHECK(db.insertFingerprints(b, clip(2, v1()), &err));
+
+    Reindexer reindexer(db);
+    err.clear();
+    CHECK(!reindexer.rehash(FingerprintSchemeV2::ID, FingerprintV2::indexProfile(), &err));
+    CHECK(err.contains("no stored constellation"));
+    CHECK_EQ(db.scheme(), Fingerprint::SCHEME);
+    CHECK_EQ(recognize(db, clip(1, v1()), Fingerprint::SCHEME), a);
+}
+
+TEST_CASE(unrecordedCatalogsAreStampedV1) {
+    QTemporaryDir dir;
+    const QString file = dir.filePath("catalog.db");
+    const QString empty = dir.filePath("empty.db");
+    QString err;
+    int id = -1;
+    {
+        Database db(file);
+        CHECK(openCatalog(db, FingerprintSchemeV1::ID, &err));
+        CHECK(addSong(db, 1, v1(), id, &err));
+        Database fresh(empty);
+        CHECK(openCatalog(fresh, FingerprintSchemeV1::ID, &err));
+    }
+    // As written before the scheme was recorded, by the hashing V1 keeps
+    CHECK(execRaw(file, "DELETE FROM meta WHERE key='hash_scheme'"));
+    CHECK(execRaw(empty, "DELETE FROM meta WHERE key='hash_scheme'"));
+
+    Database db(file);
+    CHECK(openCatalog(db, FingerprintSchemeV2::ID, &err));
+    CHECK_EQ(db.scheme(), FingerprintSchemeV1::ID);
+    int stored = 0;
+    CHECK(db.storedScheme(stored, &err));
+    CHECK_EQ(stored, FingerprintSchemeV1::ID);
+    CHECK_EQ(recognize(db, clip(1, v1()), FingerprintSchemeV1::ID), id);
+
+    // Without fingerprints there is nothing to keep: a new catalog's scheme
+    Database other(empty);
+    CHECK(openCatalog(other, FingerprintSchemeV2::ID, &err));
+    CHECK_EQ(other.scheme(), FingerprintSchemeV2::ID);
+}
+
+TEST_CASE(schemesOfOtherBuildsAreRefused) {
+    QTemporaryDir dir;
+    const QString file = dir.filePath("catalog.db");
+    QString err;
+    {
+        Database db(file);
+        CHECK(openCatalog(db, 0, &err));
+    }
+    CHECK(execRaw(file, "UPDATE meta SET value='99' WHERE key='hash_scheme'"));
+
+    Database db(file);
+    err.clear();
+    CHECK(!openCatalog(db, 0, &err));
+    CHECK(err.contains("scheme 99"));
+}
@@ -0,0 +1,313 @@
+#include "Check.h"
+#include "TestAudio.h"
+#include "db/Database.h"
+#include "db/ShardMap.h"
+#include "server/ShardCoordinator.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QJsonObject>
+#include <QProcess>
+#include <QTemporaryDir>
+#include <QThread>
+#include <QtEndian>
+#include <memory>
+
+namespace {
+
+constexpr int SHARDS = 2;
+constexpr int SONGS = 6;
+constexpr int SONG_SECONDS = 10;
+
+/// Run the event loop until `done` holds or `ms` have passed
+template <class F>
+bool spinUntil(F done, int ms = 20000) {
+    QElapsedTimer t;
+    t.start();
+    while (!done()) {
+        if (t.hasExpired(ms)) return false;
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 20);
+        QThread::msleep(2);
+    }
+    return true;
+}
+
+/// Socket name no other test run uses
+QString socketName(const QString& tag) {
+    return QString("mra-test-%1-%2").arg(QCoreApplication::applicationPid()).arg(tag);
+}
+
+/// A MusicRecognitionServer process serving one catalog
+class ShardProcess {
+public:
+    ~ShardProcess() { stop(); }
+
+    bool start(const QString& db, const QString& socket, QString* err) {
+        m_socket = socket;
+        m_proc.setProgram(SERVER_EXECUTABLE);
+        m_proc.setArguments({"--db", db, "--socket", socket, "--workers", "2", "--matchers", "1"});
+        m_proc.setProcessChannelMode(QProcess::MergedChannels);
+        m_proc.start();
+
+        QByteArray output;
+        while (!output.contains("Listening on")) {
+            if (!m_proc.waitForReadyRead(60000)) {
+                if (err) *err = "Shard did not start: " + QString::fromLocal8Bit(output);
+                return false;
+            }
+            output += m_proc.readAll();
+        }
+        // Later output is not needed, but the pipe must not fill up
+        QObject::connect(&m_proc, &QProcess::readyRead, &m_proc, [this] { m_proc.readAll(); });
+        return true;
+    }
+
+    /// Gone at once, as after a crash
+    void kill() {
+        m_proc.kill();
+        m_proc.waitForFinished(5000);
+    }
+
+    void stop() {
+        if (m_proc.state() == QProcess::NotRunning) return;
+        m_proc.terminate();
+        if (!m_proc.waitForFinished(5000)) kill();
+    }
+
+    const QString& socket() const { return m_socket; }
+
+private:
+    QProcess m_proc;
+    QString m_socket;
+};
+
+/// Catalog "music.db" split over SHARDS shard databases by ShardMap
+struct Cluster {
+    QTemporaryDir dir;
+    int shardOf[SONGS + 1] = {};
+    int localId[SONGS + 1] = {};
+    std::unique_ptr<ShardProcess> procs[SHARDS];
+
+    QString database(int shard) const {
+        return ShardMap::shardDatabase(dir.filePath("music.db"), shard);
+    }
+
+    bool build(QString* err) {
+        std::unique_ptr<Database> dbs[SHARDS];
+        for (int s = 0; s < SHARDS; ++s) {
+            dbs[s] = std::make_unique<Database>(database(s));
+            if (!dbs[s]->open(err) || !dbs[s]->migrate(err)) return false;
+        }
+        for (int i = 1; i <= SONGS; ++i) {
+            const QString file = QString("Test - Song %1.wav").arg(i);
+            const int s = ShardMap::shardOf(dir.filePath(file), SHARDS);
+            SongRow row;
+            row.artist = "Test";
+            row.title = QString("Song %1").arg(i);
+            const auto hashes = Fingerprint::compute(testaudio::tones(uint32_t(i), SONG_SECONDS),
+                                                     testaudio::SAMPLE_RATE);
+            if (!dbs[s]->insertSong(row, localId[i], err) ||
+                !dbs[s]->insertFingerprints(localId[i], hashes, err)) {
+                return false;
+            }
+            shardOf[i] = s;
+        }
+        return true;
+    }
+
+    bool startShards(QString* err) {
+        for (int s = 0; s < SHARDS; ++s) {
+            procs[s] = std::make_unique<ShardProcess>();
+            if (!procs[s]->start(database(s), socketName(QString("shard%1").arg(s)), err)) return false;
+        }
+        return true;
+    }
+
+    QStringList sockets() const {
+        QStringList out;
+        for (const auto& p : procs) out << p->socket();
+        return out;
+    }
+};
+
+/// Fingerprints of three seconds of song `seed`
+HashList clip(int seed) {
+    const std::vector<int16_t> pcm = testaudio::tones(uint32_t(seed), SONG_SECONDS);
+    const std::vector<int16_t> part(pcm.begin() + 2 * testaudio::SAMPLE_RATE,
+                                    pcm.begin() + 5 * testaudio::SAMPLE_RATE);
+    return Fingerprint::compute(part, testaudio::SAMPLE_RATE, Fingerprint::queryProfile());
+}
+
+/// One coordinator query, waited for on the event loop
+bool ask(ShardCoordinator& coordinator, int seed, ClusterResult& out) {
+    bool done = false;
+    coordinator.query(clip(seed), coordinator.scheme(), Deadline(),
+                      [&done, &out](const ClusterResult& r) {
+        out = r;
+        done = true;
+    });
+    return spinUntil([&done] { return done; });
+}
+
+} // namespace
+
+TEST_CASE(shardMapIsStableAndByFileName) {
+    const int s = ShardMap::shardOf("/music/a/Artist - Title.wav", 8);
+    CHECK(s >= 0 && s < 8);
+    CHECK_EQ(ShardMap::shardOf("/other/folder/Artist - Title.wav", 8), s);
+    CHECK_EQ(ShardMap::shardOf("Artist - Title.wav", 8), s);
+    CHECK_EQ(ShardMap::shardOf("/music/a/Artist - Title.wav", 1), 0);
+
+    // Names spread over every shard
+    bool used[4] = {};
+    for (int i = 0; i < 64; ++i) used[ShardMap::shardOf(QString("song%1.wav").arg(i), 4)] = true;
+    CHECK(used[0] && used[1] && used[2] && used[3]);
+
+    CHECK(ShardMap::shardDatabase("/srv/music.db", 3) == "/srv/music.shard3.db");
+    CHECK(ShardMap::shardDatabase("/srv/music", 0) == "/srv/music.shard0");
+}
+
+TEST_CASE(hashQueryFrameLayout) {
+    const HashList hashes = {{0xA1B2C3D4u, 1500}, {7u, -20}};
+    const QByteArray frame = ShardCoordinator::encodeQuery(9, 1, 5, 250, hashes);
+    CHECK_EQ(frame.size(), 24 + 2 * 8);
+
+    const uchar* p = reinterpret_cast<const uchar*>(frame.constData());
+    CHECK_EQ(qFromLittleEndian<quint32>(p), quint32(frame.size() - 4));
+    CHECK_EQ(qFromLittleEndian<quint32>(p + 4), quint32(9));
+    CHECK_EQ(qFromLittleEndian<quint32>(p + 8), quint32(0));  // no sample rate: hashes follow
+    CHECK_EQ(qFromLittleEndian<quint32>(p + 12), quint32(1));
+    CHECK_EQ(qFromLittleEndian<quint32>(p + 16), quint32(5));
+    CHECK_EQ(qFromLittleEndian<quint32>(p + 20), quint32(250));
+    CHECK_EQ(qFromLittleEndian<quint32>(p + 24), 0xA1B2C3D4u);
+    CHECK_EQ(qFromLittleEndian<qint32>(p + 28), 1500);
+    CHECK_EQ(qFromLittleEndian<quint32>(p + 32), 7u);
+    CHECK_EQ(qFromLittleEndian<qint32>(p + 36), -20);
+
+    // The scheme request is an empty hash query of scheme 0
+    const QByteArray schemeRequest = ShardCoordinator::encodeQuery(0, 0, 0, 0, HashList());
+    CHECK_EQ(schemeRequest.size(), 24);
+}
+
+TEST_CASE(candidateJsonRoundTrip) {
+    MatchCandidate c;
+    c.song.id = 12;
+    c.song.title = "Title";
+    c.song.artist = "Artist";
+    c.song.album = "Album";
+    c.song.genre = "Genre";
+    c.song.year = 1987;
+    c.votes = 41;
+    c.score = 17.25;
+    c.deltaMs = -3400;
+
+    const MatchCandidate d = ShardCoordinator::fromJson(ShardCoordinator::toJson(c));
+    CHECK_EQ(d.song.id, 12);
+    CHECK(d.song.title == c.song.title && d.song.artist == c.song.artist &&
+          d.song.album == c.song.album && d.song.genre == c.song.genre);
+    CHECK_EQ(d.song.year, 1987);
+    CHECK_EQ(d.votes, 41);
+    CHECK_EQ(d.score, 17.25);
+    CHECK_EQ(d.deltaMs, -3400);
+}
+
+TEST_CASE(coordinatorFindsSongsOnEveryShard) {
+    Cluster cluster;
+    QString err;
+    CHECK(cluster.build(&err));
+    CHECK(cluster.startShards(&err));
+
+    // Both shards hold songs, so answers really are merged
+    bool used[SHARDS] = {};
+    for (int i = 1; i <= SONGS; ++i) used[cluster.shardOf[i]] = true;
+    CHECK(used[0] && used[1]);
+
+    ShardCoordinator coordinator(cluster.sockets());
+    coordinator.setTopK(3);
+    coordinator.setTimeoutMs(10000);
+    CHECK(coordinator.start(&err));
+    CHECK_EQ(coordinator.scheme(), Fingerprint::SCHEME);
+    CHECK_EQ(coordinator.connectedShards(), SHARDS);
+
+    for (int i = 1; i <= SONGS; ++i) {
+        ClusterResult r;
+        CHECK(ask(coordinator, i, r));
+        CHECK_EQ(r.shards, SHARDS);
+        CHECK_EQ(r.answered, SHARDS);
+        CHECK(!r.incomplete);
+        CHECK(!r.candidates.empty() && r.candidates.size() <= 3);
+        if (r.candidates.empty()) continue;
+        CHECK_EQ(r.candidates[0].shard, cluster.shardOf[i]);
+        CHECK_EQ(r.candidates[0].match.song.id, cluster.localId[i]);
+        for (size_t k = 1; k < r.candidates.size(); ++k) {
+            CHECK(r.candidates[k - 1].match.score >= r.candidates[k].match.score);
+        }
+    }
+}
+
+TEST_CASE(lostShardLeavesTheAnswerIncomplete) {
+    Cluster cluster;
+    QString err;
+    CHECK(cluster.build(&err));
+    CHECK(cluster.startShards(&err));
+
+    ShardCoordinator coordinator(cluster.sockets());
+    coordinator.setTimeoutMs(10000);
+    coordinator.setReconnectMs(50);
+    CHECK(coordinator.start(&err));
+
+    cluster.procs[1]->kill();
+    CHECK(spinUntil([&coordinator] { return coordinator.connectedShards() == 1; }));
+
+    for (int i = 1; i <= SONGS; ++i) {
+        ClusterResult r;
+        CHECK(ask(coordinator, i, r));
+        CHECK_EQ(r.answered, 1);
+        CHECK(r.incomplete);
+        if (cluster.shardOf[i] == 0) {
+            CHECK(!r.candidates.empty() && r.candidates[0].match.song.id == cluster.localId[i]);
+        }
+    }
+
+    // A restarted shard is reconnected and confirms its scheme
+    cluster.procs[1] = std::make_unique<ShardProcess>();
+    CHECK(cluster.procs[1]->start(cluster.database(1), socketName("shard1"), &err));
+    CHECK(spinUntil([&coordinator] { return coordinator.connectedShards() == SHARDS; }));
+    ClusterResult r;
+    CHECK(ask(coordinator, 1, r));
+    CHECK_EQ(r.answered, SHARDS);
+    CHECK(!r.incomplete);
+}
+
+TEST_CASE(shardsMustAgreeOnTheScheme) {
+    Cluster cluster;
+    QString err;
+    CHECK(cluster.build(&err));
+    CHECK(cluster.startShards(&err));
+
+    // An empty catalog of the other scheme compiled into this build
+    const QString otherDb = cluster.dir.filePath("other.db");
+    {
+        Database other(otherDb);
+        other.setScheme(FingerprintSchemeV2::ID);
+        CHECK(other.open(&err) && other.migrate(&err));
+    }
+    ShardProcess otherShard;
+    CHECK(otherShard.start(otherDb, socketName("other"), &err));
+
+    ShardCoordinator mixed({cluster.procs[0]->socket(), otherShard.socket()});
+    err.clear();
+    CHECK(!mixed.start(&err));
+    CHECK(err.contains("different fingerprint schemes"));
+
+    ShardCoordinator explicitScheme({cluster.procs[0]->socket()});
+    explicitScheme.setScheme(FingerprintSchemeV2::ID);
+    err.clear();
+    CHECK(!explicitScheme.start(&err));
+    CHECK(err.contains("serves fingerprint scheme"));
+
+    ShardCoordinator matching({otherShard.socket()});
+    matching.setScheme(FingerprintSchemeV2::ID);
+    CHECK(matching.start(&err));
+    CHECK_EQ(matching.scheme(), FingerprintSchemeV2::ID);
+}
@@ -0,0 +1,133 @@
+#include "Check.h"
+#include "TestCatalog.h"
+
+namespace {
+
+constexpr int SONG_SECONDS = 15;
+
+using testcatalog::Catalog;
+
+/// Three seconds of song `seed` from 4 s
+HashList clip(uint32_t seed) {
+    const std::vector<int16_t> pcm = testaudio::tones(seed, SONG_SECONDS);
+    const std::vector<int16_t> part(pcm.begin() + 4 * testaudio::SAMPLE_RATE,
+                                    pcm.begin() + 7 * testaudio::SAMPLE_RATE);
+    return Fingerprint::compute(part, testaudio::SAMPLE_RATE, Fingerprint::queryProfile());
+}
+
+/// Id of the song `db` matches `query` to; -1 if none, -2 on error
+int recognize(Database& db, const HashList& query, const MatchOptions& opts = MatchOptions()) {
+    MatchResult r;
+    QString err;
+    if (!db.match(query, opts, r, &err)) return -2;
+    return r.found ? r.song.id : -1;
+}
+
+/// Store song `seed` in `db`
+bool addSong(Database& db, uint32_t seed, int& id, QString* err) {
+    SongRow s;
+    s.title = QString("Song %1").arg(seed);
+    s.artist = "Test";
+    return db.insertSong(s, id, err) &&
+           db.insertFingerprints(id, Fingerprint::compute(testaudio::tones(seed, SONG_SECONDS),
+                                                          testaudio::SAMPLE_RATE), err);
+}
+
+/// A second Database on the catalog's file, as another process would open it
+bool openOther(Database& db, QString* err) { return db.open(err) && db.migrate(err); }
+
+} // namespace
+
+TEST_CASE(songsOfAnotherWriterAreFound) {
+    Catalog catalog;
+    QString err;
+    CHECK(catalog.build(2, SONG_SECONDS, &err));
+    Database other(catalog.path());
+    CHECK(openOther(other, &err));
+
+    // Loaded without song 3: its hashes are Bloom negatives here
+    CHECK(recognize(other, clip(3)) != -2);
+    int id = -1;
+    CHECK(addSong(catalog.db, 3, id, &err));
+    CHECK_EQ(recognize(other, clip(3)), id);
+    MatchOptions early;
+    early.earlyTermination = true;
+    CHECK_EQ(recognize(other, clip(3), early), id);
+
+    // Writes of both sides, in turns
+    int mine = -1;
+    CHECK(addSong(other, 4, mine, &err));
+    CHECK(addSong(catalog.db, 5, id, &err));
+    CHECK_EQ(recognize(other, clip(4)), mine);
+    CHECK_EQ(recognize(other, clip(5)), id);
+    CHECK_EQ(recognize(catalog.db, clip(4)), mine);
+    CHECK_EQ(recognize(catalog.db, clip(5)), id);
+}
+
+TEST_CASE(prunedLogsReloadTheCatalog) {
+    Catalog catalog;
+    QString err;
+    CHECK(catalog.build(2, SONG_SECONDS, &err));
+    Database other(catalog.path());
+    CHECK(openOther(other, &err));
+    CHECK_EQ(recognize(other, clip(1)), catalog.ids[1]);
+
+    // The log no longer tells what changed: everything is read again
+    int id = -1;
+    qint64 seq = 0;
+    CHECK(addSong(catalog.db, 3, id, &err));
+    CHECK(catalog.db.deleteSong(catalog.ids[1], &err));
+    CHECK(catalog.db.lastChangeSeq(seq, &err));
+    CHECK(catalog.db.pruneChanges(seq, &err));
+    CHECK_EQ(recognize(other, clip(3)), id);
+    CHECK(recognize(other, clip(1)) != catalog.ids[1]);
+}
+
+TEST_CASE(deletesOfAnotherWriterLeaveTheCache) {
+    Catalog catalog;
+    QString err;
+    CHECK(catalog.build(3, SONG_SECONDS, &err));
+    Database other(catalog.path());
+    CHECK(openOther(other, &err));
+
+    // Cached here, then deleted there
+    CHECK_EQ(recognize(other, clip(2)), catalog.ids[2]);
+    CHECK(other.postingCache().stats().entries > 0);
+    CHECK(catalog.db.deleteSong(catalog.ids[2], &err));
+    CHECK(recognize(other, clip(2)) != catalog.ids[2]);
+
+    std::vector<MatchResult> batch;
+    CHECK(other.bestMatchBatch({clip(1), clip(2)}, batch, &err));
+    CHECK(batch.size() == 2 && batch[0].song.id == catalog.ids[1]);
+    CHECK(batch.size() == 2 && (!batch[1].found || batch[1].song.id != catalog.ids[2]));
+}
+
+TEST_CASE(stopListFollowsAnotherWriter) {
+    Catalog catalog;
+    QString err;
+    CHECK(catalog.build(0, SONG_SECONDS, &err));
+    Database other(catalog.path());
+    CHECK(openOther(other, &err));
+
+    HotHashPolicy policy;
+    policy.maxPostings = 2;
+    CHECK(other.setHotHashPolicy(policy, &err));
+    CHECK_EQ(other.stopListSize(), size_t(0));
+
+    // Hash 7 reaches three postings through the other connection
+    const uint32_t hot = 7;
+    int a = -1, b = -1;
+    SongRow s;
+    s.title = "Hot";
+    s.artist = "Test";
+    CHECK(catalog.db.insertSong(s, a, &err));
+    CHECK(catalog.db.insertFingerprints(a, {{hot, 0}, {hot, 100}, {8, 0}}, &err));
+    CHECK(recognize(other, {{8, 0}}) == a);
+    CHECK_EQ(other.stopListSize(), size_t(0));
+
+    CHECK(catalog.db.insertSong(s, b, &err));
+    CHECK(catalog.db.insertFingerprints(b, {{hot, 0}, {9, 0}}, &err));
+    CHECK(recognize(other, {{9, 0}}) == b);
+    CHECK_EQ(other.stopListSize(), size_t(1));
+    CHECK_EQ(recognize(other, {{hot, 0}}), -1);
+}
@@ -0,0 +1,162 @@
+#include "Check.h"
+#include "util/TaskPool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+namespace {
+
+/// Spin (with short sleeps) until `done` holds or `ms` have passed
+template <class F>
+bool waitFor(F done, int ms = 5000) {
+    const auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+    while (!done()) {
+        if (std::chrono::steady_clock::now() >= until) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+/// Concurrency high-water mark of the tasks that enter/leave it
+struct Gauge {
+    std::atomic<int> now{0};
+    std::atomic<int> peak{0};
+
+    void enter() {
+        const int n = ++now;
+        int p = peak.load();
+        while (n > p && !peak.compare_exchange_weak(p, n)) {}
+    }
+    void leave() { --now; }
+};
+
+} // namespace
+
+TEST_CASE(runsEverySubmittedTask) {
+    TaskPool pool(4);
+    std::atomic<int> ran{0};
+    {
+        TaskGroup group(pool);
+        for (int i = 0; i < 200; ++i) {
+            group.submit(TaskLane::Normal, [&ran] { ++ran; });
+        }
+        group.wait();
+        CHECK_EQ(group.pending(), 0);
+    }
+    CHECK_EQ(ran.load(), 200);
+
+    // Counters are updated after a task body returns, so a group can be
+    // done a moment before they are
+    CHECK(waitFor([&pool] { return pool.stats(TaskLane::Normal).running == 0; }));
+    const TaskPool::LaneStats s = pool.stats(TaskLane::Normal);
+    CHECK_EQ(s.submitted, uint64_t(200));
+    CHECK_EQ(s.completed, uint64_t(200));
+    CHECK_EQ(s.queued, 0);
+    CHECK_EQ(s.running, 0);
+}
+
+TEST_CASE(asyncReturnsTheResult) {
+    TaskPool pool(2);
+    std::future<int> f = pool.async(TaskLane::Interactive, [] { return 6 * 7; });
+    CHECK_EQ(f.get(), 42);
+}
+
+TEST_CASE(tasksSeeTheirLane) {
+    TaskPool pool(2);
+    CHECK(pool.async(TaskLane::Background, [] { return TaskPool::currentLane(); }).get()
+          == TaskLane::Background);
+    CHECK(pool.async(TaskLane::Interactive, [] { return TaskPool::currentLane(); }).get()
+          == TaskLane::Interactive);
+
+    // Nested submissions inherit the lane of the task that made them
+    std::future<TaskLane> inner;
+    pool.async(TaskLane::Background, [&pool, &inner] {
+        inner = pool.async(TaskPool::currentLane(), [] { return TaskPool::currentLane(); });
+    }).get();
+    CHECK(inner.get() == TaskLane::Background);
+
+    {
+        TaskPool::LaneScope scope(TaskLane::Interactive);
+        CHECK(TaskPool::currentLane() == TaskLane::Interactive);
+    }
+    CHECK(TaskPool::currentLane() == TaskLane::Normal);
+}
+
+TEST_CASE(backgroundLimitCapsConcurrency) {
+    TaskPool pool(4);
+    CHECK_EQ(pool.backgroundLimit(), 3);
+    pool.setBackgroundLimit(2);
+    CHECK_EQ(pool.backgroundLimit(), 2);
+
+    Gauge gauge;
+    {
+        TaskGroup group(pool);
+        for (int i = 0; i < 16; ++i) {
+            group.submit(TaskLane::Background, [&gauge] {
+                gauge.enter();
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                gauge.leave();
+            });
+        }
+    }
+    CHECK(gauge.peak.load() <= 2);
+    CHECK(gauge.peak.load() >= 1);
+    CHECK(waitFor([&pool] { return pool.stats(TaskLane::Background).completed == 16; }));
+}
+
+TEST_CASE(interactiveRunsWhileBackgroundIsBusy) {
+    TaskPool pool(2);
+    pool.setBackgroundLimit(1);
+
+    // Occupy the one worker Background may use, with more queued behind it
+    std::atomic<bool> release{false};
+    std::atomic<int> started{0};
+    TaskGroup background(pool);
+    for (int i = 0; i < 4; ++i) {
+        background.submit(TaskLane::Background, [&] {
+            ++started;
+            while (!release.load()) std::this_thread::yield();
+        });
+    }
+    CHECK(waitFor([&] { return started.load() == 1; }));
+
+    // The other worker is kept free for this
+    std::atomic<bool> interactive{false};
+    pool.submit(TaskLane::Interactive, [&interactive] { interactive = true; });
+    CHECK(waitFor([&] { return interactive.load(); }));
+    CHECK_EQ(started.load(), 1);
+
+    release = true;
+    background.wait();
+    CHECK_EQ(started.load(), 4);
+}
+
+TEST_CASE(parallelForVisitsEachIndexOnce) {
+    TaskPool pool(4);
+    const size_t n = 1000;
+    std::vector<std::atomic<int>> hits(n);
+    Gauge gauge;
+    pool.parallelFor(TaskLane::Normal, n, [&](size_t i) {
+        gauge.enter();
+        ++hits[i];
+        gauge.leave();
+    }, 2);
+
+    CHECK(std::all_of(hits.begin(), hits.end(), [](const std::atomic<int>& h) { return h == 1; }));
+    CHECK(gauge.peak.load() <= 2);
+}
+
+TEST_CASE(parallelForNestsInsideTasks) {
+    TaskPool pool(2);
+    std::atomic<int> sum{0};
+    {
+        TaskGroup group(pool);
+        for (int t = 0; t < 4; ++t) {
+            group.submit(TaskLane::Normal, [&pool, &sum] {
+                pool.parallelFor(TaskLane::Normal, 50, [&sum](size_t i) { sum += int(i); });
+            });
+        }
+    }
+    CHECK_EQ(sum.load(), 4 * (49 * 50 / 2));
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @file TestAudio.h
+ * @brief Synthetic recordings for tests that need real fingerprints.
+ *
+ * Two tones that jump to new pitches every 100 ms: dense, distinct
+ * peaks, so every seed gives a recording that matches itself and nothing
+ * else.
+ */
+namespace testaudio {
+
+constexpr int SAMPLE_RATE = 44100;
+
+inline std::vector<int16_t> tones(uint32_t seed, double seconds, int sampleRate = SAMPLE_RATE) {
+    std::vector<int16_t> pcm(size_t(seconds * sampleRate));
+    const double pi = 3.14159265358979323846;
+    uint32_t x = seed * 2654435761u + 7u;
+    double f1 = 440, f2 = 1200;
+    for (size_t i = 0; i < pcm.size(); ++i) {
+        if (i % size_t(sampleRate / 10) == 0) {
+            x = x * 1664525u + 1013904223u;
+            f1 = 200 + (x >> 20) % 1800;
+            f2 = 2000 + (x >> 8) % 3000;
+        }
+        const double t = double(i) / sampleRate;
+        pcm[i] = int16_t(9000 * std::sin(2 * pi * f1 * t) + 6000 * std::sin(2 * pi * f2 * t));
+    }
+    return pcm;
+}
+
+/// `pcm` between `before` and `after` samples of silence
+inline std::vector<int16_t> padded(const std::vector<int16_t>& pcm, size_t before, size_t after = 0) {
+    std::vector<int16_t> out(before, 0);
+    out.insert(out.end(), pcm.begin(), pcm.end());
+    out.resize(out.size() + after, 0);
+    return out;
+}
+
+} // namespace testaudio
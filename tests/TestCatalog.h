@@ -0,0 +1,45 @@
+#pragma once
+#include "TestAudio.h"
+#include "db/Database.h"
+#include "fingerprint/Fingerprint.h"
+#include <QTemporaryDir>
+#include <vector>
+
+/**
+ * @file TestCatalog.h
+ * @brief Catalog of synthetic songs for tests that recognize them.
+ *
+ * Song `seed` is testaudio::tones(seed, seconds), fingerprinted with the
+ * default profile and stored as "Song <seed>" by "Test".
+ */
+namespace testcatalog {
+
+/// Catalog of songs 1..n in a temporary file, ids by seed
+struct Catalog {
+    QTemporaryDir dir;
+    Database db{path()};
+    std::vector<int> ids;
+
+    /// The catalog's SQLite file (for a second Database on it)
+    QString path() const { return dir.filePath("catalog.db"); }
+
+    /// Open and migrate the catalog, then store songs 1..`songs`
+    bool build(int songs, double seconds, QString* err) {
+        if (!db.open(err) || !db.migrate(err)) return false;
+        ids.assign(size_t(songs) + 1, -1);
+        for (uint32_t seed = 1; seed <= uint32_t(songs); ++seed) {
+            SongRow s;
+            s.title = QString("Song %1").arg(seed);
+            s.artist = "Test";
+            const auto hashes = Fingerprint::compute(testaudio::tones(seed, seconds),
+                                                     testaudio::SAMPLE_RATE);
+            if (!db.insertSong(s, ids[seed], err) ||
+                !db.insertFingerprints(ids[seed], hashes, err)) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+} // namespace testcatalog
@@ -0,0 +1,112 @@
+#include "Check.h"
+#include "TestCatalog.h"
+#include "monitor/TrackMonitor.h"
+#include <cstdlib>
+
+namespace {
+
+constexpr int SONG_SECONDS = 30;
+
+using testcatalog::Catalog;
+
+/// 4 s of silence, the first `seconds[i]` of song `seeds[i]` back to
+/// back, then 4 s of silence
+std::vector<int16_t> stream(const std::vector<uint32_t>& seeds, const std::vector<int>& seconds) {
+    const size_t silence = size_t(4 * testaudio::SAMPLE_RATE);
+    std::vector<int16_t> pcm(silence, 0);
+    for (size_t i = 0; i < seeds.size(); ++i) {
+        const std::vector<int16_t> song = testaudio::tones(seeds[i], seconds[i]);
+        pcm.insert(pcm.end(), song.begin(), song.end());
+    }
+    pcm.resize(pcm.size() + silence, 0);
+    return pcm;
+}
+
+/// Feed `pcm` in chunks of a typical capture buffer
+void feed(TrackMonitor& m, const std::vector<int16_t>& pcm) {
+    QString err;
+    for (size_t i = 0; i < pcm.size(); i += 4096) {
+        if (!CHECK(m.push(pcm.data() + i, std::min<size_t>(4096, pcm.size() - i), &err))) break;
+    }
+}
+
+/// `e` starts song `id` at stream time `atMs`, from the song's beginning
+void checkStarted(const TrackEvent& e, int id, qint64 atMs) {
+    CHECK(e.type == TrackEvent::Started);
+    CHECK_EQ(e.song.id, id);
+    CHECK(std::llabs(e.streamMs - atMs) <= 200);
+    CHECK(std::llabs(e.songOffsetMs) <= 200);
+    CHECK(e.score >= MonitorConfig().startScore);
+}
+
+/// `e` ends song `id`, which stopped playing at stream time `atMs`: the
+/// last evaluation it won is at most a window later
+void checkEnded(const TrackEvent& e, int id, qint64 atMs) {
+    CHECK(e.type == TrackEvent::Ended);
+    CHECK_EQ(e.song.id, id);
+    CHECK(e.streamMs >= atMs - MonitorConfig().hopMs);
+    CHECK(e.streamMs <= atMs + MonitorConfig().windowMs);
+}
+
+} // namespace
+
+TEST_CASE(silenceRaisesNoEvents) {
+    Catalog catalog;
+    QString err;
+    CHECK(catalog.build(3, SONG_SECONDS, &err));
+
+    TrackMonitor m(catalog.db, testaudio::SAMPLE_RATE);
+    std::vector<TrackEvent> events;
+    m.setEventHandler([&events](const TrackEvent& e) { events.push_back(e); });
+    feed(m, stream({}, {}));
+    CHECK(events.empty());
+    CHECK_EQ(m.activeSongId(), -1);
+    CHECK_EQ(m.streamMs(), qint64(8000));
+}
+
+TEST_CASE(backToBackSongsStartAndEnd) {
+    Catalog catalog;
+    QString err;
+    CHECK(catalog.build(3, SONG_SECONDS, &err));
+
+    TrackMonitor m(catalog.db, testaudio::SAMPLE_RATE);
+    std::vector<TrackEvent> events;
+    m.setEventHandler([&events](const TrackEvent& e) { events.push_back(e); });
+    feed(m, stream({1, 2}, {SONG_SECONDS, SONG_SECONDS}));
+    CHECK_EQ(m.activeSongId(), catalog.ids[2]);
+    CHECK_EQ(m.streamMs(), qint64(68000));
+
+    // The song still playing is closed at the end of the stream
+    m.finish();
+    CHECK_EQ(m.activeSongId(), -1);
+    CHECK_EQ(m.streamMs(), qint64(0));
+
+    CHECK_EQ(events.size(), size_t(4));
+    if (events.size() == 4) {
+        checkStarted(events[0], catalog.ids[1], 4000);
+        checkEnded(events[1], catalog.ids[1], 34000);
+        checkStarted(events[2], catalog.ids[2], 34000);
+        checkEnded(events[3], catalog.ids[2], 64000);
+    }
+}
+
+TEST_CASE(replayIsANewPlay) {
+    Catalog catalog;
+    QString err;
+    CHECK(catalog.build(3, SONG_SECONDS, &err));
+
+    TrackMonitor m(catalog.db, testaudio::SAMPLE_RATE);
+    std::vector<TrackEvent> events;
+    m.setEventHandler([&events](const TrackEvent& e) { events.push_back(e); });
+    feed(m, stream({3, 3}, {SONG_SECONDS, 20}));
+    m.finish();
+
+    // Same song, new alignment: the first play ends, a second one starts
+    CHECK_EQ(events.size(), size_t(4));
+    if (events.size() == 4) {
+        checkStarted(events[0], catalog.ids[3], 4000);
+        checkEnded(events[1], catalog.ids[3], 34000);
+        checkStarted(events[2], catalog.ids[3], 34000);
+        checkEnded(events[3], catalog.ids[3], 54000);
+    }
+}
@@ -0,0 +1,81 @@
+#include "Check.h"
+#include "db/VoteTable.h"
+
+TEST_CASE(emptyTableHasNoLeader) {
+    VoteTable votes;
+    CHECK(votes.empty());
+    CHECK_EQ(votes.best().songId, -1);
+    CHECK_EQ(votes.runnerUp().songId, -1);
+    CHECK(votes.top(3).empty());
+}
+
+TEST_CASE(bestAndRunnerUpTrackVotes) {
+    VoteTable votes;
+    votes.add(1, 100);
+    votes.add(1, 100);
+    votes.add(1, 250);   // same song, other alignment
+    votes.add(2, -40);
+    CHECK_EQ(votes.size(), size_t(3));
+    CHECK_EQ(votes.best().songId, 1);
+    CHECK_EQ(votes.best().deltaMs, 100);
+    CHECK_EQ(votes.best().count, 2);
+    CHECK_EQ(votes.runnerUp().songId, 2);
+
+    // Song 2 overtakes: the old leader becomes runner-up
+    votes.add(2, -40, 2.5);
+    CHECK_EQ(votes.best().songId, 2);
+    CHECK_EQ(votes.best().score, 3.5);
+    CHECK_EQ(votes.best().count, 2);
+    CHECK_EQ(votes.runnerUp().songId, 1);
+    CHECK_EQ(votes.runnerUp().deltaMs, 100);
+}
+
+TEST_CASE(voteAlignsPostingsToTheQuery) {
+    VoteTable votes;
+    const std::vector<Posting> postings = {{7, 1500}, {8, 300}};
+    votes.vote(postings, 500);
+    votes.vote({{7, 2500}}, 1500);
+    CHECK_EQ(votes.best().songId, 7);
+    CHECK_EQ(votes.best().deltaMs, 1000);
+    CHECK_EQ(votes.best().count, 2);
+    CHECK_EQ(votes.runnerUp().songId, 8);
+    CHECK_EQ(votes.runnerUp().deltaMs, -200);
+}
+
+TEST_CASE(topKeepsOneBinPerSong) {
+    VoteTable votes;
+    for (int i = 0; i < 5; ++i) votes.add(1, 0);
+    for (int i = 0; i < 3; ++i) votes.add(1, 40);
+    for (int i = 0; i < 4; ++i) votes.add(2, 10);
+    votes.add(3, 0);
+
+    const std::vector<VoteBin> top = votes.top(2);
+    CHECK_EQ(top.size(), size_t(2));
+    CHECK_EQ(top[0].songId, 1);
+    CHECK_EQ(top[0].deltaMs, 0);
+    CHECK_EQ(top[1].songId, 2);
+    CHECK_EQ(votes.top(-1).size(), size_t(3));
+}
+
+TEST_CASE(mergeEqualsVotingInOneTable) {
+    VoteTable whole, left, right;
+    const int songs[] = {4, 4, 9, 4, 9, 9, 9, 2};
+    const int deltas[] = {10, 10, 20, 30, 20, 20, 5, 0};
+    for (int i = 0; i < 8; ++i) {
+        whole.add(songs[i], deltas[i], 1.0 + i * 0.25);
+        (i % 2 ? left : right).add(songs[i], deltas[i], 1.0 + i * 0.25);
+    }
+    left.merge(right);
+
+    CHECK_EQ(left.size(), whole.size());
+    CHECK_EQ(left.best().songId, whole.best().songId);
+    CHECK_EQ(left.best().deltaMs, whole.best().deltaMs);
+    CHECK_EQ(left.best().score, whole.best().score);
+    CHECK_EQ(left.best().count, whole.best().count);
+    CHECK_EQ(left.runnerUp().songId, whole.runnerUp().songId);
+    CHECK_EQ(left.runnerUp().score, whole.runnerUp().score);
+
+    left.clear();
+    CHECK(left.empty());
+    CHECK_EQ(left.best().songId, -1);
+}